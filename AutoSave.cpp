@@ -0,0 +1,143 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "AutoSave.h"
+#include "SceneStore.h"
+#include "SceneFile.h"
+#include <fstream>
+#include <filesystem>
+
+using namespace std;
+
+AutoSave::~AutoSave()
+{
+    {
+        lock_guard<mutex> guard(lock_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    if (worker_.joinable()) worker_.join();
+}
+
+void AutoSave::save(const SceneSnapshot& S, const string& reason, double snapshotMs, uint64_t mark)
+{
+    {
+        lock_guard<mutex> guard(lock_);
+        pending_.scene = S;
+        pending_.reason = reason;
+        pending_.mark = mark;
+        pending_.snapshotMs = snapshotMs;
+        pending_.start = chrono::steady_clock::now();
+        hasRequest_ = true;
+
+        if (!worker_.joinable()) worker_ = thread(&AutoSave::work, this);
+    }
+    wake_.notify_all();
+}
+
+vector<AutoSave::Report> AutoSave::finished()
+{
+    lock_guard<mutex> guard(lock_);
+    vector<Report> R;
+    R.swap(reports_);
+    return R;
+}
+
+bool AutoSave::busy()
+{
+    lock_guard<mutex> guard(lock_);
+    return writing_ || hasRequest_;
+}
+
+void AutoSave::work()
+{
+    for (;;)
+    {
+        Request R;
+        {
+            unique_lock<mutex> guard(lock_);
+            wake_.wait(guard, [&] { return stop_ || hasRequest_; });
+
+            // the last request is still written when the app closes
+            if (!hasRequest_) return;
+            R = move(pending_);
+            pending_ = Request();
+            hasRequest_ = false;
+            writing_ = true;
+        }
+
+        Report done = write(R);
+
+        // the snapshot (and maybe the last copies of some objects) is
+        // released here, before the report is published
+        R = Request();
+
+        lock_guard<mutex> guard(lock_);
+        reports_.push_back(done);
+        writing_ = false;
+    }
+}
+
+// path.tmp then rename: the file at path is always a complete one
+static bool replaceFile(const string& path, const string& tmp, string& error)
+{
+    error_code ec;
+    filesystem::rename(tmp, path, ec);
+    if (!ec) return true;
+
+    error = "cannot replace " + path + " (" + ec.message() + ")";
+    filesystem::remove(tmp, ec);
+    return false;
+}
+
+AutoSave::Report AutoSave::write(const Request& R)
+{
+    Report rep;
+    rep.reason = R.reason;
+    rep.mark = R.mark;
+    rep.snapshotMs = R.snapshotMs;
+
+    // empty slots are skipped: diff against an empty scene visits the objects in order
+    SceneStore S;
+    R.scene.diff(SceneSnapshot(), [&](int, const SceneSnapshot::Item& obj, const SceneSnapshot::Item&)
+    {
+        S.add(*obj);
+    });
+    rep.objects = S.size();
+
+    if (!writeSceneFile("scene.bin.tmp", S, R.mark))
+    {
+        rep.error = "cannot write scene.bin.tmp";
+        error_code ec;
+        filesystem::remove("scene.bin.tmp", ec);
+    }
+    else
+    {
+        ofstream F("scene.txt.tmp", ios::trunc);
+        S.write(F);
+        F.close();
+
+        if (!F)
+        {
+            rep.error = "cannot write scene.txt.tmp";
+            error_code ec;
+            filesystem::remove("scene.txt.tmp", ec);
+            filesystem::remove("scene.bin.tmp", ec);
+        }
+        else
+        {
+            error_code ec;
+            // same time on both files: Load takes scene.txt only once edited
+            auto textTime = filesystem::last_write_time("scene.txt.tmp", ec);
+            if (!ec) filesystem::last_write_time("scene.bin.tmp", textTime, ec);
+
+            rep.binBytes = (size_t)filesystem::file_size("scene.bin.tmp", ec);
+            rep.textBytes = (size_t)filesystem::file_size("scene.txt.tmp", ec);
+
+            rep.ok = replaceFile("scene.bin", "scene.bin.tmp", rep.error) &&
+                     replaceFile("scene.txt", "scene.txt.tmp", rep.error);
+        }
+    }
+
+    rep.latencyMs = chrono::duration<double, milli>(chrono::steady_clock::now() - R.start).count();
+    return rep;
+}
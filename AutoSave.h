@@ -0,0 +1,81 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "SceneSnapshot.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+using namespace std;
+
+/*
+ Scene saving on a background thread.
+ The UI thread hands over a snapshot (see Model::snapshot: frozen objects,
+ shared with the live scene) and goes on; the worker converts it, writes
+ scene.bin and scene.txt to temporary files, then renames them over the
+ old ones, so a crash during a save leaves the previous files intact.
+ scene.bin keeps the ids of the objects and the journal mark given with
+ the request (see SceneJournal.h); it gets the time of scene.txt, so that
+ Load can tell when scene.txt was edited since.
+ Only the latest request waiting is kept: a save in progress is never
+ queued behind stale ones.
+*/
+class AutoSave
+{
+public:
+    // one finished save
+    struct Report
+    {
+        string reason;           // "Save", "Autosave", ...
+        uint64_t mark = 0;       // journal mark written in scene.bin
+        bool   ok = false;
+        string error;
+        int    objects = 0;
+        size_t binBytes = 0;     // scene.bin
+        size_t textBytes = 0;    // scene.txt
+        double snapshotMs = 0;   // taken on the UI thread
+        double latencyMs = 0;    // from the request to the last rename
+    };
+
+    static const int PeriodSeconds = 30;   // between autosaves of a changed scene
+
+    int savedState = -1;     // history state of the last save requested
+
+    AutoSave() {}
+    ~AutoSave();             // waits for the save in progress
+
+    AutoSave(const AutoSave&) = delete;
+    AutoSave& operator = (const AutoSave&) = delete;
+
+    // never waits for the disk
+    void save(const SceneSnapshot& S, const string& reason, double snapshotMs, uint64_t mark = 0);
+
+    // saves finished since the last call, oldest first
+    vector<Report> finished();
+
+    bool busy();
+
+private:
+    struct Request
+    {
+        SceneSnapshot scene;
+        string reason;
+        uint64_t mark = 0;
+        double snapshotMs = 0;
+        chrono::steady_clock::time_point start;
+    };
+
+    void work();
+    static Report write(const Request& R);
+
+    thread worker_;          // started with the first save
+    mutex lock_;
+    condition_variable wake_;
+    bool hasRequest_ = false;
+    Request pending_;
+    bool writing_ = false;
+    bool stop_ = false;
+    vector<Report> reports_;
+};
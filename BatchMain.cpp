@@ -0,0 +1,267 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+/*
+ PictorBatch: renders scene files to PNG images, without window nor OpenGL.
+
+   PictorBatch [-o dir] [-s WxH] [-p WxH [-t tile]] [-j threads] scene files...
+
+ A file is read as scene.bin (SceneView) when its name ends with .bin,
+ as the text format of scene.txt otherwise; the image is dir/<name>.png,
+ the size of the window by default (1200x800).
+ The files are rendered in parallel on a pool of threads, one file per task;
+ each thread keeps its scene store and framebuffer from one file to the next.
+ A single file has its PNG compressed in parallel instead.
+ With -p, the part of the scene of size -s is scaled to a poster of WxH
+ pixels (see Poster.h), rendered by tiles of tile pixels (512 by default):
+ the files are then done one after the other, each on the whole pool.
+ Two files giving the same image name (a/scene.txt and b/scene.bin) are
+ rejected as bad arguments rather than written over one another.
+ Exit code: 0 all rendered, 1 some file could not be read or parsed,
+ 2 bad arguments, 3 some image could not be written.
+*/
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <mutex>
+#include <filesystem>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include "SceneStore.h"
+#include "SceneFile.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Raster.h"
+#include "PngWriter.h"
+#include "Poster.h"
+
+using namespace std;
+
+// one file to render, and what happened
+struct Job
+{
+    string input;
+    string output;
+
+    bool   readError = false;
+    bool   writeError = false;
+    string error;
+    int    objects = 0;
+    double loadMs = 0, renderMs = 0, pngMs = 0;
+    size_t bytes = 0;
+};
+
+// scaled rendering to a large image (-p)
+struct PosterMode
+{
+    bool on = false;
+    V2 size;
+    int tile = 512;
+};
+
+// kept by each thread of the pool from one job to the next
+struct Worker
+{
+    SceneStore scene;
+    Raster raster;
+};
+
+static double msSince(chrono::steady_clock::time_point t)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+}
+
+static bool loadScene(const string& path, SceneStore& S, string& error)
+{
+    if (filesystem::path(path).extension() == ".bin")
+    {
+        SceneView V;
+        if (!V.open(path, error)) return false;
+        S.assign(V);
+        return true;
+    }
+
+    MappedFile F;
+    if (!F.open(path, true))
+    {
+        error = "cannot open the file";
+        return false;
+    }
+
+    // one file per thread already: the parse itself is sequential
+    SceneStore::ParseError E;
+    if (!S.parse(string_view((const char*)F.data(), F.size()), E))
+    {
+        error = to_string(E.line) + ":" + to_string(E.column) + ": " + E.message;
+        return false;
+    }
+    return true;
+}
+
+// pngPool: compresses the image, nullptr when render runs as a task of it
+static void render(Job& J, V2 size, ThreadPool* pngPool)
+{
+    static thread_local Worker W;
+
+    auto start = chrono::steady_clock::now();
+    if (!loadScene(J.input, W.scene, J.error))
+    {
+        J.readError = true;
+        return;
+    }
+    J.objects = W.scene.size();
+    J.loadMs = msSince(start);
+
+    start = chrono::steady_clock::now();
+    W.raster.resize(size.x, size.y);
+    W.raster.clear(Color::Black);
+    W.scene.draw(W.raster);
+    J.renderMs = msSince(start);
+
+    start = chrono::steady_clock::now();
+    if (!writePng(J.output, W.raster, J.error, &J.bytes, pngPool))
+        J.writeError = true;
+    J.pngMs = msSince(start);
+}
+
+// one file at a time, the tiles on the pool
+static void renderPoster(Job& J, V2 world, const PosterMode& P, ThreadPool& pool)
+{
+    static SceneStore scene;
+
+    auto start = chrono::steady_clock::now();
+    if (!loadScene(J.input, scene, J.error))
+    {
+        J.readError = true;
+        return;
+    }
+    J.objects = scene.size();
+    J.loadMs = msSince(start);
+
+    PosterStats stats;
+    if (!writePoster(J.output, scene, world, P.size, P.tile, &pool, J.error, &stats))
+        J.writeError = true;
+    J.renderMs = stats.renderMs;
+    J.pngMs = stats.pngMs;
+    J.bytes = stats.bytes;
+}
+
+// the whole of s as an integer >= minimum
+static bool readInt(const char* s, int minimum, int& v)
+{
+    char* end = nullptr;
+    errno = 0;
+    long x = strtol(s, &end, 10);
+    if (end == s || *end != '\0' || errno == ERANGE || x < minimum || x > INT_MAX) return false;
+    v = (int)x;
+    return true;
+}
+
+static int usage()
+{
+    cerr << "usage : PictorBatch [-o dir] [-s WxH] [-p WxH [-t tile]] [-j threads] scene files..." << endl;
+    return 2;
+}
+
+int main(int argc, char* argv[])
+{
+    string outDir = ".";
+    V2 size(1200, 800);
+    int threads = 0;
+    PosterMode poster;
+    vector<Job> jobs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string a = argv[i];
+        if (a == "-o" && i + 1 < argc) outDir = argv[++i];
+        else if (a == "-s" && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &size.x, &size.y) != 2 || size.x <= 0 || size.y <= 0)
+                return usage();
+        }
+        else if (a == "-p" && i + 1 < argc)
+        {
+            poster.on = true;
+            if (sscanf(argv[++i], "%dx%d", &poster.size.x, &poster.size.y) != 2 || poster.size.x <= 0 || poster.size.y <= 0)
+                return usage();
+        }
+        else if (a == "-t" && i + 1 < argc)
+        {
+            if (!readInt(argv[++i], 1, poster.tile)) return usage();
+        }
+        else if (a == "-j" && i + 1 < argc)
+        {
+            if (!readInt(argv[++i], 0, threads)) return usage();
+        }
+        else if (!a.empty() && a[0] == '-') return usage();
+        else
+        {
+            Job J;
+            J.input = a;
+            J.output = (filesystem::path(outDir) / filesystem::path(a).stem()).string() + ".png";
+            jobs.push_back(J);
+        }
+    }
+    if (jobs.empty()) return usage();
+
+    set<string> outputs;
+    for (const Job& J : jobs)
+        if (!outputs.insert(J.output).second)
+        {
+            cerr << J.input << " : " << J.output << " is already the image of another file" << endl;
+            return 2;
+        }
+
+    error_code ec;
+    filesystem::create_directories(outDir, ec);
+
+    ThreadPool pool(threads);
+    mutex printLock;
+    auto start = chrono::steady_clock::now();
+
+    // tasks are taken one by one: a large scene does not hold back the others.
+    // A single file runs on the calling thread, out of any loop of the pool:
+    // its image is then compressed on the whole pool
+    ThreadPool* pngPool = jobs.size() == 1 ? &pool : nullptr;
+    auto one = [&](int i)
+    {
+        Job& J = jobs[i];
+        if (poster.on) renderPoster(J, size, poster, pool);
+        else render(J, size, pngPool);
+
+        lock_guard<mutex> guard(printLock);
+        if (J.readError)
+            cout << J.input << ":" << J.error << endl;
+        else if (J.writeError)
+            cout << J.input << " : " << J.error << endl;
+        else
+            cout << J.input << " -> " << J.output << " : " << J.objects << " objects, load "
+                 << J.loadMs << " ms, render " << J.renderMs << " ms, png " << J.pngMs << " ms ("
+                 << J.bytes / 1024 << " KB)" << endl;
+    };
+    if (poster.on)
+        for (int i = 0; i < (int)jobs.size(); i++) one(i);
+    else
+        pool.run((int)jobs.size(), one);
+
+    int readErrors = 0, writeErrors = 0;
+    for (const Job& J : jobs)
+    {
+        readErrors += J.readError;
+        writeErrors += J.writeError;
+    }
+
+    cout << jobs.size() << " files on " << pool.size() << " threads in " << msSince(start) << " ms";
+    if (readErrors) cout << ", " << readErrors << " not read";
+    if (writeErrors) cout << ", " << writeErrors << " not written";
+    cout << endl;
+
+    if (readErrors) return 1;
+    if (writeErrors) return 3;
+    return 0;
+}
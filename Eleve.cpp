@@ -4,12 +4,19 @@
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <chrono>
+#include <filesystem>
 #include "V2.h"
 #include "Graphics.h"
 #include "Event.h"
 #include "Model.h"
 #include "Button.h"
 #include "Tool.h"
+#include "SceneStore.h"
+#include "SceneFile.h"
+#include "ThreadPool.h"
+#include "SvgExport.h"
+#include "SvgImport.h"
 
 using namespace std;
 
@@ -17,173 +24,65 @@ using namespace std;
 void drawApp(Graphics& G, const Model& D);
 void processEvent(const Event& Ev, Model& Data);
 void drawCursor(Graphics& G, const Model& D);
-void pushUndoState(Model& Data);
 
-// SERIALIZATION HELPERS //////////////////////////////////////////
+// SERIALIZATION ////////////////////////////////////////////////
 
-// Helper: serialize a Color to string
-string serializeColor(const Color& c)
-{
-    // Use RGB values (0-1 range)
-    ostringstream oss;
-    oss << c.R << " " << c.G << " " << c.B;
-    return oss.str();
-}
+// scenes are written / read through the data-oriented store (text) or
+// its mapped binary twin (SceneView): the type of each object is resolved
+// once, then every row is formatted from contiguous arrays
 
-// Helper: deserialize a Color from stream
-Color deserializeColor(istringstream& iss)
+// replaces the scene with the rows of S (SceneStore or SceneView),
+// as one undoable action
+template <class Rows>
+void replaceScene(Model& Data, const Rows& S)
 {
-    float r, g, b;
-    iss >> r >> g >> b;
-    return Color(r, g, b);
+    Data.history.beginScene(Data);
+    Data.clearObjects();
+    Data.LObjets.reserve(S.size());
+    for (int i = 0; i < S.size(); i++)
+        Data.addObject(S.makeObject(i, Data.shapePool));
+    Data.history.commitScene(Data);
+
+    Data.selectedObject = -1;
 }
 
 string serializeScene(const Model& Data)
 {
+    SceneStore S;
+    S.build(Data.LObjets);
+
     ostringstream oss;
-    oss << Data.LObjets.size() << "\n";
-    for (auto& obj : Data.LObjets)
-    {
-        // Serialize drawing attributes (colors, thickness, fill)
-        auto& attr = obj->drawInfo_;
-        string borderCol = serializeColor(attr.borderColor_);
-        string fillCol = serializeColor(attr.interiorColor_);
-        int thick = attr.thickness_;
-        int filled = attr.isFilled_ ? 1 : 0;
-
-        if (auto r = dynamic_pointer_cast<ObjRectangle>(obj))
-        {
-            oss << "RECT "
-                << r->P1_.x << " " << r->P1_.y << " "
-                << r->P2_.x << " " << r->P2_.y << " "
-                << borderCol << " " << fillCol << " "
-                << thick << " " << filled << "\n";
-        }
-        else if (auto s = dynamic_pointer_cast<ObjSegment>(obj))
-        {
-            oss << "SEG "
-                << s->P1_.x << " " << s->P1_.y << " "
-                << s->P2_.x << " " << s->P2_.y << " "
-                << borderCol << " " << fillCol << " "
-                << thick << " " << filled << "\n";
-        }
-        else if (auto c = dynamic_pointer_cast<ObjCircle>(obj))
-        {
-            oss << "CIRC "
-                << c->center_.x << " " << c->center_.y << " "
-                << c->radius_ << " "
-                << borderCol << " " << fillCol << " "
-                << thick << " " << filled << "\n";
-        }
-        else if (auto p = dynamic_pointer_cast<ObjPolygon>(obj))
-        {
-            oss << "POLY " << p->pts_.size();
-            for (auto& pt : p->pts_)
-                oss << " " << pt.x << " " << pt.y;
-            oss << " " << borderCol << " " << fillCol << " "
-                << thick << " " << filled << "\n";
-        }
-    }
+    S.write(oss);
     return oss.str();
 }
 
-void deserializeScene(Model& Data, const string& s)
+// replaces the scene, as one undoable action;
+// false (scene unchanged) on a syntax error
+bool deserializeScene(Model& Data, string_view s, SceneStore::ParseError& E)
 {
-    istringstream iss(s);
-    size_t n = 0;
-    iss >> n;
-    Data.LObjets.clear();
-    Data.selectedObject = -1;
-
-    for (size_t i = 0; i < n; ++i)
-    {
-        string type;
-        iss >> type;
-        
-        if (type == "RECT")
-        {
-            V2 p1, p2;
-            iss >> p1.x >> p1.y >> p2.x >> p2.y;
-            
-            Color borderCol = deserializeColor(iss);
-            Color fillCol = deserializeColor(iss);
-            int thick, filled;
-            iss >> thick >> filled;
-
-            ObjAttr opt(borderCol, filled != 0, fillCol, thick);
-            auto r = make_shared<ObjRectangle>(opt, p1, p2);
-            Data.LObjets.push_back(r);
-        }
-        else if (type == "SEG")
-        {
-            V2 p1, p2;
-            iss >> p1.x >> p1.y >> p2.x >> p2.y;
-            
-            Color borderCol = deserializeColor(iss);
-            Color fillCol = deserializeColor(iss);
-            int thick, filled;
-            iss >> thick >> filled;
-
-            ObjAttr opt(borderCol, filled != 0, fillCol, thick);
-            auto sObj = make_shared<ObjSegment>(opt, p1, p2);
-            Data.LObjets.push_back(sObj);
-        }
-        else if (type == "CIRC")
-        {
-            V2 c; float r;
-            iss >> c.x >> c.y >> r;
-            
-            Color borderCol = deserializeColor(iss);
-            Color fillCol = deserializeColor(iss);
-            int thick, filled;
-            iss >> thick >> filled;
-
-            ObjAttr opt(borderCol, filled != 0, fillCol, thick);
-            auto cObj = make_shared<ObjCircle>(opt, c, c + V2((int)r, 0));
-            Data.LObjets.push_back(cObj);
-        }
-        else if (type == "POLY")
-        {
-            int m = 0;
-            iss >> m;
-
-            vector<V2> points;
-            for (int k = 0; k < m; ++k)
-            {
-                V2 pt;
-                iss >> pt.x >> pt.y;
-                points.push_back(pt);
-            }
-            
-            Color borderCol = deserializeColor(iss);
-            Color fillCol = deserializeColor(iss);
-            int thick, filled;
-            iss >> thick >> filled;
-
-            ObjAttr opt(borderCol, filled != 0, fillCol, thick);
-            auto pObj = make_shared<ObjPolygon>(opt);
-            pObj->pts_ = points;
-            Data.LObjets.push_back(pObj);
-        }
-    }
+    SceneStore S;
+    if (!S.parse(s, E, &ThreadPool::shared())) return false;
+    replaceScene(Data, S);
+    return true;
 }
 
+
 // UNDO ////////////////////////////////////////////////////////////
 
-void pushUndoState(Model& Data)
+void doUndo(Model& Data)
 {
-    string s = serializeScene(Data);
-    Data.undoStack.push_back(s);
-    if (Data.undoStack.size() > 20)
-        Data.undoStack.erase(Data.undoStack.begin());
+    Data.history.undo(Data);
 }
 
-void doUndo(Model& Data)
+void doRedo(Model& Data)
 {
-    if (Data.undoStack.empty()) return;
-    string s = Data.undoStack.back();
-    Data.undoStack.pop_back();
-    deserializeScene(Data, s);
+    Data.history.redo(Data);
+}
+
+// previous / next state in time, across the branches of the undo tree
+void doTravel(Model& Data, int steps)
+{
+    Data.history.travel(Data, steps);
 }
 
 // ================================================================
@@ -209,18 +108,34 @@ Color paletteColorFromIndex(int idx)
     }
 }
 
+// change(attr) applied to the drawing options, and to the selected object
+// if any, recorded as an Attributes edit (undone alone, journaled as a delta)
+template <class F>
+void changeAttributes(Model& Data, F change)
+{
+    change(Data.drawingOptions);
+
+    ObjGeom* obj = Data.findObject(Data.selectedObject);
+    if (!obj) return;
+    ObjAttr attr = obj->drawInfo_;
+    change(attr);
+    Data.history.setAttributes(Data, Data.selectedObject, attr);
+}
+
 // Border color button
 void bntBorderColorClick(Model& Data)
 {
     borderPaletteIndex = (borderPaletteIndex + 1) % 6;
-    Data.drawingOptions.borderColor_ = paletteColorFromIndex(borderPaletteIndex);
+    Color c = paletteColorFromIndex(borderPaletteIndex);
+    changeAttributes(Data, [&](ObjAttr& A) { A.borderColor_ = c; });
 }
 
 // Fill color button
 void bntFillColorClick(Model& Data)
 {
     fillPaletteIndex = (fillPaletteIndex + 1) % 6;
-    Data.drawingOptions.interiorColor_ = paletteColorFromIndex(fillPaletteIndex);
+    Color c = paletteColorFromIndex(fillPaletteIndex);
+    changeAttributes(Data, [&](ObjAttr& A) { A.interiorColor_ = c; });
 }
 
 // Thickness button (cycles 1, 3, 5, 7)
@@ -231,13 +146,14 @@ void bntThicknessClick(Model& Data)
     else if (t == 3) t = 5;
     else if (t == 5) t = 7;
     else             t = 1;
-    Data.drawingOptions.thickness_ = t;
+    changeAttributes(Data, [&](ObjAttr& A) { A.thickness_ = t; });
 }
 
 // Fill toggle (on/off)
 void bntFillToggleClick(Model& Data)
 {
-    Data.drawingOptions.isFilled_ = !Data.drawingOptions.isFilled_;
+    bool filled = !Data.drawingOptions.isFilled_;
+    changeAttributes(Data, [&](ObjAttr& A) { A.isFilled_ = filled; });
 }
 
 // ================================================================
@@ -282,32 +198,25 @@ void bntToolEditPointsClick(Model& Data)
 
 // FRONT / BACK //////////////////////////////////////////////////////
 
+// one step, above / below the next object
 void bntToolMoveFrontClick(Model& Data)
 {
-    int idx = Data.selectedObject;
-    if (idx < 0 || idx >= (int)Data.LObjets.size() - 1) return;
-    pushUndoState(Data);
-    std::swap(Data.LObjets[idx], Data.LObjets[idx + 1]);
-    Data.selectedObject = idx + 1;
+    Data.history.stepOrder(Data, Data.selectedObject, +1);
 }
 
 void bntToolMoveBackClick(Model& Data)
 {
-    int idx = Data.selectedObject;
-    if (idx <= 0 || idx >= (int)Data.LObjets.size()) return;
-    pushUndoState(Data);
-    std::swap(Data.LObjets[idx], Data.LObjets[idx - 1]);
-    Data.selectedObject = idx - 1;
+    Data.history.stepOrder(Data, Data.selectedObject, -1);
 }
 
 // RAZ ///////////////////////////////////////////////////////////////
 
 void bntToolRAZClick(Model& Data)
 {
-    if (!Data.LObjets.empty())
-        pushUndoState(Data);
+    Data.history.beginScene(Data);
+    Data.clearObjects();
+    Data.history.commitScene(Data);
 
-    Data.LObjets.clear();
     Data.selectedObject = -1;
 
     // Reset tool and drawing options
@@ -319,20 +228,191 @@ void bntToolRAZClick(Model& Data)
 
 // SAVE / LOAD ///////////////////////////////////////////////////////
 
+// scene.bin (binary, see SceneFile.h) is loaded in place from a memory mapping;
+// scene.txt stays the text version, read when there is no scene.bin.
+// Large text scenes are formatted / parsed in blocks on the threads of the pool.
+// Every change is logged in scene.journal as it happens (see SceneJournal.h):
+// the Save button and the autosave write a checkpoint there, and only
+// rewrite scene.bin / scene.txt when the log has grown (needsFullSave);
+// F6 rewrites them now.
+// These files are written by the background thread of Data.autosave from
+// a snapshot of the scene (full save, or every PeriodSeconds when the
+// scene changed)
+
+// a full save is worth it when the log since the last one is a quarter of scene.bin
+bool needsFullSave(const Model& Data)
+{
+    error_code ec;
+    uintmax_t bin = filesystem::file_size("scene.bin", ec);
+    if (ec || !Data.journal.isOpen()) return true;
+    return Data.journal.bytesSinceBase() > max<uintmax_t>(1 << 20, bin / 4);
+}
+
+void requestSave(Model& Data, const string& reason, bool full = false)
+{
+    auto start = chrono::steady_clock::now();
+    Data.journal.sync(Data);
+    Data.autosave.savedState = Data.history.state();
+
+    if (!full && !needsFullSave(Data))
+    {
+        Data.journal.markSaved();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << reason << " : checkpoint in scene.journal in " << ms << " ms ("
+             << Data.journal.bytesSinceBase() / 1024 << " KB of changes since the last full save)" << endl;
+        return;
+    }
+
+    uint64_t mark = Data.journal.beginBase(Data);
+    SceneSnapshot S = Data.snapshot();
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    Data.autosave.save(S, reason, ms, mark);
+}
+
+// saving after small edits costs the size of the edits; a checkpoint is
+// in scene.journal when the click returns
 void bntToolSaveClick(Model& Data)
 {
-    ofstream F("scene.txt");
-    if (!F) return;
-    F << serializeScene(Data);
+    requestSave(Data, "Save");
+    Data.journal.flush();
 }
 
+// F6: scene.bin / scene.txt rewritten whatever the size of the log
+void fullSave(Model& Data)
+{
+    requestSave(Data, "Full save", true);
+}
+
+// Timer event: report finished saves, start an autosave when due
+void autosaveTick(Model& Data)
+{
+    static auto last = chrono::steady_clock::now();
+
+    for (const AutoSave::Report& R : Data.autosave.finished())
+    {
+        if (!R.ok)
+        {
+            cout << R.reason << " : failed, " << R.error << endl;
+            continue;
+        }
+        Data.journal.baseWritten(R.mark);
+
+        cout << R.reason << " : " << R.objects << " objects, "
+             << R.binBytes / 1024 << " KB scene.bin + " << R.textBytes / 1024 << " KB scene.txt in "
+             << R.latencyMs << " ms (snapshot " << R.snapshotMs << " ms on the UI thread)" << endl;
+    }
+
+    auto now = chrono::steady_clock::now();
+    if (now - last < chrono::seconds(AutoSave::PeriodSeconds)) return;
+    last = now;
+
+    if (Data.history.state() != Data.autosave.savedState && !Data.autosave.busy())
+        requestSave(Data, "Autosave");
+}
+
+// F4: scene.svg, the picture of the window for other tools (see SvgExport.h)
+void exportScene(Model& Data)
+{
+    auto start = chrono::steady_clock::now();
+
+    string error;
+    size_t bytes = 0;
+    int groups = 0;
+    if (!exportSvg("scene.svg", Data.LObjets, Graphics().getWindowSize(), error, &bytes, &groups))
+    {
+        cout << "Export : " << error << endl;
+        return;
+    }
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Export : " << Data.objectCount() << " objects, " << groups << " groups, "
+         << bytes / 1024 << " KB scene.svg in " << ms << " ms" << endl;
+}
+
+// F5: the shapes of scene.svg added on top of the scene, as one undoable action.
+// The file is parsed first (nothing changes if it cannot be read), then the
+// objects are moved into LObjets at once and indexed in one pass
+void importScene(Model& Data)
+{
+    SvgReader::Options O;
+    O.tolerance = 0.5f;
+    O.height = (float)Graphics().getWindowSize().y;
+
+    vector< shared_ptr<ObjGeom> > shapes;
+    string error;
+    int skipped = 0;
+    if (!importSvg("scene.svg", shapes, Data.shapePool, O, error, &skipped))
+    {
+        cout << "Import : " << error << endl;
+        return;
+    }
+
+    // on top of the scene: only the new objects are indexed
+    Data.history.beginScene(Data);
+    Data.LObjets.reserve(Data.LObjets.size() + shapes.size());
+    for (auto& obj : shapes)
+        Data.addObject(move(obj));
+    Data.history.commitScene(Data);
+    Data.selectedObject = -1;
+
+    if (skipped) cout << "Import : " << skipped << " elements of scene.svg not supported" << endl;
+}
+
+// scene.bin, then the changes saved in scene.journal since
 void bntToolLoadClick(Model& Data)
 {
-    ifstream F("scene.txt");
-    if (!F) return;
-    stringstream buf;
-    buf << F.rdbuf();
-    deserializeScene(Data, buf.str());
+    // the log and the files must not change under the load
+    if (Data.autosave.busy())
+    {
+        cout << "Load : a save is in progress, try again" << endl;
+        return;
+    }
+
+    // scene.txt edited after the last save wins over scene.bin
+    // (a save gives both files the same time)
+    error_code ecBin, ecText;
+    auto binTime = filesystem::last_write_time("scene.bin", ecBin);
+    auto textTime = filesystem::last_write_time("scene.txt", ecText);
+    bool textNewer = !ecBin && !ecText && textTime > binTime;
+    if (textNewer)
+        cout << "Load : scene.txt is newer than scene.bin, loading scene.txt" << endl;
+
+    SceneView V;
+    string error;
+    if (!textNewer && V.open("scene.bin", error))
+    {
+        uint64_t mark = V.journalMark() ? V.journalMark() : SceneJournal::NoFile;
+        SceneJournal::Replay R = Data.journal.planLoad(mark);
+
+        Data.history.beginScene(Data);
+        Data.clearObjects();
+        if (!R.usable || R.fromBin)
+        {
+            Data.LObjets.reserve(V.size());
+            for (int i = 0; i < V.size(); i++)
+                Data.addObject(V.makeObject(i, Data.shapePool));
+        }
+        SceneJournal::apply(Data, R);
+        Data.history.commitScene(Data);
+        Data.selectedObject = -1;
+
+        if (Data.journal.loaded(Data, R, mark)) requestSave(Data, "Load", true);
+        return;
+    }
+    if (!error.empty() && ifstream("scene.bin"))
+        cout << "Load : scene.bin ignored (" << error << ")" << endl;
+
+    MappedFile F;
+    if (!F.open("scene.txt", true)) return;
+
+    SceneStore::ParseError E;
+    if (!deserializeScene(Data, string_view((const char*)F.data(), F.size()), E))
+    {
+        cout << "Load : scene.txt:" << E.line << ":" << E.column << ": " << E.message << endl;
+        return;
+    }
+    if (Data.journal.loaded(Data, SceneJournal::Replay(), SceneJournal::NoFile)) requestSave(Data, "Load", true);
 }
 
 // UNDO //////////////////////////////////////////////////////////////
@@ -375,6 +455,12 @@ void initApp(Model& App)
     App.LButtons.push_back(make_shared<Button>("Undo", V2(x, 0), V2(s, s), "outil_undo.png", bntToolUndoClick));      x += s;
 
     cout << "Total de botoes criados: " << App.LButtons.size() << endl;
+
+    // scene left by a crash
+    string message;
+    App.journal.open(App, message);
+    if (!message.empty())
+        cout << "Startup : " << message << endl;
 }
 
 // MAIN //////////////////////////////////////////////////////////////
@@ -382,17 +468,29 @@ void initApp(Model& App)
 int main(int argc, char* argv[])
 {
     cout << "Press ESC to abort" << endl;
+    cout << "Ctrl+Z / Ctrl+Y : undo / redo" << endl;
+    cout << "F2 / F3 : earlier / later state (all branches)" << endl;
+    cout << "F4 / F5 : export / import scene.svg" << endl;
     Graphics::initMainWindow("Pictor", V2(1200, 800), V2(200, 200));
     return 0;
 }
 
 // EVENTS ///////////////////////////////////////////////////////////
 
-void processEvent(const Event& Ev, Model& Data)
+void handleEvent(const Event& Ev, Model& Data)
 {
     if (Ev.Type == EventType::MouseMove)
         Data.currentMousePos = V2(Ev.x, Ev.y);
 
+    // Ctrl+Z / Ctrl+Y, F2 / F3, F4 / F5, F6
+    if (Ev.Type == EventType::KeyDown && Ev.info == "\x1a") { doUndo(Data); return; }
+    if (Ev.Type == EventType::KeyDown && Ev.info == "\x19") { doRedo(Data); return; }
+    if (Ev.Type == EventType::KeyDown && Ev.info == "F2")   { doTravel(Data, -1); return; }
+    if (Ev.Type == EventType::KeyDown && Ev.info == "F3")   { doTravel(Data, +1); return; }
+    if (Ev.Type == EventType::KeyDown && Ev.info == "F4")   { exportScene(Data); return; }
+    if (Ev.Type == EventType::KeyDown && Ev.info == "F5")   { importScene(Data); return; }
+    if (Ev.Type == EventType::KeyDown && Ev.info == "F6")   { fullSave(Data); return; }
+
     // Button click
     for (auto& B : Data.LButtons)
     {
@@ -409,6 +507,17 @@ void processEvent(const Event& Ev, Model& Data)
         Data.currentTool->processEvent(Ev, Data);
 }
 
+void processEvent(const Event& Ev, Model& Data)
+{
+    if (Ev.Type == EventType::Timer) { autosaveTick(Data); return; }
+
+    handleEvent(Ev, Data);
+
+    // each new history state is logged as soon as it exists
+    // (formatted here, written by the thread of the journal)
+    Data.journal.sync(Data);
+}
+
 // CURSOR ///////////////////////////////////////////////////////////
 
 void drawCursor(Graphics& G, const Model& D)
@@ -427,7 +536,7 @@ void drawApp(Graphics& G, const Model& D)
     G.clearWindow(Color::Black);
 
     for (auto& O : D.LObjets)
-        O->draw(G);
+        if (O) O->draw(G);
 
     for (auto& B : D.LButtons)
         B->draw(G);
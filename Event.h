@@ -6,7 +6,7 @@
 
 using namespace std;
 
-enum class EventType { MouseMove, MouseDown, MouseUp, KeyDown, KeyUp };
+enum class EventType { MouseMove, MouseDown, MouseUp, KeyDown, KeyUp, Timer };
 
 struct Event
 {
@@ -19,7 +19,7 @@ struct Event
 
 	void print() const
 	{
-		string name[] = { "MouseMove", "MouseDown", "MouseUp", "KeyDown", "KeyUp" };
+		string name[] = { "MouseMove", "MouseDown", "MouseUp", "KeyDown", "KeyUp", "Timer" };
 		cout << name[(int)Type] << " " << x << " " << y << " " << info << endl;
 	}
 
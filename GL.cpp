@@ -35,6 +35,18 @@ void myglEvent(Event& V)
 	GL::AskScreenRedraw();
 }
 
+// one Timer event per second (autosave, JPG files changed on disk),
+// the screen is only redrawn when a texture has to be reloaded
+const int TimerMs = 1000;
+bool CheckJPGTextures();
+
+void myglTimer(int)
+{
+	processEvent(Event(EventType::Timer, -1, -1, ""), Data);
+	if (CheckJPGTextures()) GL::AskScreenRedraw();
+	glutTimerFunc(TimerMs, myglTimer, 0);
+}
+
  
 void GLRender()
 {
@@ -203,7 +215,7 @@ namespace GL
 
 
 		glutDisplayFunc(GLRender);        // fonction appele lors d'un repaint
-		//glutTimerFunc(100, fnt, 0);         
+		glutTimerFunc(TimerMs, myglTimer, 0);
 		glutMainLoop();
 	}
 	 
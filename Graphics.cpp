@@ -1,6 +1,7 @@
 #include "Graphics.h"
 #include "GlutImport.h"
 #include <algorithm>
+#include <cmath>
 
 
 extern V2 Wsize;
@@ -19,7 +20,7 @@ V2   Graphics::getWindowSize()
 /////////////////////////////////////////////////////////////
 
 int GetTextureIdFromPNG(std::string PNGFileName);
-int GetTextureIdFromJPG(std::string JPGFileName);
+int GetTextureIdFromJPG(std::string JPGFileName, int minWidth, int minHeight);
 
 string GetExtension(string filename)
 {
@@ -45,7 +46,7 @@ void Graphics::drawRectWithTexture(std::string JPGPNGFileName, V2 pos, V2 size,
 	int idTexture = 0;
 	auto ext = GetExtSafe(JPGPNGFileName);
 
-	if (ext == ".jpg" || ext == ".jpeg")      idTexture = GetTextureIdFromJPG(JPGPNGFileName);
+	if (ext == ".jpg" || ext == ".jpeg")      idTexture = GetTextureIdFromJPG(JPGPNGFileName, (int)ceil(fabs(size.x)), (int)ceil(fabs(size.y)));
 	else if (ext == ".png")                   idTexture = GetTextureIdFromPNG(JPGPNGFileName);
 	else                                      idTexture = GetTextureIdFromPNG("error.png");
 
@@ -143,6 +144,25 @@ void Graphics::drawRectangle(V2 P1, V2 Size, Color c, bool fill, int thickness)
 
 }
 
+void Graphics::drawSquares(const vector<V2>& Centers, int s, Color c)
+{
+	if (Centers.empty()) return;
+
+	glDisable(GL_TEXTURE_2D);
+	glColor4d(c.R, c.G, c.B, c.A);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	glBegin(GL_QUADS);
+	for (V2 P : Centers)
+	{
+		glVertex2i(P.x - s, P.y - s);
+		glVertex2i(P.x + s, P.y - s);
+		glVertex2i(P.x + s, P.y + s);
+		glVertex2i(P.x - s, P.y + s);
+	}
+	glEnd();
+}
+
 void Graphics::drawCircle(V2 C, float r, Color c, bool fill, int thickness)
 {
 	glLineWidth(thickness);
@@ -35,5 +35,8 @@ public:
 	void drawRectangle(V2 P1, V2 Size, Color c, bool fill = false, int thickness = 1);
 	void drawCircle(V2 C, float r, Color c, bool fill = false, int thickness = 1);
 
+	// filled squares of half-size s centered on each point, in a single batch
+	void drawSquares(const vector<V2>& Centers, int s, Color c);
+
 
 };
\ No newline at end of file
@@ -0,0 +1,786 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "History.h"
+#include "Model.h"
+#include "SceneStore.h"
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <chrono>
+
+using namespace std;
+
+// MEMORY ////////////////////////////////////////////////////////
+
+size_t objectBytes(const ObjGeom* obj)
+{
+    if (!obj) return 0;
+    if (obj->kind() == ShapeKind::Polygon)
+        return sizeof(ObjPolygon) + static_cast<const ObjPolygon*>(obj)->pts_.capacity() * sizeof(V2);
+    return 64;
+}
+
+size_t Edit::bytes() const
+{
+    return sizeof(Edit) + objectBytes(obj.get()) + objectBytes(before.get()) + sceneBytes;
+}
+
+// RECORD ////////////////////////////////////////////////////////
+
+History::History()
+{
+    nodes_.emplace_back();
+}
+
+History::~History()
+{
+    closeFile();
+}
+
+void History::record(const Edit& E)
+{
+    pending_.edits.push_back(E);
+    if (depth_ == 0) push(pending_);
+}
+
+void History::begin()
+{
+    depth_++;
+}
+
+void History::commit()
+{
+    if (depth_ > 0) depth_--;
+    if (depth_ == 0 && !pending_.edits.empty()) push(pending_);
+}
+
+// the action becomes a new child of the current state
+void History::push(Entry& E)
+{
+    int n = (int)nodes_.size();
+    nodes_.emplace_back();
+
+    Node& N = nodes_[n];
+    N.serial = nextSerial_++;
+    N.parent = current_;
+    N.depth = nodes_[current_].depth + 1;
+    N.entry.edits.swap(E.edits);
+    for (const Edit& x : N.entry.edits) N.entry.bytes += x.bytes();
+
+    nodes_[current_].redoChild = n;
+    current_ = n;
+
+    residentBytes_ += N.entry.bytes;
+    lruPushFront(n);
+    if (entries() > maxEntries) prune();
+    evict();
+}
+
+void History::clear()
+{
+    nodes_.clear();
+    nodes_.emplace_back();
+    current_ = 0;
+    nextSerial_ = 1;
+    pending_.edits.clear();
+    depth_ = 0;
+    lruHead_ = lruTail_ = -1;
+    residentBytes_ = 0;
+    closeFile();
+}
+
+int History::add(Model& Data, shared_ptr<ObjGeom> obj)
+{
+    Data.addObject(obj);
+    added(Data, obj->id_);
+    return obj->id_;
+}
+
+void History::added(Model& Data, int id)
+{
+    Edit E;
+    E.type = EditType::Add;
+    E.id = id;
+    E.slot = Data.slotOf(id);
+    E.epoch = Data.layoutEpoch;
+    E.aboveId = Data.aboveIdOf(id);
+    record(E);
+}
+
+void History::remove(Model& Data, int id)
+{
+    if (!Data.findObject(id)) return;
+
+    Edit E;
+    E.type = EditType::Remove;
+    E.id = id;
+    E.slot = Data.slotOf(id);
+    E.epoch = Data.layoutEpoch;
+    E.aboveId = Data.aboveIdOf(id);
+    E.obj = Data.removeObject(id);
+    record(E);
+}
+
+static Edit positionEdit(Model& Data, EditType type, int id)
+{
+    Edit E;
+    E.type = type;
+    E.id = id;
+    E.slot = Data.slotOf(id);
+    E.epoch = Data.layoutEpoch;
+    E.aboveId = Data.aboveIdOf(id);
+    return E;
+}
+
+void History::bringToFront(Model& Data, int id)
+{
+    if (!Data.findObject(id)) return;
+    Edit E = positionEdit(Data, EditType::Front, id);
+    Data.bringToFront(id);
+    record(E);
+}
+
+void History::sendToBack(Model& Data, int id)
+{
+    if (!Data.findObject(id)) return;
+    Edit E = positionEdit(Data, EditType::Back, id);
+    Data.sendToBack(id);
+    record(E);
+}
+
+void History::swapOrder(Model& Data, int idA, int idB)
+{
+    if (!Data.findObject(idA) || !Data.findObject(idB)) return;
+
+    Edit E;
+    E.type = EditType::Swap;
+    E.id = idA;
+    E.otherId = idB;
+    Data.swapOrder(idA, idB);
+    record(E);
+}
+
+// undone as the swap it is
+void History::stepOrder(Model& Data, int id, int dir)
+{
+    if (!Data.findObject(id)) return;
+
+    Edit E;
+    E.type = EditType::Swap;
+    E.id = id;
+    E.otherId = Data.stepOrder(id, dir);
+    if (E.otherId >= 0) record(E);
+}
+
+void History::moved(Model&, int id, V2 delta)
+{
+    if (delta.x == 0 && delta.y == 0) return;
+
+    Edit E;
+    E.type = EditType::Move;
+    E.id = id;
+    E.delta = delta;
+    record(E);
+}
+
+void History::pointMoved(Model&, int id, int pt, V2 from, V2 to)
+{
+    if (from.x == to.x && from.y == to.y) return;
+
+    Edit E;
+    E.type = EditType::SetPoint;
+    E.id = id;
+    E.pt = pt;
+    E.from = from;
+    E.to = to;
+    record(E);
+}
+
+void History::reshaped(Model& Data, int id, shared_ptr<ObjGeom> before)
+{
+    ObjGeom* obj = Data.findObject(id);
+    if (!obj || !before) return;
+
+    Edit E;
+    E.type = EditType::Reshape;
+    E.id = id;
+    E.before = before;
+    E.obj = obj->clone(Data.shapePool);
+    record(E);
+}
+
+void History::setAttributes(Model& Data, int id, const ObjAttr& attr)
+{
+    ObjGeom* obj = Data.editObject(id);
+    if (!obj) return;
+
+    Edit E;
+    E.type = EditType::Attributes;
+    E.id = id;
+    E.attrFrom = obj->drawInfo_;
+    E.attrTo = attr;
+    obj->drawInfo_ = attr;
+    record(E);
+}
+
+void History::beginScene(Model& Data)
+{
+    sceneBefore_ = Data.snapshot(&sceneBeforeBytes_);
+}
+
+void History::commitScene(Model& Data)
+{
+    Edit E;
+    E.type = EditType::Scene;
+    E.sceneBefore = sceneBefore_;
+    E.sceneAfter = Data.snapshot(&E.sceneBytes);
+    E.sceneBytes += sceneBeforeBytes_;
+
+    sceneBefore_ = SceneSnapshot();
+    sceneBeforeBytes_ = 0;
+    record(E);
+}
+
+// UNDO / REDO ///////////////////////////////////////////////////
+
+// Move, SetPoint and Attributes modify the object in place (editObject)
+void History::apply(Model& Data, Edit& E)
+{
+    ObjGeom* obj = nullptr;
+    if (E.type == EditType::Move || E.type == EditType::SetPoint || E.type == EditType::Attributes)
+        obj = Data.editObject(E.id);
+
+    switch (E.type)
+    {
+    case EditType::Add:
+        Data.placeObject(E.obj, E.slot, E.epoch, E.aboveId);
+        E.obj = nullptr;
+        break;
+
+    case EditType::Remove:
+        E.obj = Data.removeObject(E.id);
+        break;
+
+    case EditType::Front:      Data.bringToFront(E.id);             break;
+    case EditType::Back:       Data.sendToBack(E.id);               break;
+    case EditType::Swap:       Data.swapOrder(E.id, E.otherId);     break;
+
+    case EditType::Move:       if (obj) obj->moveBy(E.delta);       break;
+    case EditType::SetPoint:   if (obj) obj->setPoint(E.pt, E.to);  break;
+    case EditType::Reshape:    Data.replaceObject(E.id, E.obj->clone(Data.shapePool)); break;
+    case EditType::Attributes: if (obj) obj->drawInfo_ = E.attrTo;  break;
+    case EditType::Scene:      Data.restore(E.sceneAfter);          break;
+    }
+}
+
+void History::revert(Model& Data, Edit& E)
+{
+    ObjGeom* obj = nullptr;
+    if (E.type == EditType::Move || E.type == EditType::SetPoint || E.type == EditType::Attributes)
+        obj = Data.editObject(E.id);
+
+    switch (E.type)
+    {
+    case EditType::Add:
+        E.obj = Data.removeObject(E.id);
+        break;
+
+    case EditType::Remove:
+        Data.placeObject(E.obj, E.slot, E.epoch, E.aboveId);
+        E.obj = nullptr;
+        break;
+
+    case EditType::Front:
+    case EditType::Back:
+        Data.moveObject(E.id, E.slot, E.epoch, E.aboveId);
+        break;
+
+    case EditType::Swap:       Data.swapOrder(E.id, E.otherId);       break;
+
+    case EditType::Move:       if (obj) obj->moveBy(-E.delta);        break;
+    case EditType::SetPoint:   if (obj) obj->setPoint(E.pt, E.from);  break;
+    case EditType::Reshape:    Data.replaceObject(E.id, E.before->clone(Data.shapePool)); break;
+    case EditType::Attributes: if (obj) obj->drawInfo_ = E.attrFrom;  break;
+    case EditType::Scene:      Data.restore(E.sceneBefore);           break;
+    }
+}
+
+// NAVIGATION ////////////////////////////////////////////////////
+
+void History::revertNode(Model& Data, int n)
+{
+    load(Data, n);
+    Node& N = nodes_[n];
+
+    bool swapped = false;
+    for (int i = (int)N.entry.edits.size() - 1; i >= 0; i--)
+    {
+        Edit& E = N.entry.edits[i];
+        revert(Data, E);
+        swapped |= (E.type == EditType::Add || E.type == EditType::Remove);
+    }
+    // the file copy does not hold the instances taken out of the scene
+    if (swapped) dropRecord(N);
+
+    lruUnlink(n);
+    lruPushFront(n);
+}
+
+void History::applyNode(Model& Data, int n)
+{
+    load(Data, n);
+    Node& N = nodes_[n];
+
+    bool swapped = false;
+    for (Edit& E : N.entry.edits)
+    {
+        apply(Data, E);
+        swapped |= (E.type == EditType::Add || E.type == EditType::Remove);
+    }
+    if (swapped) dropRecord(N);
+
+    lruUnlink(n);
+    lruPushFront(n);
+}
+
+bool History::goTo(Model& Data, int state)
+{
+    auto it = lower_bound(nodes_.begin(), nodes_.end(), state,
+                          [](const Node& N, int s) { return N.serial < s; });
+    if (it == nodes_.end() || it->serial != state) return false;
+    return goToNode(Data, int(it - nodes_.begin()));
+}
+
+bool History::goToNode(Model& Data, int state)
+{
+    if (state < 0 || state >= (int)nodes_.size() || state == current_) return false;
+
+    // up from the current state to the common ancestor,
+    // remembering the way down to the target
+    vector<int> down;
+    int a = current_, b = state;
+
+    while (nodes_[b].depth > nodes_[a].depth)
+    {
+        down.push_back(b);
+        b = nodes_[b].parent;
+    }
+    while (a != b)
+    {
+        if (nodes_[a].depth >= nodes_[b].depth)
+        {
+            revertNode(Data, a);
+            evict();
+            a = nodes_[a].parent;
+        }
+        else
+        {
+            down.push_back(b);
+            b = nodes_[b].parent;
+        }
+    }
+
+    for (int i = (int)down.size() - 1; i >= 0; i--)
+    {
+        int n = down[i];
+        applyNode(Data, n);
+        evict();
+        nodes_[nodes_[n].parent].redoChild = n;
+    }
+
+    current_ = state;
+    Data.sceneRevision++;
+    return true;
+}
+
+bool History::undo(Model& Data)
+{
+    return goToNode(Data, nodes_[current_].parent);
+}
+
+bool History::redo(Model& Data)
+{
+    return goToNode(Data, nodes_[current_].redoChild);
+}
+
+bool History::travel(Model& Data, int steps)
+{
+    int state = current_ + steps;
+    if (state < 0) state = 0;
+    if (state >= (int)nodes_.size()) state = (int)nodes_.size() - 1;
+    return goToNode(Data, state);
+}
+
+// PRUNING ///////////////////////////////////////////////////////
+
+/*
+ The states on the way from the initial one to the current one and on to
+ its redo chain are kept. The branches hanging from it go first, least
+ recently created first; if that is not enough, the oldest states of the
+ way go and the first one kept becomes the initial state (its edits are
+ dropped, it cannot be undone any more). Nodes keep their order, so a
+ parent is always before its children.
+*/
+void History::prune()
+{
+    int n = (int)nodes_.size();
+    int target = maxEntries - maxEntries / 4;
+    int count = n - 1;
+
+    vector<int> way;
+    for (int a = current_; a >= 0; a = nodes_[a].parent) way.push_back(a);
+    reverse(way.begin(), way.end());
+    int currentPos = (int)way.size() - 1;
+    for (int c = nodes_[current_].redoChild; c >= 0; c = nodes_[c].redoChild) way.push_back(c);
+
+    vector<char> onWay(n, 0), drop(n, 0);
+    for (int a : way) onWay[a] = 1;
+
+    // branches, by their most recent node
+    vector<int> newest(n), size(n, 1), branches;
+    for (int i = 0; i < n; i++) newest[i] = i;
+    for (int i = n - 1; i > 0; i--)
+    {
+        int p = nodes_[i].parent;
+        newest[p] = max(newest[p], newest[i]);
+        size[p] += size[i];
+        if (!onWay[i] && onWay[p]) branches.push_back(i);
+    }
+    sort(branches.begin(), branches.end(), [&](int a, int b) { return newest[a] < newest[b]; });
+
+    for (int b : branches)
+    {
+        if (count <= target) break;
+        drop[b] = 1;
+        count -= size[b];
+    }
+    for (int i = 1; i < n; i++)
+        if (drop[nodes_[i].parent]) drop[i] = 1;
+
+    // then the oldest states, never the current one
+    int first = min(max(count - target, 0), currentPos);
+    for (int k = 0; k < first; k++) drop[way[k]] = 1;
+    int root = way[first];
+
+    auto release = [&](int i)
+    {
+        Node& N = nodes_[i];
+        if (N.resident)
+        {
+            residentBytes_ -= N.entry.bytes;
+            lruUnlink(i);
+        }
+        dropRecord(N);
+        N.entry = Entry();
+    };
+    for (int i = 0; i < n; i++)
+        if (drop[i]) release(i);
+
+    if (root != 0)
+    {
+        release(root);
+        nodes_[root].resident = true;
+        nodes_[root].parent = -1;
+    }
+
+    // renumber the nodes kept
+    vector<int> index(n, -1);
+    int m = 0;
+    for (int i = 0; i < n; i++)
+        if (!drop[i]) index[i] = m++;
+
+    auto remap = [&](int i) { return i >= 0 ? index[i] : -1; };
+    vector<Node> kept;
+    kept.reserve(m);
+    for (int i = 0; i < n; i++)
+    {
+        if (drop[i]) continue;
+        Node N = move(nodes_[i]);
+        N.parent = remap(N.parent);
+        N.redoChild = remap(N.redoChild);
+        N.lruPrev = remap(N.lruPrev);
+        N.lruNext = remap(N.lruNext);
+        N.depth = N.parent >= 0 ? kept[N.parent].depth + 1 : 0;
+        kept.push_back(move(N));
+    }
+    nodes_.swap(kept);
+
+    current_ = index[current_];
+    lruHead_ = remap(lruHead_);
+    lruTail_ = remap(lruTail_);
+
+    compactFile();
+}
+
+// SPILL FILE ////////////////////////////////////////////////////
+
+/*
+ Nodes leave memory least recently used first. A node is written once at
+ the end of the file and keeps its offset, so spilling it again costs
+ nothing unless undo / redo changed it since (Add / Remove records).
+ Records use the text format of scene.txt for objects, with enough digits
+ to read back the exact values.
+ The records nobody refers to any more (changed or dropped nodes) are
+ removed by rewriting the file, when they take more than half of it.
+*/
+
+void History::lruUnlink(int n)
+{
+    Node& N = nodes_[n];
+    if (N.lruPrev >= 0) nodes_[N.lruPrev].lruNext = N.lruNext; else if (lruHead_ == n) lruHead_ = N.lruNext;
+    if (N.lruNext >= 0) nodes_[N.lruNext].lruPrev = N.lruPrev; else if (lruTail_ == n) lruTail_ = N.lruPrev;
+    N.lruPrev = N.lruNext = -1;
+}
+
+void History::lruPushFront(int n)
+{
+    Node& N = nodes_[n];
+    N.lruPrev = -1;
+    N.lruNext = lruHead_;
+    if (lruHead_ >= 0) nodes_[lruHead_].lruPrev = n;
+    lruHead_ = n;
+    if (lruTail_ < 0) lruTail_ = n;
+}
+
+// keep the most recent node in memory whatever its size
+void History::evict()
+{
+    while (residentBytes_ > budgetBytes && lruTail_ >= 0 && lruTail_ != lruHead_)
+        if (!spill(lruTail_)) return;
+}
+
+static void writeObject(ostream& os, const ObjGeom* obj)
+{
+    SceneStore S;
+    if (obj) S.add(*obj);
+    S.write(os);
+}
+
+static shared_ptr<ObjGeom> readObject(istream& is, int id, const shared_ptr<ShapePool>& pool)
+{
+    SceneStore S;
+    S.read(is);
+    if (S.size() == 0) return nullptr;
+
+    shared_ptr<ObjGeom> obj = S.makeObject(0, pool);
+    obj->id_ = id;
+    return obj;
+}
+
+// occupied slots with their ids, then the objects
+static void writeSnapshot(ostream& os, const SceneSnapshot& S)
+{
+    SceneStore store;
+    vector<int> slots;
+
+    for (int i = 0; i < S.size(); i++)
+    {
+        SceneSnapshot::Item obj = S.get(i);
+        if (!obj) continue;
+        store.add(*obj);
+        slots.push_back(i);
+        slots.push_back(obj->id_);
+    }
+
+    os << S.size() << " " << store.size() << "\n";
+    for (size_t k = 0; k < slots.size(); k += 2)
+        os << slots[k] << " " << slots[k + 1] << "\n";
+    store.write(os);
+}
+
+static SceneSnapshot readSnapshot(istream& is, const shared_ptr<ShapePool>& pool, size_t& bytes)
+{
+    int size = 0, count = 0;
+    is >> size >> count;
+
+    vector<int> slots(2 * count);
+    for (int& v : slots) is >> v;
+
+    SceneStore store;
+    store.read(is);
+
+    SceneSnapshot S;
+    S.resize(size);
+    for (int k = 0; k < count && k < store.size(); k++)
+    {
+        shared_ptr<ObjGeom> obj = store.makeObject(k, pool);
+        obj->id_ = slots[2 * k + 1];
+        bytes += objectBytes(obj.get());
+        S.set(slots[2 * k], obj);
+    }
+    bytes += S.allocatedBytes();
+    return S;
+}
+
+static string spillFileName()
+{
+    error_code ec;
+    filesystem::path dir = filesystem::temp_directory_path(ec);
+    return (dir / ("pictor_history_" +
+        to_string(chrono::steady_clock::now().time_since_epoch().count()) + ".tmp")).string();
+}
+
+bool History::spill(int n)
+{
+    Node& N = nodes_[n];
+
+    if (N.fileOffset < 0)
+    {
+        if (fileSize_ > 2 * fileLive_ + (1 << 20)) compactFile();
+        if (!file_.is_open())
+        {
+            fileName_ = spillFileName();
+            file_.open(fileName_, ios::in | ios::out | ios::trunc | ios::binary);
+            fileSize_ = fileLive_ = 0;
+        }
+        if (!file_) return false;
+
+        ostringstream os;
+        os.precision(9);
+        os << N.entry.edits.size() << "\n";
+        for (const Edit& E : N.entry.edits)
+        {
+            os << (int)E.type << " " << E.id << " " << E.slot << " " << E.epoch << " "
+               << E.aboveId << " " << E.otherId << " " << E.delta.x << " " << E.delta.y << " "
+               << E.pt << " " << E.from.x << " " << E.from.y << " " << E.to.x << " " << E.to.y << "\n";
+            SceneStore::writeAttr(os, E.attrFrom);
+            SceneStore::writeAttr(os, E.attrTo);
+
+            if (E.type == EditType::Scene)
+            {
+                writeSnapshot(os, E.sceneBefore);
+                writeSnapshot(os, E.sceneAfter);
+            }
+            else
+            {
+                writeObject(os, E.obj.get());
+                writeObject(os, E.before.get());
+            }
+        }
+
+        string record = os.str();
+        file_.seekp(0, ios::end);
+        file_.write(record.data(), record.size());
+        if (!file_) return false;
+
+        N.fileOffset = fileSize_;
+        N.fileLength = (int)record.size();
+        fileSize_ += record.size();
+        fileLive_ += record.size();
+    }
+
+    residentBytes_ -= N.entry.bytes;
+    N.entry = Entry();
+    N.resident = false;
+    lruUnlink(n);
+    return true;
+}
+
+void History::load(Model& Data, int n)
+{
+    Node& N = nodes_[n];
+    if (N.resident) return;
+
+    string record(N.fileLength, '\0');
+    file_.clear();
+    file_.seekg(N.fileOffset);
+    file_.read(&record[0], record.size());
+
+    istringstream is(record);
+    size_t count = 0;
+    is >> count;
+
+    N.entry.edits.resize(count);
+    for (Edit& E : N.entry.edits)
+    {
+        int type;
+        is >> type >> E.id >> E.slot >> E.epoch >> E.aboveId >> E.otherId >> E.delta.x >> E.delta.y
+           >> E.pt >> E.from.x >> E.from.y >> E.to.x >> E.to.y;
+        E.type = (EditType)type;
+        E.attrFrom = SceneStore::readAttr(is);
+        E.attrTo = SceneStore::readAttr(is);
+
+        if (E.type == EditType::Scene)
+        {
+            E.sceneBefore = readSnapshot(is, Data.shapePool, E.sceneBytes);
+            E.sceneAfter = readSnapshot(is, Data.shapePool, E.sceneBytes);
+        }
+        else
+        {
+            E.obj = readObject(is, E.id, Data.shapePool);
+            E.before = readObject(is, E.id, Data.shapePool);
+        }
+        N.entry.bytes += E.bytes();
+    }
+
+    N.resident = true;
+    residentBytes_ += N.entry.bytes;
+    lruPushFront(n);
+}
+
+void History::dropRecord(Node& N)
+{
+    if (N.fileOffset < 0) return;
+    fileLive_ -= N.fileLength;
+    N.fileOffset = -1;
+}
+
+// copies the records still referenced to a new file
+void History::compactFile()
+{
+    if (!file_.is_open() || fileSize_ == fileLive_) return;
+    if (fileLive_ == 0)
+    {
+        closeFile();
+        return;
+    }
+
+    string name = spillFileName();
+    fstream out(name, ios::in | ios::out | ios::trunc | ios::binary);
+
+    vector<long long> offsets;
+    long long size = 0;
+    string record;
+    for (const Node& N : nodes_)
+    {
+        if (N.fileOffset < 0) continue;
+        record.resize(N.fileLength);
+        file_.clear();
+        file_.seekg(N.fileOffset);
+        file_.read(&record[0], record.size());
+        out.write(record.data(), record.size());
+        offsets.push_back(size);
+        size += record.size();
+    }
+
+    error_code ec;
+    if (!file_ || !out)
+    {
+        // keep the old file
+        file_.clear();
+        out.close();
+        filesystem::remove(name, ec);
+        return;
+    }
+
+    size_t k = 0;
+    for (Node& N : nodes_)
+        if (N.fileOffset >= 0) N.fileOffset = offsets[k++];
+
+    file_.close();
+    filesystem::remove(fileName_, ec);
+    file_ = move(out);
+    fileName_ = name;
+    fileSize_ = fileLive_ = size;
+}
+
+void History::closeFile()
+{
+    if (!file_.is_open()) return;
+    file_.close();
+
+    error_code ec;
+    filesystem::remove(fileName_, ec);
+    fileSize_ = fileLive_ = 0;
+    for (Node& N : nodes_) N.fileOffset = -1;
+}
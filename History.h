@@ -0,0 +1,177 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "V2.h"
+#include "ObjAttr.h"
+#include "ObjGeom.h"
+#include "SceneSnapshot.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <memory>
+using namespace std;
+
+class Model;
+
+enum class EditType { Add, Remove, Front, Back, Swap, Move, SetPoint, Reshape, Attributes, Scene };
+
+/*
+ One elementary change of the scene, with what is needed to revert it.
+ Only the fields used by the type are set.
+*/
+struct Edit
+{
+    EditType type;
+    int id = -1;
+
+    // Add / Remove / Reshape : the object (Reshape: geometry after)
+    shared_ptr<ObjGeom> obj;
+    shared_ptr<ObjGeom> before;   // Reshape: geometry before
+
+    // Add / Remove / Front / Back : position before the change
+    int slot = -1;
+    int epoch = -1;
+    int aboveId = -1;
+
+    int otherId = -1;             // Swap
+    V2  delta;                    // Move
+    int pt = -1;                  // SetPoint
+    V2  from, to;                 // SetPoint
+    ObjAttr attrFrom, attrTo;     // Attributes
+
+    // Scene : whole scene before / after (shared with the other snapshots)
+    SceneSnapshot sceneBefore, sceneAfter;
+    size_t sceneBytes = 0;        // memory the two snapshots did not share
+
+    size_t bytes() const;         // memory kept by the record
+};
+
+size_t objectBytes(const ObjGeom* obj);   // approximate memory of an object
+
+/*
+ Undo tree.
+ Each user action is one node holding the edits it made, child of the state
+ it was made in: a new action after some undos starts a new branch instead of
+ discarding the undone ones. Moving from a state to another reverts the edits
+ up to their common ancestor and replays the ones down to the target, so the
+ cost is proportional to the path, not to the scene.
+ Only the most recently used nodes keep their edits in memory (budgetBytes);
+ the others are written to an append-only file and read back when needed.
+ Above maxEntries states, the least recent branches are dropped, then the
+ oldest states of the current one, down to 3/4 of the limit, and the file
+ is rewritten without their records.
+
+ The functions below perform the change on the Model and record it
+ (the ones named in the past tense only record a change already made,
+ e.g. at the end of a drag).
+ Several calls can be grouped in one node with begin() / commit().
+ Whole scene changes keep two snapshots instead (see SceneSnapshot): they
+ share the unchanged objects with each other and with the other entries.
+*/
+class History
+{
+public:
+    size_t budgetBytes = 64 * 1024 * 1024;   // edits kept in memory
+    int    maxEntries = 10000;               // states kept
+
+    History();
+    ~History();
+
+    // record
+    int  add(Model& Data, shared_ptr<ObjGeom> obj);
+    void added(Model& Data, int id);
+    void remove(Model& Data, int id);
+    void bringToFront(Model& Data, int id);
+    void sendToBack(Model& Data, int id);
+    void swapOrder(Model& Data, int idA, int idB);
+    void stepOrder(Model& Data, int id, int dir);     // one step up (+1) / down (-1)
+    void moved(Model& Data, int id, V2 delta);
+    void pointMoved(Model& Data, int id, int pt, V2 from, V2 to);
+    void reshaped(Model& Data, int id, shared_ptr<ObjGeom> before);
+    void setAttributes(Model& Data, int id, const ObjAttr& attr);
+
+    void begin();
+    void commit();
+
+    // changes of the whole scene (RAZ, Load) are recorded as two snapshots
+    // taken before and after: beginScene(); ...change...; commitScene();
+    void beginScene(Model& Data);
+    void commitScene(Model& Data);
+
+    // navigate
+    // states are numbered in creation order, 0 is the initial state;
+    // a number stays valid until its state is dropped
+    bool undo(Model& Data);                  // to the parent state
+    bool redo(Model& Data);                  // to the child last created or visited
+    bool goTo(Model& Data, int state);       // any state, through the common ancestor
+    bool travel(Model& Data, int steps);     // earlier (< 0) / later (> 0) state in time
+    bool canUndo() const { return nodes_[current_].parent >= 0; }
+    bool canRedo() const { return nodes_[current_].redoChild >= 0; }
+
+    int  state() const   { return nodes_[current_].serial; }
+    int  entries() const { return (int)nodes_.size() - 1; }
+
+    void clear();
+    size_t    bytes() const     { return residentBytes_; }   // edits in memory
+    long long diskBytes() const { return fileSize_; }        // spill file
+
+private:
+    struct Entry
+    {
+        vector<Edit> edits;
+        size_t bytes = 0;
+    };
+
+    struct Node
+    {
+        int serial = 0;               // state number
+        int parent = -1;
+        int depth = 0;
+        int redoChild = -1;
+        Entry entry;                  // edits, when resident
+        bool resident = true;
+        long long fileOffset = -1;    // copy in the spill file (-1: none or out of date)
+        int fileLength = 0;
+        int lruPrev = -1, lruNext = -1;
+    };
+
+    vector<Node> nodes_;    // nodes_[0] is the initial state, then by serial
+    int   current_ = 0;
+    int   nextSerial_ = 1;
+    Entry pending_;         // edits of the action being recorded
+    int   depth_ = 0;       // begin() nesting
+
+    // resident nodes, most recently used first
+    int    lruHead_ = -1, lruTail_ = -1;
+    size_t residentBytes_ = 0;
+
+    fstream   file_;
+    string    fileName_;
+    long long fileSize_ = 0;
+    long long fileLive_ = 0;        // records still referenced
+
+    SceneSnapshot sceneBefore_;     // pending beginScene
+    size_t sceneBeforeBytes_ = 0;
+
+    void record(const Edit& E);
+    void push(Entry& E);
+
+    void revertNode(Model& Data, int n);
+    void applyNode(Model& Data, int n);
+    bool goToNode(Model& Data, int n);
+    void prune();
+
+    void lruUnlink(int n);
+    void lruPushFront(int n);
+    void evict();
+    bool spill(int n);
+    void load(Model& Data, int n);
+    void dropRecord(Node& N);
+    void compactFile();
+    void closeFile();
+
+    // Add / Remove keep the instance taken out of the scene,
+    // so the record is updated when it is applied / reverted
+    static void apply(Model& Data, Edit& E);     // redo one edit
+    static void revert(Model& Data, Edit& E);    // undo one edit
+};
@@ -0,0 +1,107 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Test.h"
+#include "Model.h"
+
+using namespace std;
+
+static void addRect(Model& M, int x)
+{
+    M.history.add(M, make_shared<ObjRectangle>(ObjAttr(), V2(x, 0), V2(x + 10, 10)));
+}
+
+static int undoAll(Model& M)
+{
+    int steps = 0;
+    while (M.history.undo(M)) steps++;
+    return steps;
+}
+
+// above the limit the old branch goes first, then the oldest states
+TEST(historyPrune)
+{
+    Model M;
+    M.history.maxEntries = 8;
+
+    for (int i = 0; i < 6; i++) addRect(M, 20 * i);        // states 1..6
+    for (int i = 0; i < 3; i++) M.history.undo(M);
+    for (int i = 0; i < 3; i++) addRect(M, -20 * i);       // states 7..9, 4..6 dropped
+
+    CHECK(M.history.entries() == 6);
+    CHECK(M.history.state() == 9);
+    CHECK(!M.history.goTo(M, 4));
+    CHECK(M.history.goTo(M, 3));
+    CHECK(M.objectCount() == 3);
+    CHECK(M.history.goTo(M, 9));
+    CHECK(M.objectCount() == 6);
+
+    for (int i = 0; i < 3; i++) addRect(M, 200 + 20 * i);  // states 10..12, 0..2 dropped
+    CHECK(M.history.entries() == 6);
+    CHECK(M.history.state() == 12);
+    CHECK(undoAll(M) == 6);
+    CHECK(M.history.state() == 3);
+    CHECK(M.objectCount() == 3);
+    CHECK(M.history.travel(M, 100));
+    CHECK(M.objectCount() == 9);
+}
+
+// the spill file keeps only the records of the states kept
+TEST(historySpillPrune)
+{
+    auto run = [](int maxEntries, long long& disk)
+    {
+        Model M;
+        M.history.budgetBytes = 0;      // every node but the last one on disk
+        M.history.maxEntries = maxEntries;
+
+        for (int i = 0; i < 200; i++)
+        {
+            addRect(M, i);
+            if (i % 10 == 9)
+            {
+                // undo / redo through the file, then a new branch
+                M.history.undo(M);
+                M.history.undo(M);
+                M.history.redo(M);
+            }
+        }
+        disk = M.history.diskBytes();
+
+        // every state kept reads back from the file
+        int count = M.objectCount();
+        int steps = undoAll(M);
+        CHECK(count - M.objectCount() == steps);
+        return steps;
+    };
+
+    long long capped = 0, full = 0;
+    int undone = run(40, capped);
+    run(10000, full);
+
+    CHECK(undone <= 40);
+    CHECK(capped > 0);
+    CHECK(capped * 3 < full);
+}
+
+// an attribute change is one edit of the object, undone and redone alone,
+// without copying a snapshot of the scene
+TEST(historyAttributes)
+{
+    Model M;
+    addRect(M, 0);
+    addRect(M, 20);
+    int id = M.LObjets.back()->id_;
+
+    ObjAttr A = M.findObject(id)->drawInfo_;
+    A.borderColor_ = Color::Red;
+    A.thickness_ = 5;
+    M.history.setAttributes(M, id, A);
+    CHECK(M.findObject(id)->drawInfo_.thickness_ == 5);
+
+    REQUIRE(M.history.undo(M));
+    CHECK(M.findObject(id)->drawInfo_.thickness_ != 5);
+    CHECK(M.objectCount() == 2);
+    REQUIRE(M.history.redo(M));
+    CHECK(M.findObject(id)->drawInfo_.thickness_ == 5);
+    CHECK(M.findObject(id)->drawInfo_.borderColor_.G == 0);
+}
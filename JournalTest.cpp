@@ -0,0 +1,148 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Test.h"
+#include "Model.h"
+#include "SceneFile.h"
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+static const string journalPath = "testdata/journalTest.journal";
+static const string binPath = "testdata/journalTest.bin";
+static const string crashPath = "testdata/journalCrash.journal";
+
+static void removeFiles()
+{
+    error_code ec;
+    for (const string& p : { journalPath, binPath, crashPath }) filesystem::remove(p, ec);
+}
+
+static int addRect(Model& M, int x)
+{
+    return M.history.add(M, make_shared<ObjRectangle>(ObjAttr(), V2(x, 0), V2(x + 10, 10)));
+}
+
+static void checkScene(const Model& M, const SceneStore& expected)
+{
+    SceneStore S;
+    S.build(M.LObjets);
+    REQUIRE(S.size() == expected.size());
+    for (int i = 0; i < S.size(); i++)
+    {
+        CHECK(S.kind_[i] == expected.kind_[i]);
+        CHECK(S.A_[i] == expected.A_[i]);
+        CHECK(S.B_[i] == expected.B_[i]);
+        CHECK(S.id_[i] == expected.id_[i]);
+    }
+}
+
+// the journal left by a crash, as it is when the writer has caught up
+static void copyForCrash(SceneJournal& J)
+{
+    J.flush();
+    filesystem::copy_file(journalPath, crashPath, filesystem::copy_options::overwrite_existing);
+}
+
+// scene.bin written for a BASE, then the batches logged after it
+TEST(journalReplayBaseBatch)
+{
+    removeFiles();
+    SceneStore expected;
+    uint64_t mark = 0;
+    {
+        Model A;
+        SceneJournal J(journalPath, binPath);
+        string message;
+        CHECK(!J.open(A, message));
+
+        int a = addRect(A, 0);
+        addRect(A, 100);
+        J.sync(A);
+
+        mark = J.beginBase(A);
+        SceneStore S;
+        S.build(A.LObjets);
+        REQUIRE(writeSceneFile(binPath, S, mark));
+        J.baseWritten(mark);
+
+        A.history.remove(A, a);
+        addRect(A, 200);
+        J.sync(A);
+
+        expected.build(A.LObjets);
+        copyForCrash(J);
+    }
+
+    // the records before the BASE were dropped once scene.bin was written
+    {
+        ifstream F(crashPath);
+        string header, base;
+        getline(F, header);
+        getline(F, base);
+        CHECK(base == "BASE " + to_string(mark));
+    }
+
+    {
+        Model B;
+        SceneJournal K(crashPath, binPath);
+        string message;
+        CHECK(K.open(B, message));
+        CHECK(message.find("on scene.bin") != string::npos);
+        checkScene(B, expected);
+    }
+    removeFiles();
+}
+
+// a record cut by a crash is not replayed, and is cut from the file
+TEST(journalTornRecord)
+{
+    removeFiles();
+    SceneStore expected;
+    uintmax_t full = 0;
+    {
+        Model A;
+        SceneJournal J(journalPath, binPath);
+        string message;
+        J.open(A, message);
+
+        addRect(A, 0);
+        J.sync(A);
+        expected.build(A.LObjets);
+
+        addRect(A, 100);
+        addRect(A, 200);
+        J.sync(A);
+        copyForCrash(J);
+    }
+    full = filesystem::file_size(crashPath);
+    filesystem::resize_file(crashPath, full - 3);    // in the END line
+
+    {
+        Model B;
+        SceneJournal K(crashPath, binPath);
+        string message;
+        CHECK(K.open(B, message));
+        checkScene(B, expected);
+
+        K.flush();
+        CHECK(K.bytes() == filesystem::file_size(crashPath));
+        CHECK(K.bytes() < full - 3);
+
+        // logging goes on after the last good record
+        addRect(B, 300);
+        K.sync(B);
+        expected.build(B.LObjets);
+        K.flush();
+        filesystem::copy_file(crashPath, journalPath, filesystem::copy_options::overwrite_existing);
+    }
+
+    {
+        Model C;
+        SceneJournal L(journalPath, binPath);
+        string message;
+        CHECK(L.open(C, message));
+        checkScene(C, expected);
+    }
+    removeFiles();
+}
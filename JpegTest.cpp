@@ -0,0 +1,127 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Test.h"
+#include "jpeg_decoder.h"
+#include "picoPNG.h"
+#include "ThreadPool.h"
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+/*
+ testdata/jpeg: small baseline JPEGs, 4:2:0, 4:2:2, 4:4:0, 4:4:4 and gray,
+ of odd and tiny sizes; the ones of 640x480 or so are large enough for the
+ parallel paths and most have restart intervals.
+*/
+struct JpegFile
+{
+    string name;
+    vector<unsigned char> data;
+};
+
+static vector<JpegFile> jpegCorpus()
+{
+    vector<JpegFile> files;
+    for (auto& e : filesystem::directory_iterator("testdata/jpeg"))
+        if (e.path().extension() == ".jpg") files.push_back({ e.path().filename().string(), {} });
+    sort(files.begin(), files.end(), [](const JpegFile& a, const JpegFile& b) { return a.name < b.name; });
+    for (JpegFile& f : files) loadFile(f.data, "testdata/jpeg/" + f.name);
+    return files;
+}
+
+static void runOnPool(void* pool, int count, Jpeg::Decoder::TaskFunc task, void* arg)
+{
+    ((ThreadPool*)pool)->run(count, [=](int i) { task(arg, i); });
+}
+
+// a decoder of its own, scalar and in sequence
+struct JpegImage
+{
+    int result = -1, width = 0, height = 0, scale = 0;
+    vector<unsigned char> pixels;
+};
+
+static JpegImage reference(const JpegFile& f, int scale)
+{
+    Jpeg::Decoder::LimitSimd(Jpeg::Decoder::SimdScalar);
+    Jpeg::Decoder D;
+    D.SetScale(scale);
+    D.Decode(f.data.data(), f.data.size());
+
+    JpegImage I;
+    I.result = D.GetResult();
+    if (I.result == Jpeg::Decoder::OK)
+    {
+        I.width = D.GetWidth();
+        I.height = D.GetHeight();
+        I.scale = D.GetScale();
+        I.pixels.assign(D.GetImage(), D.GetImage() + D.GetImageSize());
+    }
+    return I;
+}
+
+static bool sameImage(const Jpeg::Decoder& D, const JpegImage& I)
+{
+    return D.GetResult() == I.result && D.GetWidth() == I.width && D.GetHeight() == I.height
+        && D.GetScale() == I.scale && D.GetImageSize() == I.pixels.size()
+        && memcmp(D.GetImage(), I.pixels.data(), I.pixels.size()) == 0;
+}
+
+// every instruction set, with and without the pool, at every scale, gives
+// the image of the scalar decoder byte for byte; one decoder per setting
+// goes through all the files, its buffers kept (or released) in between
+TEST(jpegDecodeEquivalence)
+{
+    vector<JpegFile> files = jpegCorpus();
+    REQUIRE(files.size() >= 5);
+
+    const int scales[] = { 1, 2, 4, 8 };
+    vector<JpegImage> ref;          // file i at scales[k]: ref[i * 4 + k]
+    for (const JpegFile& f : files)
+    {
+        for (int scale : scales)
+        {
+            ref.push_back(reference(f, scale));
+            CHECK(ref.back().result == Jpeg::Decoder::OK);
+        }
+        int w = 0, h = 0;
+        CHECK(Jpeg::Decoder::ReadSize(f.data.data(), f.data.size(), w, h));
+        CHECK(w == ref[ref.size() - 4].width && h == ref[ref.size() - 4].height);
+    }
+
+    ThreadPool pool(4);
+    const Jpeg::Decoder::Simd levels[] = { Jpeg::Decoder::SimdScalar, Jpeg::Decoder::SimdSSE2, Jpeg::Decoder::SimdAVX2 };
+    for (Jpeg::Decoder::Simd simd : levels)
+        for (int parallel = 0; parallel < 2; parallel++)
+        {
+            Jpeg::Decoder::LimitSimd(simd);
+            Jpeg::Decoder D;
+            if (parallel) D.SetParallel(runOnPool, &pool, pool.size());
+
+            for (int k = 0; k < 4; k++)
+            {
+                D.SetScale(scales[k]);
+                for (size_t i = 0; i < files.size(); i++)
+                {
+                    const JpegFile& f = files[i];
+                    const JpegImage& I = ref[i * 4 + k];
+                    D.Decode(f.data.data(), f.data.size());
+                    if (!sameImage(D, I))
+                        testFailure(__FILE__, __LINE__, f.name + ": simd " + to_string(simd) + (parallel ? ", parallel" : "")
+                                    + ", 1/" + to_string(scales[k]) + " differs from the scalar decode");
+                    CHECK(D.GetSimd() <= simd);
+
+                    // a broken file in between changes nothing for the next one
+                    if (i % 3 == 1)
+                    {
+                        D.Decode(f.data.data(), f.data.size() / 2);
+                        CHECK(D.GetResult() != Jpeg::Decoder::OK);
+                    }
+                    if (i % 4 == 2) D.ReleaseBuffers();
+                }
+            }
+        }
+    Jpeg::Decoder::LimitSimd(Jpeg::Decoder::SimdAVX2);
+}
@@ -0,0 +1,104 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+bool MappedFile::open(const string& path, bool populate)
+{
+    close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              populate ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    file_ = file;
+    mapping_ = mapping;
+    data_ = (const unsigned char*)view;
+    size_ = (size_t)size.QuadPart;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle((HANDLE)mapping_);
+    if (file_) CloseHandle((HANDLE)file_);
+    data_ = nullptr;
+    mapping_ = file_ = nullptr;
+    size_ = 0;
+}
+
+#else
+
+bool MappedFile::open(const string& path, bool populate)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (populate) flags |= MAP_POPULATE;   // map the whole file at once rather than page by page
+#endif
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, flags, fd, 0);
+    ::close(fd);   // the mapping stays valid
+    if (view == MAP_FAILED) return false;
+
+    if (populate) madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+    data_ = (const unsigned char*)view;
+    size_ = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data_) munmap((void*)data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#endif
@@ -0,0 +1,39 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include <string>
+#include <cstddef>
+using namespace std;
+
+/*
+ Read-only memory mapping of a whole file.
+ The content is paged in by the system as it is used: nothing is copied.
+ populate is for readers that go through the whole file once, in order
+ (e.g. the text parser): the pages are read ahead, all at once where
+ supported, instead of one fault at a time.
+*/
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    bool open(const string& path, bool populate = false);   // false if missing or unreadable
+    void close();
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool   isOpen() const { return data_ != nullptr; }
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+
+#ifdef _WIN32
+    void* file_ = nullptr;      // HANDLE
+    void* mapping_ = nullptr;   // HANDLE
+#endif
+};
@@ -0,0 +1,379 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Model.h"
+
+using namespace std;
+
+/*
+ Objects keep their slot in LObjets until the list is compacted:
+ - removing an object empties its slot: O(1)
+ - bring to front appends the object and empties its old slot: O(1)
+ - send to back uses the empty slots kept in front of the list: O(1)
+ The list is compacted (O(n)) once there are more empty slots than
+ objects, so each operation stays O(1) amortized.
+*/
+
+ObjGeom* Model::findObject(int id) const
+{
+    auto it = slotOfId.find(id);
+    if (it == slotOfId.end()) return nullptr;
+    return LObjets[it->second].get();
+}
+
+int Model::slotOf(int id) const
+{
+    auto it = slotOfId.find(id);
+    return (it == slotOfId.end()) ? -1 : it->second;
+}
+
+int Model::addObject(shared_ptr<ObjGeom> obj)
+{
+    if (obj->id_ < 0 || slotOfId.count(obj->id_))
+        obj->id_ = nextObjectId++;
+    else if (obj->id_ >= nextObjectId)
+        nextObjectId = obj->id_ + 1;
+
+    slotOfId[obj->id_] = (int)LObjets.size();
+    LObjets.push_back(obj);
+    markSlot((int)LObjets.size() - 1);
+    sceneRevision++;
+    return obj->id_;
+}
+
+void Model::releaseSlot(int slot)
+{
+    LObjets[slot] = nullptr;
+    holeCount++;
+    markSlot(slot);
+
+    // trailing empty slots are simply dropped
+    while (!LObjets.empty() && !LObjets.back() && (int)LObjets.size() > frontGap)
+    {
+        LObjets.pop_back();
+        holeCount--;
+    }
+}
+
+shared_ptr<ObjGeom> Model::removeObject(int id)
+{
+    auto it = slotOfId.find(id);
+    if (it == slotOfId.end()) return nullptr;
+
+    int slot = it->second;
+    slotOfId.erase(it);
+
+    shared_ptr<ObjGeom> obj = LObjets[slot];
+    releaseSlot(slot);
+
+    if (holeCount > objectCount() + 32) compact(0);
+    sceneRevision++;
+    return obj;
+}
+
+void Model::clearObjects()
+{
+    LObjets.clear();
+    slotOfId.clear();
+    holeCount = 0;
+    frontGap = 0;
+    layoutEpoch++;
+    sceneRevision++;
+    markLayout();
+}
+
+void Model::bringToFront(int id)
+{
+    int slot = slotOf(id);
+    if (slot < 0 || slot == (int)LObjets.size() - 1) return;
+
+    shared_ptr<ObjGeom> obj = LObjets[slot];
+    LObjets[slot] = nullptr;
+    holeCount++;
+    markSlot(slot);
+
+    slotOfId[id] = (int)LObjets.size();
+    LObjets.push_back(obj);
+    markSlot((int)LObjets.size() - 1);
+
+    if (holeCount > objectCount() + 32) compact(0);
+}
+
+void Model::sendToBack(int id)
+{
+    int slot = slotOf(id);
+    if (slot < 0 || slot == frontGap) return;
+
+    if (frontGap == 0)
+    {
+        compact(objectCount() / 2 + 16);
+        slot = slotOf(id);
+    }
+
+    shared_ptr<ObjGeom> obj = LObjets[slot];
+    frontGap--;
+    LObjets[frontGap] = obj;
+    slotOfId[id] = frontGap;
+    markSlot(frontGap);
+    holeCount--;
+
+    releaseSlot(slot);
+}
+
+void Model::swapOrder(int idA, int idB)
+{
+    int a = slotOf(idA), b = slotOf(idB);
+    if (a < 0 || b < 0) return;
+
+    swap(LObjets[a], LObjets[b]);
+    slotOfId[idA] = b;
+    slotOfId[idB] = a;
+    markSlot(a);
+    markSlot(b);
+}
+
+int Model::stepOrder(int id, int dir)
+{
+    int slot = slotOf(id);
+    if (slot < 0) return -1;
+
+    const SlotSet& used = usedSlots();
+    int s = dir > 0 ? used.next(slot) : used.prev(slot);
+    if (s < 0) return -1;
+
+    int other = LObjets[s]->id_;
+    swapOrder(id, other);
+    return other;
+}
+
+int Model::aboveIdOf(int id) const
+{
+    int slot = slotOf(id);
+    if (slot < 0) return -1;
+
+    int s = usedSlots().next(slot);
+    return s < 0 ? -1 : LObjets[s]->id_;
+}
+
+void Model::placeObject(shared_ptr<ObjGeom> obj, int slot, int epoch, int aboveId)
+{
+    // same layout: the old slot is still free
+    if (epoch == layoutEpoch && slot >= frontGap &&
+        (slot >= (int)LObjets.size() || !LObjets[slot]))
+    {
+        if (slot >= (int)LObjets.size())
+        {
+            holeCount += slot - (int)LObjets.size() + 1;
+            LObjets.resize(slot + 1);
+        }
+        LObjets[slot] = obj;
+        holeCount--;
+        slotOfId[obj->id_] = slot;
+        markSlot(slot);
+        if (obj->id_ >= nextObjectId) nextObjectId = obj->id_ + 1;
+        sceneRevision++;
+        return;
+    }
+
+    // otherwise just below the object that was above it
+    int above = slotOf(aboveId);
+    if (above < 0)
+    {
+        addObject(obj);
+        return;
+    }
+
+    if (above - 1 >= frontGap && !LObjets[above - 1])
+    {
+        LObjets[above - 1] = obj;
+        holeCount--;
+        slotOfId[obj->id_] = above - 1;
+        markSlot(above - 1);
+    }
+    else
+    {
+        // no free slot there: shift the objects above, O(n)
+        LObjets.insert(LObjets.begin() + above, obj);
+        for (int s = above; s < (int)LObjets.size(); s++)
+            if (LObjets[s]) slotOfId[LObjets[s]->id_] = s;
+        layoutEpoch++;
+        markLayout();
+    }
+    if (obj->id_ >= nextObjectId) nextObjectId = obj->id_ + 1;
+    sceneRevision++;
+}
+
+void Model::moveObject(int id, int slot, int epoch, int aboveId)
+{
+    int cur = slotOf(id);
+    if (cur < 0) return;
+
+    shared_ptr<ObjGeom> obj = LObjets[cur];
+    slotOfId.erase(id);
+    releaseSlot(cur);
+
+    placeObject(obj, slot, epoch, aboveId);
+}
+
+void Model::replaceObject(int id, shared_ptr<ObjGeom> obj)
+{
+    int slot = slotOf(id);
+    if (slot < 0) return;
+
+    obj->id_ = id;
+    LObjets[slot] = obj;
+    markSlot(slot);
+    sceneRevision++;
+}
+
+// an object not frozen is in no snapshot: its slot is already marked
+ObjGeom* Model::editObject(int id)
+{
+    int slot = slotOf(id);
+    if (slot < 0) return nullptr;
+
+    shared_ptr<ObjGeom>& obj = LObjets[slot];
+    if (obj->frozen_)
+    {
+        obj = obj->clone(shapePool);
+        markSlot(slot);
+    }
+    return obj.get();
+}
+
+void Model::compact(int headroom)
+{
+    vector< shared_ptr<ObjGeom> > L;
+    L.reserve(headroom + objectCount());
+    L.resize(headroom);
+
+    for (auto& obj : LObjets)
+    {
+        if (!obj) continue;
+        slotOfId[obj->id_] = (int)L.size();
+        L.push_back(obj);
+    }
+
+    LObjets.swap(L);
+    holeCount = headroom;
+    frontGap = headroom;
+    layoutEpoch++;
+    markLayout();
+}
+
+// USED SLOTS ////////////////////////////////////////////////////
+
+/*
+ used_ holds the non-empty slots of LObjets, so that the object above or
+ below another one is found without walking over the empty slots between
+ them. Every slot change goes through markSlot, which updates it; after a
+ renumbering (markLayout, restore) it is rebuilt when next needed.
+*/
+
+const SlotSet& Model::usedSlots() const
+{
+    if (usedStale_)
+    {
+        used_.clear();
+        used_.reserve((int)LObjets.size());
+        for (int slot = 0; slot < (int)LObjets.size(); slot++)
+            if (LObjets[slot]) used_.set(slot, true);
+        usedStale_ = false;
+    }
+    return used_;
+}
+
+// SNAPSHOTS /////////////////////////////////////////////////////
+
+/*
+ The Model keeps its last snapshot (mirror_). Taking a new snapshot only
+ updates the slots changed since. The objects are not copied: a snapshot
+ marks them frozen, and editObject copies a frozen object before it is
+ modified, so each object is copied at most once per snapshot.
+ Nothing is tracked before the first snapshot (relayout_ starts true).
+*/
+
+void Model::markSlot(int slot)
+{
+    if (slot < 0) return;
+    if (!usedStale_)
+    {
+        used_.reserve(slot + 1);
+        used_.set(slot, slot < (int)LObjets.size() && LObjets[slot]);
+    }
+
+    if (relayout_) return;
+    dirtySlots_.push_back(slot);
+
+    // many changes since the last snapshot: cheaper to check every slot
+    if (dirtySlots_.size() > LObjets.size() + 64) markLayout();
+}
+
+void Model::markLayout()
+{
+    relayout_ = true;
+    usedStale_ = true;
+    dirtySlots_.clear();
+}
+
+SceneSnapshot Model::snapshot(size_t* bytes)
+{
+    size_t nodes = mirror_.allocatedBytes();
+
+    int n = (int)LObjets.size();
+    mirror_.resize(n);
+
+    if (relayout_)
+    {
+        // set() keeps the nodes whose slots did not change
+        for (int slot = 0; slot < n; slot++)
+            mirror_.set(slot, LObjets[slot]);
+    }
+    else
+    {
+        for (int slot : dirtySlots_)
+            if (slot < n) mirror_.set(slot, LObjets[slot]);
+    }
+    dirtySlots_.clear();
+    relayout_ = false;
+
+    if (bytes) *bytes = mirror_.allocatedBytes() - nodes;
+    return mirror_;
+}
+
+void Model::restore(const SceneSnapshot& S)
+{
+    // from here LObjets matches the slots of current
+    SceneSnapshot current = snapshot();
+    if ((int)LObjets.size() < S.size()) LObjets.resize(S.size());
+
+    current.diff(S, [&](int slot, const SceneSnapshot::Item&, const SceneSnapshot::Item& to)
+    {
+        shared_ptr<ObjGeom>& live = LObjets[slot];
+
+        // the object may already have been put in its new slot
+        if (live && slotOf(live->id_) == slot)
+            slotOfId.erase(live->id_);
+        live = nullptr;
+
+        // shared with S: frozen, copied by editObject when modified
+        if (to)
+        {
+            live = const_pointer_cast<ObjGeom>(to);
+            slotOfId[live->id_] = slot;
+            if (live->id_ >= nextObjectId) nextObjectId = live->id_ + 1;
+        }
+    });
+
+    LObjets.resize(S.size());
+    mirror_ = S;
+    dirtySlots_.clear();
+    relayout_ = false;
+
+    holeCount = (int)LObjets.size() - objectCount();
+    frontGap = 0;
+    while (frontGap < (int)LObjets.size() && !LObjets[frontGap]) frontGap++;
+
+    usedStale_ = true;
+    layoutEpoch++;
+    sceneRevision++;
+}
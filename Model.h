@@ -5,9 +5,16 @@
 #include "ObjGeom.h"
 #include "V2.h"
 #include "ObjAttr.h"
+#include "ShapePool.h"
+#include "History.h"
+#include "SceneSnapshot.h"
+#include "AutoSave.h"
+#include "SceneJournal.h"
+#include "SlotSet.h"
 #include <vector>
 #include <memory>
 #include <string>
+#include <unordered_map>
 using namespace std;
 
 // forward declarations
@@ -15,7 +22,6 @@ class Tool;
 class Button;
 class Model;
 void initApp(Model& Data);
-void pushUndoState(Model& Data);
 
 class Model
 {
@@ -27,19 +33,102 @@ public:
 
     ObjAttr drawingOptions;
 
+    // memory of the scene objects (see allocateShape)
+    shared_ptr<ShapePool> shapePool = make_shared<ShapePool>();
+
+    // objects in draw order
+    // a removed object leaves an empty slot (nullptr) until the list is compacted
     vector< shared_ptr<ObjGeom> > LObjets;
 
+    // object id -> slot in LObjets
+    unordered_map<int, int> slotOfId;
+    int nextObjectId = 1;
+    int holeCount = 0;     // empty slots in LObjets
+    int frontGap = 0;      // LObjets[0 .. frontGap-1] are empty, kept for sendToBack
+    int layoutEpoch = 0;   // incremented when slots are renumbered (compaction)
+
+    // incremented each time objects are added, removed or rebuilt,
+    // so that indices built over LObjets know they are stale
+    int sceneRevision = 0;
+
     vector< shared_ptr<Button> > LButtons;
 
-    // index of selected object (-1 if none)
+    // id of selected object (-1 if none)
     int selectedObject = -1;
 
-    // undo stack
-    vector<string> undoStack;
+    // undo / redo journal
+    History history;
+
+    // background saves of snapshots of the scene
+    AutoSave autosave;
+
+    // log of the changes since the last full save (after autosave:
+    // closed first when the app exits)
+    SceneJournal journal;
 
     Model()
     {
         initApp(*this);
     }
+
+    //  Objects, addressed by their stable id 
+
+    int objectCount() const { return (int)slotOfId.size(); }
+
+    ObjGeom* findObject(int id) const;   // nullptr if unknown
+    int      slotOf(int id) const;       // -1 if unknown
+
+    int  addObject(shared_ptr<ObjGeom> obj);    // on top, returns its id
+    shared_ptr<ObjGeom> removeObject(int id);
+    void clearObjects();
+
+    // z-order
+    void bringToFront(int id);
+    void sendToBack(int id);
+    void swapOrder(int idA, int idB);
+    int  stepOrder(int id, int dir);    // swap with the next object above (+1) / below (-1),
+                                        // returns its id (-1 if none)
+    int  aboveIdOf(int id) const;       // id of the next object above (-1 if on top)
+
+    // put an object back where it was: in its old slot if the layout did not
+    // change since (same layoutEpoch), otherwise just below aboveId
+    void placeObject(shared_ptr<ObjGeom> obj, int slot, int epoch, int aboveId);
+    void moveObject(int id, int slot, int epoch, int aboveId);
+
+    // same id, other object (geometry restored by undo)
+    void replaceObject(int id, shared_ptr<ObjGeom> obj);
+
+    // object to modify in place (geometry, attributes), nullptr if unknown;
+    // when a snapshot holds it, a copy takes its slot first
+    ObjGeom* editObject(int id);
+
+    //  Snapshots of the whole scene 
+
+    // frozen view of LObjets, sharing its objects with the scene and every
+    // node not changed since with the previous snapshot: the cost is
+    // proportional to the change.
+    // bytes (optional) receives the memory taken by the new nodes
+    SceneSnapshot snapshot(size_t* bytes = nullptr);
+
+    // make the scene equal to S; only the slots that differ are rebuilt
+    void restore(const SceneSnapshot& S);
+
+private:
+    void releaseSlot(int slot);
+    void compact(int headroom);
+
+    // last snapshot, kept in sync lazily: the slots changed since are listed
+    // in dirtySlots_, or relayout_ is set when they were renumbered
+    SceneSnapshot mirror_;
+    vector<int> dirtySlots_;
+    bool relayout_ = true;
+
+    void markSlot(int slot);
+    void markLayout();
+
+    // non-empty slots of LObjets (see usedSlots)
+    mutable SlotSet used_;
+    mutable bool usedStale_ = true;
+    const SlotSet& usedSlots() const;
 };
 
@@ -0,0 +1,126 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Test.h"
+#include "Model.h"
+#include "SlotSet.h"
+
+using namespace std;
+
+static int addRect(Model& M, int x)
+{
+    return M.addObject(make_shared<ObjRectangle>(ObjAttr(), V2(x, 0), V2(x + 10, 10)));
+}
+
+static V2 cornerOf(const ObjGeom* obj)
+{
+    return static_cast<const ObjRectangle*>(obj)->P1_;
+}
+
+// a snapshot shares the objects of the scene; editing one copies it first
+TEST(snapshotSharesObjects)
+{
+    Model M;
+    int a = addRect(M, 0), b = addRect(M, 100);
+
+    SceneSnapshot S = M.snapshot();
+    REQUIRE(S.size() == 2);
+    CHECK(S.get(0).get() == M.findObject(a));
+    CHECK(S.get(1).get() == M.findObject(b));
+
+    ObjGeom* obj = M.editObject(a);
+    REQUIRE(obj);
+    CHECK(obj != S.get(0).get());
+    CHECK(!obj->frozen_);
+    obj->moveBy(V2(5, 5));
+    CHECK(M.editObject(a) == obj);    // copied once
+
+    CHECK(cornerOf(S.get(0).get()) == V2(0, 0));
+    CHECK(cornerOf(M.findObject(a)) == V2(5, 5));
+
+    // the next snapshot changes the edited slot only
+    SceneSnapshot T = M.snapshot();
+    CHECK(T.get(0).get() == obj);
+    CHECK(T.get(1) == S.get(1));
+
+    int changed = 0;
+    S.diff(T, [&](int, const SceneSnapshot::Item&, const SceneSnapshot::Item&) { changed++; });
+    CHECK(changed == 1);
+
+    // back to S: the scene shares its objects again
+    M.restore(S);
+    CHECK(M.findObject(a) == S.get(0).get());
+    CHECK(cornerOf(M.findObject(a)) == V2(0, 0));
+    CHECK(cornerOf(T.get(0).get()) == V2(5, 5));
+}
+
+// a copy of a snapshot never writes into the nodes of its source
+TEST(snapshotCopyOnWrite)
+{
+    auto obj = [](int x) { return make_shared<ObjSegment>(ObjAttr(), V2(x, 0), V2(x, 1)); };
+
+    SceneSnapshot S;
+    S.resize(100);
+    for (int i = 0; i < 100; i++) S.set(i, obj(i));
+
+    SceneSnapshot T = S;
+    T.set(40, obj(-1));
+    S.set(41, obj(-2));
+
+    CHECK(static_cast<const ObjSegment*>(S.get(40).get())->P1_.x == 40);
+    CHECK(static_cast<const ObjSegment*>(T.get(41).get())->P1_.x == 41);
+    CHECK(static_cast<const ObjSegment*>(T.get(40).get())->P1_.x == -1);
+    CHECK(S.get(0) == T.get(0));
+}
+
+// next / prev of a SlotSet against a plain scan, over a few levels
+TEST(slotSetNextPrev)
+{
+    const int n = 300000;
+    SlotSet S;
+    vector<bool> on(n, false);
+    unsigned seed = 7;
+    auto next = [&](int range) { seed = seed * 1103515245 + 12345; return int((seed >> 8) % range); };
+
+    for (int round = 0; round < 3; round++)
+    {
+        for (int k = 0; k < 2000; k++)
+        {
+            int slot = next(n);
+            S.reserve(slot + 1);
+            on[slot] = round != 1;
+            S.set(slot, on[slot]);
+        }
+        for (int k = 0; k < 500; k++)
+        {
+            int slot = next(n);
+            int up = -1, down = -1;
+            for (int s = slot + 1; s < n && up < 0; s++) if (on[s]) up = s;
+            for (int s = slot - 1; s >= 0 && down < 0; s--) if (on[s]) down = s;
+            CHECK(S.next(slot) == up);
+            CHECK(S.prev(slot) == down);
+            CHECK(S.has(slot) == on[slot]);
+        }
+    }
+}
+
+// the object above or below another one, after many removals
+TEST(modelOrderWithHoles)
+{
+    Model M;
+    vector<int> ids;
+    for (int i = 0; i < 1000; i++) ids.push_back(addRect(M, i));
+    for (int i = 100; i < 400; i++) M.removeObject(ids[i]);
+    CHECK(M.holeCount == 300);      // not compacted
+
+    CHECK(M.aboveIdOf(ids[99]) == ids[400]);
+    CHECK(M.stepOrder(ids[400], -1) == ids[99]);
+    CHECK(M.slotOf(ids[400]) < M.slotOf(ids[99]));
+    CHECK(M.aboveIdOf(ids[999]) == -1);
+
+    M.sendToBack(ids[50]);
+    CHECK(M.stepOrder(ids[50], -1) == -1);
+    CHECK(M.aboveIdOf(ids[50]) == ids[0]);
+    M.bringToFront(ids[0]);
+    CHECK(M.aboveIdOf(ids[999]) == ids[0]);
+    CHECK(M.stepOrder(ids[0], +1) == -1);
+}
@@ -5,24 +5,109 @@
 #include "V2.h"
 #include "ObjAttr.h"
 #include "Graphics.h"
+#include "ShapePool.h"
 #include <vector>
 #include <memory>
 using namespace std;
 
+// concrete type of an ObjGeom, stored in the object (no RTTI needed)
+enum class ShapeKind : unsigned char { Rectangle, Segment, Circle, Polygon };
+
+class ObjRectangle;
+class ObjSegment;
+class ObjCircle;
+class ObjPolygon;
+
+/*
+ Visitor over the concrete shape types.
+ Used by code that needs the exact type (serialization, highlight, export)
+ instead of chains of dynamic_pointer_cast.
+*/
+class ShapeVisitor
+{
+public:
+    virtual ~ShapeVisitor() {}
+
+    virtual void visit(const ObjRectangle&) {}
+    virtual void visit(const ObjSegment&) {}
+    virtual void visit(const ObjCircle&) {}
+    virtual void visit(const ObjPolygon&) {}
+};
+
+/*
+ Drawing of each kind of shape, shared by the objects (Graphics) and the
+ rows of SceneStore (any target with the drawLine / drawRectangle /
+ drawCircle interface of Graphics, e.g. Raster).
+*/
+template <class G>
+void drawRectangleShape(G& g, V2 P1, V2 P2, const ObjAttr& at)
+{
+    V2 P, size;
+    getPLH(P1, P2, P, size);
+
+    if (at.isFilled_)
+        g.drawRectangle(P, size, at.interiorColor_, true);
+
+    g.drawRectangle(P, size, at.borderColor_, false, at.thickness_);
+}
+
+template <class G>
+void drawSegmentShape(G& g, V2 P1, V2 P2, const ObjAttr& at)
+{
+    g.drawLine(P1, P2, at.borderColor_, at.thickness_);
+}
+
+template <class G>
+void drawCircleShape(G& g, V2 C, float r, const ObjAttr& at)
+{
+    if (at.isFilled_)
+        g.drawCircle(C, r, at.interiorColor_, true);
+
+    g.drawCircle(C, r, at.borderColor_, false, at.thickness_);
+}
+
+// open polyline through the points
+template <class G>
+void drawPolygonShape(G& g, const V2* pts, int n, const ObjAttr& at)
+{
+    for (int i = 0; i < n - 1; i++)
+        g.drawLine(pts[i], pts[i + 1], at.borderColor_, at.thickness_);
+}
+
 /*
  Base class for all geometric objects.
  Supports:
  - Drawing
  - Hit testing (for selection)
  - Point editing (for ToolEditPoints)
+ - Type dispatch (kind tag + visitor)
 */
 class ObjGeom
 {
+    ShapeKind kind_;
+
 public:
     ObjAttr drawInfo_;
 
-    ObjGeom() {}
-    ObjGeom(ObjAttr di) : drawInfo_(di) {}
+    // stable id given by the Model (-1 until the object is added)
+    int id_ = -1;
+
+    // held by a snapshot (set by SceneSnapshot::set): never modified again,
+    // Model::editObject puts a copy in its slot to be modified instead
+    bool frozen_ = false;
+
+    ObjGeom(ShapeKind kind, ObjAttr di) : kind_(kind), drawInfo_(di) {}
+
+    // a copy is not frozen
+    ObjGeom(const ObjGeom& o) : kind_(o.kind_), drawInfo_(o.drawInfo_), id_(o.id_) {}
+    virtual ~ObjGeom() {}
+
+    //  Type dispatch 
+    ShapeKind kind() const { return kind_; }
+    virtual void accept(ShapeVisitor& V) const = 0;
+
+    // copy of the object (same id), in the pool if one is given
+    virtual shared_ptr<ObjGeom> clone(const shared_ptr<ShapePool>& pool = nullptr) const = 0;
 
     // Draw the object
     virtual void draw(Graphics& G) {}
@@ -49,17 +134,18 @@ public:
     V2 P1_;
     V2 P2_;
 
-    ObjRectangle(ObjAttr di, V2 A, V2 B) : ObjGeom(di), P1_(A), P2_(B) {}
+    ObjRectangle(ObjAttr di, V2 A, V2 B) : ObjGeom(ShapeKind::Rectangle, di), P1_(A), P2_(B) {}
 
-    void draw(Graphics& G) override
-    {
-        V2 P, size;
-        getPLH(P1_, P2_, P, size);
+    void accept(ShapeVisitor& V) const override { V.visit(*this); }
 
-        if (drawInfo_.isFilled_)
-            G.drawRectangle(P, size, drawInfo_.interiorColor_, true);
+    shared_ptr<ObjGeom> clone(const shared_ptr<ShapePool>& pool) const override
+    {
+        return allocateShape<ObjRectangle>(pool, *this);
+    }
 
-        G.drawRectangle(P, size, drawInfo_.borderColor_, false, drawInfo_.thickness_);
+    void draw(Graphics& G) override
+    {
+        drawRectangleShape(G, P1_, P2_, drawInfo_);
     }
 
     //  Hit Test (inside rectangle) 
@@ -110,11 +196,18 @@ public:
     V2 P1_;
     V2 P2_;
 
-    ObjSegment(ObjAttr di, V2 A, V2 B) : ObjGeom(di), P1_(A), P2_(B) {}
+    ObjSegment(ObjAttr di, V2 A, V2 B) : ObjGeom(ShapeKind::Segment, di), P1_(A), P2_(B) {}
+
+    void accept(ShapeVisitor& V) const override { V.visit(*this); }
+
+    shared_ptr<ObjGeom> clone(const shared_ptr<ShapePool>& pool) const override
+    {
+        return allocateShape<ObjSegment>(pool, *this);
+    }
 
     void draw(Graphics& G) override
     {
-        G.drawLine(P1_, P2_, drawInfo_.borderColor_, drawInfo_.thickness_);
+        drawSegmentShape(G, P1_, P2_, drawInfo_);
     }
 
     //  Hit test
@@ -173,19 +266,22 @@ public:
     V2 center_;
     float radius_;
 
-    ObjCircle(ObjAttr di, V2 C, V2 boundary) : ObjGeom(di)
+    ObjCircle(ObjAttr di, V2 C, V2 boundary) : ObjGeom(ShapeKind::Circle, di)
     {
         center_ = C;
         radius_ = (boundary - C).norm();
     }
 
-    void draw(Graphics& G) override
+    void accept(ShapeVisitor& V) const override { V.visit(*this); }
+
+    shared_ptr<ObjGeom> clone(const shared_ptr<ShapePool>& pool) const override
     {
-        if (drawInfo_.isFilled_)
-            G.drawCircle(center_, radius_, drawInfo_.interiorColor_, true);
+        return allocateShape<ObjCircle>(pool, *this);
+    }
 
-        G.drawCircle(center_, radius_, drawInfo_.borderColor_,
-            false, drawInfo_.thickness_);
+    void draw(Graphics& G) override
+    {
+        drawCircleShape(G, center_, radius_, drawInfo_);
     }
 
     //  Hit Test (click inside circle) 
@@ -243,17 +339,20 @@ class ObjPolygon : public ObjGeom
 public:
     vector<V2> pts_;
 
-    ObjPolygon(ObjAttr di) : ObjGeom(di) {}
+    ObjPolygon(ObjAttr di) : ObjGeom(ShapeKind::Polygon, di) {}
+
+    void accept(ShapeVisitor& V) const override { V.visit(*this); }
+
+    shared_ptr<ObjGeom> clone(const shared_ptr<ShapePool>& pool) const override
+    {
+        return allocateShape<ObjPolygon>(pool, *this);
+    }
 
     void addPoint(V2 P) { pts_.push_back(P); }
 
     void draw(Graphics& G) override
     {
-        for (int i = 0; i < (int)pts_.size() - 1; i++)
-        {
-            G.drawLine(pts_[i], pts_[i + 1],
-                drawInfo_.borderColor_, drawInfo_.thickness_);
-        }
+        drawPolygonShape(G, pts_.data(), (int)pts_.size(), drawInfo_);
     }
 
     //  Hit Test 
@@ -0,0 +1,101 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Test.h"
+#include "picoPNG.h"
+#include "PngWriter.h"
+#include "Raster.h"
+#include <filesystem>
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+// the icons of the tools: outil_*.png, in the project directory
+static vector< vector<unsigned char> > icons()
+{
+    vector<string> names;
+    for (auto& e : filesystem::directory_iterator("."))
+    {
+        string name = e.path().filename().string();
+        if (name.rfind("outil_", 0) == 0 && e.path().extension() == ".png") names.push_back(name);
+    }
+    sort(names.begin(), names.end());
+
+    vector< vector<unsigned char> > files(names.size());
+    for (size_t i = 0; i < names.size(); i++) loadFile(files[i], names[i]);
+    return files;
+}
+
+// a PngWriter image decodes back to the raster, with or without kept buffers
+TEST(pngRoundTrip)
+{
+    const char* path = "testdata/pngRoundTrip.tmp.png";
+    Raster R;
+    R.resize(700, 500);
+    R.clear(Color(0.1f, 0.2f, 0.3f));
+    R.drawRectangle(V2(20, 30), V2(300, 200), Color::Red, true);
+    R.drawCircle(V2(400, 250), 120, Color(0.5f, 1, 0.25f, 0.5f), true);
+    R.drawLine(V2(0, 0), V2(699, 499), Color::White, 3);
+
+    string error;
+    REQUIRE(writePng(path, R, error));
+
+    vector<unsigned char> file, a, b;
+    loadFile(file, path);
+    remove(path);
+
+    unsigned long w = 0, h = 0;
+    REQUIRE(decodePNG(a, w, h, file.data(), file.size(), false) == 0);
+    REQUIRE(w == 700 && h == 500);
+    for (int y = 0; y < 500; y++)
+        CHECK(equal(R.row(y), R.row(y) + 700 * 3, a.data() + (size_t)(499 - y) * 700 * 3));
+
+    PNGBuffers B;
+    for (int k = 0; k < 2; k++)
+    {
+        REQUIRE(decodePNG(b, w, h, file.data(), file.size(), false, false, &B) == 0);
+        CHECK(a == b);
+    }
+}
+
+// decodePNG over the icons, new buffers each time or kept ones
+BENCH(pngDecode)
+{
+    const int runs = 5;
+    vector< vector<unsigned char> > files = icons();
+    REQUIRE(!files.empty());
+
+    size_t bytes = 0, pixels = 0;
+    for (auto& f : files)
+    {
+        vector<unsigned char> out;
+        unsigned long w = 0, h = 0;
+        CHECK(decodePNG(out, w, h, f.data(), f.size()) == 0);
+        bytes += f.size();
+        pixels += w * h;
+    }
+
+    double fresh = bestMs(runs, [&]
+    {
+        for (auto& f : files)
+        {
+            vector<unsigned char> out;
+            unsigned long w, h;
+            decodePNG(out, w, h, f.data(), f.size());
+        }
+    });
+
+    PNGBuffers B;
+    vector<unsigned char> out;
+    double kept = bestMs(runs, [&]
+    {
+        for (auto& f : files)
+        {
+            unsigned long w, h;
+            decodePNG(out, w, h, f.data(), f.size(), true, false, &B);
+        }
+    });
+
+    cout << "  " << files.size() << " icons (" << bytes / 1024 << " KB, " << pixels << " pixels): "
+         << fresh << " ms (" << pixels / fresh / 1000 << " Mpixels/s), buffers kept " << kept << " ms (x" << fresh / kept << ")" << endl;
+}
@@ -0,0 +1,454 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "PngWriter.h"
+#include "Raster.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+// CHECKSUMS ///////////////////////////////////////////////////////
+
+static uint32_t crc32(uint32_t crc, const uint8_t* p, size_t n)
+{
+    static uint32_t table[256];
+    static bool init = [] {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)init;
+
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = table[(crc ^ p[i]) & 255] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t adler32(const uint8_t* p, size_t n)
+{
+    uint32_t a = 1, b = 0;
+    while (n)
+    {
+        size_t k = n < 5552 ? n : 5552;   // no overflow before the modulo
+        n -= k;
+        while (k--) { a += *p++; b += a; }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
+
+// adler32 of A then B, from those of A and B (as adler32_combine of zlib)
+static uint32_t adler32Combine(uint32_t a1, uint32_t a2, size_t len2)
+{
+    const uint32_t Base = 65521;
+    uint32_t rem = (uint32_t)(len2 % Base);
+    uint32_t sum1 = a1 & 0xffff;
+    uint32_t sum2 = (uint32_t)(((uint64_t)rem * sum1) % Base);
+    sum1 += (a2 & 0xffff) + Base - 1;
+    sum2 += (a1 >> 16) + (a2 >> 16) + Base - rem;
+    if (sum1 >= Base) sum1 -= Base;
+    if (sum1 >= Base) sum1 -= Base;
+    if (sum2 >= 2 * Base) sum2 -= 2 * Base;
+    if (sum2 >= Base) sum2 -= Base;
+    return sum2 << 16 | sum1;
+}
+
+// DEFLATE /////////////////////////////////////////////////////////
+
+// bits are written from the least significant one
+struct BitWriter
+{
+    vector<uint8_t>& out;
+    uint64_t acc = 0;
+    int n = 0;
+
+    BitWriter(vector<uint8_t>& o) : out(o) {}
+
+    void put(uint32_t v, int len)
+    {
+        acc |= (uint64_t)v << n;
+        n += len;
+        while (n >= 8)
+        {
+            out.push_back((uint8_t)acc);
+            acc >>= 8;
+            n -= 8;
+        }
+    }
+    void flush() { if (n) put(0, 8 - n); }
+};
+
+// fixed Huffman codes of RFC 1951, reversed for BitWriter
+struct FixedCodes
+{
+    uint16_t lit[288];     // code
+    uint8_t  litLen[288];  // bits
+    uint8_t  lenSym[259];  // match length -> symbol - 257
+    uint8_t  distSym[512]; // see distSymbol
+
+    static uint16_t reverse(uint32_t code, int len)
+    {
+        uint32_t r = 0;
+        for (int i = 0; i < len; i++) r |= ((code >> i) & 1) << (len - 1 - i);
+        return (uint16_t)r;
+    }
+
+    FixedCodes()
+    {
+        for (int s = 0; s < 288; s++)
+        {
+            uint32_t code; int len;
+            if      (s < 144) { code = 0x30 + s;          len = 8; }
+            else if (s < 256) { code = 0x190 + s - 144;   len = 9; }
+            else if (s < 280) { code = s - 256;           len = 7; }
+            else              { code = 0xc0 + s - 280;    len = 8; }
+            lit[s] = reverse(code, len);
+            litLen[s] = (uint8_t)len;
+        }
+        for (int s = 0, l = 3; s < 29; s++)
+            for (int k = 0; k < (1 << lenExtra[s]) && l <= 258; k++) lenSym[l++] = (uint8_t)s;
+        lenSym[258] = 28;
+
+        for (int s = 0, d = 1; s < 30; s++)
+            for (int k = 0; k < (1 << distExtra[s]); k++, d++)
+            {
+                if (d <= 256) distSym[d - 1] = (uint8_t)s;
+                else distSym[256 + ((d - 1) >> 7)] = (uint8_t)s;
+            }
+    }
+
+    int distSymbol(int d) const { return d <= 256 ? distSym[d - 1] : distSym[256 + ((d - 1) >> 7)]; }
+
+    static const uint16_t lenBase[29];
+    static const uint8_t  lenExtra[29];
+    static const uint16_t distBase[30];
+    static const uint8_t  distExtra[30];
+};
+
+const uint16_t FixedCodes::lenBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                           35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t  FixedCodes::lenExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t FixedCodes::distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                            8193, 12289, 16385, 24577 };
+const uint8_t  FixedCodes::distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                             7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/*
+ One block of fixed codes, final when last; otherwise followed by an empty
+ stored block (sync flush) so the next chunk starts on a byte, with no
+ match reaching back into this one.
+ Matches are found with a hash of the next 3 bytes giving the last
+ position where they were seen (greedy, no chain): fast, and enough for
+ rendered pictures, made of runs.
+*/
+static void deflate(const uint8_t* d, size_t n, bool last, vector<uint8_t>& out)
+{
+    static const FixedCodes C;
+    const int HashBits = 15;
+    const size_t Window = 32768;
+
+    // one table per thread, chunks are far below 2 GB
+    static thread_local vector<int32_t> head;
+    head.assign((size_t)1 << HashBits, -1);
+    auto hash = [&](size_t i) { return ((d[i] << 16 | d[i + 1] << 8 | d[i + 2]) * 2654435761u) >> (32 - HashBits); };
+
+    BitWriter B(out);
+    B.put(last ? 1 : 0, 1);
+    B.put(1, 2);   // fixed codes
+
+    size_t i = 0;
+    while (i < n)
+    {
+        size_t len = 0, dist = 0;
+        if (i + 3 <= n)
+        {
+            uint32_t h = hash(i);
+            int32_t cand = head[h];
+            head[h] = (int32_t)i;
+            if (cand >= 0 && i - cand <= Window)
+            {
+                size_t max = n - i < 258 ? n - i : 258;
+                while (len < max && d[cand + len] == d[i + len]) len++;
+                dist = i - (size_t)cand;
+            }
+        }
+
+        if (len < 3)
+        {
+            B.put(C.lit[d[i]], C.litLen[d[i]]);
+            i++;
+            continue;
+        }
+
+        int ls = C.lenSym[len];
+        B.put(C.lit[257 + ls], C.litLen[257 + ls]);
+        B.put((uint32_t)(len - C.lenBase[ls]), C.lenExtra[ls]);
+        int ds = C.distSymbol((int)dist);
+        B.put(FixedCodes::reverse(ds, 5), 5);
+        B.put((uint32_t)(dist - C.distBase[ds]), C.distExtra[ds]);
+
+        for (size_t k = 1; k < len && i + k + 3 <= n; k++) head[hash(i + k)] = (int32_t)(i + k);
+        i += len;
+    }
+
+    B.put(C.lit[256], C.litLen[256]);   // end of block
+    if (!last)
+    {
+        B.put(0, 3);                    // stored block, not final
+        B.flush();
+        const uint8_t empty[4] = { 0x00, 0x00, 0xff, 0xff };
+        out.insert(out.end(), empty, empty + 4);
+    }
+    B.flush();
+}
+
+// FILTERS /////////////////////////////////////////////////////////
+
+static inline int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+// |v| of a filtered byte read as signed
+static inline uint32_t cost(int v)
+{
+    uint8_t u = (uint8_t)v;
+    return u < 128 ? u : 256 - u;
+}
+
+/*
+ Filter type byte then the n filtered bytes of row (3 bytes per pixel),
+ prev being the row above. The type is the one whose bytes have the
+ smallest sum of absolute values, as libpng does by default: one pass
+ scores the five filters, a second one writes the chosen one.
+*/
+static void filterRow(const uint8_t* row, const uint8_t* prev, size_t n, uint8_t* out)
+{
+    const size_t bpp = 3;
+    uint32_t sum[5] = { 0, 0, 0, 0, 0 };
+    for (size_t i = 0; i < n; i++)
+    {
+        int x = row[i], b = prev[i];
+        int a = i >= bpp ? row[i - bpp] : 0;
+        int c = i >= bpp ? prev[i - bpp] : 0;
+        sum[0] += cost(x);
+        sum[1] += cost(x - a);
+        sum[2] += cost(x - b);
+        sum[3] += cost(x - ((a + b) >> 1));
+        sum[4] += cost(x - paeth(a, b, c));
+    }
+
+    int type = 0;
+    for (int t = 1; t < 5; t++)
+        if (sum[t] < sum[type]) type = t;
+
+    out[0] = (uint8_t)type;
+    out++;
+    for (size_t i = 0; i < n; i++)
+    {
+        int x = row[i], b = prev[i];
+        int a = i >= bpp ? row[i - bpp] : 0;
+        int c = i >= bpp ? prev[i - bpp] : 0;
+        int v;
+        switch (type)
+        {
+        case 0:  v = x; break;
+        case 1:  v = x - a; break;
+        case 2:  v = x - b; break;
+        case 3:  v = x - ((a + b) >> 1); break;
+        default: v = x - paeth(a, b, c); break;
+        }
+        out[i] = (uint8_t)v;
+    }
+}
+
+// PNG /////////////////////////////////////////////////////////////
+
+static void putBE(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+void PngWriter::chunk(const char* type, const uint8_t* data, size_t n)
+{
+    uint8_t head[8];
+    putBE(head, (uint32_t)n);
+    memcpy(head + 4, type, 4);
+
+    uint32_t crc = crc32(0, head + 4, 4);
+    crc = crc32(crc, data, n);
+    uint8_t tail[4];
+    putBE(tail, crc);
+
+    out_.write((const char*)head, 8);
+    out_.write((const char*)data, n);
+    out_.write((const char*)tail, 4);
+    bytes_ += 12 + n;
+}
+
+bool PngWriter::open(const string& path, int width, int height, ThreadPool* pool)
+{
+    path_ = path;
+    pool_ = pool;
+    w_ = width;
+    h_ = height;
+    rows_ = 0;
+    bytes_ = 0;
+    adler_ = 1;
+    started_ = false;
+
+    size_t rowBytes = (size_t)w_ * 3;
+    rowsPerChunk_ = (int)max((size_t)1, ChunkBytes / (rowBytes + 1));
+    wave_.clear();
+    wave_.resize(pool_ ? pool_->size() * 2 : 1);
+    filling_ = 0;
+    lastRow_.assign(rowBytes, 0);
+
+    out_.open(path, ios::binary | ios::trunc);
+    if (!out_) return false;
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out_.write((const char*)signature, 8);
+    bytes_ = 8;
+
+    uint8_t ihdr[13];
+    putBE(ihdr, (uint32_t)w_);
+    putBE(ihdr + 4, (uint32_t)h_);
+    ihdr[8] = 8;    // bits per channel
+    ihdr[9] = 2;    // RGB
+    ihdr[10] = 0;   // deflate
+    ihdr[11] = 0;   // filters of PNG
+    ihdr[12] = 0;   // no interlace
+    chunk("IHDR", ihdr, 13);
+    return true;
+}
+
+void PngWriter::addRow(const uint8_t* rgb)
+{
+    if (!out_.is_open() || rows_ >= h_) return;
+
+    size_t rowBytes = (size_t)w_ * 3;
+    Chunk& C = wave_[filling_];
+    if (C.rows == 0)
+    {
+        C.raw.resize((size_t)rowsPerChunk_ * rowBytes);
+        C.prev = lastRow_;
+    }
+    uint8_t* row = C.raw.data() + (size_t)C.rows * rowBytes;
+    memcpy(row, rgb, rowBytes);
+    C.rows++;
+    rows_++;
+
+    bool end = rows_ == h_;
+    if (C.rows < rowsPerChunk_ && !end) return;
+
+    // the chunk is full: the next one filters its first row from this one
+    lastRow_.assign(row, row + rowBytes);
+    C.last = end;
+    if (++filling_ == (int)wave_.size() || end) flushWave();
+}
+
+void PngWriter::compress(Chunk& C, int width)
+{
+    size_t rowBytes = (size_t)width * 3;
+    C.filtered.resize((size_t)C.rows * (rowBytes + 1));
+
+    const uint8_t* prev = C.prev.data();
+    for (int r = 0; r < C.rows; r++)
+    {
+        const uint8_t* row = C.raw.data() + (size_t)r * rowBytes;
+        filterRow(row, prev, rowBytes, C.filtered.data() + (size_t)r * (rowBytes + 1));
+        prev = row;
+    }
+
+    C.adler = adler32(C.filtered.data(), C.filtered.size());
+    C.z.clear();
+    deflate(C.filtered.data(), C.filtered.size(), C.last, C.z);
+}
+
+// compresses the full chunks at once, then writes them in order
+void PngWriter::flushWave()
+{
+    int n = filling_;
+    auto task = [&](int i) { compress(wave_[i], w_); };
+    if (pool_) pool_->run(n, task);
+    else for (int i = 0; i < n; i++) task(i);
+
+    for (int i = 0; i < n; i++)
+    {
+        Chunk& C = wave_[i];
+        if (!started_)
+        {
+            const uint8_t zlib[2] = { 0x78, 0x01 };
+            C.z.insert(C.z.begin(), zlib, zlib + 2);
+            started_ = true;
+        }
+        adler_ = adler32Combine(adler_, C.adler, C.filtered.size());
+        if (C.last)
+        {
+            uint8_t adler[4];
+            putBE(adler, adler_);
+            C.z.insert(C.z.end(), adler, adler + 4);
+        }
+        chunk("IDAT", C.z.data(), C.z.size());
+        C.rows = 0;
+    }
+    filling_ = 0;
+}
+
+bool PngWriter::close(string& error)
+{
+    if (!out_.is_open())
+    {
+        error = "cannot create " + path_;
+        return false;
+    }
+    if (rows_ != h_)
+    {
+        error = path_ + " : " + to_string(rows_) + " rows given for " + to_string(h_);
+        out_.close();
+        return false;
+    }
+
+    chunk("IEND", nullptr, 0);
+
+    vector<Chunk>().swap(wave_);
+    out_.close();
+    if (!out_)
+    {
+        error = "cannot write " + path_;
+        return false;
+    }
+    return true;
+}
+
+bool writePng(const string& path, const Raster& R, string& error, size_t* bytes, ThreadPool* pool)
+{
+    PngWriter W;
+    if (!W.open(path, R.width(), R.height(), pool))
+    {
+        error = "cannot create " + path;
+        return false;
+    }
+    for (int y = R.height() - 1; y >= 0; y--)
+        W.addRow(R.row(y));
+
+    if (!W.close(error)) return false;
+    if (bytes) *bytes = W.bytes();
+    return true;
+}
@@ -0,0 +1,74 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+using namespace std;
+
+class Raster;
+class ThreadPool;
+
+/*
+ PNG writer (picoPNG only reads them): 8 bits RGB, rows given from the
+ top of the image.
+ Rows are gathered in chunks of about ChunkBytes. Each chunk is filtered
+ (per row, the PNG filter whose output has the smallest sum of absolute
+ values) and deflated on its own, ending with a sync flush so that the
+ chunks join into one zlib stream, as pigz does. With a pool, a wave of
+ chunks is compressed in parallel, then written as IDAT chunks in order;
+ only that wave of rows is held, never the whole image.
+ The chunks depend on the width only: the file is the same whatever the
+ number of threads.
+*/
+class PngWriter
+{
+public:
+    static const size_t ChunkBytes = 256 * 1024;
+
+    PngWriter() {}
+    PngWriter(const PngWriter&) = delete;
+    PngWriter& operator = (const PngWriter&) = delete;
+
+    // the pool must not be running the caller (no nested ThreadPool::run)
+    bool open(const string& path, int width, int height, ThreadPool* pool = nullptr);
+    void addRow(const uint8_t* rgb);    // width * 3 bytes
+    bool close(string& error);          // false if the file could not be written
+
+    size_t bytes() const { return bytes_; }   // written so far
+
+private:
+    struct Chunk
+    {
+        vector<uint8_t> raw;        // rows, unfiltered
+        vector<uint8_t> prev;       // row above the first one (zeros at the top)
+        int rows = 0;
+        bool last = false;          // ends the image: final deflate block
+        vector<uint8_t> filtered;
+        vector<uint8_t> z;          // deflate data
+        uint32_t adler = 1;
+    };
+
+    string path_;
+    ofstream out_;
+    ThreadPool* pool_ = nullptr;
+    int w_ = 0;
+    int h_ = 0;
+    int rows_ = 0;
+    int rowsPerChunk_ = 1;
+    size_t bytes_ = 0;
+    uint32_t adler_ = 1;            // of all the chunks written
+    bool started_ = false;          // zlib header written
+
+    vector<Chunk> wave_;            // chunks being filled, then compressed
+    int filling_ = 0;
+    vector<uint8_t> lastRow_;
+
+    void chunk(const char* type, const uint8_t* data, size_t n);
+    void flushWave();
+    static void compress(Chunk& C, int width);
+};
+
+// the raster, top row first
+bool writePng(const string& path, const Raster& R, string& error, size_t* bytes = nullptr, ThreadPool* pool = nullptr);
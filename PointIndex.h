@@ -0,0 +1,169 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "V2.h"
+#include "ObjGeom.h"
+#include <vector>
+#include <memory>
+#include <unordered_map>
+using namespace std;
+
+/*
+ Uniform grid over the editable points of the scene (getPoint of every object).
+ Used by ToolEditPoints to:
+ - find the handle under the mouse without scanning every point of every object
+ - enumerate only the handles inside the viewport
+ The grid is updated point by point while a handle is dragged.
+*/
+class PointIndex
+{
+public:
+    struct Handle
+    {
+        int obj;   // id of the object
+        int pt;    // point index (getPoint / setPoint)
+        V2  pos;
+    };
+
+    PointIndex(int cellSize = 32) : cellSize_(cellSize) {}
+
+    void clear()
+    {
+        cells_.clear();
+        count_ = 0;
+    }
+
+    int size() const { return count_; }
+
+    // rebuild from scratch
+    void build(const vector< shared_ptr<ObjGeom> >& objects)
+    {
+        clear();
+        for (auto& obj : objects)
+        {
+            if (!obj) continue;
+            int count = obj->getPointCount();
+            for (int p = 0; p < count; p++)
+                insert(obj->id_, p, obj->getPoint(p));
+        }
+    }
+
+    void insert(int obj, int pt, V2 P)
+    {
+        Handle H = { obj, pt, P };
+        cells_[key(cellOf(P.x), cellOf(P.y))].push_back(H);
+        count_++;
+    }
+
+    void remove(int obj, int pt, V2 P)
+    {
+        auto it = cells_.find(key(cellOf(P.x), cellOf(P.y)));
+        if (it == cells_.end()) return;
+
+        vector<Handle>& L = it->second;
+        for (int i = 0; i < (int)L.size(); i++)
+        {
+            if (L[i].obj == obj && L[i].pt == pt)
+            {
+                L[i] = L.back();
+                L.pop_back();
+                count_--;
+                break;
+            }
+        }
+        if (L.empty()) cells_.erase(it);
+    }
+
+    void move(int obj, int pt, V2 oldP, V2 newP)
+    {
+        if (cellOf(oldP.x) == cellOf(newP.x) && cellOf(oldP.y) == cellOf(newP.y))
+        {
+            auto it = cells_.find(key(cellOf(oldP.x), cellOf(oldP.y)));
+            if (it == cells_.end()) return;
+            for (Handle& H : it->second)
+                if (H.obj == obj && H.pt == pt) { H.pos = newP; return; }
+            return;
+        }
+        remove(obj, pt, oldP);
+        insert(obj, pt, newP);
+    }
+
+    // call O.setPoint(pt, P) and keep the index in sync
+    void setPoint(int obj, ObjGeom& O, int pt, V2 P)
+    {
+        // shapes with two handles may derive one from the other
+        // (the circle radius handle follows the center), so re-read both
+        int first = pt, last = pt;
+        if (O.getPointCount() <= 2) { first = 0; last = O.getPointCount() - 1; }
+
+        V2 before[2];
+        for (int p = first; p <= last; p++) before[p - first] = O.getPoint(p);
+
+        O.setPoint(pt, P);
+
+        for (int p = first; p <= last; p++)
+            move(obj, p, before[p - first], O.getPoint(p));
+    }
+
+    // all handles within radius of P
+    void findNear(V2 P, int radius, vector<Handle>& out) const
+    {
+        int r2 = radius * radius;
+
+        for (int cy = cellOf(P.y - radius); cy <= cellOf(P.y + radius); cy++)
+            for (int cx = cellOf(P.x - radius); cx <= cellOf(P.x + radius); cx++)
+            {
+                auto it = cells_.find(key(cx, cy));
+                if (it == cells_.end()) continue;
+
+                for (const Handle& H : it->second)
+                {
+                    int dx = H.pos.x - P.x;
+                    int dy = H.pos.y - P.y;
+                    if (dx * dx + dy * dy <= r2) out.push_back(H);
+                }
+            }
+    }
+
+    // positions of all handles inside the rectangle pos/size
+    void collect(V2 pos, V2 size, vector<V2>& out) const
+    {
+        int cx0 = cellOf(pos.x), cx1 = cellOf(pos.x + size.x);
+        int cy0 = cellOf(pos.y), cy1 = cellOf(pos.y + size.y);
+        long long visited = (long long)(cx1 - cx0 + 1) * (cy1 - cy0 + 1);
+
+        // sparse scene: walk the occupied cells instead of the viewport cells
+        if (visited > (long long)cells_.size())
+        {
+            for (auto& C : cells_)
+                for (const Handle& H : C.second)
+                    if (H.pos.isInside(pos, size)) out.push_back(H.pos);
+            return;
+        }
+
+        for (int cy = cy0; cy <= cy1; cy++)
+            for (int cx = cx0; cx <= cx1; cx++)
+            {
+                auto it = cells_.find(key(cx, cy));
+                if (it == cells_.end()) continue;
+                for (const Handle& H : it->second)
+                    if (H.pos.isInside(pos, size)) out.push_back(H.pos);
+            }
+    }
+
+private:
+    int cellSize_;
+    int count_ = 0;
+    unordered_map<long long, vector<Handle> > cells_;
+
+    // floor division, correct for negative coordinates
+    int cellOf(int v) const
+    {
+        return (v >= 0) ? v / cellSize_ : -((-v + cellSize_ - 1) / cellSize_);
+    }
+
+    static long long key(int cx, int cy)
+    {
+        return ((long long)cx << 32) ^ (unsigned int)cy;
+    }
+};
@@ -0,0 +1,164 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Poster.h"
+#include "SceneStore.h"
+#include "ThreadPool.h"
+#include "Raster.h"
+#include "PngWriter.h"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+using namespace std;
+
+static double msSince(chrono::steady_clock::time_point t)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+}
+
+bool writePoster(const string& path, const SceneStore& S, V2 world, V2 size, int tile,
+                 ThreadPool* pool, string& error, PosterStats* stats)
+{
+    if (world.x <= 0 || world.y <= 0 || size.x <= 0 || size.y <= 0)
+    {
+        error = "empty poster";
+        return false;
+    }
+
+    const int T = max(16, tile);
+    const int tilesX = (size.x + T - 1) / T;
+    const int bands = (size.y + T - 1) / T;     // rows of tiles, 0 at the top
+    const double sx = (double)size.x / world.x;
+    const double sy = (double)size.y / world.y;
+    const double scale = (sx + sy) / 2;
+
+    // tiles met by row i; pixels as in Raster::pixel, a margin for
+    // wide lines and rounding
+    auto cover = [&](int i, int& tx0, int& tx1, int& b0, int& b1)
+    {
+        V2 lo, hi;
+        S.bounds(i, lo, hi);
+        if (lo.x > hi.x) return false;
+
+        int pad = (int)ceil(S.attr_[i].thickness_ * scale / 2) + 2;
+        int x0 = (int)floor(lo.x * sx) - pad, x1 = (int)floor(hi.x * sx) + pad;
+        int y0 = (int)floor(lo.y * sy) - pad, y1 = (int)floor(hi.y * sy) + pad;
+        if (x1 < 0 || y1 < 0 || x0 >= size.x || y0 >= size.y) return false;
+
+        tx0 = max(x0, 0) / T;
+        tx1 = min(x1, size.x - 1) / T;
+        b0 = (size.y - 1 - min(y1, size.y - 1)) / T;
+        b1 = (size.y - 1 - max(y0, 0)) / T;
+        return true;
+    };
+
+    // rows by the first row of tiles they meet, in z-order
+    struct Item { int row, tx0, tx1, b1; };
+    vector<size_t> start(bands + 1, 0);
+    int n = S.size();
+    for (int i = 0; i < n; i++)
+    {
+        int tx0, tx1, b0, b1;
+        if (cover(i, tx0, tx1, b0, b1)) start[b0 + 1]++;
+    }
+    for (int b = 0; b < bands; b++) start[b + 1] += start[b];
+
+    vector<Item> items(start[bands]);
+    {
+        vector<size_t> next(start.begin(), start.end() - 1);
+        for (int i = 0; i < n; i++)
+        {
+            int tx0, tx1, b0, b1;
+            if (cover(i, tx0, tx1, b0, b1)) items[next[b0]++] = { i, tx0, tx1, b1 };
+        }
+    }
+
+    PngWriter W;
+    if (!W.open(path, size.x, size.y, pool))
+    {
+        error = "cannot create " + path;
+        return false;
+    }
+
+    vector<Raster> raster(tilesX);
+    vector<uint8_t> line((size_t)size.x * 3);
+    double renderMs = 0, pngMs = 0;
+    size_t drawn = 0;
+
+    // rows met by the current row of tiles, then the rows of each tile
+    vector<Item> active, merged;
+    vector<size_t> first(tilesX + 1);
+    vector<int> rows;
+
+    for (int b = 0; b < bands; b++)
+    {
+        int top = size.y - b * T;
+        int y0 = max(0, top - T);
+        int h = top - y0;
+
+        auto t0 = chrono::steady_clock::now();
+
+        merged.clear();
+        merge(active.begin(), active.end(), items.begin() + start[b], items.begin() + start[b + 1],
+              back_inserter(merged), [](const Item& p, const Item& q) { return p.row < q.row; });
+        active.swap(merged);
+
+        fill(first.begin(), first.end(), 0);
+        for (const Item& it : active)
+            for (int tx = it.tx0; tx <= it.tx1; tx++) first[tx + 1]++;
+        for (int tx = 0; tx < tilesX; tx++) first[tx + 1] += first[tx];
+
+        rows.resize(first[tilesX]);
+        {
+            vector<size_t> next(first.begin(), first.end() - 1);
+            for (const Item& it : active)
+                for (int tx = it.tx0; tx <= it.tx1; tx++) rows[next[tx]++] = it.row;
+        }
+        drawn += rows.size();
+
+        auto draw = [&](int tx)
+        {
+            Raster& R = raster[tx];
+            int x0 = tx * T;
+            R.resize(min(T, size.x - x0), h);
+            R.clear(Color::Black);
+            R.setView(sx, sy, V2(x0, y0));
+
+            for (size_t k = first[tx]; k < first[tx + 1]; k++)
+                S.drawRow(R, rows[k]);
+        };
+        if (pool) pool->run(tilesX, draw);
+        else for (int tx = 0; tx < tilesX; tx++) draw(tx);
+        renderMs += msSince(t0);
+
+        // the rows ending here are not met by the next row of tiles
+        active.erase(remove_if(active.begin(), active.end(), [&](const Item& it) { return it.b1 == b; }), active.end());
+
+        // rows of the image, top first
+        t0 = chrono::steady_clock::now();
+        for (int y = h - 1; y >= 0; y--)
+        {
+            for (int tx = 0; tx < tilesX; tx++)
+                memcpy(line.data() + (size_t)tx * T * 3, raster[tx].row(y), (size_t)raster[tx].width() * 3);
+            W.addRow(line.data());
+        }
+        pngMs += msSince(t0);
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    bool ok = W.close(error);
+    pngMs += msSince(t0);
+
+    if (stats)
+    {
+        stats->tiles = tilesX * bands;
+        stats->drawn = drawn;
+        stats->bytes = W.bytes();
+        stats->renderMs = renderMs;
+        stats->pngMs = pngMs;
+    }
+    return ok;
+}
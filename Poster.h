@@ -0,0 +1,36 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "V2.h"
+#include <string>
+using namespace std;
+
+class SceneStore;
+class ThreadPool;
+
+/*
+ Poster export: the part (0,0)-world of a scene, scaled to an image of
+ any size, written as a PNG without ever holding the whole image.
+ The image is cut in tiles of tile x tile pixels. Each row of the scene
+ is first listed once, under the first row of tiles its box meets
+ (thickness included). A row of tiles takes the rows still met from the
+ one above plus its new ones, lists them in its tiles in z-order, and is
+ rendered, one Raster per tile with the view of its part of the image;
+ its pixel rows go to the PngWriter before the next row of tiles is drawn.
+ Memory is a row of tiles, one entry per row of the scene and the lists
+ of one row of tiles, whatever the size of the image.
+ The tiles of a row, then the compression, run on the pool when one is
+ given (not from inside a task of it). The image is the same as the one
+ of a single raster with the same view.
+*/
+struct PosterStats
+{
+    int tiles = 0;
+    size_t drawn = 0;           // rows drawn, summed over the tiles
+    size_t bytes = 0;           // of the file
+    double renderMs = 0;        // tiles
+    double pngMs = 0;           // encoder
+};
+
+bool writePoster(const string& path, const SceneStore& S, V2 world, V2 size, int tile,
+                 ThreadPool* pool, string& error, PosterStats* stats = nullptr);
@@ -0,0 +1,286 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Raster.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+void Raster::resize(int width, int height)
+{
+    w_ = max(0, width);
+    h_ = max(0, height);
+    px_.resize((size_t)w_ * h_ * 3);
+}
+
+void Raster::setView(double sx, double sy, V2 origin)
+{
+    view_ = true;
+    sx_ = sx;
+    sy_ = sy;
+    origin_ = origin;
+}
+
+void Raster::resetView()
+{
+    view_ = false;
+    sx_ = sy_ = 1;
+    origin_ = V2(0, 0);
+}
+
+// the origin is subtracted after flooring: two tiles place a point on the
+// same pixel of the whole image
+V2 Raster::pixel(V2 P) const
+{
+    if (!view_) return P;
+    return V2((int)floor(P.x * sx_) - origin_.x, (int)floor(P.y * sy_) - origin_.y);
+}
+
+// without view, truncated as V2(double, double)
+V2 Raster::pixel(double x, double y) const
+{
+    if (!view_) return V2(x, y);
+    return V2((int)floor(x * sx_) - origin_.x, (int)floor(y * sy_) - origin_.y);
+}
+
+int Raster::pixels(int thickness) const
+{
+    if (!view_) return thickness;
+    return max(1, (int)lround(thickness * (sx_ + sy_) / 2));
+}
+
+static uint8_t to8(float c)
+{
+    int v = (int)lround(c * 255);
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+Raster::Pen Raster::pen(Color c, bool blend)
+{
+    Pen p;
+    p.r = to8(c.R);
+    p.g = to8(c.G);
+    p.b = to8(c.B);
+    p.alpha = max(0, min(256, (int)lround(c.A * 256)));
+    p.blend = blend && p.alpha < 256;
+    return p;
+}
+
+void Raster::clear(Color c)
+{
+    Pen p = pen(c, false);
+    uint8_t* d = px_.data();
+    for (size_t i = 0, n = (size_t)w_ * h_; i < n; i++, d += 3)
+    {
+        d[0] = p.r;
+        d[1] = p.g;
+        d[2] = p.b;
+    }
+}
+
+// pixels x0..x1 of row y
+void Raster::span(int y, int x0, int x1, const Pen& p)
+{
+    if (y < 0 || y >= h_) return;
+    x0 = max(x0, 0);
+    x1 = min(x1, w_ - 1);
+    if (x0 > x1) return;
+
+    uint8_t* d = px_.data() + ((size_t)y * w_ + x0) * 3;
+    if (!p.blend)
+    {
+        // one pixel, then copies of what is written, doubling
+        size_t n = (size_t)(x1 - x0 + 1) * 3;
+        d[0] = p.r;
+        d[1] = p.g;
+        d[2] = p.b;
+        for (size_t done = 3; done < n; done *= 2)
+            memcpy(d + done, d, min(done, n - done));
+        return;
+    }
+
+    int a = p.alpha;
+    for (int x = x0; x <= x1; x++, d += 3)
+    {
+        d[0] = (uint8_t)(d[0] + (((p.r - d[0]) * a) >> 8));
+        d[1] = (uint8_t)(d[1] + (((p.g - d[1]) * a) >> 8));
+        d[2] = (uint8_t)(d[2] + (((p.b - d[2]) * a) >> 8));
+    }
+}
+
+void Raster::setPixel(V2 P, Color c)
+{
+    P = pixel(P);
+    span(P.y, P.x, P.x, pen(c, false));
+}
+
+/*
+ Line without its last pixel (a polyline does not blend its vertices twice),
+ one pixel per step on the major axis; a wide line covers thickness pixels
+ across it, as non antialiased wide lines of OpenGL.
+ Only the steps inside the raster are walked.
+*/
+void Raster::line(V2 P1, V2 P2, const Pen& p, int thickness)
+{
+    int dx = P2.x - P1.x, dy = P2.y - P1.y;
+    int n = max(abs(dx), abs(dy));
+    if (n == 0) return;
+
+    bool xMajor = abs(dx) >= abs(dy);
+    int major0 = xMajor ? P1.x : P1.y;
+    int dMajor = xMajor ? dx : dy;
+    int minor0 = xMajor ? P1.y : P1.x;
+    int dMinor = xMajor ? dy : dx;
+    int size = xMajor ? w_ : h_;
+    int minorSize = xMajor ? h_ : w_;
+
+    // steps i with 0 <= major0 + i * sign < size
+    int i0, i1;
+    if (dMajor > 0) { i0 = max(0, -major0);             i1 = min(n - 1, size - 1 - major0); }
+    else            { i0 = max(0, major0 - (size - 1)); i1 = min(n - 1, major0); }
+
+    int t = max(1, thickness);
+    int below = (t - 1) / 2, above = t / 2;
+    int step = dMajor > 0 ? 1 : -1;
+
+    // and whose thickness may reach the raster across it: the steps from
+    // -above - 0.5 to minorSize - 1 + below + 0.5 on the minor axis, with
+    // one step of margin for the rounding of the division
+    if (dMinor != 0)
+    {
+        double lo = (-above - minor0 - 0.5) * n / dMinor;
+        double hi = (minorSize - 1 + below - minor0 + 0.5) * n / dMinor;
+        if (dMinor < 0) swap(lo, hi);
+        i0 = max(i0, (int)max(floor(lo) - 1, -1.0));
+        i1 = min(i1, (int)min(ceil(hi) + 1, (double)n));
+    }
+    else if (minor0 + above < 0 || minor0 - below >= minorSize) return;
+
+    // bytes between two pixels along each axis
+    ptrdiff_t majorStride = xMajor ? 3 : (ptrdiff_t)w_ * 3;
+    ptrdiff_t minorStride = xMajor ? (ptrdiff_t)w_ * 3 : 3;
+    int a = p.alpha;
+
+    for (int i = i0; i <= i1; i++)
+    {
+        int major = major0 + i * step;
+        int minor = minor0 + (int)floor((double)dMinor * i / n + 0.5);
+        int m0 = max(minor - below, 0), m1 = min(minor + above, minorSize - 1);
+
+        uint8_t* d = px_.data() + major * majorStride + m0 * minorStride;
+        for (int m = m0; m <= m1; m++, d += minorStride)
+        {
+            if (p.blend)
+            {
+                d[0] = (uint8_t)(d[0] + (((p.r - d[0]) * a) >> 8));
+                d[1] = (uint8_t)(d[1] + (((p.g - d[1]) * a) >> 8));
+                d[2] = (uint8_t)(d[2] + (((p.b - d[2]) * a) >> 8));
+            }
+            else
+            {
+                d[0] = p.r;
+                d[1] = p.g;
+                d[2] = p.b;
+            }
+        }
+    }
+}
+
+void Raster::drawLine(V2 P1, V2 P2, Color c, int thickness)
+{
+    line(pixel(P1), pixel(P2), pen(c, true), pixels(thickness));
+}
+
+// pixels whose center is inside, even-odd rule
+void Raster::fillPolygon(const V2* pts, int n, const Pen& p)
+{
+    if (n < 3) return;
+
+    int y0 = pts[0].y, y1 = pts[0].y;
+    for (int i = 1; i < n; i++)
+    {
+        y0 = min(y0, pts[i].y);
+        y1 = max(y1, pts[i].y);
+    }
+    y0 = max(y0, 0);
+    y1 = min(y1, h_);
+
+    for (int y = y0; y < y1; y++)
+    {
+        float cy = y + 0.5f;
+        xs_.clear();
+        for (int i = 0; i < n; i++)
+        {
+            V2 A = pts[i], B = pts[(i + 1) % n];
+            if ((A.y <= cy) == (B.y <= cy)) continue;
+            xs_.push_back(A.x + (cy - A.y) * (B.x - A.x) / (float)(B.y - A.y));
+        }
+        sort(xs_.begin(), xs_.end());
+
+        for (size_t k = 0; k + 1 < xs_.size(); k += 2)
+            span(y, (int)ceil(xs_[k] - 0.5f), (int)ceil(xs_[k + 1] - 0.5f) - 1, p);
+    }
+}
+
+// closed outline or filled, points in pixels
+void Raster::polygon(const vector<V2>& pts, const Pen& p, bool fill, int thickness)
+{
+    int n = (int)pts.size();
+    if (fill)
+    {
+        fillPolygon(pts.data(), n, p);
+        return;
+    }
+    for (int i = 0; i < n; i++)
+        line(pts[i], pts[(i + 1) % n], p, thickness);
+}
+
+// as the window, no blending
+void Raster::drawPolygon(const vector<V2>& pts, Color c, bool fill, int thickness)
+{
+    poly_.clear();
+    for (V2 P : pts) poly_.push_back(pixel(P));
+    polygon(poly_, pen(c, false), fill, pixels(thickness));
+}
+
+void Raster::drawRectangle(V2 P, V2 size, Color c, bool fill, int thickness)
+{
+    Pen p = pen(c, false);
+    V2 Q = pixel(P);
+    size = pixel(P + size) - Q;
+    P = Q;
+    if (fill)
+    {
+        for (int y = max(P.y, 0); y < min(P.y + size.y, h_); y++)
+            span(y, P.x, P.x + size.x - 1, p);
+        return;
+    }
+
+    V2 C[4] = { P, V2(P.x + size.x, P.y), P + size, V2(P.x, P.y + size.y) };
+    for (int i = 0; i < 4; i++)
+        line(C[i], C[(i + 1) % 4], p, pixels(thickness));
+}
+
+// same points as Graphics::drawCircle, in pixels; with a view, as many
+// as drawCircle would take for the radius in pixels
+void Raster::circlePoints(V2 C, float r)
+{
+    int lineAmount = (int)(r * (sx_ + sy_) / 2 / 4);
+    if (lineAmount < 20) lineAmount = 20;
+
+    const double PI = 3.14159265358;
+    double step = 2 * PI / lineAmount;
+
+    circle_.clear();
+    for (int i = 0; i <= lineAmount; i++)
+        circle_.push_back(pixel(C.x + r * cos(i * step), C.y + r * sin(i * step)));
+}
+
+// Graphics::drawCircle draws its polygon with the default width:
+// the outline is one pixel wide whatever the thickness (scaled by a view)
+void Raster::drawCircle(V2 C, float r, Color c, bool fill, int)
+{
+    circlePoints(C, r);
+    polygon(circle_, pen(c, false), fill, pixels(1));
+}
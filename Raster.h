@@ -0,0 +1,75 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "V2.h"
+#include "Color.h"
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+/*
+ CPU framebuffer (RGB, 8 bits) with the drawing calls of Graphics,
+ for rendering without a window (batch renderer).
+ Same conventions as the window: y axis going up (row 0 at the bottom),
+ only lines are blended with the alpha of their color, rectangles and
+ circles replace the pixels; circles are the same polygons as drawCircle,
+ wide lines cover thickness pixels across their major axis.
+ The memory is kept when the raster is resized to a smaller size, so one
+ raster can be reused for many images.
+ A scene is drawn with SceneStore::draw(raster).
+ With a view, the drawing calls take world coordinates: a world point P
+ is the pixel (floor(P.x * sx), floor(P.y * sy)) of a larger image whose
+ part starting at origin is this raster; thicknesses are scaled too.
+ A part is then a tile of that image, pixel for pixel (see Poster.h).
+*/
+class Raster
+{
+public:
+    void resize(int width, int height);
+    int  width() const  { return w_; }
+    int  height() const { return h_; }
+
+    void setView(double sx, double sy, V2 origin);
+    void resetView();           // world = pixels
+
+    void clear(Color c);
+    void setPixel(V2 P, Color c);
+    void drawLine(V2 P1, V2 P2, Color c, int thickness = 1);
+    void drawRectangle(V2 P, V2 size, Color c, bool fill = false, int thickness = 1);
+    void drawCircle(V2 C, float r, Color c, bool fill = false, int thickness = 1);
+    void drawPolygon(const vector<V2>& pts, Color c, bool fill = false, int thickness = 1);
+
+    // 3 bytes per pixel, y going up
+    const uint8_t* row(int y) const { return px_.data() + (size_t)y * w_ * 3; }
+
+private:
+    struct Pen
+    {
+        uint8_t r, g, b;
+        int alpha;            // 0..256
+        bool blend;
+    };
+
+    int w_ = 0;
+    int h_ = 0;
+    vector<uint8_t> px_;
+    vector<float> xs_;        // crossings of a scanline, polygon fill
+    vector<V2> circle_;       // points of the last circle
+    vector<V2> poly_;         // points of drawPolygon, in pixels
+
+    bool view_ = false;
+    double sx_ = 1, sy_ = 1;
+    V2 origin_;
+
+    static Pen pen(Color c, bool blend);
+    void span(int y, int x0, int x1, const Pen& p);    // [x0, x1], clipped
+    void line(V2 P1, V2 P2, const Pen& p, int thickness);
+    void fillPolygon(const V2* pts, int n, const Pen& p);
+    void polygon(const vector<V2>& pts, const Pen& p, bool fill, int thickness);
+    void circlePoints(V2 C, float r);
+
+    // world -> pixels of this raster
+    V2 pixel(V2 P) const;
+    V2 pixel(double x, double y) const;
+    int pixels(int thickness) const;
+};
@@ -0,0 +1,26 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+// Graphics without OpenGL nor window (PictorBatch, PictorTests): these targets
+// draw the scene into a Raster through SceneStore, so nothing is drawn here;
+// the functions only let the objects, whose draw takes a Graphics, link.
+
+#include "Graphics.h"
+
+void Graphics::initMainWindow(string, V2, V2) {}
+
+V2 Graphics::getWindowSize()
+{
+	return V2(0, 0);
+}
+
+void Graphics::clearWindow(Color) {}
+
+void Graphics::drawStringFontMono(V2, string, float, float, Color) {}
+void Graphics::drawStringFontRoman(V2, string, float, float, Color) {}
+void Graphics::drawRectWithTexture(std::string, V2, V2, float) {}
+void Graphics::setPixel(V2, Color) {}
+void Graphics::drawLine(V2, V2, Color, int) {}
+void Graphics::drawPolygon(vector<V2>&, Color, bool, int) {}
+void Graphics::drawRectangle(V2, V2, Color, bool, int) {}
+void Graphics::drawCircle(V2, float, Color, bool, int) {}
+void Graphics::drawSquares(const vector<V2>&, int, Color) {}
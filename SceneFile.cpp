@@ -0,0 +1,292 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "SceneFile.h"
+#include "SceneStore.h"
+#include <fstream>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+static_assert(sizeof(V2) == 8, "V2 must be two int32 to be mapped");
+static_assert(sizeof(ShapeKind) == 1, "ShapeKind must be one byte to be mapped");
+static_assert(sizeof(PackedAttr) == 12, "PackedAttr must be packed");
+static_assert(sizeof(FileAttr) == 40, "FileAttr must be packed");
+
+static const char Magic[8] = { 'P', 'I', 'C', 'T', 'S', 'C', 'N', '\0' };
+
+// ATTRIBUTES ////////////////////////////////////////////////////
+
+static uint8_t to8(float v)
+{
+    if (v <= 0) return 0;
+    if (v >= 1) return 255;
+    return (uint8_t)lround(v * 255);
+}
+
+PackedAttr packAttr(const ObjAttr& at)
+{
+    PackedAttr p;
+    const Color& b = at.borderColor_;
+    const Color& f = at.interiorColor_;
+    p.border[0] = to8(b.R); p.border[1] = to8(b.G); p.border[2] = to8(b.B); p.border[3] = to8(b.A);
+    p.fill[0]   = to8(f.R); p.fill[1]   = to8(f.G); p.fill[2]   = to8(f.B); p.fill[3]   = to8(f.A);
+    p.thickness = (uint16_t)max(0, min(at.thickness_, 65535));
+    p.filled = at.isFilled_ ? 1 : 0;
+    p.reserved = 0;
+    return p;
+}
+
+ObjAttr unpackAttr(const PackedAttr& p)
+{
+    Color border(p.border[0] / 255.f, p.border[1] / 255.f, p.border[2] / 255.f, p.border[3] / 255.f);
+    Color fill(p.fill[0] / 255.f, p.fill[1] / 255.f, p.fill[2] / 255.f, p.fill[3] / 255.f);
+    return ObjAttr(border, p.filled != 0, fill, p.thickness);
+}
+
+FileAttr fileAttr(const ObjAttr& at)
+{
+    FileAttr f;
+    const Color& b = at.borderColor_;
+    const Color& c = at.interiorColor_;
+    f.border[0] = b.R; f.border[1] = b.G; f.border[2] = b.B; f.border[3] = b.A;
+    f.fill[0]   = c.R; f.fill[1]   = c.G; f.fill[2]   = c.B; f.fill[3]   = c.A;
+    f.thickness = at.thickness_;
+    f.filled = at.isFilled_ ? 1 : 0;
+    return f;
+}
+
+ObjAttr readFileAttr(const FileAttr& f)
+{
+    Color border(f.border[0], f.border[1], f.border[2], f.border[3]);
+    Color fill(f.fill[0], f.fill[1], f.fill[2], f.fill[3]);
+    return ObjAttr(border, f.filled != 0, fill, f.thickness);
+}
+
+// WRITE /////////////////////////////////////////////////////////
+
+static uint64_t align8(uint64_t v) { return (v + 7) & ~(uint64_t)7; }
+
+static void writeTable(ofstream& F, uint64_t offset, const void* data, size_t bytes)
+{
+    // zero padding up to the table offset
+    static const char zeros[8] = {};
+    uint64_t pos = (uint64_t)F.tellp();
+    F.write(zeros, (streamsize)(offset - pos));
+    if (bytes) F.write((const char*)data, (streamsize)bytes);
+}
+
+bool writeSceneFile(const string& path, const SceneStore& S, uint64_t journalMark)
+{
+    // attribute table: one entry per distinct set
+    vector<FileAttr> attrs;
+    vector<uint32_t> attrIndex(S.size());
+    unordered_map<string, uint32_t> known;
+
+    for (int i = 0; i < S.size(); i++)
+    {
+        FileAttr p = fileAttr(S.attr_[i]);
+        string key((const char*)&p, sizeof(p));
+
+        auto it = known.find(key);
+        if (it == known.end())
+        {
+            it = known.emplace(key, (uint32_t)attrs.size()).first;
+            attrs.push_back(p);
+        }
+        attrIndex[i] = it->second;
+    }
+
+    uint64_t n = (uint64_t)S.size();
+
+    SceneFileHeader H;
+    memcpy(H.magic, Magic, sizeof(Magic));
+    H.version = SceneFileVersion;
+    H.headerBytes = sizeof(SceneFileHeader);
+    H.journalMark = journalMark;
+    H.shapes = n;
+    H.points = S.points_.size();
+    H.attrs = attrs.size();
+
+    H.kindOffset      = align8(sizeof(SceneFileHeader));
+    H.aOffset         = align8(H.kindOffset + n);
+    H.bOffset         = align8(H.aOffset + n * sizeof(V2));
+    H.radiusOffset    = align8(H.bOffset + n * sizeof(V2));
+    H.firstOffset     = align8(H.radiusOffset + n * sizeof(float));
+    H.countOffset     = align8(H.firstOffset + n * sizeof(int));
+    H.attrIndexOffset = align8(H.countOffset + n * sizeof(int));
+    H.attrOffset      = align8(H.attrIndexOffset + n * sizeof(uint32_t));
+    H.pointOffset     = align8(H.attrOffset + attrs.size() * sizeof(FileAttr));
+    H.idOffset        = align8(H.pointOffset + H.points * sizeof(V2));
+    H.fileBytes       = H.idOffset + n * sizeof(int);
+
+    ofstream F(path, ios::binary | ios::trunc);
+    if (!F) return false;
+
+    F.write((const char*)&H, sizeof(H));
+    writeTable(F, H.kindOffset,      S.kind_.data(),   n);
+    writeTable(F, H.aOffset,         S.A_.data(),      n * sizeof(V2));
+    writeTable(F, H.bOffset,         S.B_.data(),      n * sizeof(V2));
+    writeTable(F, H.radiusOffset,    S.radius_.data(), n * sizeof(float));
+    writeTable(F, H.firstOffset,     S.first_.data(),  n * sizeof(int));
+    writeTable(F, H.countOffset,     S.count_.data(),  n * sizeof(int));
+    writeTable(F, H.attrIndexOffset, attrIndex.data(), n * sizeof(uint32_t));
+    writeTable(F, H.attrOffset,      attrs.data(),     attrs.size() * sizeof(FileAttr));
+    writeTable(F, H.pointOffset,     S.points_.data(), S.points_.size() * sizeof(V2));
+    writeTable(F, H.idOffset,        S.id_.data(),     n * sizeof(int));
+
+    return (bool)F;
+}
+
+// VIEW //////////////////////////////////////////////////////////
+
+static bool tableFits(const SceneFileHeader& H, uint64_t offset, uint64_t count, uint64_t itemBytes, uint64_t fileBytes)
+{
+    if (offset % 4 != 0 || offset < H.headerBytes) return false;
+    if (count > fileBytes / itemBytes) return false;
+    return offset <= fileBytes && count * itemBytes <= fileBytes - offset;
+}
+
+bool SceneView::open(const string& path, string& error)
+{
+    close();
+
+    if (!file_.open(path))
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    const unsigned char* base = file_.data();
+    uint64_t bytes = file_.size();
+
+    // version 1 headers stop before idOffset
+    const size_t headerV1 = offsetof(SceneFileHeader, idOffset);
+
+    SceneFileHeader H = {};
+    if (bytes < headerV1) { error = "file too short"; close(); return false; }
+    memcpy(&H, base, headerV1);
+
+    if (memcmp(H.magic, Magic, sizeof(Magic)) != 0) { error = "not a scene file"; close(); return false; }
+    if (H.version < 1 || H.version > SceneFileVersion)
+    {
+        error = "unsupported version " + to_string(H.version);
+        close();
+        return false;
+    }
+    size_t headerSize = H.version == 1 ? headerV1 : sizeof(H);
+    if (bytes < headerSize) { error = "file too short"; close(); return false; }
+    memcpy(&H, base, headerSize);
+
+    uint64_t n = H.shapes;
+    uint64_t attrBytes = H.version < 3 ? sizeof(PackedAttr) : sizeof(FileAttr);
+    bool ok = H.headerBytes >= headerSize && H.fileBytes == bytes &&
+              n <= 0x7fffffff && H.points <= 0x7fffffff && H.attrs <= 0xffffffff &&
+              tableFits(H, H.kindOffset,      n, 1, bytes) &&
+              tableFits(H, H.aOffset,         n, sizeof(V2), bytes) &&
+              tableFits(H, H.bOffset,         n, sizeof(V2), bytes) &&
+              tableFits(H, H.radiusOffset,    n, sizeof(float), bytes) &&
+              tableFits(H, H.firstOffset,     n, sizeof(int), bytes) &&
+              tableFits(H, H.countOffset,     n, sizeof(int), bytes) &&
+              tableFits(H, H.attrIndexOffset, n, sizeof(uint32_t), bytes) &&
+              tableFits(H, H.attrOffset,      H.attrs, attrBytes, bytes) &&
+              tableFits(H, H.pointOffset,     H.points, sizeof(V2), bytes) &&
+              (H.version == 1 || tableFits(H, H.idOffset, n, sizeof(int), bytes));
+    if (!ok) { error = "corrupt header"; close(); return false; }
+
+    kind_      = (const ShapeKind*)(base + H.kindOffset);
+    A_         = (const V2*)(base + H.aOffset);
+    B_         = (const V2*)(base + H.bOffset);
+    radius_    = (const float*)(base + H.radiusOffset);
+    first_     = (const int*)(base + H.firstOffset);
+    count_     = (const int*)(base + H.countOffset);
+    attrIndex_ = (const uint32_t*)(base + H.attrIndexOffset);
+    points_    = (const V2*)(base + H.pointOffset);
+    id_        = H.version == 1 ? nullptr : (const int*)(base + H.idOffset);
+    journalMark_ = H.journalMark;
+    size_ = (int)n;
+    pointCount_ = (int)H.points;
+
+    attrs_.resize(H.attrs);
+    if (H.version < 3)
+    {
+        const PackedAttr* packed = (const PackedAttr*)(base + H.attrOffset);
+        for (size_t k = 0; k < attrs_.size(); k++)
+            attrs_[k] = unpackAttr(packed[k]);
+    }
+    else
+    {
+        const FileAttr* stored = (const FileAttr*)(base + H.attrOffset);
+        for (size_t k = 0; k < attrs_.size(); k++)
+            attrs_[k] = readFileAttr(stored[k]);
+    }
+
+    // rows refer only to what exists
+    for (int i = 0; i < size_; i++)
+    {
+        bool valid = (unsigned char)kind_[i] <= (unsigned char)ShapeKind::Polygon && attrIndex_[i] < H.attrs;
+        if (valid && kind_[i] == ShapeKind::Polygon)
+            valid = first_[i] >= 0 && count_[i] >= 0 && count_[i] <= pointCount_ - first_[i];
+        if (!valid)
+        {
+            error = "corrupt shape " + to_string(i);
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void SceneView::close()
+{
+    file_.close();
+    kind_ = nullptr;
+    A_ = B_ = points_ = nullptr;
+    radius_ = nullptr;
+    first_ = count_ = nullptr;
+    attrIndex_ = nullptr;
+    id_ = nullptr;
+    journalMark_ = 0;
+    size_ = pointCount_ = 0;
+    attrs_.clear();
+}
+
+static shared_ptr<ObjGeom> makeShape(const SceneView& V, int i, const shared_ptr<ShapePool>& pool)
+{
+    const ObjAttr& at = V.attr(i);
+
+    switch (V.kind_[i])
+    {
+    case ShapeKind::Rectangle:
+        return allocateShape<ObjRectangle>(pool, at, V.A_[i], V.B_[i]);
+
+    case ShapeKind::Segment:
+        return allocateShape<ObjSegment>(pool, at, V.A_[i], V.B_[i]);
+
+    case ShapeKind::Circle:
+    {
+        auto c = allocateShape<ObjCircle>(pool, at, V.A_[i], V.A_[i]);
+        c->radius_ = V.radius_[i];
+        return c;
+    }
+
+    case ShapeKind::Polygon:
+    {
+        auto p = allocateShape<ObjPolygon>(pool, at);
+        p->pts_.assign(V.points_ + V.first_[i], V.points_ + V.first_[i] + V.count_[i]);
+        return p;
+    }
+    }
+    return nullptr;
+}
+
+// the object keeps its saved id (Model::addObject gives a new one if taken)
+shared_ptr<ObjGeom> SceneView::makeObject(int i, const shared_ptr<ShapePool>& pool) const
+{
+    shared_ptr<ObjGeom> obj = makeShape(*this, i, pool);
+    if (obj && id_) obj->id_ = id_[i];
+    return obj;
+}
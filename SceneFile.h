@@ -0,0 +1,121 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "V2.h"
+#include "ObjAttr.h"
+#include "ObjGeom.h"
+#include "ShapePool.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+using namespace std;
+
+class SceneStore;
+
+/*
+ Binary scene file (scene.bin).
+ Little-endian, each table starts on an 8-byte boundary:
+   header
+   kind         uint8 per shape (ShapeKind), in draw order
+   A, B         2 x int32 per shape: rectangle / segment corners, circle center in A
+   radius       float per shape (circles)
+   first, count int32 per shape: polygon vertices, as a range of the point table
+   attr         uint32 per shape: index in the attribute table
+   attrs        FileAttr per distinct set of attributes (PackedAttr before version 3)
+   points       2 x int32 per polygon vertex
+   ids          int32 per shape: id of the object (version 2)
+ The tables are the columns of SceneStore: a mapped file is read in place
+ (SceneView) or copied column by column (SceneStore::assign).
+ Version 2 adds the object ids and the journal mark, so that the edits
+ logged in scene.journal (see SceneJournal.h) can be replayed on the file.
+ Version 3 keeps the colors as floats, as in the scene: a save / load
+ cycle gives back the exact colors.
+ Version 1 files (no ids, mark 0) and version 2 files are still read.
+*/
+struct SceneFileHeader
+{
+    char     magic[8];          // "PICTSCN" + '\0'
+    uint32_t version;           // SceneFileVersion
+    uint32_t headerBytes;       // sizeof(SceneFileHeader)
+    uint64_t shapes;
+    uint64_t points;
+    uint64_t attrs;
+    uint64_t kindOffset, aOffset, bOffset, radiusOffset;
+    uint64_t firstOffset, countOffset, attrIndexOffset;
+    uint64_t attrOffset, pointOffset;
+    uint64_t fileBytes;
+
+    // version 2
+    uint64_t idOffset;
+    uint64_t journalMark;       // BASE record of scene.journal matching this file (0: none)
+};
+
+const uint32_t SceneFileVersion = 3;
+
+// colors as float RGBA (version 3)
+struct FileAttr
+{
+    float    border[4];
+    float    fill[4];
+    int32_t  thickness;
+    uint32_t filled;
+};
+
+FileAttr fileAttr(const ObjAttr& at);
+ObjAttr  readFileAttr(const FileAttr& f);
+
+// colors as 8-bit RGBA (versions 1 and 2)
+struct PackedAttr
+{
+    uint8_t  border[4];
+    uint8_t  fill[4];
+    uint16_t thickness;
+    uint8_t  filled;
+    uint8_t  reserved;
+};
+
+PackedAttr packAttr(const ObjAttr& at);
+ObjAttr    unpackAttr(const PackedAttr& p);
+
+// write the rows of S with their ids, false if the file cannot be written
+bool writeSceneFile(const string& path, const SceneStore& S, uint64_t journalMark = 0);
+
+/*
+ Scene file mapped in memory.
+ The columns point into the mapping: nothing is read before it is used.
+ The file is checked when opened (table bounds, kinds, indices), so the
+ columns can be used without further test.
+*/
+class SceneView
+{
+public:
+    const ShapeKind* kind_   = nullptr;
+    const V2*        A_      = nullptr;
+    const V2*        B_      = nullptr;
+    const float*     radius_ = nullptr;
+    const int*       first_  = nullptr;
+    const int*       count_  = nullptr;
+    const uint32_t*  attrIndex_ = nullptr;
+    const V2*        points_ = nullptr;
+    const int*       id_     = nullptr;    // null in version 1 files
+
+    bool open(const string& path, string& error);
+    void close();
+
+    int size() const       { return size_; }
+    int pointCount() const { return pointCount_; }
+
+    const ObjAttr& attr(int i) const { return attrs_[attrIndex_[i]]; }
+    uint64_t journalMark() const { return journalMark_; }
+
+    shared_ptr<ObjGeom> makeObject(int i, const shared_ptr<ShapePool>& pool = nullptr) const;
+
+private:
+    MappedFile file_;
+    int size_ = 0;
+    int pointCount_ = 0;
+    uint64_t journalMark_ = 0;
+    vector<ObjAttr> attrs_;    // attribute table, unpacked (one entry per distinct set)
+};
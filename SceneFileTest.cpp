@@ -0,0 +1,85 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Test.h"
+#include "SceneFile.h"
+#include "SceneStore.h"
+#include <cstdio>
+#include <cmath>
+
+using namespace std;
+
+static SceneStore sampleScene(const ObjAttr& A)
+{
+    SceneStore S;
+    V2 poly[] = { V2(1, 2), V2(30, 4), V2(5, 60) };
+
+    S.addRectangle(V2(10, 20), V2(30, 40), A);
+    S.addSegment(V2(-5, 7), V2(8, -9), A);
+    S.addCircle(V2(100, 50), 12.5f, A);
+    S.addPolygon(poly, 3, A);
+    S.id_ = { 7, 3, -1, 12 };
+    return S;
+}
+
+static bool sameColor(const Color& a, const Color& b)
+{
+    return a.R == b.R && a.G == b.G && a.B == b.B && a.A == b.A;
+}
+
+static void checkRows(const SceneView& V, const SceneStore& S)
+{
+    REQUIRE(V.size() == S.size());
+    REQUIRE(V.id_);
+    for (int i = 0; i < S.size(); i++)
+    {
+        CHECK(V.kind_[i] == S.kind_[i]);
+        CHECK(V.A_[i] == S.A_[i]);
+        CHECK(V.radius_[i] == S.radius_[i]);
+        CHECK(V.count_[i] == S.count_[i]);
+        CHECK(V.id_[i] == S.id_[i]);
+    }
+}
+
+// version 3 gives back the colors as they were
+TEST(sceneFileColors)
+{
+    ObjAttr A(Color(1 / 3.f, 0.5f, 0.25f, 0.7f), true, Color(0.1f, 0.2f, 0.3f), 3);
+    SceneStore S = sampleScene(A);
+
+    const char* path = "testdata/sceneFileColors.tmp";
+    REQUIRE(writeSceneFile(path, S, 9));
+
+    SceneView V;
+    string error;
+    REQUIRE(V.open(path, error));
+    checkRows(V, S);
+    CHECK(V.journalMark() == 9);
+    for (int i = 0; i < V.size(); i++)
+    {
+        const ObjAttr& B = V.attr(i);
+        CHECK(sameColor(B.borderColor_, A.borderColor_));
+        CHECK(sameColor(B.interiorColor_, A.interiorColor_));
+        CHECK(B.isFilled_ && B.thickness_ == 3);
+    }
+
+    V.close();
+    remove(path);
+}
+
+// files written before version 3 still open, colors rounded to 8 bits
+TEST(sceneFileVersion2)
+{
+    ObjAttr A(Color(1, 0.5f, 0.25f), true, Color(0.1f, 0.2f, 0.3f), 3);
+    SceneStore S = sampleScene(A);
+
+    SceneView V;
+    string error;
+    REQUIRE(V.open("testdata/scene_v2.bin", error));
+    checkRows(V, S);
+    CHECK(V.journalMark() == 5);
+
+    const ObjAttr& B = V.attr(0);
+    CHECK(B.isFilled_ && B.thickness_ == 3);
+    CHECK(fabs(B.borderColor_.G - 0.5f) < 1.f / 255);
+    CHECK(fabs(B.interiorColor_.R - 0.1f) < 1.f / 255);
+}
@@ -0,0 +1,607 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "SceneJournal.h"
+#include "SceneFile.h"
+#include "Model.h"
+#include <sstream>
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+using namespace std;
+
+static const string Header = "PICTJRN 1\n";
+
+SceneJournal::SceneJournal(const string& path, const string& binPath) : path_(path), binPath_(binPath)
+{
+}
+
+SceneJournal::~SceneJournal()
+{
+    if (open_) append("CLOSE\n");
+    {
+        lock_guard<mutex> guard(lock_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    if (writer_.joinable()) writer_.join();
+}
+
+// WRITER ////////////////////////////////////////////////////////
+
+void SceneJournal::post(Op op)
+{
+    {
+        lock_guard<mutex> guard(lock_);
+        ops_.push_back(move(op));
+        if (!writer_.joinable()) writer_ = thread(&SceneJournal::work, this);
+    }
+    wake_.notify_all();
+}
+
+void SceneJournal::append(const string& text)
+{
+    if (!open_ || text.empty()) return;
+    Op op;
+    op.text = text;
+    post(move(op));
+}
+
+void SceneJournal::appendBase(uint64_t mark, bool fileToCome)
+{
+    if (!open_) return;
+    Op op;
+    op.type = Op::Base;
+    op.mark = mark;
+    op.fileToCome = fileToCome;
+    post(move(op));
+}
+
+void SceneJournal::flush()
+{
+    unique_lock<mutex> guard(lock_);
+    idle_.wait(guard, [&] { return ops_.empty() && !writing_; });
+}
+
+// records in the order they were queued; the last ones are still written
+// when the journal is destroyed
+void SceneJournal::work()
+{
+    for (;;)
+    {
+        Op op;
+        {
+            unique_lock<mutex> guard(lock_);
+            writing_ = false;
+            if (ops_.empty()) idle_.notify_all();
+            wake_.wait(guard, [&] { return stop_ || !ops_.empty(); });
+            if (ops_.empty()) return;
+
+            op = move(ops_.front());
+            ops_.pop_front();
+            writing_ = true;
+        }
+
+        switch (op.type)
+        {
+        case Op::Write:
+            write(op.text);
+            break;
+
+        case Op::Base:
+            baseOffset_ = fileBytes_.load();
+            if (op.fileToCome) bases_.push_back({ op.mark, fileBytes_.load() });
+            write("BASE " + to_string(op.mark) + "\n");
+            break;
+
+        case Op::Drop:
+            dropBefore(op.mark);
+            break;
+        }
+    }
+}
+
+void SceneJournal::write(const string& text)
+{
+    if (!out_.is_open()) return;
+
+    out_.write(text.data(), (streamsize)text.size());
+    out_.flush();
+    if (!out_)
+    {
+        cout << "Journal : cannot write " << path_ << ", edits are no longer logged" << endl;
+        out_.close();
+        open_ = false;
+        return;
+    }
+    fileBytes_ += text.size();
+}
+
+// FILE //////////////////////////////////////////////////////////
+
+// keep the first keepBytes of the file (a new file if 0), then append
+void SceneJournal::start(Model& Data, size_t keepBytes)
+{
+    flush();
+    out_.close();
+
+    error_code ec;
+    if (keepBytes > 0) filesystem::resize_file(path_, keepBytes, ec);
+    if (keepBytes == 0 || ec)
+    {
+        keepBytes = 0;
+        out_.open(path_, ios::binary | ios::trunc);
+    }
+    else out_.open(path_, ios::binary | ios::app);
+
+    // offsets of the BASE records still in the file
+    vector<Entry> E;
+    if (keepBytes > 0) scan(path_, keepBytes, E);
+
+    baseOffset_ = 0;
+    auto pending = bases_;
+    bases_.clear();
+    size_t begin = Header.size();
+    for (const Entry& e : E)
+    {
+        if (e.kind == Kind::Base)
+        {
+            baseOffset_ = begin;
+            for (auto& b : pending)
+                if (b.first == e.mark) bases_.push_back({ b.first, begin });
+        }
+        begin = e.end;
+    }
+
+    open_ = out_.is_open();
+    fileBytes_ = keepBytes;
+    if (keepBytes == 0) append(Header);
+
+    rebase(Data);
+}
+
+// the current scene is what is logged so far
+void SceneJournal::rebase(Model& Data)
+{
+    last_ = Data.snapshot();
+    syncedState_ = Data.history.state();
+}
+
+/*
+ Reads the records up to the first one that is incomplete (cut by a crash)
+ or unreadable; validBytes is the end of the last good one.
+*/
+bool SceneJournal::read(const string& path, vector<Entry>& E, vector<Replay::Batch>& batches, size_t& validBytes)
+{
+    E.clear();
+    batches.clear();
+    validBytes = 0;
+
+    ifstream F(path, ios::binary);
+    if (!F) return false;
+    string text((istreambuf_iterator<char>(F)), istreambuf_iterator<char>());
+    if (text.compare(0, Header.size(), Header) != 0) return false;
+
+    istringstream is(text);
+    is.seekg((streamoff)Header.size());
+    validBytes = Header.size();
+
+    for (;;)
+    {
+        string word;
+        if (!(is >> word)) break;
+
+        Entry e;
+        if (word == "BASE")
+        {
+            e.kind = Kind::Base;
+            if (!(is >> e.mark)) break;
+        }
+        else if (word == "SAVE")  e.kind = Kind::Save;
+        else if (word == "CLOSE") e.kind = Kind::Close;
+        else if (word == "BATCH")
+        {
+            int sets = 0, dels = 0;
+            if (!(is >> sets >> dels) || sets < 0 || dels < 0) break;
+
+            Replay::Batch B;
+            B.dels.resize(dels);
+            for (int& id : B.dels) is >> id;
+            B.sets.resize(sets);
+            for (auto& s : B.sets) is >> s.first >> s.second;
+            B.objects.read(is);
+
+            string end;
+            if (!(is >> end) || end != "END" || B.objects.size() != sets) break;
+
+            e.kind = Kind::Batch;
+            e.batch = (int)batches.size();
+            batches.push_back(move(B));
+        }
+        else break;
+
+        // the record ends with its line
+        if (is.peek() == '\r') is.get();
+        if (is.peek() != '\n') break;
+        is.get();
+
+        e.end = (size_t)is.tellg();
+        validBytes = e.end;
+        E.push_back(e);
+    }
+    return true;
+}
+
+/*
+ Kinds, marks and ends of the records in the first bytes of the file,
+ from the first line of each record: a BATCH is skipped by its line count
+ (removed ids, one per set, the object count, one per object, END).
+*/
+bool SceneJournal::scan(const string& path, size_t bytes, vector<Entry>& E)
+{
+    E.clear();
+
+    ifstream F(path, ios::binary);
+    string line;
+    if (!getline(F, line) || line + "\n" != Header) return false;
+    size_t pos = Header.size();
+
+    auto next = [&]()
+    {
+        if (!getline(F, line) || F.eof()) return false;
+        pos += line.size() + 1;
+        return true;
+    };
+
+    while (pos < bytes && next())
+    {
+        istringstream is(line);
+        string word;
+        is >> word;
+
+        Entry e;
+        if (word == "BASE")
+        {
+            e.kind = Kind::Base;
+            if (!(is >> e.mark)) break;
+        }
+        else if (word == "SAVE")  e.kind = Kind::Save;
+        else if (word == "CLOSE") e.kind = Kind::Close;
+        else if (word == "BATCH")
+        {
+            long long sets = -1;
+            is >> sets;
+            if (sets < 0) break;
+
+            bool complete = true;
+            for (long long k = 0; k < 2 * sets + 2 && complete; k++) complete = next();
+            if (!complete || !next() || line.compare(0, 3, "END") != 0) break;
+            e.kind = Kind::Batch;
+        }
+        else break;
+
+        if (pos > bytes) break;
+        e.end = pos;
+        E.push_back(e);
+    }
+    return true;
+}
+
+/*
+ Batches to apply: from the last BASE whose scene is available (binMark,
+ or 0: empty scene) up to the last checkpoint (toSave) or to the end.
+ A BASE with a mark is a checkpoint too: its scene.bin was a full save.
+*/
+SceneJournal::Replay SceneJournal::plan(const vector<Entry>& E, vector<Replay::Batch>& batches, uint64_t binMark, bool toSave)
+{
+    Replay R;
+
+    int last = (int)E.size() - 1;
+    if (toSave)
+        while (last >= 0 && !(E[last].kind == Kind::Save || (E[last].kind == Kind::Base && E[last].mark != 0)))
+            last--;
+    if (last < 0) return R;
+
+    int first = last;
+    while (first >= 0 && !(E[first].kind == Kind::Base && (E[first].mark == 0 || E[first].mark == binMark)))
+        first--;
+    if (first < 0) return R;
+
+    R.usable = true;
+    R.fromBin = E[first].mark != 0;
+    R.keepBytes = E[last].end;
+    for (int i = first + 1; i <= last; i++)
+        if (E[i].kind == Kind::Batch) R.todo.push_back(move(batches[E[i].batch]));
+    R.batches = (int)R.todo.size();
+    return R;
+}
+
+// STARTUP ///////////////////////////////////////////////////////
+
+static uint64_t markOfSceneFile(SceneView& V, const string& path)
+{
+    string error;
+    if (!V.open(path, error)) return SceneJournal::NoFile;
+    return V.journalMark() ? V.journalMark() : SceneJournal::NoFile;
+}
+
+bool SceneJournal::open(Model& Data, string& message)
+{
+    vector<Entry> E;
+    vector<Replay::Batch> batches;
+    size_t valid = 0;
+
+    if (!read(path_, E, batches, valid))
+    {
+        start(Data, 0);
+        appendBase(0, false);
+        return false;
+    }
+
+    bool closed = !E.empty() && E.back().kind == Kind::Close;
+    if (!closed)
+    {
+        SceneView V;
+        uint64_t binMark = markOfSceneFile(V, binPath_);
+        Replay R = plan(E, batches, binMark, false);
+
+        if (R.usable)
+        {
+            if (R.fromBin)
+                for (int i = 0; i < V.size(); i++)
+                    Data.addObject(V.makeObject(i, Data.shapePool));
+            apply(Data, R);
+
+            // the log goes on from the recovered scene
+            start(Data, valid);
+            message = "recovered " + to_string(R.batches) + " changes from " + path_ +
+                      (R.fromBin ? " on scene.bin" : "") + ", " + to_string(Data.objectCount()) + " objects";
+            return true;
+        }
+        message = "cannot recover " + path_ + " (no matching scene.bin)";
+    }
+
+    // unsaved changes of the last session are dropped, saved ones are kept
+    // for Load; this session starts from an empty scene
+    size_t keep = 0;
+    for (const Entry& e : E)
+        if (e.kind == Kind::Save || (e.kind == Kind::Base && e.mark != 0)) keep = e.end;
+    start(Data, keep);
+    appendBase(0, false);
+    return false;
+}
+
+// LOGGING ///////////////////////////////////////////////////////
+
+void SceneJournal::sync(Model& Data)
+{
+    if (!open_ || Data.history.state() == syncedState_) return;
+    append(batch(Data));
+}
+
+/*
+ Changes between last_ and the scene, as objects to remove and objects to
+ set: new, modified or moved in the z-order, each one given with the id of
+ the object just above it. Replayed from the top, "just below aboveId"
+ rebuilds the order, provided the objects not set kept their relative order.
+ - few slots changed: the objects in them (the others did not move)
+ - many (the slots were renumbered): the objects outside the longest
+   sequence that kept its order, or modified
+*/
+string SceneJournal::batch(Model& Data)
+{
+    SceneSnapshot cur = Data.snapshot();
+    syncedState_ = Data.history.state();
+
+    vector<int> dels;
+    vector<pair<int, int>> sets;
+    SceneStore objects;
+
+    unordered_set<int> newIds, oldIds;
+    size_t changed = 0;
+    cur.diff(last_, [&](int, const SceneSnapshot::Item& now, const SceneSnapshot::Item& before)
+    {
+        if (now) newIds.insert(now->id_);
+        if (before) oldIds.insert(before->id_);
+        changed++;
+    });
+
+    if (changed <= 4096 || changed <= (size_t)cur.size() / 8)
+    {
+        for (int id : oldIds)
+            if (!Data.findObject(id)) dels.push_back(id);
+
+        vector<pair<int, int>> order;   // slot, id
+        for (int id : newIds) order.push_back({ Data.slotOf(id), id });
+        sort(order.rbegin(), order.rend());
+
+        for (auto& o : order)
+        {
+            sets.push_back({ o.second, Data.aboveIdOf(o.second) });
+            objects.add(*cur.get(o.first));
+        }
+    }
+    else
+    {
+        // both scenes in z-order
+        vector<SceneSnapshot::Item> now, before;
+        auto collect = [](vector<SceneSnapshot::Item>& L)
+        {
+            return [&L](int, const SceneSnapshot::Item& obj, const SceneSnapshot::Item&) { L.push_back(obj); };
+        };
+        cur.diff(SceneSnapshot(), collect(now));
+        last_.diff(SceneSnapshot(), collect(before));
+
+        unordered_map<int, int> oldPos;
+        for (int i = 0; i < (int)before.size(); i++) oldPos[before[i]->id_] = i;
+
+        // longest increasing sequence of the old positions (patience sort)
+        int n = (int)now.size();
+        vector<int> pos(n, -1), tails, prev(n, -1);
+        for (int i = 0; i < n; i++)
+        {
+            auto it = oldPos.find(now[i]->id_);
+            if (it == oldPos.end()) continue;
+            pos[i] = it->second;
+
+            auto t = lower_bound(tails.begin(), tails.end(), pos[i], [&](int k, int p) { return pos[k] < p; });
+            if (t != tails.begin()) prev[i] = *(t - 1);
+            if (t == tails.end()) tails.push_back(i);
+            else *t = i;
+        }
+        vector<char> keep(n, 0);
+        for (int k = tails.empty() ? -1 : tails.back(); k >= 0; k = prev[k]) keep[k] = 1;
+
+        vector<char> alive(before.size(), 0);
+        for (int i = n - 1; i >= 0; i--)
+        {
+            if (pos[i] >= 0) alive[pos[i]] = 1;
+            if (keep[i] && before[pos[i]] == now[i]) continue;
+
+            sets.push_back({ now[i]->id_, i + 1 < n ? now[i + 1]->id_ : -1 });
+            objects.add(*now[i]);
+        }
+        for (size_t k = 0; k < before.size(); k++)
+            if (!alive[k]) dels.push_back(before[k]->id_);
+    }
+
+    last_ = cur;
+    if (sets.empty() && dels.empty()) return "";
+
+    ostringstream os;
+    os << "BATCH " << sets.size() << " " << dels.size() << "\n";
+    for (size_t k = 0; k < dels.size(); k++) os << (k ? " " : "") << dels[k];
+    os << "\n";
+    for (auto& s : sets) os << s.first << " " << s.second << "\n";
+    objects.write(os);
+    os << "END\n";
+    return os.str();
+}
+
+void SceneJournal::apply(Model& Data, const Replay& R)
+{
+    for (const Replay::Batch& B : R.todo)
+    {
+        for (int id : B.dels) Data.removeObject(id);
+
+        for (int k = 0; k < (int)B.sets.size(); k++)
+        {
+            int id = B.sets[k].first, above = B.sets[k].second;
+            shared_ptr<ObjGeom> obj = B.objects.makeObject(k, Data.shapePool);
+            obj->id_ = id;
+
+            if (Data.findObject(id))
+            {
+                if (Data.aboveIdOf(id) != above) Data.moveObject(id, -1, -1, above);
+                Data.replaceObject(id, obj);
+            }
+            else Data.placeObject(obj, -1, -1, above);
+        }
+    }
+}
+
+// SAVE / LOAD ///////////////////////////////////////////////////
+
+void SceneJournal::markSaved()
+{
+    append("SAVE\n");
+}
+
+uint64_t SceneJournal::beginBase(Model& Data)
+{
+    sync(Data);
+
+    uint64_t mark = (uint64_t)chrono::duration_cast<chrono::microseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+    mark = max(mark, lastMark_ + 1);
+    lastMark_ = mark;
+
+    appendBase(mark, true);
+    return mark;
+}
+
+void SceneJournal::baseWritten(uint64_t mark)
+{
+    if (!open_) return;
+    Op op;
+    op.type = Op::Drop;
+    op.mark = mark;
+    post(move(op));
+}
+
+// writer thread: header + the records from the BASE of mark on, then the
+// file is replaced
+void SceneJournal::dropBefore(uint64_t mark)
+{
+    auto it = find_if(bases_.begin(), bases_.end(), [&](const pair<uint64_t, size_t>& b) { return b.first == mark; });
+    if (it == bases_.end() || !out_.is_open()) return;
+
+    size_t from = it->second;
+    out_.close();
+
+    string tail;
+    {
+        ifstream F(path_, ios::binary);
+        F.seekg((streamoff)from);
+        tail.assign((istreambuf_iterator<char>(F)), istreambuf_iterator<char>());
+    }
+
+    string tmp = path_ + ".tmp";
+    {
+        ofstream T(tmp, ios::binary | ios::trunc);
+        T << Header << tail;
+    }
+    error_code ec;
+    filesystem::rename(tmp, path_, ec);
+    if (ec)
+    {
+        filesystem::remove(tmp, ec);
+        out_.open(path_, ios::binary | ios::app);
+        open_ = out_.is_open();
+        return;
+    }
+
+    size_t removed = from - Header.size();
+    fileBytes_ -= removed;
+    baseOffset_ = baseOffset_ >= from ? baseOffset_ - removed : Header.size();
+
+    vector<pair<uint64_t, size_t>> later;
+    for (auto& b : bases_)
+        if (b.second > from) later.push_back({ b.first, b.second - removed });
+    bases_.swap(later);
+
+    out_.open(path_, ios::binary | ios::app);
+    open_ = out_.is_open();
+}
+
+SceneJournal::Replay SceneJournal::planLoad(uint64_t binMark)
+{
+    flush();
+
+    vector<Entry> E;
+    vector<Replay::Batch> batches;
+    size_t valid = 0;
+    if (!open_ || !read(path_, E, batches, valid)) return Replay();
+    return plan(E, batches, binMark, true);
+}
+
+bool SceneJournal::loaded(Model& Data, const Replay& R, uint64_t binMark)
+{
+    if (!open_) return false;
+
+    if (R.usable)
+    {
+        start(Data, R.keepBytes);
+        return false;
+    }
+
+    // the log cannot describe the loaded scene: it starts again on scene.bin,
+    // or on a full save when there is no mark to refer to
+    start(Data, 0);
+    if (binMark == NoFile) return true;
+
+    appendBase(binMark, false);
+    return false;
+}
@@ -0,0 +1,154 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "SceneSnapshot.h"
+#include "SceneStore.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+using namespace std;
+
+class Model;
+
+/*
+ Append-only log of the scene changes (scene.journal), next to scene.bin.
+ Records, one or more lines each:
+   PICTJRN 1            header
+   BASE mark            following batches apply to scene.bin written with
+                        this mark (0: to an empty scene)
+   BATCH sets dels      changes of one history state to the next:
+                        removed ids, then "id aboveId" of each object set
+                        (top first), then the objects in scene.txt format, END
+   SAVE                 checkpoint: what Load returns to
+   CLOSE                clean exit: nothing to recover
+ Every change of state is logged as it happens (sync), so saving a scene
+ after small edits only writes a SAVE line. scene.bin is rewritten in the
+ background when the log grows (BASE + AutoSave), then the records before
+ its BASE are dropped.
+ A log that does not end with CLOSE is replayed at startup; a record cut
+ by a crash is ignored.
+ The UI thread only formats the records: a writer thread appends them in
+ order and drops the records before a BASE once its scene.bin is written.
+ Reading the log (startup, Load) first waits for the writes queued.
+*/
+class SceneJournal
+{
+public:
+    static const uint64_t NoFile = ~(uint64_t)0;   // no usable scene.bin
+
+    // result of reading the log for a Load or a recovery
+    struct Replay
+    {
+        bool     usable = false;   // false: no log, or no BASE matching the files
+        bool     fromBin = false;  // batches apply to scene.bin, else to an empty scene
+        int      batches = 0;
+        size_t   keepBytes = 0;    // end of the last record replayed
+
+        struct Batch
+        {
+            vector<int> dels;
+            vector<pair<int, int>> sets;   // id, aboveId
+            SceneStore objects;            // one row per set
+        };
+        vector<Batch> todo;
+    };
+
+    explicit SceneJournal(const string& path = "scene.journal", const string& binPath = "scene.bin");
+    ~SceneJournal();   // CLOSE, then waits for the writer
+
+    SceneJournal(const SceneJournal&) = delete;
+    SceneJournal& operator = (const SceneJournal&) = delete;
+
+    // startup: replays a log left by a crash (true, message set),
+    // then starts logging from the current scene
+    bool open(Model& Data, string& message);
+
+    // logs the changes since the last sync if the history state changed
+    void sync(Model& Data);
+
+    // Save: a SAVE line
+    void markSaved();
+
+    // Save with a new scene.bin: returns the mark to write in it
+    uint64_t beginBase(Model& Data);
+
+    // scene.bin with this mark is on disk: the records before it are dropped
+    void baseWritten(uint64_t mark);
+
+    // Load: batches from the BASE matching scene.bin (binMark, or NoFile) up to the last SAVE
+    Replay planLoad(uint64_t binMark);
+    static void apply(Model& Data, const Replay& R);
+
+    // after a Load applied with R: later records are dropped, logging starts
+    // again; true when the log needs a full save to refer to (text scene)
+    bool loaded(Model& Data, const Replay& R, uint64_t binMark);
+
+    // waits until the records queued are in the file
+    void flush();
+
+    // as written so far by the writer thread
+    size_t bytes() const          { return fileBytes_; }
+    size_t bytesSinceBase() const { return fileBytes_ - baseOffset_; }
+    bool   isOpen() const         { return open_; }
+
+private:
+    enum class Kind { Base, Batch, Save, Close };
+    struct Entry
+    {
+        Kind     kind;
+        uint64_t mark = 0;
+        size_t   end = 0;      // byte after the record
+        int      batch = -1;   // index in Replay::todo
+    };
+
+    // work of the writer thread
+    struct Op
+    {
+        enum Type { Write, Base, Drop } type = Write;
+        string   text;
+        uint64_t mark = 0;
+        bool     fileToCome = false;     // Base: a scene.bin with this mark is being written
+    };
+
+    string path_, binPath_;
+
+    // UI thread
+    uint64_t lastMark_ = 0;
+    SceneSnapshot last_;             // scene as logged so far
+    int syncedState_ = -1;
+
+    // writer thread (or the UI thread once flush() returned)
+    ofstream out_;
+    atomic<size_t> fileBytes_{ 0 };
+    atomic<size_t> baseOffset_{ 0 };         // start of the last BASE
+    atomic<bool>   open_{ false };
+    vector<pair<uint64_t, size_t>> bases_;   // marks waiting for their scene.bin, offset of their BASE
+
+    thread writer_;                  // started with the first record
+    mutex lock_;
+    condition_variable wake_, idle_;
+    deque<Op> ops_;
+    bool writing_ = false;
+    bool stop_ = false;
+
+    static bool read(const string& path, vector<Entry>& E, vector<Replay::Batch>& batches, size_t& validBytes);
+    static bool scan(const string& path, size_t bytes, vector<Entry>& E);
+    static Replay plan(const vector<Entry>& E, vector<Replay::Batch>& batches, uint64_t binMark, bool toSave);
+
+    void post(Op op);
+    void append(const string& text);
+    void appendBase(uint64_t mark, bool fileToCome);
+    void start(Model& Data, size_t keepBytes);   // truncate the file, log from the current scene
+    void rebase(Model& Data);
+    string batch(Model& Data);
+
+    void work();
+    void write(const string& text);
+    void dropBefore(uint64_t mark);
+};
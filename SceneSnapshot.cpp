@@ -0,0 +1,125 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "SceneSnapshot.h"
+
+using namespace std;
+
+// snapshots are copied on the UI and autosave threads
+unsigned SceneSnapshot::newOwner()
+{
+    static atomic<unsigned> last{ 0 };
+    return ++last;
+}
+
+// the nodes of S are now shared: neither value may modify them in place
+SceneSnapshot::SceneSnapshot(const SceneSnapshot& S)
+    : root_(S.root_), shift_(S.shift_), size_(S.size_), allocated_(S.allocated_), owner_(newOwner())
+{
+    S.owner_ = newOwner();
+}
+
+SceneSnapshot& SceneSnapshot::operator = (const SceneSnapshot& S)
+{
+    if (this == &S) return *this;
+    root_ = S.root_;
+    shift_ = S.shift_;
+    size_ = S.size_;
+    allocated_ = S.allocated_;
+    owner_ = newOwner();
+    S.owner_ = newOwner();
+    return *this;
+}
+
+SceneSnapshot::Item SceneSnapshot::get(int i) const
+{
+    if (i < 0 || i >= size_) return nullptr;
+
+    const Ref* p = &root_;
+    for (int s = shift_; s > 0; s -= Bits)
+    {
+        if (!*p) return nullptr;
+        p = &node(*p)->slot[(i >> s) & Mask];
+    }
+    if (!*p) return nullptr;
+    return item(node(*p)->slot[i & Mask]);
+}
+
+// node that can be modified: copied first if it was not created by this value
+SceneSnapshot::Node* SceneSnapshot::own(Ref& p)
+{
+    if (!p)
+    {
+        p = make_shared<Node>();
+        allocated_ += sizeof(Node);
+    }
+    else if (node(p)->owner != owner_)
+    {
+        p = make_shared<Node>(*node(p));
+        allocated_ += sizeof(Node);
+    }
+    Node* n = (Node*)p.get();
+    n->owner = owner_;
+    return n;
+}
+
+void SceneSnapshot::set(int i, const Item& obj)
+{
+    if (i < 0 || i >= size_) return;
+    if (get(i) == obj) return;
+
+    Ref* p = &root_;
+    for (int s = shift_; s > 0; s -= Bits)
+        p = &own(*p)->slot[(i >> s) & Mask];
+
+    shared_ptr<ObjGeom> o = const_pointer_cast<ObjGeom>(obj);
+    if (o) o->frozen_ = true;
+    own(*p)->slot[i & Mask] = o;
+}
+
+void SceneSnapshot::resize(int n)
+{
+    if (n <= 0)
+    {
+        root_.reset();
+        shift_ = 0;
+        size_ = 0;
+        return;
+    }
+
+    // slots beyond the new size are emptied, so growing again finds them empty
+    if (n < size_) clearFrom(root_, shift_, n, *this);
+
+    while (((long long)Width << shift_) < n)
+    {
+        root_ = lift(root_);
+        if (root_) allocated_ += sizeof(Node);
+        shift_ += Bits;
+    }
+    size_ = n;
+}
+
+// empty the slots from 'from' (relative to the subtree) to the end of the subtree
+void SceneSnapshot::clearFrom(Ref& p, int shift, int from, SceneSnapshot& S)
+{
+    if (!p) return;
+    if (from <= 0) { p.reset(); return; }
+
+    int j = from >> shift;
+    if (j >= Width) return;
+
+    Node* n = S.own(p);
+    for (int k = j + 1; k < Width; k++) n->slot[k].reset();
+
+    if (shift == 0) n->slot[j].reset();
+    else clearFrom(n->slot[j], shift - Bits, from - (j << shift), S);
+}
+
+// same content, one level deeper
+SceneSnapshot::Ref SceneSnapshot::lift(const Ref& p) const
+{
+    if (!p) return p;
+    shared_ptr<Node> n = make_shared<Node>();
+    n->slot[0] = p;
+    n->owner = owner_;
+    return n;
+}
@@ -0,0 +1,94 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "ObjGeom.h"
+#include <memory>
+#include <algorithm>
+#include <atomic>
+using namespace std;
+
+/*
+ Persistent (copy-on-write) list of frozen objects, one per slot of LObjets.
+ Stored as a 32-ary tree: copying a snapshot only copies the root, and
+ changing one slot copies the O(log n) nodes on its path, so consecutive
+ snapshots share every unchanged node and object.
+ Each value has an owner tag, given anew when it is copied (to both
+ values): nodes carrying the tag of a value were created by it since and
+ are modified in place, the others are copied first.
+ Objects stored here are marked frozen and never modified again
+ (see Model::editObject): a snapshot shares them with the scene.
+*/
+class SceneSnapshot
+{
+public:
+    typedef shared_ptr<const ObjGeom> Item;
+
+    SceneSnapshot() : owner_(newOwner()) {}
+    SceneSnapshot(const SceneSnapshot& S);
+    SceneSnapshot& operator = (const SceneSnapshot& S);
+
+    int  size() const { return size_; }
+    Item get(int i) const;
+
+    void set(int i, const Item& obj);
+    void resize(int n);
+
+    // bytes of the nodes created by set / resize on this value
+    size_t allocatedBytes() const { return allocated_; }
+
+    // calls f(slot, mine, other) for every slot where the two snapshots differ,
+    // skipping the subtrees they share
+    template <class F>
+    void diff(const SceneSnapshot& other, F f) const
+    {
+        Ref a = root_, b = other.root_;
+        int shift = max(shift_, other.shift_);
+        for (int s = shift_; s < shift; s += Bits) a = lift(a);
+        for (int s = other.shift_; s < shift; s += Bits) b = lift(b);
+        diffNodes(a, b, shift, 0, f);
+    }
+
+private:
+    static const int Bits = 5;
+    static const int Width = 1 << Bits;
+    static const int Mask = Width - 1;
+
+    // a node holds Width children (inner nodes) or Width objects (leaves)
+    typedef shared_ptr<void> Ref;
+    struct Node
+    {
+        Ref slot[Width];
+        unsigned owner = 0;   // tag of the value that may modify it in place
+    };
+
+    Ref    root_;
+    int    shift_ = 0;     // Bits * (depth - 1)
+    int    size_ = 0;
+    size_t allocated_ = 0;
+    mutable unsigned owner_;   // a copy changes the tag of its source too
+
+    static unsigned newOwner();
+    Node* own(Ref& p);
+    Ref lift(const Ref& p) const;
+    static void clearFrom(Ref& p, int shift, int from, SceneSnapshot& S);
+
+    static const Node* node(const Ref& p) { return (const Node*)p.get(); }
+    static Item item(const Ref& p) { return static_pointer_cast<const ObjGeom>(static_pointer_cast<ObjGeom>(p)); }
+
+    template <class F>
+    static void diffNodes(const Ref& a, const Ref& b, int shift, int base, F& f)
+    {
+        if (a == b) return;
+        static const Ref none;
+
+        for (int j = 0; j < Width; j++)
+        {
+            const Ref& x = a ? node(a)->slot[j] : none;
+            const Ref& y = b ? node(b)->slot[j] : none;
+            if (x == y) continue;
+
+            if (shift == 0) f(base + j, item(x), item(y));
+            else diffNodes(x, y, shift - Bits, base + (j << shift), f);
+        }
+    }
+};
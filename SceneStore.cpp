@@ -0,0 +1,802 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "SceneStore.h"
+#include "SceneFile.h"
+#include "ThreadPool.h"
+#include <string>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+// ROWS //////////////////////////////////////////////////////////
+
+void SceneStore::clear()
+{
+    kind_.clear();
+    A_.clear();
+    B_.clear();
+    radius_.clear();
+    first_.clear();
+    count_.clear();
+    attr_.clear();
+    id_.clear();
+    points_.clear();
+}
+
+void SceneStore::reserve(size_t shapes, size_t points)
+{
+    kind_.reserve(shapes);
+    A_.reserve(shapes);
+    B_.reserve(shapes);
+    radius_.reserve(shapes);
+    first_.reserve(shapes);
+    count_.reserve(shapes);
+    attr_.reserve(shapes);
+    id_.reserve(shapes);
+    points_.reserve(points);
+}
+
+static int addRow(SceneStore& S, ShapeKind k, V2 A, V2 B, float r,
+                  int first, int count, const ObjAttr& attr)
+{
+    S.kind_.push_back(k);
+    S.A_.push_back(A);
+    S.B_.push_back(B);
+    S.radius_.push_back(r);
+    S.first_.push_back(first);
+    S.count_.push_back(count);
+    S.attr_.push_back(attr);
+    S.id_.push_back(-1);
+    return S.size() - 1;
+}
+
+int SceneStore::addRectangle(V2 P1, V2 P2, const ObjAttr& attr)
+{
+    return addRow(*this, ShapeKind::Rectangle, P1, P2, 0, 0, 0, attr);
+}
+
+int SceneStore::addSegment(V2 P1, V2 P2, const ObjAttr& attr)
+{
+    return addRow(*this, ShapeKind::Segment, P1, P2, 0, 0, 0, attr);
+}
+
+int SceneStore::addCircle(V2 C, float r, const ObjAttr& attr)
+{
+    return addRow(*this, ShapeKind::Circle, C, C, r, 0, 0, attr);
+}
+
+int SceneStore::addPolygon(const V2* pts, int n, const ObjAttr& attr)
+{
+    int first = (int)points_.size();
+    points_.insert(points_.end(), pts, pts + n);
+    return addRow(*this, ShapeKind::Polygon, V2(), V2(), 0, first, n, attr);
+}
+
+// OBJECTS ///////////////////////////////////////////////////////
+
+void SceneStore::add(const ObjGeom& obj)
+{
+    switch (obj.kind())
+    {
+    case ShapeKind::Rectangle:
+    {
+        auto& r = static_cast<const ObjRectangle&>(obj);
+        addRectangle(r.P1_, r.P2_, r.drawInfo_);
+        break;
+    }
+    case ShapeKind::Segment:
+    {
+        auto& s = static_cast<const ObjSegment&>(obj);
+        addSegment(s.P1_, s.P2_, s.drawInfo_);
+        break;
+    }
+    case ShapeKind::Circle:
+    {
+        auto& c = static_cast<const ObjCircle&>(obj);
+        addCircle(c.center_, c.radius_, c.drawInfo_);
+        break;
+    }
+    case ShapeKind::Polygon:
+    {
+        auto& p = static_cast<const ObjPolygon&>(obj);
+        addPolygon(p.pts_.data(), (int)p.pts_.size(), p.drawInfo_);
+        break;
+    }
+    }
+    id_.back() = obj.id_;
+}
+
+void SceneStore::build(const vector< shared_ptr<ObjGeom> >& objects)
+{
+    // empty slots (removed objects) are skipped
+    size_t points = 0;
+    for (auto& obj : objects)
+        if (obj && obj->kind() == ShapeKind::Polygon) points += obj->getPointCount();
+
+    clear();
+    reserve(objects.size(), points);
+
+    for (auto& obj : objects)
+        if (obj) add(*obj);
+}
+
+static shared_ptr<ObjGeom> makeShape(const SceneStore& S, int i, const shared_ptr<ShapePool>& pool)
+{
+    const ObjAttr& at = S.attr_[i];
+
+    switch (S.kind_[i])
+    {
+    case ShapeKind::Rectangle:
+        return allocateShape<ObjRectangle>(pool, at, S.A_[i], S.B_[i]);
+
+    case ShapeKind::Segment:
+        return allocateShape<ObjSegment>(pool, at, S.A_[i], S.B_[i]);
+
+    case ShapeKind::Circle:
+    {
+        auto c = allocateShape<ObjCircle>(pool, at, S.A_[i], S.A_[i]);
+        c->radius_ = S.radius_[i];
+        return c;
+    }
+
+    case ShapeKind::Polygon:
+    {
+        auto p = allocateShape<ObjPolygon>(pool, at);
+        p->pts_.assign(S.points_.begin() + S.first_[i],
+                       S.points_.begin() + S.first_[i] + S.count_[i]);
+        return p;
+    }
+    }
+    return nullptr;
+}
+
+// the object keeps its saved id (Model::addObject gives a new one if taken)
+shared_ptr<ObjGeom> SceneStore::makeObject(int i, const shared_ptr<ShapePool>& pool) const
+{
+    shared_ptr<ObjGeom> obj = makeShape(*this, i, pool);
+    if (obj) obj->id_ = id_[i];
+    return obj;
+}
+
+void SceneStore::assign(const SceneView& V)
+{
+    int n = V.size();
+    kind_.assign(V.kind_, V.kind_ + n);
+    A_.assign(V.A_, V.A_ + n);
+    B_.assign(V.B_, V.B_ + n);
+    radius_.assign(V.radius_, V.radius_ + n);
+    first_.assign(V.first_, V.first_ + n);
+    count_.assign(V.count_, V.count_ + n);
+    points_.assign(V.points_, V.points_ + V.pointCount());
+    if (V.id_) id_.assign(V.id_, V.id_ + n);
+    else       id_.assign(n, -1);
+
+    attr_.resize(n);
+    for (int i = 0; i < n; i++) attr_[i] = V.attr(i);
+}
+
+// BOUNDS ////////////////////////////////////////////////////////
+
+void SceneStore::bounds(int i, V2& lo, V2& hi) const
+{
+    switch (kind_[i])
+    {
+    case ShapeKind::Rectangle:
+    case ShapeKind::Segment:
+        lo = V2(min(A_[i].x, B_[i].x), min(A_[i].y, B_[i].y));
+        hi = V2(max(A_[i].x, B_[i].x), max(A_[i].y, B_[i].y));
+        break;
+
+    case ShapeKind::Circle:
+    {
+        float r = radius_[i];
+        lo = V2((int)floor(A_[i].x - r), (int)floor(A_[i].y - r));
+        hi = V2((int)ceil(A_[i].x + r), (int)ceil(A_[i].y + r));
+        break;
+    }
+    case ShapeKind::Polygon:
+    {
+        lo = V2(1, 1);
+        hi = V2(0, 0);
+        const V2* p = points_.data() + first_[i];
+        for (int k = 0; k < count_[i]; k++)
+        {
+            if (k == 0) { lo = hi = p[0]; continue; }
+            lo = V2(min(lo.x, p[k].x), min(lo.y, p[k].y));
+            hi = V2(max(hi.x, p[k].x), max(hi.y, p[k].y));
+        }
+        break;
+    }
+    }
+}
+
+// TEXT FORMAT ///////////////////////////////////////////////////
+
+// Color as RGB values (0-1 range)
+static void writeColor(ostream& os, const Color& c)
+{
+    os << c.R << " " << c.G << " " << c.B;
+}
+
+static Color readColor(istream& is)
+{
+    float r, g, b;
+    is >> r >> g >> b;
+    return Color(r, g, b);
+}
+
+void SceneStore::writeAttr(ostream& os, const ObjAttr& at)
+{
+    os << " ";
+    writeColor(os, at.borderColor_);
+    os << " ";
+    writeColor(os, at.interiorColor_);
+    os << " " << at.thickness_ << " " << (at.isFilled_ ? 1 : 0) << "\n";
+}
+
+ObjAttr SceneStore::readAttr(istream& is)
+{
+    Color borderCol = readColor(is);
+    Color fillCol = readColor(is);
+    int thick, filled;
+    is >> thick >> filled;
+    return ObjAttr(borderCol, filled != 0, fillCol, thick);
+}
+
+// optional id at the end of the line, -1 if none
+static int readId(istream& is)
+{
+    while (is.peek() == ' ' || is.peek() == '\t' || is.peek() == '\r') is.get();
+
+    int id = -1;
+    int c = is.peek();
+    if ((c >= '0' && c <= '9') || c == '-') is >> id;
+    return id;
+}
+
+// numbers with to_chars: shortest text that reads back to the same value
+static void put(string& out, int v)
+{
+    char buf[16];
+    out.append(buf, to_chars(buf, buf + sizeof(buf), v).ptr);
+}
+
+static void put(string& out, float v)
+{
+    char buf[32];
+    out.append(buf, to_chars(buf, buf + sizeof(buf), v).ptr);
+}
+
+static void put(string& out, V2 P)
+{
+    out += ' ';
+    put(out, P.x);
+    out += ' ';
+    put(out, P.y);
+}
+
+static void put(string& out, const Color& c)
+{
+    out += ' ';
+    put(out, c.R);
+    out += ' ';
+    put(out, c.G);
+    out += ' ';
+    put(out, c.B);
+}
+
+// lines of rows [begin, end) appended to out
+static void formatRows(const SceneStore& S, int begin, int end, string& out)
+{
+    for (int i = begin; i < end; i++)
+    {
+        switch (S.kind_[i])
+        {
+        case ShapeKind::Rectangle:
+            out += "RECT";
+            put(out, S.A_[i]);
+            put(out, S.B_[i]);
+            break;
+
+        case ShapeKind::Segment:
+            out += "SEG";
+            put(out, S.A_[i]);
+            put(out, S.B_[i]);
+            break;
+
+        case ShapeKind::Circle:
+            out += "CIRC";
+            put(out, S.A_[i]);
+            out += ' ';
+            put(out, S.radius_[i]);
+            break;
+
+        case ShapeKind::Polygon:
+        {
+            out += "POLY ";
+            put(out, S.count_[i]);
+            const V2* p = S.points_.data() + S.first_[i];
+            for (int k = 0; k < S.count_[i]; k++)
+                put(out, p[k]);
+            break;
+        }
+        }
+
+        const ObjAttr& at = S.attr_[i];
+        put(out, at.borderColor_);
+        put(out, at.interiorColor_);
+        out += ' ';
+        put(out, at.thickness_);
+        out += at.isFilled_ ? " 1" : " 0";
+        if (S.id_[i] >= 0)
+        {
+            out += ' ';
+            put(out, S.id_[i]);
+        }
+        out += '\n';
+    }
+}
+
+void SceneStore::write(ostream& os, ThreadPool* pool) const
+{
+    const int BlockRows = 8192;
+
+    string header = to_string(size()) + "\n";
+    os.write(header.data(), header.size());
+
+    // blocks are formatted wave by wave, so only a few of them are in memory
+    int blocks = (size() + BlockRows - 1) / BlockRows;
+    int wave = pool ? pool->size() * 4 : 1;
+    vector<string> text(min(wave, max(blocks, 1)));
+
+    for (int b0 = 0; b0 < blocks; b0 += wave)
+    {
+        int count = min(wave, blocks - b0);
+        auto format = [&](int k)
+        {
+            int begin = (b0 + k) * BlockRows;
+            text[k].clear();
+            formatRows(*this, begin, min(begin + BlockRows, size()), text[k]);
+        };
+
+        if (pool) pool->run(count, format);
+        else      format(0);
+
+        for (int k = 0; k < count; k++)
+            os.write(text[k].data(), text[k].size());
+    }
+}
+
+void SceneStore::read(istream& is)
+{
+    size_t n = 0;
+    is >> n;
+    clear();
+    reserve(n, 0);
+
+    vector<V2> points;
+    for (size_t i = 0; i < n; ++i)
+    {
+        string type;
+        is >> type;
+
+        if (type == "RECT" || type == "SEG")
+        {
+            V2 p1, p2;
+            is >> p1.x >> p1.y >> p2.x >> p2.y;
+            ObjAttr at = readAttr(is);
+
+            if (type == "RECT") addRectangle(p1, p2, at);
+            else                addSegment(p1, p2, at);
+            id_.back() = readId(is);
+        }
+        else if (type == "CIRC")
+        {
+            V2 c; float r;
+            is >> c.x >> c.y >> r;
+            addCircle(c, r, readAttr(is));
+            id_.back() = readId(is);
+        }
+        else if (type == "POLY")
+        {
+            int m = 0;
+            is >> m;
+
+            points.clear();
+            for (int k = 0; k < m; ++k)
+            {
+                V2 pt;
+                is >> pt.x >> pt.y;
+                points.push_back(pt);
+            }
+            addPolygon(points.data(), (int)points.size(), readAttr(is));
+            id_.back() = readId(is);
+        }
+    }
+}
+
+// FAST PARSER ///////////////////////////////////////////////////
+
+namespace
+{
+    // position in the text, one record per line
+    struct Cursor
+    {
+        const char* p;
+        const char* end;
+        const char* lineStart;
+        int line = 1;
+        SceneStore::ParseError* error;
+
+        bool fail(const char* message)
+        {
+            if (error->message.empty())
+            {
+                error->line = line;
+                error->column = (int)(p - lineStart) + 1;
+                error->message = message;
+            }
+            return false;
+        }
+
+        void skipBlanks()
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        }
+
+        bool atLineEnd()
+        {
+            skipBlanks();
+            return p == end || *p == '\n';
+        }
+
+        // skip empty lines
+        void skipLines()
+        {
+            for (;;)
+            {
+                skipBlanks();
+                if (p == end || *p != '\n') return;
+                p++;
+                line++;
+                lineStart = p;
+            }
+        }
+
+        bool endLine()
+        {
+            if (!atLineEnd()) return fail("unexpected text at end of line");
+            if (p < end)
+            {
+                p++;
+                line++;
+                lineStart = p;
+            }
+            return true;
+        }
+
+        template <class T>
+        bool number(T& v, const char* what)
+        {
+            skipBlanks();
+            auto r = from_chars(p, end, v);
+            if (r.ec != errc()) return fail(what);
+            p = r.ptr;
+            return true;
+        }
+
+        // coordinates, counts, flags: up to 8 digits without from_chars
+        bool number(int& v, const char* what)
+        {
+            skipBlanks();
+            const char* q = p;
+            bool negative = (q < end && *q == '-');
+            if (negative) q++;
+
+            unsigned int m = 0;
+            int digits = 0;
+            while (q < end && (unsigned char)(*q - '0') < 10 && digits < 9) { m = m * 10 + (*q - '0'); q++; digits++; }
+            if (digits == 0 || digits == 9) return number<int>(v, what);
+
+            v = negative ? -(int)m : (int)m;
+            p = q;
+            return true;
+        }
+
+        // short decimals ("0", "0.8", "114.586") are the common case:
+        // m / 10^k is exact for m < 2^24 and k <= 10, so the result is the
+        // same as from_chars, which is used for anything else
+        bool number(float& v, const char* what)
+        {
+            skipBlanks();
+            static const float pow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+            const char* q = p;
+            bool negative = (q < end && *q == '-');
+            if (negative) q++;
+
+            unsigned int m = 0;
+            int digits = 0, decimals = 0;
+            const char* start = q;
+            while (q < end && *q >= '0' && *q <= '9' && digits < 8) { m = m * 10 + (*q - '0'); q++; digits++; }
+            if (q < end && *q == '.')
+            {
+                q++;
+                while (q < end && *q >= '0' && *q <= '9' && digits < 8) { m = m * 10 + (*q - '0'); q++; digits++; decimals++; }
+            }
+
+            bool simple = q > start && digits > 0 && digits < 8 && decimals <= 10 &&
+                          (q == end || !((*q >= '0' && *q <= '9') || *q == 'e' || *q == 'E' || *q == '.'));
+            if (!simple)
+            {
+                auto r = from_chars(p, end, v);
+                if (r.ec != errc()) return fail(what);
+                p = r.ptr;
+                return true;
+            }
+
+            v = (float)m / pow10[decimals];
+            if (negative) v = -v;
+            p = q;
+            return true;
+        }
+
+        bool point(V2& P)
+        {
+            return number(P.x, "expected integer coordinate") && number(P.y, "expected integer coordinate");
+        }
+
+        bool color(Color& c)
+        {
+            return number(c.R, "expected color component") && number(c.G, "expected color component") &&
+                   number(c.B, "expected color component");
+        }
+
+        // optional attributes and id, then end of line
+        bool attributes(ObjAttr& at, int& id)
+        {
+            at = ObjAttr();
+            id = -1;
+            if (atLineEnd()) return endLine();
+
+            int filled = 0;
+            if (!color(at.borderColor_) || !color(at.interiorColor_) ||
+                !number(at.thickness_, "expected thickness") || !number(filled, "expected filled flag (0 or 1)"))
+                return false;
+            at.isFilled_ = filled != 0;
+            if (!atLineEnd() && !number(id, "expected object id")) return false;
+            return endLine();
+        }
+
+        string_view word()
+        {
+            skipBlanks();
+            const char* w = p;
+            while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+            return string_view(w, p - w);
+        }
+    };
+}
+
+// one line of the body, after the shape count
+static bool parseShape(Cursor& C, SceneStore& S)
+{
+    const char* typeStart = C.p;
+    string_view type = C.word();
+    ObjAttr at;
+    int id;
+
+    if (type == "RECT" || type == "SEG")
+    {
+        V2 p1, p2;
+        if (!C.point(p1) || !C.point(p2) || !C.attributes(at, id)) return false;
+        if (type == "RECT") S.addRectangle(p1, p2, at);
+        else                S.addSegment(p1, p2, at);
+        S.id_.back() = id;
+        return true;
+    }
+    if (type == "CIRC")
+    {
+        V2 c; float r;
+        if (!C.point(c) || !C.number(r, "expected radius") || !C.attributes(at, id)) return false;
+        S.addCircle(c, r, at);
+        S.id_.back() = id;
+        return true;
+    }
+    if (type == "POLY")
+    {
+        int m = 0;
+        if (!C.number(m, "expected point count")) return false;
+        if (m < 0) return C.fail("negative point count");
+
+        // points go straight to the shared pool
+        int first = (int)S.points_.size();
+        for (int k = 0; k < m; k++)
+        {
+            V2 pt;
+            if (!C.point(pt)) return false;
+            S.points_.push_back(pt);
+        }
+        if (!C.attributes(at, id)) return false;
+        addRow(S, ShapeKind::Polygon, V2(), V2(), 0, first, m, at);
+        S.id_.back() = id;
+        return true;
+    }
+
+    C.p = typeStart;
+    return C.fail("unknown shape type (RECT, SEG, CIRC or POLY expected)");
+}
+
+// every line up to the end of the cursor
+static bool parsePiece(Cursor& C, SceneStore& S)
+{
+    for (;;)
+    {
+        C.skipLines();
+        if (C.p == C.end) return true;
+        if (!parseShape(C, S)) return false;
+    }
+}
+
+// rows of S copied at row / point of D (already sized)
+static void copyRows(SceneStore& D, int row, int point, const SceneStore& S)
+{
+    copy(S.kind_.begin(), S.kind_.end(), D.kind_.begin() + row);
+    copy(S.A_.begin(), S.A_.end(), D.A_.begin() + row);
+    copy(S.B_.begin(), S.B_.end(), D.B_.begin() + row);
+    copy(S.radius_.begin(), S.radius_.end(), D.radius_.begin() + row);
+    copy(S.count_.begin(), S.count_.end(), D.count_.begin() + row);
+    copy(S.attr_.begin(), S.attr_.end(), D.attr_.begin() + row);
+    copy(S.id_.begin(), S.id_.end(), D.id_.begin() + row);
+    copy(S.points_.begin(), S.points_.end(), D.points_.begin() + point);
+
+    // polygon ranges move with the pool, other rows keep first = 0
+    for (int i = 0; i < S.size(); i++)
+        D.first_[row + i] = S.kind_[i] == ShapeKind::Polygon ? S.first_[i] + point : S.first_[i];
+}
+
+bool SceneStore::parse(string_view text, ParseError& error, ThreadPool* pool)
+{
+    clear();
+    error = ParseError();
+
+    Cursor C;
+    C.p = C.lineStart = text.data();
+    C.end = text.data() + text.size();
+    C.error = &error;
+
+    C.skipLines();
+    long long n = 0;
+    if (!C.number(n, "expected shape count") || n < 0 || !C.endLine())
+    {
+        C.fail("expected shape count");
+        clear();
+        return false;
+    }
+
+    // small texts, or no pool (or a pool of one thread, where the join
+    // would only add a copy): one pass
+    const size_t PieceBytes = 1 << 20;
+    size_t rest = C.end - C.p;
+    int pieces = pool && pool->size() > 1 ? (int)min((size_t)pool->size() * 4, rest / PieceBytes) : 0;
+
+    if (pieces < 2)
+    {
+        reserve((size_t)min(n, (long long)text.size() / 8), 0);
+
+        for (long long i = 0; i < n; i++)
+        {
+            C.skipLines();
+            if (C.p == C.end)
+            {
+                string message = "expected " + to_string(n) + " shapes, found " + to_string(i);
+                C.fail(message.c_str());
+                clear();
+                return false;
+            }
+            if (!parseShape(C, *this))
+            {
+                clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // pieces of the body, each one starting at the beginning of a line
+    vector<const char*> cut(pieces + 1);
+    cut[0] = C.p;
+    cut[pieces] = C.end;
+    for (int k = 1; k < pieces; k++)
+    {
+        const char* q = max(C.p + rest / pieces * k, cut[k - 1]);
+        q = (const char*)memchr(q, '\n', C.end - q);
+        cut[k] = q ? q + 1 : C.end;
+    }
+
+    vector<SceneStore> parts(pieces);
+    vector<ParseError> errors(pieces);
+    vector<char> ok(pieces);
+
+    pool->run(pieces, [&](int k)
+    {
+        Cursor P;
+        P.p = P.lineStart = cut[k];
+        P.end = cut[k + 1];
+        P.error = &errors[k];
+        parts[k].reserve((size_t)(cut[k + 1] - cut[k]) / 32, 0);
+        ok[k] = parsePiece(P, parts[k]);
+    });
+
+    // pieces in order, up to the n-th row: the first error before it is
+    // the one of a sequential parse, what follows it is ignored alike
+    long long rows = 0;
+    int used = 0;
+    for (; used < pieces && rows < n; used++)
+    {
+        rows += parts[used].size();
+        if (rows < n && !ok[used])
+        {
+            error = errors[used];
+            error.line += (int)count(text.data(), cut[used], '\n');
+            clear();
+            return false;
+        }
+    }
+
+    if (rows < n)
+    {
+        const char* lastLine = C.end;
+        while (lastLine > text.data() && lastLine[-1] != '\n') lastLine--;
+
+        error.line = 1 + (int)count(text.data(), C.end, '\n');
+        error.column = (int)(C.end - lastLine) + 1;
+        error.message = "expected " + to_string(n) + " shapes, found " + to_string(rows);
+        clear();
+        return false;
+    }
+
+    // join the pieces in parallel, each at its own offset
+    vector<int> row(used + 1, 0), point(used + 1, 0);
+    for (int k = 0; k < used; k++)
+    {
+        row[k + 1] = row[k] + parts[k].size();
+        point[k + 1] = point[k] + (int)parts[k].points_.size();
+    }
+
+    kind_.resize(row[used]);
+    A_.resize(row[used]);
+    B_.resize(row[used]);
+    radius_.resize(row[used]);
+    first_.resize(row[used]);
+    count_.resize(row[used]);
+    attr_.resize(row[used]);
+    id_.resize(row[used]);
+    points_.resize(point[used]);
+
+    pool->run(used, [&](int k) { copyRows(*this, row[k], point[k], parts[k]); });
+
+    // rows after the n-th one are dropped, with their points
+    if (rows > n)
+    {
+        for (long long i = n; i < rows; i++)
+            if (kind_[i] == ShapeKind::Polygon)
+            {
+                points_.resize(first_[i]);
+                break;
+            }
+
+        kind_.resize(n);
+        A_.resize(n);
+        B_.resize(n);
+        radius_.resize(n);
+        first_.resize(n);
+        count_.resize(n);
+        attr_.resize(n);
+        id_.resize(n);
+    }
+    return true;
+}
@@ -0,0 +1,119 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "V2.h"
+#include "Color.h"
+#include "ObjAttr.h"
+#include "ObjGeom.h"
+#include "ShapePool.h"
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <string>
+#include <string_view>
+using namespace std;
+
+class SceneView;
+class ThreadPool;
+
+/*
+ Data-oriented copy of a scene.
+ One row per shape, stored in draw order (row index = z-order):
+ - kind_  : type tag
+ - A_, B_ : rectangle / segment corners, circle center in A_
+ - radius_: circle radius
+ - first_, count_ : polygon points, as a range of the shared pool points_
+ - attr_  : drawing attributes
+ - id_    : id of the object in the Model, -1 if none (e.g. shapes of an import)
+ No pointer, no virtual call: loops over the rows walk contiguous arrays.
+ The app builds it for files (scene.txt, scene.bin, autosave, history
+ records); the window still draws and hit-tests the objects of the Model.
+ draw serves the targets without a Model (PictorBatch, Poster).
+ A circle keeps its float radius when read (the first deserializer
+ truncated it to an int).
+*/
+class SceneStore
+{
+public:
+    vector<ShapeKind> kind_;
+    vector<V2>        A_;
+    vector<V2>        B_;
+    vector<float>     radius_;
+    vector<int>       first_;
+    vector<int>       count_;
+    vector<ObjAttr>   attr_;
+    vector<int>       id_;
+
+    vector<V2>        points_;   // shared vertex pool of all polygons
+
+    int size() const { return (int)kind_.size(); }
+
+    void clear();
+    void reserve(size_t shapes, size_t points);
+
+    // append a row (id -1), returns its index
+    int addRectangle(V2 P1, V2 P2, const ObjAttr& attr);
+    int addSegment(V2 P1, V2 P2, const ObjAttr& attr);
+    int addCircle(V2 C, float r, const ObjAttr& attr);
+    int addPolygon(const V2* pts, int n, const ObjAttr& attr);
+
+    // conversion from / to the object list of the Model, ids included
+    // (objects are created in the pool when one is given)
+    void add(const ObjGeom& obj);
+    void build(const vector< shared_ptr<ObjGeom> >& objects);
+    shared_ptr<ObjGeom> makeObject(int i, const shared_ptr<ShapePool>& pool = nullptr) const;
+
+    // copy of a mapped scene file (see SceneFile.h), column by column
+    void assign(const SceneView& V);
+
+    // text format of scene.txt: the shape count, then one line per row
+    //   RECT x1 y1 x2 y2 | SEG x1 y1 x2 y2 | CIRC x y r | POLY n x1 y1 ... xn yn
+    // followed by the attributes (border RGB, fill RGB, thickness, filled)
+    // and the id of the object when it has one
+    // with a pool, blocks of rows are formatted in parallel and written in order
+    void write(ostream& os, ThreadPool* pool = nullptr) const;
+    void read(istream& is);
+    static void    writeAttr(ostream& os, const ObjAttr& at);   // one line
+    static ObjAttr readAttr(istream& is);
+
+    // same text format, parsed from memory (e.g. a mapped file) without
+    // stream or temporary allocation; the attributes and the id at the end
+    // of a line are optional (older files have none).
+    // On bad input the store is left empty and the position is reported.
+    // With a pool, a large text is cut at line boundaries and the pieces
+    // are parsed in parallel, then joined: same rows, same errors
+    struct ParseError
+    {
+        int line = 0;      // 1-based
+        int column = 0;
+        string message;
+    };
+    bool parse(string_view text, ParseError& error, ThreadPool* pool = nullptr);
+
+    // box of the points of row i (lo > hi for a polygon without points),
+    // the thickness of the outline not included
+    void bounds(int i, V2& lo, V2& hi) const;
+
+    // draw every row in z-order, with any target that has the
+    // drawLine / drawRectangle / drawCircle interface of Graphics
+    template <class G>
+    void draw(G& g) const
+    {
+        int n = size();
+        for (int i = 0; i < n; i++)
+            drawRow(g, i);
+    }
+
+    // as the object of the row would draw itself (see ObjGeom.h)
+    template <class G>
+    void drawRow(G& g, int i) const
+    {
+        switch (kind_[i])
+        {
+        case ShapeKind::Rectangle: drawRectangleShape(g, A_[i], B_[i], attr_[i]); break;
+        case ShapeKind::Segment:   drawSegmentShape(g, A_[i], B_[i], attr_[i]); break;
+        case ShapeKind::Circle:    drawCircleShape(g, A_[i], radius_[i], attr_[i]); break;
+        case ShapeKind::Polygon:   drawPolygonShape(g, points_.data() + first_[i], count_[i], attr_[i]); break;
+        }
+    }
+};
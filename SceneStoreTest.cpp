@@ -0,0 +1,329 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Test.h"
+#include "SceneStore.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+static SceneStore sampleScene()
+{
+    SceneStore S;
+    ObjAttr A(Color(1, 0.5f, 0.25f), true, Color(0.1f, 0.2f, 0.3f), 3);
+    V2 poly[] = { V2(1, 2), V2(30, 4), V2(5, 60) };
+
+    S.addRectangle(V2(10, 20), V2(30, 40), A);
+    S.addSegment(V2(-5, 7), V2(8, -9), A);
+    S.addCircle(V2(100, 50), 12.5f, A);
+    S.addPolygon(poly, 3, A);
+    S.id_ = { 7, 3, -1, 12 };
+    return S;
+}
+
+static void checkSame(const SceneStore& S, const SceneStore& T)
+{
+    REQUIRE(S.size() == T.size());
+    for (int i = 0; i < S.size(); i++)
+    {
+        CHECK(S.kind_[i] == T.kind_[i]);
+        CHECK(S.A_[i] == T.A_[i]);
+        CHECK(S.radius_[i] == T.radius_[i]);
+        CHECK(S.count_[i] == T.count_[i]);
+        CHECK(S.id_[i] == T.id_[i]);
+    }
+    CHECK(S.points_ == T.points_);
+}
+
+// ids written at the end of the lines come back with both readers
+TEST(sceneTextIds)
+{
+    SceneStore S = sampleScene();
+    ostringstream os;
+    S.write(os);
+    string text = os.str();
+
+    SceneStore P;
+    SceneStore::ParseError E;
+    CHECK(P.parse(text, E));
+    checkSame(S, P);
+
+    SceneStore R;
+    istringstream is(text);
+    R.read(is);
+    checkSame(S, R);
+}
+
+// lines without id, or without attributes, still read
+TEST(sceneTextOldLines)
+{
+    string text = "2\nRECT 1 2 3 4 1 1 1 0 0 0 2 0\nSEG 5 6 7 8\n";
+
+    SceneStore P;
+    SceneStore::ParseError E;
+    REQUIRE(P.parse(text, E));
+    REQUIRE(P.size() == 2);
+    CHECK(P.id_[0] == -1);
+    CHECK(P.id_[1] == -1);
+
+    CHECK(!P.parse("1\nRECT 1 2 3 4 1 1 1 0 0 0 2 0 5 x\n", E));
+    CHECK(E.line == 2);
+}
+
+// n shapes of the four kinds in turn, spread over a 1920x1080 window
+static SceneStore randomScene(int n)
+{
+    SceneStore S;
+    unsigned seed = 1;
+    auto next = [&](int range) { seed = seed * 1103515245 + 12345; return int((seed >> 8) % range); };
+    ObjAttr attrs[] = { ObjAttr(Color(0.8f, 0.2f, 0.1f), true, Color(0.25f, 0.5f, 1), 2),
+                        ObjAttr(Color::White, false, Color::White, 1) };
+    for (int i = 0; i < n; i++)
+    {
+        V2 P(next(1920), next(1080));
+        const ObjAttr& A = attrs[i % 2];
+        switch (i % 4)
+        {
+        case 0: S.addRectangle(P, P + V2(next(100), next(100)), A); break;
+        case 1: S.addSegment(P, P + V2(next(100), next(100)), A); break;
+        case 2: S.addCircle(P, next(10000) / 100.f, A); break;
+        case 3:
+        {
+            V2 poly[] = { P, P + V2(next(50), 0), P + V2(0, next(50)), P + V2(next(50), next(50)) };
+            S.addPolygon(poly, 4, A);
+            break;
+        }
+        }
+    }
+    return S;
+}
+
+// scene.txt read through istream (SceneStore::read) and parsed from the
+// mapped file (SceneStore::parse), on one thread and on the pool
+BENCH(sceneParse)
+{
+    const int n = 500000, runs = 5;
+    const char* path = "testdata/sceneParse.tmp";
+
+    SceneStore S = randomScene(n);
+    {
+        ofstream F(path);
+        S.write(F);
+    }
+
+    double read = bestMs(runs, [&]
+    {
+        ifstream F(path);
+        SceneStore R;
+        R.read(F);
+        CHECK(R.size() == n);
+    });
+
+    auto parse = [&](ThreadPool* pool)
+    {
+        return bestMs(runs, [&]
+        {
+            MappedFile F;
+            F.open(path, true);
+            SceneStore P;
+            SceneStore::ParseError E;
+            CHECK(P.parse(string_view((const char*)F.data(), F.size()), E, pool));
+            CHECK(P.size() == n);
+        });
+    };
+    double single = parse(nullptr);
+    double parallel = parse(&ThreadPool::shared());
+
+    cout << "  read " << read << " ms, parse " << single << " ms (x" << read / single
+         << "), parse on the pool (" << ThreadPool::shared().size() << " threads) " << parallel
+         << " ms (x" << read / parallel << "), "
+         << n << " shapes" << endl;
+    remove(path);
+}
+
+// LAYOUTS ///////////////////////////////////////////////////////
+
+// box of the points of a shape, through its virtual accept
+struct BoxVisitor : ShapeVisitor
+{
+    V2 lo, hi;
+
+    void box(V2 A, V2 B)
+    {
+        lo = V2(min(A.x, B.x), min(A.y, B.y));
+        hi = V2(max(A.x, B.x), max(A.y, B.y));
+    }
+    void visit(const ObjRectangle& r) override { box(r.P1_, r.P2_); }
+    void visit(const ObjSegment& s) override   { box(s.P1_, s.P2_); }
+    void visit(const ObjCircle& c) override
+    {
+        float r = c.radius_;
+        lo = V2((int)floor(c.center_.x - r), (int)floor(c.center_.y - r));
+        hi = V2((int)ceil(c.center_.x + r), (int)ceil(c.center_.y + r));
+    }
+    void visit(const ObjPolygon& p) override
+    {
+        lo = V2(1, 1);
+        hi = V2(0, 0);
+        for (size_t k = 0; k < p.pts_.size(); k++)
+        {
+            if (k == 0) { lo = hi = p.pts_[0]; continue; }
+            lo = V2(min(lo.x, p.pts_[k].x), min(lo.y, p.pts_[k].y));
+            hi = V2(max(hi.x, p.pts_[k].x), max(hi.y, p.pts_[k].y));
+        }
+    }
+};
+
+// the object list as scene.txt was written before SceneStore: a stream,
+// a cast per object
+static void writeObjects(ostream& os, const vector< shared_ptr<ObjGeom> >& objects)
+{
+    os << objects.size() << "\n";
+    for (auto& obj : objects)
+    {
+        const ObjAttr& a = obj->drawInfo_;
+        ostringstream attr;
+        attr << a.borderColor_.R << " " << a.borderColor_.G << " " << a.borderColor_.B << " "
+             << a.interiorColor_.R << " " << a.interiorColor_.G << " " << a.interiorColor_.B << " "
+             << a.thickness_ << " " << (a.isFilled_ ? 1 : 0);
+
+        if (auto r = dynamic_pointer_cast<ObjRectangle>(obj))
+            os << "RECT " << r->P1_.x << " " << r->P1_.y << " " << r->P2_.x << " " << r->P2_.y << " " << attr.str() << "\n";
+        else if (auto s = dynamic_pointer_cast<ObjSegment>(obj))
+            os << "SEG " << s->P1_.x << " " << s->P1_.y << " " << s->P2_.x << " " << s->P2_.y << " " << attr.str() << "\n";
+        else if (auto c = dynamic_pointer_cast<ObjCircle>(obj))
+            os << "CIRC " << c->center_.x << " " << c->center_.y << " " << c->radius_ << " " << attr.str() << "\n";
+        else if (auto p = dynamic_pointer_cast<ObjPolygon>(obj))
+        {
+            os << "POLY " << p->pts_.size();
+            for (auto& pt : p->pts_) os << " " << pt.x << " " << pt.y;
+            os << " " << attr.str() << "\n";
+        }
+    }
+}
+
+// and read back the same way, one make_shared per line
+static void readObjects(istream& is, vector< shared_ptr<ObjGeom> >& objects)
+{
+    size_t n = 0;
+    is >> n;
+    objects.clear();
+    for (size_t i = 0; i < n; i++)
+    {
+        string type;
+        is >> type;
+        V2 p1, p2;
+        float r = 0;
+        vector<V2> pts;
+        if (type == "RECT" || type == "SEG") is >> p1.x >> p1.y >> p2.x >> p2.y;
+        else if (type == "CIRC") is >> p1.x >> p1.y >> r;
+        else if (type == "POLY")
+        {
+            int m = 0;
+            is >> m;
+            pts.resize(m);
+            for (V2& pt : pts) is >> pt.x >> pt.y;
+        }
+        Color border, fill;
+        int thick = 1, filled = 0;
+        is >> border.R >> border.G >> border.B >> fill.R >> fill.G >> fill.B >> thick >> filled;
+        ObjAttr A(border, filled != 0, fill, thick);
+
+        if (type == "RECT") objects.push_back(make_shared<ObjRectangle>(A, p1, p2));
+        else if (type == "SEG") objects.push_back(make_shared<ObjSegment>(A, p1, p2));
+        else if (type == "CIRC")
+        {
+            auto c = make_shared<ObjCircle>(A, p1, p1);
+            c->radius_ = r;
+            objects.push_back(c);
+        }
+        else
+        {
+            auto p = make_shared<ObjPolygon>(A);
+            p->pts_ = pts;
+            objects.push_back(p);
+        }
+    }
+}
+
+// the same scene as the object list of the Model (LObjets) and as a
+// SceneStore: a pass over the geometry of every shape, writing scene.txt,
+// reading it back
+BENCH(sceneLayouts)
+{
+    const int n = 200000, runs = 3;
+    SceneStore S = randomScene(n);
+    vector< shared_ptr<ObjGeom> > objects;
+    for (int i = 0; i < n; i++) objects.push_back(S.makeObject(i));
+
+    double areaObjects = 0, areaStore = 0;
+    double iterObjects = bestMs(runs, [&]
+    {
+        BoxVisitor V;
+        areaObjects = 0;
+        for (auto& obj : objects)
+        {
+            obj->accept(V);
+            areaObjects += (V.hi.x - V.lo.x) * (double)(V.hi.y - V.lo.y);
+        }
+    });
+    double iterStore = bestMs(runs, [&]
+    {
+        V2 lo, hi;
+        areaStore = 0;
+        for (int i = 0; i < S.size(); i++)
+        {
+            S.bounds(i, lo, hi);
+            areaStore += (hi.x - lo.x) * (double)(hi.y - lo.y);
+        }
+    });
+    CHECK(areaObjects == areaStore);
+
+    string textObjects, textStore;
+    double writeObjectsMs = bestMs(runs, [&]
+    {
+        ostringstream os;
+        writeObjects(os, objects);
+        textObjects = os.str();
+    });
+    double writeStore = bestMs(runs, [&]
+    {
+        ostringstream os;
+        S.write(os);
+        textStore = os.str();
+    });
+
+    double readObjectsMs = bestMs(runs, [&]
+    {
+        istringstream is(textObjects);
+        vector< shared_ptr<ObjGeom> > R;
+        readObjects(is, R);
+        CHECK((int)R.size() == n);
+    });
+    double parseStore = bestMs(runs, [&]
+    {
+        SceneStore P;
+        SceneStore::ParseError E;
+        CHECK(P.parse(textStore, E));
+        CHECK(P.size() == n);
+    });
+    double parseToObjects = bestMs(runs, [&]
+    {
+        SceneStore P;
+        SceneStore::ParseError E;
+        CHECK(P.parse(textStore, E));
+        vector< shared_ptr<ObjGeom> > R;
+        R.reserve(P.size());
+        for (int i = 0; i < P.size(); i++) R.push_back(P.makeObject(i));
+    });
+
+    cout << "  " << n << " shapes, objects / store: iterate " << iterObjects << " / " << iterStore
+         << " ms (x" << iterObjects / iterStore << "), write " << writeObjectsMs << " / " << writeStore
+         << " ms (x" << writeObjectsMs / writeStore << "), read " << readObjectsMs << " / " << parseStore
+         << " ms (x" << readObjectsMs / parseStore << "), parsed into objects " << parseToObjects << " ms" << endl;
+}
@@ -0,0 +1,113 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "ShapePool.h"
+#include <new>
+
+using namespace std;
+
+// blocks keep the alignment of operator new
+size_t ShapePool::roundUp(size_t size)
+{
+    if (size < sizeof(FreeBlock)) size = sizeof(FreeBlock);
+    return (size + Align - 1) / Align * Align;
+}
+
+void ShapePool::grow(SizeClass& C, size_t blockSize)
+{
+    size_t n = C.nextChunkBlocks;
+    if (C.nextChunkBlocks < 4096) C.nextChunkBlocks *= 2;
+
+    char* chunk = new char[n * blockSize];
+    C.chunks.emplace_back(chunk);
+    C.stats.chunks++;
+    C.stats.bytes += n * blockSize;
+
+    C.fresh = chunk;
+    C.freshEnd = chunk + n * blockSize;
+}
+
+void* ShapePool::allocate(size_t size)
+{
+    size_t blockSize = roundUp(size);
+    if (blockSize > MaxBlock) return ::operator new(size);
+
+    SizeClass& C = classes_[blockSize / Align - 1];
+
+    // the blocks released by other threads, all at once
+    if (!C.freeList && C.remote.load(memory_order_relaxed))
+        C.freeList = C.remote.exchange(nullptr, memory_order_acquire);
+
+    void* p;
+    if (C.freeList)
+    {
+        p = C.freeList;
+        C.freeList = C.freeList->next;
+        C.stats.recycled++;
+    }
+    else
+    {
+        if (C.fresh == C.freshEnd) grow(C, blockSize);
+        p = C.fresh;
+        C.fresh += blockSize;
+    }
+
+    C.stats.allocations++;
+    C.stats.live++;
+    return p;
+}
+
+void ShapePool::deallocate(void* p, size_t size)
+{
+    size_t blockSize = roundUp(size);
+    if (blockSize > MaxBlock) { ::operator delete(p); return; }
+
+    SizeClass& C = classes_[blockSize / Align - 1];
+    FreeBlock* B = (FreeBlock*)p;
+
+    if (this_thread::get_id() == owner_)
+    {
+        B->next = C.freeList;
+        C.freeList = B;
+        C.stats.frees++;
+        C.stats.live--;
+        return;
+    }
+
+    // pushed only, taken as a whole list: no ABA
+    B->next = C.remote.load(memory_order_relaxed);
+    while (!C.remote.compare_exchange_weak(B->next, B, memory_order_release, memory_order_relaxed)) {}
+    C.remoteFrees.fetch_add(1, memory_order_relaxed);
+}
+
+// STATS /////////////////////////////////////////////////////////
+
+ShapePool::Stats ShapePool::stats() const
+{
+    Stats S;
+    for (const SizeClass& C : classes_)
+    {
+        size_t remote = C.remoteFrees.load(memory_order_relaxed);
+        S.allocations += C.stats.allocations;
+        S.recycled    += C.stats.recycled;
+        S.frees       += C.stats.frees + remote;
+        S.chunks      += C.stats.chunks;
+        S.bytes       += C.stats.bytes;
+        S.live        += C.stats.live - remote;
+    }
+    return S;
+}
+
+void ShapePool::printStats(ostream& os) const
+{
+    for (size_t k = 0; k < MaxBlock / Align; k++)
+    {
+        const SizeClass& C = classes_[k];
+        if (!C.stats.allocations) continue;
+        os << "  pool class " << (k + 1) * Align << " B : "
+           << C.stats.live - C.remoteFrees.load(memory_order_relaxed) << " live, "
+           << C.stats.allocations << " allocs ("
+           << C.stats.recycled << " recycled), "
+           << C.stats.chunks << " chunks, "
+           << C.stats.bytes / 1024 << " KB" << endl;
+    }
+}
@@ -0,0 +1,105 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <iostream>
+#include <cstddef>
+using namespace std;
+
+/*
+ Memory pool for scene objects.
+ Blocks are grouped by size class (one class per shape type, as seen
+ through allocate_shared: object + control block + allocator).
+ Each class takes its blocks from chunks allocated in bulk, and freed
+ blocks go to a free list, so a scene rebuilt after undo or load reuses
+ the memory of the objects it replaces.
+ No lock: the pool belongs to the thread that creates it (the UI), the
+ only one that allocates. Blocks released by another thread (the last
+ reference to a shape dropped by the autosave) are pushed on an atomic
+ list of their class, taken back by the owner when its free list is empty.
+*/
+class ShapePool
+{
+public:
+    struct Stats
+    {
+        size_t allocations = 0;   // blocks handed out
+        size_t recycled    = 0;   // ... of which came from a free list
+        size_t frees       = 0;
+        size_t chunks      = 0;   // bulk allocations from the system
+        size_t bytes       = 0;   // total size of the chunks
+        size_t live        = 0;   // blocks currently in use
+    };
+
+    ShapePool() : owner_(this_thread::get_id()) {}
+    ShapePool(const ShapePool&) = delete;
+    ShapePool& operator = (const ShapePool&) = delete;
+
+    void* allocate(size_t size);               // owner thread only
+    void  deallocate(void* p, size_t size);    // any thread
+
+    // owner thread only
+    Stats stats() const;
+    void  printStats(ostream& os) const;
+
+private:
+    // larger requests go to the global operator new
+    static const size_t MaxBlock = 512;
+    static const size_t Align = alignof(max_align_t);
+
+    struct FreeBlock { FreeBlock* next; };
+
+    struct SizeClass
+    {
+        size_t nextChunkBlocks = 64;   // doubles up to 4096
+        FreeBlock* freeList = nullptr; // released by the owner
+        atomic<FreeBlock*> remote{ nullptr };   // released by other threads
+        atomic<size_t> remoteFrees{ 0 };
+        char* fresh    = nullptr;      // never used part of the last chunk
+        char* freshEnd = nullptr;
+        vector< unique_ptr<char[]> > chunks;
+        Stats stats;                   // frees and live without remoteFrees
+    };
+
+    // class k holds the blocks of (k + 1) * Align bytes
+    SizeClass classes_[MaxBlock / Align];
+    thread::id owner_;
+
+    static size_t roundUp(size_t size);
+    void grow(SizeClass& C, size_t blockSize);
+};
+
+// std allocator forwarding to a ShapePool, for allocate_shared
+// (the allocator copy kept in the control block keeps the pool alive)
+template <class T>
+struct PoolAllocator
+{
+    typedef T value_type;
+
+    shared_ptr<ShapePool> pool_;
+
+    PoolAllocator(const shared_ptr<ShapePool>& pool) : pool_(pool) {}
+
+    template <class U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool_(other.pool_) {}
+
+    T* allocate(size_t n)            { return (T*)pool_->allocate(n * sizeof(T)); }
+    void deallocate(T* p, size_t n)  { pool_->deallocate(p, n * sizeof(T)); }
+};
+
+template <class T, class U>
+bool operator == (const PoolAllocator<T>& a, const PoolAllocator<U>& b) { return a.pool_ == b.pool_; }
+
+template <class T, class U>
+bool operator != (const PoolAllocator<T>& a, const PoolAllocator<U>& b) { return a.pool_ != b.pool_; }
+
+// create a shape in the pool (or with make_shared if there is no pool)
+template <class T, class... Args>
+shared_ptr<T> allocateShape(const shared_ptr<ShapePool>& pool, Args&&... args)
+{
+    if (!pool) return make_shared<T>(std::forward<Args>(args)...);
+    return allocate_shared<T>(PoolAllocator<T>(pool), std::forward<Args>(args)...);
+}
@@ -0,0 +1,107 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Test.h"
+#include "ObjGeom.h"
+#include "ShapePool.h"
+#include "SceneStore.h"
+#include "Model.h"
+#include <thread>
+#include <algorithm>
+
+using namespace std;
+
+// a scene of n shapes of the four kinds, as Load or Undo rebuild it
+static void buildScene(vector< shared_ptr<ObjGeom> >& scene, int n, const shared_ptr<ShapePool>& pool)
+{
+    ObjAttr A;
+    scene.reserve(n);
+    for (int i = 0; i < n; i++)
+    {
+        V2 P(i % 1000, i / 1000), Q = P + V2(10, 7);
+        switch (i % 4)
+        {
+        case 0: scene.push_back(allocateShape<ObjRectangle>(pool, A, P, Q)); break;
+        case 1: scene.push_back(allocateShape<ObjSegment>(pool, A, P, Q)); break;
+        case 2: scene.push_back(allocateShape<ObjCircle>(pool, A, P, Q)); break;
+        case 3:
+        {
+            auto poly = allocateShape<ObjPolygon>(pool, A);
+            poly->addPoint(P);
+            poly->addPoint(Q);
+            scene.push_back(poly);
+            break;
+        }
+        }
+    }
+}
+
+// blocks freed by another thread go back to their class
+TEST(shapePoolRemoteFree)
+{
+    auto pool = make_shared<ShapePool>();
+    vector< shared_ptr<ObjGeom> > scene;
+    buildScene(scene, 1000, pool);
+    CHECK(pool->stats().live == 1000);
+
+    thread([&] { scene.clear(); }).join();
+    CHECK(pool->stats().live == 0);
+
+    buildScene(scene, 1000, pool);
+    ShapePool::Stats S = pool->stats();
+    CHECK(S.live == 1000);
+    CHECK(S.recycled == 1000);
+}
+
+// a 200k object Model, with and without its pool: Load of the scene
+// (whole scene replaced, recorded as in bntToolLoadClick), then undo / redo
+// of an action that reshaped every object (each step clones them all)
+BENCH(shapePool)
+{
+    const int n = 200000, rounds = 5;
+
+    vector< shared_ptr<ObjGeom> > objects;
+    buildScene(objects, n, nullptr);
+    SceneStore S;
+    S.build(objects);
+    objects.clear();
+
+    for (int usePool = 0; usePool < 2; usePool++)
+    {
+        Model Data;
+        if (!usePool) Data.shapePool = nullptr;
+        Data.history.budgetBytes = (size_t)1 << 30;     // no spill file
+
+        double load = bestMs(rounds, [&]
+        {
+            Data.history.clear();
+            Data.history.beginScene(Data);
+            Data.clearObjects();
+            Data.LObjets.reserve(n);
+            for (int i = 0; i < n; i++)
+                Data.addObject(S.makeObject(i, Data.shapePool));
+            Data.history.commitScene(Data);
+        });
+        REQUIRE((int)Data.LObjets.size() == n);
+
+        Data.history.begin();
+        for (auto& obj : vector< shared_ptr<ObjGeom> >(Data.LObjets))
+        {
+            int id = obj->id_;
+            shared_ptr<ObjGeom> before = obj->clone(Data.shapePool);
+            Data.editObject(id)->moveBy(V2(1, 1));
+            Data.history.reshaped(Data, id, before);
+        }
+        Data.history.commit();
+
+        double undo = 1e30, redo = 1e30;
+        for (int r = 0; r < rounds; r++)
+        {
+            undo = min(undo, bestMs(1, [&] { CHECK(Data.history.undo(Data)); }));
+            redo = min(redo, bestMs(1, [&] { CHECK(Data.history.redo(Data)); }));
+        }
+
+        cout << "  " << (usePool ? "pool       " : "make_shared") << " : load " << load << " ms, undo "
+             << undo << " ms, redo " << redo << " ms (" << n << " objects)" << endl;
+        if (usePool) Data.shapePool->printStats(cout);
+    }
+}
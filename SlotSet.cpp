@@ -0,0 +1,128 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "SlotSet.h"
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+static int lowestBit(uint64_t w)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, w);
+    return (int)i;
+#else
+    return __builtin_ctzll(w);
+#endif
+}
+
+static int highestBit(uint64_t w)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse64(&i, w);
+    return (int)i;
+#else
+    return 63 - __builtin_clzll(w);
+#endif
+}
+
+void SlotSet::clear()
+{
+    levels_.clear();
+    capacity_ = 0;
+}
+
+void SlotSet::reserve(int slots)
+{
+    if (slots <= capacity_) return;
+
+    // doubled: growing one slot at a time stays O(1) amortized
+    capacity_ = max(slots, 2 * capacity_);
+    if (levels_.empty()) levels_.emplace_back();
+    levels_[0].resize((capacity_ + 63) / 64, 0);
+    rebuild();
+}
+
+void SlotSet::rebuild()
+{
+    levels_.resize(1);
+    while (levels_.back().size() > 1)
+    {
+        const vector<uint64_t>& below = levels_.back();
+        vector<uint64_t> level((below.size() + 63) / 64, 0);
+        for (size_t w = 0; w < below.size(); w++)
+            if (below[w]) level[w / 64] |= uint64_t(1) << (w % 64);
+        levels_.push_back(move(level));
+    }
+}
+
+void SlotSet::set(int slot, bool on)
+{
+    size_t i = slot;
+    for (auto& level : levels_)
+    {
+        uint64_t& word = level[i / 64];
+        bool was = word != 0;
+        if (on) word |= uint64_t(1) << (i % 64);
+        else    word &= ~(uint64_t(1) << (i % 64));
+
+        // the level above only changes when the word becomes (non) empty
+        if ((word != 0) == was) return;
+        i /= 64;
+    }
+}
+
+bool SlotSet::has(int slot) const
+{
+    return slot >= 0 && slot < capacity_ && (levels_[0][slot / 64] >> (slot % 64) & 1);
+}
+
+int SlotSet::next(int slot) const
+{
+    size_t i = slot < 0 ? 0 : (size_t)slot + 1;
+    for (size_t k = 0; k < levels_.size(); k++)
+    {
+        const vector<uint64_t>& level = levels_[k];
+        size_t w = i / 64;
+        if (w >= level.size()) return -1;
+
+        uint64_t bits = level[w] & (~uint64_t(0) << (i % 64));
+        if (bits)
+        {
+            i = w * 64 + lowestBit(bits);
+            for (size_t d = k; d > 0; d--)
+                i = i * 64 + lowestBit(levels_[d - 1][i]);
+            return (int)i;
+        }
+        i = w + 1;
+    }
+    return -1;
+}
+
+int SlotSet::prev(int slot) const
+{
+    if (slot <= 0 || capacity_ == 0) return -1;
+    size_t i = min(slot - 1, capacity_ - 1);
+    for (size_t k = 0; k < levels_.size(); k++)
+    {
+        const vector<uint64_t>& level = levels_[k];
+        size_t w = i / 64;
+        uint64_t mask = (i % 64 == 63) ? ~uint64_t(0) : (uint64_t(1) << (i % 64 + 1)) - 1;
+
+        uint64_t bits = level[w] & mask;
+        if (bits)
+        {
+            i = w * 64 + highestBit(bits);
+            for (size_t d = k; d > 0; d--)
+                i = i * 64 + highestBit(levels_[d - 1][i]);
+            return (int)i;
+        }
+        if (w == 0) return -1;
+        i = w - 1;
+    }
+    return -1;
+}
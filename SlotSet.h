@@ -0,0 +1,32 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+/*
+ Set of slot numbers, to find the next or previous used slot of a list
+ with holes without walking over the holes.
+ One bit per slot, then one bit per non-empty word of the level below,
+ up to a single word: next and prev go up while the words are empty and
+ back down along the first (last) set bits, O(log64 n).
+*/
+class SlotSet
+{
+public:
+    void clear();
+    void reserve(int slots);          // set() accepts slots below this count
+
+    void set(int slot, bool on);
+    bool has(int slot) const;
+
+    int next(int slot) const;         // smallest slot > slot in the set, -1 if none
+    int prev(int slot) const;         // largest slot < slot in the set, -1 if none
+
+private:
+    vector< vector<uint64_t> > levels_;   // levels_[0]: one bit per slot
+    int capacity_ = 0;                    // slots covered by levels_[0]
+
+    void rebuild();                       // levels above 0, from levels_[0]
+};
@@ -0,0 +1,239 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "SvgExport.h"
+#include <fstream>
+#include <charconv>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+
+SvgWriter::SvgWriter(ostream& out, V2 size) : out_(out), height_((float)size.y), buf_(BufferSize)
+{
+    put("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"");
+    put(size.x);
+    put("\" height=\"");
+    put(size.y);
+    put("\" viewBox=\"0 0 ");
+    put(size.x);
+    put(" ");
+    put(size.y);
+    put("\">\n");
+
+    // the window is cleared in black (SvgImport skips this rectangle)
+    put("<rect id=\"background\" width=\"100%\" height=\"100%\" fill=\"#000000\"/>\n");
+}
+
+SvgWriter::~SvgWriter()
+{
+    finish();
+}
+
+bool SvgWriter::finish()
+{
+    if (!done_)
+    {
+        if (open_) put("</g>\n");
+        put("</svg>\n");
+        open_ = false;
+        done_ = true;
+    }
+    flush();
+    out_.flush();
+    return (bool)out_;
+}
+
+// WRITING /////////////////////////////////////////////////////////
+
+void SvgWriter::flush()
+{
+    out_.write(buf_.data(), used_);
+    bytes_ += used_;
+    used_ = 0;
+}
+
+void SvgWriter::put(const char* s, size_t n)
+{
+    if (used_ + n > buf_.size())
+    {
+        flush();
+        if (n > buf_.size()) { out_.write(s, n); bytes_ += n; return; }
+    }
+    memcpy(buf_.data() + used_, s, n);
+    used_ += n;
+}
+
+void SvgWriter::put(const char* s)
+{
+    put(s, strlen(s));
+}
+
+// shortest text that reads back to the same value
+void SvgWriter::put(float v)
+{
+    char tmp[32];
+    put(tmp, to_chars(tmp, tmp + sizeof(tmp), v).ptr - tmp);
+}
+
+void SvgWriter::put(int v)
+{
+    char tmp[16];
+    put(tmp, to_chars(tmp, tmp + sizeof(tmp), v).ptr - tmp);
+}
+
+// STYLE ///////////////////////////////////////////////////////////
+
+static int to8(float c)
+{
+    int v = (int)lround(c * 255);
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static uint32_t rgba8(const Color& c)
+{
+    return (uint32_t)to8(c.R) << 24 | (uint32_t)to8(c.G) << 16 | (uint32_t)to8(c.B) << 8 | (uint32_t)to8(c.A);
+}
+
+// "#rrggbb", the alpha is written apart
+void SvgWriter::putColor(uint32_t rgba)
+{
+    static const char hex[] = "0123456789abcdef";
+    char tmp[7] = { '#' };
+    for (int i = 0; i < 6; i++)
+        tmp[1 + i] = hex[(rgba >> (28 - 4 * i)) & 15];
+    put(tmp, 7);
+}
+
+// opens a new <g> when the attributes differ from the current one
+void SvgWriter::use(const ObjAttr& A, bool filled)
+{
+    Style S;
+    S.stroke = rgba8(A.borderColor_);
+    S.width = A.thickness_;
+    S.filled = filled;
+    if (filled) S.fill = rgba8(A.interiorColor_);
+
+    if (open_ && S == style_) return;
+
+    if (open_) put("</g>\n");
+    style_ = S;
+    open_ = true;
+    groups_++;
+
+    char tmp[32];
+    put("<g stroke=\"");
+    putColor(S.stroke);
+    if ((S.stroke & 255) != 255)
+    {
+        put("\" stroke-opacity=\"");
+        put(tmp, to_chars(tmp, tmp + sizeof(tmp), (S.stroke & 255) / 255.0f, chars_format::general, 3).ptr - tmp);
+    }
+    put("\" stroke-width=\"");
+    put(S.width);
+    if (!filled)
+        put("\" fill=\"none");
+    else
+    {
+        put("\" fill=\"");
+        putColor(S.fill);
+        if ((S.fill & 255) != 255)
+        {
+            put("\" fill-opacity=\"");
+            put(tmp, to_chars(tmp, tmp + sizeof(tmp), (S.fill & 255) / 255.0f, chars_format::general, 3).ptr - tmp);
+        }
+    }
+    put("\">\n");
+}
+
+// SHAPES //////////////////////////////////////////////////////////
+
+void SvgWriter::visit(const ObjRectangle& R)
+{
+    V2 P, size;
+    getPLH(R.P1_, R.P2_, P, size);
+
+    use(R.drawInfo_, R.drawInfo_.isFilled_);
+    put("<rect x=\"");
+    put(P.x);
+    put("\" y=\"");
+    putY((float)(P.y + size.y));
+    put("\" width=\"");
+    put(size.x);
+    put("\" height=\"");
+    put(size.y);
+    put("\"/>\n");
+    shapes_++;
+}
+
+void SvgWriter::visit(const ObjSegment& S)
+{
+    use(S.drawInfo_, false);
+    put("<line x1=\"");
+    put(S.P1_.x);
+    put("\" y1=\"");
+    putY(S.P1_.y);
+    put("\" x2=\"");
+    put(S.P2_.x);
+    put("\" y2=\"");
+    putY(S.P2_.y);
+    put("\"/>\n");
+    shapes_++;
+}
+
+void SvgWriter::visit(const ObjCircle& C)
+{
+    use(C.drawInfo_, C.drawInfo_.isFilled_);
+    put("<circle cx=\"");
+    put(C.center_.x);
+    put("\" cy=\"");
+    putY(C.center_.y);
+    put("\" r=\"");
+    put(C.radius_);
+    put("\"/>\n");
+    shapes_++;
+}
+
+// open: the last point is not joined to the first one (see ObjPolygon::draw)
+void SvgWriter::visit(const ObjPolygon& P)
+{
+    if (P.pts_.size() < 2) return;
+
+    use(P.drawInfo_, false);
+    put("<polyline points=\"");
+    for (size_t i = 0; i < P.pts_.size(); i++)
+    {
+        if (i) put(" ");
+        put(P.pts_[i].x);
+        put(",");
+        putY(P.pts_[i].y);
+    }
+    put("\"/>\n");
+    shapes_++;
+}
+
+// FILE ////////////////////////////////////////////////////////////
+
+bool exportSvg(const string& path, const vector<shared_ptr<ObjGeom>>& objects, V2 size,
+               string& error, size_t* bytes, int* groups)
+{
+    ofstream F(path, ios::binary | ios::trunc);
+    if (!F)
+    {
+        error = "cannot create " + path;
+        return false;
+    }
+
+    SvgWriter W(F, size);
+    for (const auto& O : objects)
+        if (O) W.write(*O);
+
+    if (!W.finish())
+    {
+        error = "cannot write " + path;
+        return false;
+    }
+    if (bytes) *bytes = W.bytes();
+    if (groups) *groups = W.groups();
+    return true;
+}
@@ -0,0 +1,87 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "ObjGeom.h"
+#include <ostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+using namespace std;
+
+/*
+ SVG export of the shapes, written as they are visited.
+ The text goes through a fixed buffer to the stream: memory does not grow
+ with the scene, a million objects are written like ten.
+ Consecutive shapes with the same stroke, width and fill share one <g>
+ holding these attributes, each element only has its geometry.
+ The picture is the one of the window: black background (a rect with
+ id="background"), y axis going down (SVG) instead of up (OpenGL),
+ polygons drawn as open polylines.
+*/
+class SvgWriter : public ShapeVisitor
+{
+public:
+    SvgWriter(ostream& out, V2 size);
+    ~SvgWriter();                        // finish
+
+    SvgWriter(const SvgWriter&) = delete;
+    SvgWriter& operator = (const SvgWriter&) = delete;
+
+    void write(const ObjGeom& obj) { obj.accept(*this); }
+
+    // closes the document and flushes the buffer; false if the stream failed
+    bool finish();
+
+    size_t bytes() const  { return bytes_ + used_; }
+    int    groups() const { return groups_; }
+    int    shapes() const { return shapes_; }
+
+    void visit(const ObjRectangle& R) override;
+    void visit(const ObjSegment& S) override;
+    void visit(const ObjCircle& C) override;
+    void visit(const ObjPolygon& P) override;
+
+private:
+    static const size_t BufferSize = 1 << 16;
+
+    // attributes of a <g>: colors as RGBA 8 bits, fill 0 for none
+    struct Style
+    {
+        uint32_t stroke = 0;
+        uint32_t fill = 0;
+        int      width = 0;
+        bool     filled = false;
+
+        bool operator == (const Style& o) const
+        {
+            return stroke == o.stroke && fill == o.fill && width == o.width && filled == o.filled;
+        }
+    };
+
+    ostream& out_;
+    float height_;
+    vector<char> buf_;
+    size_t used_ = 0;
+    size_t bytes_ = 0;      // already flushed
+    bool open_ = false;     // a <g> is open
+    bool done_ = false;
+    Style style_;
+    int groups_ = 0;
+    int shapes_ = 0;
+
+    void flush();
+    void put(const char* s, size_t n);
+    void put(const char* s);
+    void put(float v);
+    void put(int v);
+    void putColor(uint32_t rgba);
+    void putY(float y) { put(height_ - y); }
+
+    void use(const ObjAttr& A, bool filled);
+};
+
+// exports the objects (nullptr slots skipped) to path;
+// bytes / groups are set when the file is written
+bool exportSvg(const string& path, const vector<shared_ptr<ObjGeom>>& objects, V2 size,
+               string& error, size_t* bytes = nullptr, int* groups = nullptr);
@@ -0,0 +1,1016 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "SvgImport.h"
+#include <fstream>
+#include <charconv>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+static const size_t ChunkSize = 1 << 16;
+static const int    MaxSegments = 4096;    // per curve
+static const double Pi = 3.14159265358979323846;
+
+// TEXT ////////////////////////////////////////////////////////////
+
+static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+static string_view trim(string_view s)
+{
+    while (!s.empty() && isSpace(s.front())) s.remove_prefix(1);
+    while (!s.empty() && isSpace(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+static void skipSep(const char*& p, const char* e)
+{
+    while (p < e && (isSpace(*p) || *p == ',')) p++;
+}
+
+// SVG numbers: "10-20.5.5e3" is 10, -20.5, .5e3
+static bool number(const char*& p, const char* e, float& v)
+{
+    skipSep(p, e);
+    if (p < e && *p == '+') p++;
+    auto r = from_chars(p, e, v);
+    if (r.ec != errc()) return false;
+    p = r.ptr;
+    return true;
+}
+
+// arc flags may be written without separator: "a10 10 0 0120 20"
+static bool flag(const char*& p, const char* e, bool& v)
+{
+    skipSep(p, e);
+    if (p == e || (*p != '0' && *p != '1')) return false;
+    v = *p++ == '1';
+    return true;
+}
+
+// number with a unit, in pixels; ref is 100% (0: % not allowed)
+static float length(string_view s, float ref, float def = 0)
+{
+    const char* p = s.data();
+    const char* e = p + s.size();
+    float v;
+    if (!number(p, e, v)) return def;
+
+    string_view u = trim(string_view(p, e - p));
+    if (u.empty() || u == "px") return v;
+    if (u == "%")  return ref > 0 ? v * ref / 100 : def;
+    if (u == "mm") return v * 96 / 25.4f;
+    if (u == "cm") return v * 96 / 2.54f;
+    if (u == "in") return v * 96;
+    if (u == "pt") return v * 96 / 72;
+    if (u == "pc") return v * 16;
+    return v;
+}
+
+// COLORS //////////////////////////////////////////////////////////
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool namedColor(string_view s, Color& c)
+{
+    static const struct { const char* name; int hex; } names[] =
+    {
+        { "black", 0x000000 },  { "white", 0xffffff },  { "red", 0xff0000 },
+        { "lime", 0x00ff00 },   { "green", 0x008000 },  { "blue", 0x0000ff },
+        { "yellow", 0xffff00 }, { "cyan", 0x00ffff },   { "aqua", 0x00ffff },
+        { "magenta", 0xff00ff },{ "fuchsia", 0xff00ff },{ "gray", 0x808080 },
+        { "grey", 0x808080 },   { "silver", 0xc0c0c0 }, { "maroon", 0x800000 },
+        { "olive", 0x808000 },  { "navy", 0x000080 },   { "purple", 0x800080 },
+        { "teal", 0x008080 },   { "orange", 0xffa500 },
+    };
+    for (auto& n : names)
+        if (s == n.name) { c = ColorFromHex(n.hex); return true; }
+    return false;
+}
+
+// false: not understood, the inherited paint is kept
+static bool paint(string_view s, float& alpha, bool& none, Color& c)
+{
+    s = trim(s);
+    alpha = 1;
+
+    if (s == "none" || s == "transparent") { none = true; return true; }
+
+    // gradient or pattern: its fallback color, else gray
+    if (s.substr(0, 4) == "url(")
+    {
+        size_t close = s.find(')');
+        string_view fallback = close == string_view::npos ? string_view() : trim(s.substr(close + 1));
+        if (fallback.empty() || !paint(fallback, alpha, none, c))
+        {
+            none = false;
+            c = Color::Gray;
+        }
+        return true;
+    }
+
+    if (!s.empty() && s[0] == '#')
+    {
+        int d[6];
+        size_t n = s.size() - 1;
+        if (n != 3 && n != 6) return false;
+        for (size_t i = 0; i < n; i++)
+            if ((d[i] = hexDigit(s[1 + i])) < 0) return false;
+        if (n == 3) c = ColorFrom255(d[0] * 17, d[1] * 17, d[2] * 17);
+        else        c = ColorFrom255(d[0] * 16 + d[1], d[2] * 16 + d[3], d[4] * 16 + d[5]);
+        none = false;
+        return true;
+    }
+
+    if (s.substr(0, 4) == "rgb(" || s.substr(0, 5) == "rgba(")
+    {
+        const char* p = s.data() + s.find('(') + 1;
+        const char* e = s.data() + s.size();
+        float v[4] = { 0, 0, 0, 1 };
+        for (int i = 0; i < 4; i++)
+        {
+            skipSep(p, e);
+            if (p < e && *p == ')') break;
+            if (!number(p, e, v[i])) return false;
+            if (p < e && *p == '%') { v[i] = i < 3 ? v[i] * 2.55f : v[i] / 100; p++; }
+        }
+        c = ColorFrom255((int)lround(v[0]), (int)lround(v[1]), (int)lround(v[2]));
+        alpha = v[3];
+        none = false;
+        return true;
+    }
+
+    if (namedColor(s, c)) { none = false; return true; }
+    return false;
+}
+
+static Color withAlpha(Color c, float a)
+{
+    c.A = max(0.0f, min(1.0f, a));
+    return c;
+}
+
+// TRANSFORMS //////////////////////////////////////////////////////
+
+// application of N, then M
+template <class Affine>
+static Affine mul(const Affine& M, const Affine& N)
+{
+    Affine R;
+    R.a = M.a * N.a + M.c * N.b;
+    R.b = M.b * N.a + M.d * N.b;
+    R.c = M.a * N.c + M.c * N.d;
+    R.d = M.b * N.c + M.d * N.d;
+    R.e = M.a * N.e + M.c * N.f + M.e;
+    R.f = M.b * N.e + M.d * N.f + M.f;
+    return R;
+}
+
+// "translate(10 20) rotate(45)": T is the product, left to right
+template <class Affine>
+static bool transform(string_view s, Affine& T)
+{
+    const char* p = s.data();
+    const char* e = p + s.size();
+    T = Affine();
+
+    for (;;)
+    {
+        skipSep(p, e);
+        if (p == e) return true;
+
+        const char* name = p;
+        while (p < e && isalpha((unsigned char)*p)) p++;
+        string_view fn(name, p - name);
+        skipSep(p, e);
+        if (p == e || *p != '(') return false;
+        p++;
+
+        float v[6];
+        int n = 0;
+        for (;;)
+        {
+            skipSep(p, e);
+            if (p < e && *p == ')') { p++; break; }
+            if (n == 6 || !number(p, e, v[n])) return false;
+            n++;
+        }
+
+        Affine N;
+        if (fn == "matrix" && n == 6)
+        {
+            N.a = v[0]; N.b = v[1]; N.c = v[2]; N.d = v[3]; N.e = v[4]; N.f = v[5];
+        }
+        else if (fn == "translate" && (n == 1 || n == 2))
+        {
+            N.e = v[0];
+            N.f = n == 2 ? v[1] : 0;
+        }
+        else if (fn == "scale" && (n == 1 || n == 2))
+        {
+            N.a = v[0];
+            N.d = n == 2 ? v[1] : v[0];
+        }
+        else if (fn == "rotate" && (n == 1 || n == 3))
+        {
+            float r = (float)(v[0] * Pi / 180);
+            N.a = cos(r); N.b = sin(r); N.c = -N.b; N.d = N.a;
+            if (n == 3)
+            {
+                Affine To, Back;
+                To.e = v[1];  To.f = v[2];
+                Back.e = -v[1]; Back.f = -v[2];
+                N = mul(To, mul(N, Back));
+            }
+        }
+        else if (fn == "skewX" && n == 1) N.c = tan((float)(v[0] * Pi / 180));
+        else if (fn == "skewY" && n == 1) N.b = tan((float)(v[0] * Pi / 180));
+        else return false;
+
+        T = mul(T, N);
+    }
+}
+
+template <class Affine>
+static float scaleOf(const Affine& M)        // mean scale, for widths
+{
+    return sqrt(fabs(M.a * M.d - M.b * M.c));
+}
+
+template <class Affine>
+static float maxScaleOf(const Affine& M)     // for the flattening of arcs
+{
+    return sqrt(max(M.a * M.a + M.b * M.b, M.c * M.c + M.d * M.d));
+}
+
+// READING /////////////////////////////////////////////////////////
+
+SvgReader::SvgReader(vector< shared_ptr<ObjGeom> >& out, const shared_ptr<ShapePool>& pool, const Options& O)
+    : out_(out), pool_(pool), opt_(O)
+{
+    opt_.tolerance = max(opt_.tolerance, 0.01f);
+}
+
+// length of the construct starting with '<' at p: tag, comment, CDATA...
+// 0 if it does not end in the n bytes
+static size_t constructEnd(const char* p, size_t n)
+{
+    string_view s(p, n);
+    auto after = [&](const char* what, size_t from) -> size_t
+    {
+        size_t k = s.find(what, from);
+        return k == string_view::npos ? 0 : k + strlen(what);
+    };
+
+    if (n < 2) return 0;
+    if (p[1] == '?') return after("?>", 2);
+    if (p[1] == '!')
+    {
+        if (n < 9) return 0;
+        if (s.substr(0, 4) == "<!--") return after("-->", 4);
+        if (s.substr(0, 9) == "<![CDATA[") return after("]]>", 9);
+    }
+
+    // a '>' in a quoted value, or in the [internal subset] of a DOCTYPE, does not end the tag
+    char quote = 0;
+    int depth = 0;
+    for (size_t i = 1; i < n; i++)
+    {
+        char c = p[i];
+        if (quote) { if (c == quote) quote = 0; }
+        else if (c == '"' || c == '\'') quote = c;
+        else if (c == '[') depth++;
+        else if (c == ']') depth--;
+        else if (c == '>' && depth <= 0) return i + 1;
+    }
+    return 0;
+}
+
+bool SvgReader::read(istream& in, string& error)
+{
+    vector<char> buf(ChunkSize);
+    size_t pos = 0, end = 0;   // bytes not consumed yet
+    int line = 1;              // line of buf[0]
+    bool eof = false;
+
+    // keeps buf[pos, end) and reads until the buffer is full;
+    // the buffer only grows for a tag longer than itself
+    auto fill = [&]() -> bool
+    {
+        if (eof) return false;
+        line += (int)count(buf.data(), buf.data() + pos, '\n');
+        memmove(buf.data(), buf.data() + pos, end - pos);
+        end -= pos;
+        pos = 0;
+        if (end == buf.size()) buf.resize(buf.size() * 2);
+
+        in.read(buf.data() + end, buf.size() - end);
+        size_t got = (size_t)in.gcount();
+        eof = end + got < buf.size();
+        end += got;
+        return got > 0;
+    };
+    auto lineAt = [&](size_t i) { return line + (int)count(buf.data(), buf.data() + i, '\n'); };
+
+    bool sawSvg = false;
+    for (;;)
+    {
+        const char* lt = (const char*)memchr(buf.data() + pos, '<', end - pos);
+        if (!lt)
+        {
+            pos = end;
+            if (!fill()) break;
+            continue;
+        }
+        pos = lt - buf.data();
+
+        size_t n;
+        while ((n = constructEnd(buf.data() + pos, end - pos)) == 0)
+        {
+            if (!fill())
+            {
+                error = "line " + to_string(lineAt(pos)) + ": unterminated tag";
+                return false;
+            }
+        }
+
+        element(string_view(buf.data() + pos, n));
+        sawSvg = sawSvg || inSvg_;
+        pos += n;
+    }
+
+    if (in.bad())
+    {
+        error = "read error";
+        return false;
+    }
+    if (!sawSvg)
+    {
+        error = "no <svg> element";
+        return false;
+    }
+    return true;
+}
+
+// ELEMENTS ////////////////////////////////////////////////////////
+
+string_view SvgReader::attr(string_view name) const
+{
+    for (auto& A : attrs_)
+        if (A.first == name) return A.second;
+    return string_view();
+}
+
+// "<name a="1" b='2'/>"
+void SvgReader::element(string_view tag)
+{
+    if (tag[1] == '!' || tag[1] == '?') return;
+    if (tag[1] == '/') { end(); return; }
+
+    const char* p = tag.data() + 1;
+    const char* e = tag.data() + tag.size() - 1;   // on '>'
+    bool selfClosing = e[-1] == '/';
+    if (selfClosing) e--;
+
+    const char* n0 = p;
+    while (p < e && !isSpace(*p)) p++;
+    string_view name(n0, p - n0);
+    size_t colon = name.find(':');            // svg:rect
+    if (colon != string_view::npos) name.remove_prefix(colon + 1);
+
+    attrs_.clear();
+    for (;;)
+    {
+        while (p < e && isSpace(*p)) p++;
+        if (p >= e) break;
+
+        const char* a0 = p;
+        while (p < e && *p != '=' && !isSpace(*p)) p++;
+        string_view key(a0, p - a0);
+        while (p < e && isSpace(*p)) p++;
+        if (p >= e || *p != '=') continue;    // attribute without value
+        p++;
+        while (p < e && isSpace(*p)) p++;
+        if (p >= e || (*p != '"' && *p != '\'')) break;
+
+        char quote = *p++;
+        const char* v0 = p;
+        while (p < e && *p != quote) p++;
+        attrs_.emplace_back(key, string_view(v0, p - v0));
+        if (p < e) p++;
+    }
+
+    start(name, selfClosing);
+}
+
+void SvgReader::start(string_view name, bool selfClosing)
+{
+    // root: viewport and viewBox give the transform to the scene (y up)
+    if (!inSvg_)
+    {
+        if (name != "svg") return;
+
+        Style S;
+        S.fill.none = false;
+        S.fill.color = Color::Black;
+
+        float W = length(attr("width"), 0);
+        float H = length(attr("height"), 0);
+
+        float vb[4];
+        string_view box = attr("viewBox");
+        const char* p = box.data();
+        const char* e = p + box.size();
+        bool hasBox = !box.empty();
+        for (int i = 0; i < 4 && hasBox; i++) hasBox = number(p, e, vb[i]);
+        hasBox = hasBox && vb[2] > 0 && vb[3] > 0;
+
+        Affine V;
+        if (hasBox)
+        {
+            if (W <= 0 && H <= 0) { W = vb[2]; H = vb[3]; }
+            else if (W <= 0) W = H * vb[2] / vb[3];
+            else if (H <= 0) H = W * vb[3] / vb[2];
+
+            float sx = W / vb[2], sy = H / vb[3];
+            if (attr("preserveAspectRatio").substr(0, 4) != "none")
+                sx = sy = min(sx, sy);
+            V.a = sx;
+            V.d = sy;
+            V.e = (W - vb[2] * sx) / 2 - vb[0] * sx;
+            V.f = (H - vb[3] * sy) / 2 - vb[1] * sy;
+            S.vw = vb[2];
+            S.vh = vb[3];
+        }
+        else
+        {
+            if (H <= 0) H = opt_.height;
+            if (W <= 0) W = H;
+            S.vw = W;
+            S.vh = H;
+        }
+
+        Affine Flip;
+        Flip.d = -1;
+        Flip.f = H;
+        S.M = mul(Flip, V);
+        applyAttributes(S);
+
+        inSvg_ = true;
+        if (!selfClosing) stack_.push_back(S);
+        return;
+    }
+    if (stack_.empty()) return;
+
+    Style S = stack_.back();
+
+    Affine T;
+    string_view t = attr("transform");
+    if (!t.empty() && transform(t, T)) S.M = mul(S.M, T);
+
+    if (name == "svg")
+    {
+        Affine At;
+        At.e = length(attr("x"), S.vw);
+        At.f = length(attr("y"), S.vh);
+        S.M = mul(S.M, At);
+    }
+    applyAttributes(S);
+
+    // never drawn directly
+    static const char* hidden[] =
+    {
+        "defs", "clipPath", "mask", "symbol", "pattern", "marker", "linearGradient",
+        "radialGradient", "filter", "style", "title", "desc", "metadata", "foreignObject",
+    };
+    for (const char* h : hidden)
+        if (name == h) S.hidden = true;
+
+    if (!S.hidden)
+    {
+        // the background written by SvgExport is not a shape of the scene
+        if      (name == "rect")     { if (attr("id") != "background") rect(S); }
+        else if (name == "circle")   circle(S);
+        else if (name == "ellipse")  ellipse(S);
+        else if (name == "line")     line(S);
+        else if (name == "polyline") poly(S, false);
+        else if (name == "polygon")  poly(S, true);
+        else if (name == "path")     path(S);
+        else if (name == "text" || name == "image" || name == "use")
+        {
+            skipped_++;
+            S.hidden = true;   // and the tspan inside
+        }
+    }
+
+    if (!selfClosing) stack_.push_back(S);
+}
+
+void SvgReader::end()
+{
+    if (stack_.empty()) return;
+    stack_.pop_back();
+    if (stack_.empty()) inSvg_ = false;   // end of the root
+}
+
+// ATTRIBUTES //////////////////////////////////////////////////////
+
+void SvgReader::property(Style& S, string_view name, string_view value) const
+{
+    value = trim(value);
+    if (value == "inherit") return;
+
+    float alpha;
+    if (name == "stroke" || name == "fill")
+    {
+        Paint& P = name == "stroke" ? S.stroke : S.fill;
+        Paint Q = P;
+        if (!paint(value, alpha, Q.none, Q.color)) return;
+        P = Q;
+        if (alpha < 1) (name == "stroke" ? S.strokeOpacity : S.fillOpacity) = alpha;
+    }
+    else if (name == "stroke-width")
+        S.strokeWidth = length(value, sqrt((S.vw * S.vw + S.vh * S.vh) / 2), S.strokeWidth);
+    else if (name == "stroke-opacity" || name == "fill-opacity" || name == "opacity")
+    {
+        const char* p = value.data();
+        float v;
+        if (!number(p, value.data() + value.size(), v)) return;
+        if (p < value.data() + value.size() && *p == '%') v /= 100;
+        v = max(0.0f, min(1.0f, v));
+        if (name == "opacity") S.opacity *= v;
+        else (name == "stroke-opacity" ? S.strokeOpacity : S.fillOpacity) = v;
+    }
+    else if (name == "display")
+    {
+        if (value == "none") S.hidden = true;
+    }
+    else if (name == "visibility")
+    {
+        if (value == "hidden" || value == "collapse") S.hidden = true;
+    }
+}
+
+// presentation attributes, then style="a:b; c:d" which wins over them
+void SvgReader::applyAttributes(Style& S) const
+{
+    for (auto& A : attrs_)
+        if (A.first != "style") property(S, A.first, A.second);
+
+    string_view st = attr("style");
+    while (!st.empty())
+    {
+        size_t semi = st.find(';');
+        string_view decl = st.substr(0, semi);
+        st = semi == string_view::npos ? string_view() : st.substr(semi + 1);
+
+        size_t colon = decl.find(':');
+        if (colon != string_view::npos)
+            property(S, trim(decl.substr(0, colon)), decl.substr(colon + 1));
+    }
+}
+
+// border from the stroke (or the fill when there is no stroke),
+// interior from the fill for the shapes that have one;
+// false when nothing would be drawn
+bool SvgReader::outlineAttr(const Style& S, ObjAttr& A, bool fillable) const
+{
+    bool stroke = !S.stroke.none && S.strokeWidth > 0;
+    bool fill = !S.fill.none;
+    if (!stroke && !fill) return false;
+
+    A = ObjAttr();
+    if (stroke)
+    {
+        A.borderColor_ = withAlpha(S.stroke.color, S.opacity * S.strokeOpacity);
+        A.thickness_ = max(1, (int)lround(S.strokeWidth * scaleOf(S.M)));
+    }
+    else
+    {
+        A.borderColor_ = withAlpha(S.fill.color, S.opacity * S.fillOpacity);
+        A.thickness_ = 1;
+    }
+
+    A.isFilled_ = fillable && fill;
+    if (A.isFilled_)
+        A.interiorColor_ = withAlpha(S.fill.color, S.opacity * S.fillOpacity);
+    return true;
+}
+
+// POINTS //////////////////////////////////////////////////////////
+
+void SvgReader::addScene(float X, float Y)
+{
+    V2 P((int)lround(X), (int)lround(Y));
+    if (pts_.empty() || !(pts_.back() == P)) pts_.push_back(P);
+}
+
+void SvgReader::addPoint(const Affine& M, float x, float y)
+{
+    addScene(M.a * x + M.c * y + M.e, M.b * x + M.d * y + M.f);
+}
+
+/*
+ Curves are flattened in scene coordinates (an affine transform keeps the
+ control points of a Bezier curve), in n segments of equal parameter:
+ n = sqrt(d(d-1)/8 * L / tolerance), L the largest second difference of
+ the control points, bounds the distance to the curve (Wang's formula).
+ The first point is already in pts_.
+*/
+void SvgReader::addQuad(const Affine& M, float x0, float y0, float x1, float y1, float x2, float y2)
+{
+    auto X = [&](float x, float y) { return M.a * x + M.c * y + M.e; };
+    auto Y = [&](float x, float y) { return M.b * x + M.d * y + M.f; };
+    float X0 = X(x0, y0), Y0 = Y(x0, y0), X1 = X(x1, y1), Y1 = Y(x1, y1), X2 = X(x2, y2), Y2 = Y(x2, y2);
+
+    float L = hypot(X0 - 2 * X1 + X2, Y0 - 2 * Y1 + Y2);
+    int n = max(1, min(MaxSegments, (int)ceil(sqrt(0.25f * L / opt_.tolerance))));
+
+    for (int i = 1; i <= n; i++)
+    {
+        float t = (float)i / n, u = 1 - t;
+        addScene(u * u * X0 + 2 * u * t * X1 + t * t * X2,
+                 u * u * Y0 + 2 * u * t * Y1 + t * t * Y2);
+    }
+}
+
+void SvgReader::addCubic(const Affine& M, float x0, float y0, float x1, float y1,
+                         float x2, float y2, float x3, float y3)
+{
+    auto X = [&](float x, float y) { return M.a * x + M.c * y + M.e; };
+    auto Y = [&](float x, float y) { return M.b * x + M.d * y + M.f; };
+    float X0 = X(x0, y0), Y0 = Y(x0, y0), X1 = X(x1, y1), Y1 = Y(x1, y1);
+    float X2 = X(x2, y2), Y2 = Y(x2, y2), X3 = X(x3, y3), Y3 = Y(x3, y3);
+
+    float L = max(hypot(X0 - 2 * X1 + X2, Y0 - 2 * Y1 + Y2),
+                  hypot(X1 - 2 * X2 + X3, Y1 - 2 * Y2 + Y3));
+    int n = max(1, min(MaxSegments, (int)ceil(sqrt(0.75f * L / opt_.tolerance))));
+
+    for (int i = 1; i <= n; i++)
+    {
+        float t = (float)i / n, u = 1 - t;
+        float a = u * u * u, b = 3 * u * u * t, c = 3 * u * t * t, d = t * t * t;
+        addScene(a * X0 + b * X1 + c * X2 + d * X3,
+                 a * Y0 + b * Y1 + c * Y2 + d * Y3);
+    }
+}
+
+// elliptic arc from angle t0 over dt; a chord of angle s is at most
+// r (1 - cos(s/2)) from the arc
+void SvgReader::addArc(const Affine& M, double cx, double cy, double rx, double ry, double phi, double t0, double dt)
+{
+    double r = max(rx, ry) * maxScaleOf(M);
+    double step = r > opt_.tolerance ? 2 * acos(1 - opt_.tolerance / r) : Pi / 2;
+    int n = max(1, min(MaxSegments, (int)ceil(fabs(dt) / step)));
+
+    double cp = cos(phi), sp = sin(phi);
+    for (int i = 1; i <= n; i++)
+    {
+        double t = t0 + dt * i / n;
+        double x = rx * cos(t), y = ry * sin(t);
+        addPoint(M, (float)(cx + x * cp - y * sp), (float)(cy + x * sp + y * cp));
+    }
+}
+
+// endpoint to center parameterization (SVG 1.1, implementation notes F.6.5)
+void SvgReader::arcTo(const Affine& M, float x1, float y1, float rx, float ry, float angle,
+                      bool large, bool sweep, float x2, float y2)
+{
+    if (x1 == x2 && y1 == y2) return;
+
+    double Rx = fabs(rx), Ry = fabs(ry);
+    if (Rx == 0 || Ry == 0) { addPoint(M, x2, y2); return; }
+
+    double phi = angle * Pi / 180, cp = cos(phi), sp = sin(phi);
+    double dx = (x1 - x2) / 2.0, dy = (y1 - y2) / 2.0;
+    double xp = cp * dx + sp * dy;
+    double yp = -sp * dx + cp * dy;
+
+    double lambda = xp * xp / (Rx * Rx) + yp * yp / (Ry * Ry);
+    if (lambda > 1) { Rx *= sqrt(lambda); Ry *= sqrt(lambda); }
+
+    double num = Rx * Rx * Ry * Ry - Rx * Rx * yp * yp - Ry * Ry * xp * xp;
+    double den = Rx * Rx * yp * yp + Ry * Ry * xp * xp;
+    double k = den > 0 ? sqrt(max(0.0, num / den)) : 0;
+    if (large == sweep) k = -k;
+
+    double cxp = k * Rx * yp / Ry;
+    double cyp = -k * Ry * xp / Rx;
+    double cx = cp * cxp - sp * cyp + (x1 + x2) / 2.0;
+    double cy = sp * cxp + cp * cyp + (y1 + y2) / 2.0;
+
+    double t1 = atan2((yp - cyp) / Ry, (xp - cxp) / Rx);
+    double t2 = atan2((-yp - cyp) / Ry, (-xp - cxp) / Rx);
+    double dt = t2 - t1;
+    if (!sweep && dt > 0) dt -= 2 * Pi;
+    else if (sweep && dt < 0) dt += 2 * Pi;
+
+    addArc(M, cx, cy, Rx, Ry, phi, t1, dt);
+}
+
+void SvgReader::emitPolygon(const Style& S)
+{
+    ObjAttr A;
+    if (pts_.size() >= 2 && outlineAttr(S, A, false))
+    {
+        auto P = allocateShape<ObjPolygon>(pool_, A);
+        P->pts_ = pts_;
+        out_.push_back(P);
+        shapes_++;
+    }
+    pts_.clear();
+}
+
+// SHAPES //////////////////////////////////////////////////////////
+
+void SvgReader::rect(const Style& S)
+{
+    float x = length(attr("x"), S.vw), y = length(attr("y"), S.vh);
+    float w = length(attr("width"), S.vw), h = length(attr("height"), S.vh);
+    if (w <= 0 || h <= 0) return;
+
+    const Affine& M = S.M;
+    if (M.b != 0 || M.c != 0)   // rotated or skewed
+    {
+        pts_.clear();
+        addPoint(M, x, y);
+        addPoint(M, x + w, y);
+        addPoint(M, x + w, y + h);
+        addPoint(M, x, y + h);
+        addPoint(M, x, y);
+        emitPolygon(S);
+        return;
+    }
+
+    ObjAttr A;
+    if (!outlineAttr(S, A, true)) return;
+
+    V2 P1((int)lround(M.a * x + M.e), (int)lround(M.d * y + M.f));
+    V2 P2((int)lround(M.a * (x + w) + M.e), (int)lround(M.d * (y + h) + M.f));
+    out_.push_back(allocateShape<ObjRectangle>(pool_, A, P1, P2));
+    shapes_++;
+}
+
+void SvgReader::circle(const Style& S)
+{
+    float cx = length(attr("cx"), S.vw), cy = length(attr("cy"), S.vh);
+    float r = length(attr("r"), sqrt((S.vw * S.vw + S.vh * S.vh) / 2));
+    if (r <= 0) return;
+
+    // a circle stays a circle when the transform is a rotation and a uniform scale
+    const Affine& M = S.M;
+    float sx = M.a * M.a + M.b * M.b, sy = M.c * M.c + M.d * M.d, dot = M.a * M.c + M.b * M.d;
+    float eps = 1e-4f * max(sx, sy);
+    if (fabs(sx - sy) > eps || fabs(dot) > eps)
+    {
+        pts_.clear();
+        addPoint(M, cx + r, cy);
+        addArc(M, cx, cy, r, r, 0, 0, 2 * Pi);
+        emitPolygon(S);
+        return;
+    }
+
+    ObjAttr A;
+    if (!outlineAttr(S, A, true)) return;
+
+    V2 C((int)lround(M.a * cx + M.c * cy + M.e), (int)lround(M.b * cx + M.d * cy + M.f));
+    auto obj = allocateShape<ObjCircle>(pool_, A, C, C);
+    obj->radius_ = r * sqrt(sx);
+    out_.push_back(obj);
+    shapes_++;
+}
+
+void SvgReader::ellipse(const Style& S)
+{
+    float cx = length(attr("cx"), S.vw), cy = length(attr("cy"), S.vh);
+    float rx = length(attr("rx"), S.vw), ry = length(attr("ry"), S.vh);
+    if (rx <= 0 || ry <= 0) return;
+
+    pts_.clear();
+    addPoint(S.M, cx + rx, cy);
+    addArc(S.M, cx, cy, rx, ry, 0, 0, 2 * Pi);
+    emitPolygon(S);
+}
+
+// never filled: nothing to draw without a stroke
+void SvgReader::line(const Style& S)
+{
+    if (S.stroke.none) return;
+
+    ObjAttr A;
+    if (!outlineAttr(S, A, false)) return;
+
+    float x1 = length(attr("x1"), S.vw), y1 = length(attr("y1"), S.vh);
+    float x2 = length(attr("x2"), S.vw), y2 = length(attr("y2"), S.vh);
+    const Affine& M = S.M;
+    V2 P1((int)lround(M.a * x1 + M.c * y1 + M.e), (int)lround(M.b * x1 + M.d * y1 + M.f));
+    V2 P2((int)lround(M.a * x2 + M.c * y2 + M.e), (int)lround(M.b * x2 + M.d * y2 + M.f));
+    out_.push_back(allocateShape<ObjSegment>(pool_, A, P1, P2));
+    shapes_++;
+}
+
+// points="x,y x,y ...": a polygon is closed by its first point again
+void SvgReader::poly(const Style& S, bool closed)
+{
+    string_view list = attr("points");
+    const char* p = list.data();
+    const char* e = p + list.size();
+
+    pts_.clear();
+    float x, y, x0 = 0, y0 = 0;
+    bool first = true;
+    while (number(p, e, x) && number(p, e, y))
+    {
+        if (first) { x0 = x; y0 = y; first = false; }
+        addPoint(S.M, x, y);
+    }
+    if (closed && !first) addPoint(S.M, x0, y0);
+    emitPolygon(S);
+}
+
+// one polygon per subpath; a bad command ends the path (the part read is kept)
+void SvgReader::path(const Style& S)
+{
+    if (S.stroke.none && S.fill.none) return;
+
+    string_view d = attr("d");
+    const char* p = d.data();
+    const char* e = p + d.size();
+    const Affine& M = S.M;
+
+    float cx = 0, cy = 0;     // current point
+    float sx = 0, sy = 0;     // start of the subpath
+    float qx = 0, qy = 0;     // last control point, for S and T
+    char cmd = 0, last = 0;
+    float v[7];
+
+    auto args = [&](int n)
+    {
+        for (int i = 0; i < n; i++)
+            if (!number(p, e, v[i])) return false;
+        return true;
+    };
+    auto begin = [&]() { if (pts_.empty()) addPoint(M, cx, cy); };
+
+    pts_.clear();
+    for (;;)
+    {
+        skipSep(p, e);
+        if (p == e) break;
+        if (isalpha((unsigned char)*p)) cmd = *p++;
+        else if (!cmd || cmd == 'Z' || cmd == 'z') break;   // numbers after nothing or Z
+
+        bool rel = cmd >= 'a';
+        char C = (char)toupper(cmd);
+        float ox = rel ? cx : 0, oy = rel ? cy : 0;
+
+        bool ok = true;
+        switch (C)
+        {
+        case 'M':
+            if (!(ok = args(2))) break;
+            emitPolygon(S);
+            cx = sx = ox + v[0];
+            cy = sy = oy + v[1];
+            addPoint(M, cx, cy);
+            cmd = rel ? 'l' : 'L';    // next pairs are lines
+            break;
+
+        case 'Z':
+            if (!pts_.empty())
+            {
+                addPoint(M, sx, sy);
+                emitPolygon(S);
+            }
+            cx = sx;
+            cy = sy;
+            break;
+
+        case 'L':
+            if (!(ok = args(2))) break;
+            begin();
+            cx = ox + v[0];
+            cy = oy + v[1];
+            addPoint(M, cx, cy);
+            break;
+
+        case 'H':
+            if (!(ok = args(1))) break;
+            begin();
+            cx = ox + v[0];
+            addPoint(M, cx, cy);
+            break;
+
+        case 'V':
+            if (!(ok = args(1))) break;
+            begin();
+            cy = oy + v[0];
+            addPoint(M, cx, cy);
+            break;
+
+        case 'C':
+        case 'S':
+        {
+            float x1, y1;
+            if (C == 'C')
+            {
+                if (!(ok = args(6))) break;
+                x1 = ox + v[0]; y1 = oy + v[1];
+            }
+            else
+            {
+                if (!(ok = args(4))) break;
+                bool smooth = last == 'C' || last == 'S';
+                x1 = smooth ? 2 * cx - qx : cx;
+                y1 = smooth ? 2 * cy - qy : cy;
+                v[4] = v[2]; v[5] = v[3]; v[2] = v[0]; v[3] = v[1];
+            }
+            float x2 = ox + v[2], y2 = oy + v[3], x = ox + v[4], y = oy + v[5];
+            begin();
+            addCubic(M, cx, cy, x1, y1, x2, y2, x, y);
+            qx = x2; qy = y2;
+            cx = x;  cy = y;
+            break;
+        }
+
+        case 'Q':
+        case 'T':
+        {
+            float x1, y1;
+            if (C == 'Q')
+            {
+                if (!(ok = args(4))) break;
+                x1 = ox + v[0]; y1 = oy + v[1];
+                v[0] = v[2]; v[1] = v[3];
+            }
+            else
+            {
+                if (!(ok = args(2))) break;
+                bool smooth = last == 'Q' || last == 'T';
+                x1 = smooth ? 2 * cx - qx : cx;
+                y1 = smooth ? 2 * cy - qy : cy;
+            }
+            float x = ox + v[0], y = oy + v[1];
+            begin();
+            addQuad(M, cx, cy, x1, y1, x, y);
+            qx = x1; qy = y1;
+            cx = x;  cy = y;
+            break;
+        }
+
+        case 'A':
+        {
+            bool large, sweep;
+            if (!(ok = args(3) && flag(p, e, large) && flag(p, e, sweep) && number(p, e, v[3]) && number(p, e, v[4])))
+                break;
+            float x = ox + v[3], y = oy + v[4];
+            begin();
+            arcTo(M, cx, cy, v[0], v[1], v[2], large, sweep, x, y);
+            cx = x;
+            cy = y;
+            break;
+        }
+
+        default:
+            ok = false;
+        }
+
+        if (!ok) break;
+        last = C;
+    }
+
+    emitPolygon(S);
+}
+
+// FILE ////////////////////////////////////////////////////////////
+
+bool importSvg(const string& path, vector< shared_ptr<ObjGeom> >& objects, const shared_ptr<ShapePool>& pool,
+               const SvgReader::Options& O, string& error, int* skipped)
+{
+    ifstream F(path, ios::binary);
+    if (!F)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    // nothing is added from a document that cannot be read to the end
+    size_t before = objects.size();
+    SvgReader R(objects, pool, O);
+    if (!R.read(F, error))
+    {
+        objects.resize(before);
+        error = path + ", " + error;
+        return false;
+    }
+
+    if (skipped) *skipped = R.skipped();
+    return true;
+}
@@ -0,0 +1,117 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include "ObjGeom.h"
+#include "ShapePool.h"
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+using namespace std;
+
+/*
+ SVG import: the drawable elements of a file become scene objects.
+   rect            ObjRectangle (a polygon when rotated or skewed)
+   circle          ObjCircle (a polygon when the transform is not uniform)
+   ellipse         ObjPolygon
+   line            ObjSegment
+   polyline, polygon, path
+                   ObjPolygon, one per subpath; curves and arcs are cut in
+                   segments no farther than tolerance pixels from the curve
+ Objects have no fill but rectangles and circles: the others keep their
+ outline, in the fill color when they have no stroke.
+ Groups, transforms, viewBox, presentation attributes and style="..." are
+ followed; text, images and use are skipped, gradients become a flat color
+ (their fallback, or gray). The rect with id="background" that SvgExport
+ writes first is skipped too.
+ The file is read in chunks and each element is converted as soon as its
+ tag is complete: memory holds one chunk (or the largest tag), the open
+ groups and the objects created, never the document.
+*/
+class SvgReader
+{
+public:
+    struct Options
+    {
+        float tolerance = 0.5f;   // pixels, flattening of curves
+        float height = 800;       // when the file gives neither height nor viewBox
+    };
+
+    SvgReader(vector< shared_ptr<ObjGeom> >& out, const shared_ptr<ShapePool>& pool, const Options& O);
+
+    // appends the objects of the document to out;
+    // error: "line N: message" for a document that cannot be read
+    bool read(istream& in, string& error);
+
+    int shapes() const  { return shapes_; }    // objects created
+    int skipped() const { return skipped_; }   // drawable elements not supported
+
+private:
+    struct Affine
+    {
+        float a = 1, b = 0, c = 0, d = 1, e = 0, f = 0;   // x' = a x + c y + e, y' = b x + d y + f
+    };
+
+    struct Paint
+    {
+        bool  none = true;
+        Color color;
+    };
+
+    // state inherited by the children of an element
+    struct Style
+    {
+        Paint stroke;
+        Paint fill;            // black unless none
+        float strokeWidth = 1;
+        float strokeOpacity = 1;
+        float fillOpacity = 1;
+        float opacity = 1;     // product of the opacity of the groups
+        Affine M;              // user space -> scene (y up)
+        float vw = 0, vh = 0;  // viewport, for lengths in %
+        bool  hidden = false;  // in defs, clipPath... or display:none
+    };
+
+    vector< shared_ptr<ObjGeom> >& out_;
+    shared_ptr<ShapePool> pool_;
+    Options opt_;
+
+    vector<Style> stack_;      // open elements
+    bool inSvg_ = false;       // inside the root <svg>
+    int shapes_ = 0;
+    int skipped_ = 0;
+
+    vector< pair<string_view, string_view> > attrs_;   // of the current tag
+    vector<V2> pts_;                                     // of the current polygon
+
+    string_view attr(string_view name) const;
+    void element(string_view tag);
+    void start(string_view name, bool selfClosing);
+    void end();
+
+    void applyAttributes(Style& S) const;
+    void property(Style& S, string_view name, string_view value) const;
+
+    void rect(const Style& S);
+    void circle(const Style& S);
+    void ellipse(const Style& S);
+    void line(const Style& S);
+    void poly(const Style& S, bool closed);
+    void path(const Style& S);
+
+    bool outlineAttr(const Style& S, ObjAttr& A, bool fillable) const;
+    void addScene(float X, float Y);                 // scene coordinates
+    void addPoint(const Affine& M, float x, float y);
+    void addQuad(const Affine& M, float x0, float y0, float x1, float y1, float x2, float y2);
+    void addCubic(const Affine& M, float x0, float y0, float x1, float y1,
+                  float x2, float y2, float x3, float y3);
+    void addArc(const Affine& M, double cx, double cy, double rx, double ry, double phi, double t0, double dt);
+    void arcTo(const Affine& M, float x1, float y1, float rx, float ry, float angle,
+               bool large, bool sweep, float x2, float y2);
+    void emitPolygon(const Style& S);
+};
+
+// reads path, appends its objects to objects
+bool importSvg(const string& path, vector< shared_ptr<ObjGeom> >& objects, const shared_ptr<ShapePool>& pool,
+               const SvgReader::Options& O, string& error, int* skipped = nullptr);
@@ -0,0 +1,42 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "Test.h"
+#include "SvgExport.h"
+#include "SvgImport.h"
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+// an exported scene imports back as its shapes, without the background
+TEST(svgRoundTrip)
+{
+    ObjAttr A(Color::Red, true, Color::Blue, 2);
+    ObjRectangle rect(A, V2(10, 20), V2(110, 70));
+    ObjSegment seg(A, V2(5, 5), V2(300, 200));
+
+    ostringstream os;
+    {
+        SvgWriter W(os, V2(400, 300));
+        W.write(rect);
+        W.write(seg);
+    }
+    string text = os.str();
+    CHECK(text.find("<rect id=\"background\"") != string::npos);
+
+    vector< shared_ptr<ObjGeom> > shapes;
+    SvgReader::Options O;
+    O.height = 300;
+    SvgReader R(shapes, nullptr, O);
+    istringstream is(text);
+    string error;
+    REQUIRE(R.read(is, error));
+    CHECK(R.skipped() == 0);
+    REQUIRE(shapes.size() == 2);
+
+    REQUIRE(shapes[0]->kind() == ShapeKind::Rectangle);
+    const ObjRectangle& r = static_cast<const ObjRectangle&>(*shapes[0]);
+    CHECK(min(r.P1_.x, r.P2_.x) == 10 && max(r.P1_.x, r.P2_.x) == 110);
+    CHECK(min(r.P1_.y, r.P2_.y) == 20 && max(r.P1_.y, r.P2_.y) == 70);
+    CHECK(shapes[1]->kind() == ShapeKind::Segment);
+}
@@ -0,0 +1,64 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+using namespace std;
+
+/*
+ Minimal test runner of PictorTests (see TestMain.cpp).
+ TEST(name) { ... } declares a test, BENCH(name) { ... } a benchmark;
+ both register themselves before main. Inside a test, CHECK(cond)
+ reports a failure with its file and line and goes on, REQUIRE(cond)
+ also leaves the test.
+ Test data are read from testdata/, relative to the working directory.
+*/
+struct TestCase
+{
+    const char* name;
+    void (*run)();
+    bool bench;
+};
+
+vector<TestCase>& testCases();
+
+struct TestRegistration
+{
+    TestRegistration(const char* name, void (*run)(), bool bench)
+    {
+        testCases().push_back({ name, run, bench });
+    }
+};
+
+void testFailure(const char* file, int line, const string& what);
+
+#define TEST_CASE_(name, bench)                                              \
+    static void test_##name();                                               \
+    static TestRegistration testRegistration_##name(#name, test_##name, bench); \
+    static void test_##name()
+
+#define TEST(name)  TEST_CASE_(name, false)
+#define BENCH(name) TEST_CASE_(name, true)
+
+#define CHECK(cond) \
+    do { if (!(cond)) testFailure(__FILE__, __LINE__, #cond); } while (0)
+
+#define REQUIRE(cond) \
+    do { if (!(cond)) { testFailure(__FILE__, __LINE__, #cond); return; } } while (0)
+
+// best of runs wall times of f, in ms
+template <class F>
+double bestMs(int runs, F&& f)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; i++)
+    {
+        auto t = chrono::steady_clock::now();
+        f();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+        if (ms < best) best = ms;
+    }
+    return best;
+}
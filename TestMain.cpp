@@ -0,0 +1,76 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+/*
+ PictorTests: tests and benchmarks of the scene, file and image code,
+ without window nor OpenGL.
+
+   PictorTests              runs every test
+   PictorTests --bench      runs every benchmark
+   PictorTests names...     runs the tests and benchmarks named
+
+ Run from the project directory (the data are in testdata/).
+ Exit code: 0 all passed, 1 some check failed, 2 unknown name.
+*/
+
+#include "Test.h"
+#include "Model.h"
+#include <cstring>
+
+using namespace std;
+
+// called by Model(), defined by the app (Eleve.cpp): no tools nor buttons here
+void initApp(Model&) {}
+
+vector<TestCase>& testCases()
+{
+    static vector<TestCase> cases;
+    return cases;
+}
+
+static int failures = 0;
+
+void testFailure(const char* file, int line, const string& what)
+{
+    cout << "  " << file << ":" << line << ": failed: " << what << endl;
+    failures++;
+}
+
+static void runCase(const TestCase& T)
+{
+    int before = failures;
+    cout << (T.bench ? "bench " : "test ") << T.name << endl;
+    T.run();
+    if (!T.bench) cout << "  " << (failures == before ? "ok" : "FAILED") << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    bool bench = argc == 2 && strcmp(argv[1], "--bench") == 0;
+
+    if (argc == 1 || bench)
+    {
+        for (const TestCase& T : testCases())
+            if (T.bench == bench) runCase(T);
+    }
+    else
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            bool found = false;
+            for (const TestCase& T : testCases())
+                if (strcmp(T.name, argv[i]) == 0)
+                {
+                    runCase(T);
+                    found = true;
+                }
+            if (!found)
+            {
+                cerr << "unknown test : " << argv[i] << endl;
+                return 2;
+            }
+        }
+    }
+
+    if (failures) cout << failures << " failed checks" << endl;
+    return failures ? 1 : 0;
+}
@@ -6,7 +6,13 @@
 #include <map>
 #include <vector>
 #include <iostream>
+#include <filesystem>
+#include <chrono>
 #include "jpeg_decoder.h"
+#include "picoPNG.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Texture.h"
 
 /////////////////////////////////////////////////////////////
 //
@@ -34,52 +40,68 @@ int CreateTextureFromRGB(unsigned char* data, int width, int height)
 	glBindTexture(GL_TEXTURE_2D, t);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);		// rows of 3 x width bytes, not padded to 4
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
 	return t;
 }
 
-// from PicoPNG LIB (see sources)
-void loadFile(std::vector<unsigned char>& buffer, const std::string& filename);
-int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width, unsigned long& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32 = true);
+// PNG textures are decoded in these buffers, kept from one texture to the next
+// (textures are created on the thread of OpenGL only); beyond KeepBytes they
+// are freed after the upload, so that one large image is not held for good
+static PNGBuffers pngBuffers;
+static std::vector<unsigned char> pngStaging;
+static const size_t KeepBytes = 16 << 20;
 
-// flip image vertically
-void VsymetryRGBAImage(std::vector<unsigned char>& data, int Width, int Height, int bytePerPix)
-{
-	for (int y = 0; y < Height / 2; y++)
-	{
-		int width = Width * bytePerPix;
-		int pY = y * width;
-		int sY = (Height - y - 1) * width;
+std::map<std::string, TextureLoadStats> textureLoadStats;
 
-		for (int x = 0; x < width; x++)
-		{
-			unsigned char t = data[pY + x];
-			data[pY + x] = data[sY + x];
-			data[sY + x] = t;
-		}
-	}
+static double msSince(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
 }
 
+/*
+ The file is mapped, not read; picoPNG inflates a single IDAT chunk where
+ it lies in the mapping, and places the rows bottom-up, as glTexImage2D
+ expects them, straight into the staging image, which is uploaded from there.
+*/
 int LoadPNGintoTexture(const std::string& filename)
 {
-	std::vector<unsigned char> buffer, image;
-	loadFile(buffer, filename);
-	unsigned long w, h;
-	int error = decodePNG(image, w, h, buffer.empty() ? 0 : &buffer[0], (unsigned long)buffer.size());
+	TextureLoadStats& S = textureLoadStats[filename];
+	S = TextureLoadStats();
+	auto start = std::chrono::steady_clock::now();
+	MappedFile F;
+	if (!F.open(filename))
+	{
+		std::cout << filename << " : cannot open the file" << std::endl;
+		return IDerror;
+	}
+	S.fileBytes = F.size();
+	S.mapMs = msSince(start);
 
-	int bytePerPix = (image.size() / (w * h) );
-	VsymetryRGBAImage(image, w, h, bytePerPix);
+	start = std::chrono::steady_clock::now();
+	unsigned long w, h;
+	int error = decodePNG(pngStaging, w, h, F.data(), F.size(), true, true, &pngBuffers);
+	S.decodeMs = msSince(start);
+	S.peakBytes = S.fileBytes + pngBuffers.bytes() + pngStaging.capacity();
 
 	//if there's an error, display it
+	int id = IDerror;
 	if (error != 0)
+		std::cout << filename << " : PNG error " << error << std::endl;
+	else
 	{
-		std::cout << "error: " << error << std::endl;
-		return IDerror;
+		start = std::chrono::steady_clock::now();
+		id = CreateTextureFromRGBA(pngStaging.data(), w, h);
+		S.uploadMs = msSince(start);
+		S.width = (int)w;
+		S.height = (int)h;
 	}
 
-	//the pixels are now in the vector "image", use it as texture, draw it, ...
-
-	int id = CreateTextureFromRGBA(image.data(), w, h);
+	if (pngBuffers.bytes() + pngStaging.capacity() > KeepBytes)
+	{
+		pngBuffers.release();
+		std::vector<unsigned char>().swap(pngStaging);
+	}
 	return id;
 }
 
@@ -105,51 +127,138 @@ int GetTextureIdFromPNG(std::string PNGFileName)
 //
 /////////////////////////////////////////////////////////////
 
-int GetTextureIdFromJPG(std::string JPGFileName)
+// one decoder for all JPG textures (created on the thread of OpenGL only):
+// its image buffers are kept from one texture to the next, up to KeepBytes
+static Jpeg::Decoder jpgDecoder;
+
+// the parallel parts of a JPG decoding, on the pool of the application
+static void runOnPool(void* pool, int count, Jpeg::Decoder::TaskFunc task, void* arg)
 {
-	size_t size;
-	unsigned char* buf;
-	FILE* f;
-
-
-	f = fopen(JPGFileName.c_str(), "rb");
-	if (!f) { std::cout << "Error opening the input file.\n";  return IDerror; }
-	 
-	fseek(f, 0, SEEK_END);
-	size = ftell(f);
-	buf = (unsigned char*)malloc(size);
-	if ( buf == NULL)
+	((ThreadPool*)pool)->run(count, [=](int i) { task(arg, i); });
+}
+
+// a JPG texture, decoded at 1 / scale of the image size, from the file
+// as it was at time (its modification time)
+struct JpgTexture
+{
+	int id = 0, scale = 1, width = 0, height = 0;
+	std::filesystem::file_time_type time;
+};
+static std::map<std::string, JpgTexture> jpgTextures;
+
+// the largest scale (8, 4, 2 or 1) keeping at least width x height pixels
+static int jpgScaleFor(int imageWidth, int imageHeight, int width, int height)
+{
+	if (width <= 0 || height <= 0) return 1;
+	for (int scale = 8; scale > 1; scale /= 2)
+		if ((imageWidth + scale - 1) / scale >= width && (imageHeight + scale - 1) / scale >= height)
+			return scale;
+	return 1;
+}
+
+/*
+ The texture of a file is kept and drawn again as long as it has enough pixels
+ for the rectangle asked, minWidth x minHeight; drawn larger, the file is
+ decoded again at a larger scale and the texture replaced.
+ A lookup is a map lookup: the modification times are only read when a file
+ is decoded, and checked once a second by CheckJPGTextures.
+ At 1/2, 1/4 or 1/8, the decoder skips most of the IDCT, upsampling and colour
+ conversion work, and 4 to 64 times fewer pixels are uploaded.
+*/
+int GetTextureIdFromJPG(std::string JPGFileName, int minWidth, int minHeight)
+{
+	JpgTexture& T = jpgTextures[JPGFileName];
+	if (T.id != 0 && (T.id == IDerror || T.scale == 1 || (T.width >= minWidth && T.height >= minHeight)))
+		return T.id;
+
+	TextureLoadStats& S = textureLoadStats[JPGFileName];
+	S = TextureLoadStats();
+	std::error_code ec;
+	T.time = std::filesystem::last_write_time(JPGFileName, ec);	// min() when missing
+
+	auto start = std::chrono::steady_clock::now();
+	MappedFile F;
+	if (!F.open(JPGFileName))
 	{
-		std::cout << "Memory error loading JPG\n";
-		return IDerror;
+		std::cout << "Error opening the input file.\n";
+		if (T.id == 0) T.id = IDerror;
+		T.scale = 1;		// not tried again
+		return T.id;
 	}
-	fseek(f, 0, SEEK_SET);
-	size_t read = fread(buf, 1, size, f);
-	fclose(f);
+	S.fileBytes = F.size();
+	S.mapMs = msSince(start);
+
+	start = std::chrono::steady_clock::now();
+	int scale = 1, imageWidth, imageHeight;
+	if (Jpeg::Decoder::ReadSize(F.data(), F.size(), imageWidth, imageHeight))
+		scale = jpgScaleFor(imageWidth, imageHeight, minWidth, minHeight);
 
-	Jpeg::Decoder decoder(buf, size);
-	int tt = decoder.GetResult();
+	Jpeg::Decoder& decoder = jpgDecoder;
+	ThreadPool& pool = ThreadPool::shared();
+	decoder.SetParallel(runOnPool, &pool, pool.size());
+	decoder.SetScale(scale);
+	decoder.Decode(F.data(), F.size());
+	S.decodeMs = msSince(start);
+	S.peakBytes = S.fileBytes + decoder.GetBufferSize();
 
+	int id = IDerror;
 	if (decoder.GetResult() != Jpeg::Decoder::OK)
-	{
 		std::cout << "Error decoding the input file\n";
-		return IDerror;
+	else if ( ! decoder.IsColor() )
+		std::cout << "Error - not an RGB image\n";
+	else
+	{
+		start = std::chrono::steady_clock::now();
+		id = CreateTextureFromRGB(decoder.GetImage(), decoder.GetWidth(), decoder.GetHeight());
+		S.uploadMs = msSince(start);
+		S.width = decoder.GetWidth();
+		S.height = decoder.GetHeight();
 	}
 
-	std::cout << "JPG width  : " << decoder.GetWidth()  << std::endl;
-	std::cout << "JPG height : " << decoder.GetHeight() << std::endl;
-	
-	if ( ! decoder.IsColor() )
+	if (id != IDerror)
 	{
-		std::cout << "Error - not an RGB image\n";
-		return IDerror;
+		if (T.id != 0)		// the texture at the smaller scale
+		{
+			GLuint old = T.id;
+			glDeleteTextures(1, &old);
+		}
+		T.id = id;
+		T.scale = decoder.GetScale();
+		T.width = decoder.GetWidth();
+		T.height = decoder.GetHeight();
+	}
+	else
+	{
+		if (T.id == 0) T.id = IDerror;
+		T.scale = 1;		// not tried again: the smaller texture stays
 	}
-	 
 
-	unsigned char* buff = decoder.GetImage();
-	size_t  len         = decoder.GetImageSize();
+	if (decoder.GetBufferSize() > KeepBytes)
+		decoder.ReleaseBuffers();
+	return T.id;
+}
 
+/*
+ Timer tick (see GL.cpp): the JPG files written since their texture was
+ made, or created since they were missing, lose their texture and are
+ decoded again when next drawn. True if the window needs a redraw.
+*/
+bool CheckJPGTextures()
+{
+	bool changed = false;
+	for (auto& e : jpgTextures)
+	{
+		JpgTexture& T = e.second;
+		std::error_code ec;
+		if (T.id == 0 || std::filesystem::last_write_time(e.first, ec) == T.time) continue;
 
-	int id = CreateTextureFromRGB(buff, decoder.GetWidth(), decoder.GetHeight());
-	return id;
+		if (T.id != IDerror)
+		{
+			GLuint old = T.id;
+			glDeleteTextures(1, &old);
+		}
+		T = JpgTexture();
+		changed = true;
+	}
+	return changed;
 }
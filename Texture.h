@@ -0,0 +1,19 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include <map>
+#include <string>
+#include <cstddef>
+
+// what loading a texture cost
+struct TextureLoadStats
+{
+	size_t fileBytes = 0;
+	size_t peakBytes = 0;		// file mapping, decoder buffers and decoded image, all held at the end of the decode
+	double mapMs = 0, decodeMs = 0, uploadMs = 0;
+	int width = 0, height = 0;	// of the texture (a JPG may be decoded at 1/2, 1/4 or 1/8)
+};
+
+// the last load of each PNG or JPG file, by file name; filled on every
+// load, read by whoever wants the figures (nothing is printed)
+extern std::map<std::string, TextureLoadStats> textureLoadStats;
@@ -0,0 +1,95 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads)
+{
+    if (threads <= 0) threads = (int)thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+
+    // the caller of run is one of the threads
+    for (int i = 1; i < threads; i++)
+        workers_.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> guard(lock_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (thread& t : workers_) t.join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+// tasks are taken one by one: fast threads take more of them
+void ThreadPool::take(Job& job)
+{
+    for (int i = job.next++; i < job.count; i = job.next++)
+    {
+        (*job.f)(i);
+        job.done++;
+    }
+}
+
+void ThreadPool::work()
+{
+    unsigned seen = 0;
+    for (;;)
+    {
+        Job* job;
+        {
+            unique_lock<mutex> guard(lock_);
+            wake_.wait(guard, [&] { return stop_ || (job_ && generation_ != seen); });
+            if (stop_) return;
+            seen = generation_;
+            job = job_;
+            busy_++;
+        }
+
+        take(*job);
+
+        {
+            lock_guard<mutex> guard(lock_);
+            busy_--;
+        }
+        finished_.notify_all();
+    }
+}
+
+void ThreadPool::run(int count, const function<void(int)>& f)
+{
+    if (count <= 0) return;
+    if (workers_.empty() || count == 1)
+    {
+        for (int i = 0; i < count; i++) f(i);
+        return;
+    }
+
+    lock_guard<mutex> one(runLock_);
+
+    Job job;
+    job.f = &f;
+    job.count = count;
+    {
+        lock_guard<mutex> guard(lock_);
+        job_ = &job;
+        generation_++;
+    }
+    wake_.notify_all();
+
+    take(job);
+
+    // the job lives on this stack: wait for the last worker to leave it
+    unique_lock<mutex> guard(lock_);
+    finished_.wait(guard, [&] { return job.done == count && busy_ == 0; });
+    job_ = nullptr;
+}
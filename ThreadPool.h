@@ -0,0 +1,57 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+using namespace std;
+
+/*
+ Fixed set of worker threads for data-parallel loops.
+ run(count, f) calls f(0) ... f(count - 1), spread over the workers and
+ the calling thread, and returns when every call is done.
+ One loop at a time: run must not be called from inside a task.
+*/
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threads = 0);   // 0: one per hardware thread
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+
+    // threads taking part in a loop, the caller included
+    int size() const { return (int)workers_.size() + 1; }
+
+    void run(int count, const function<void(int)>& f);
+
+    // pool of the application, created on first use
+    static ThreadPool& shared();
+
+private:
+    struct Job
+    {
+        const function<void(int)>* f;
+        int count;
+        atomic<int> next{ 0 };
+        atomic<int> done{ 0 };
+    };
+
+    void work();
+    static void take(Job& job);
+
+    vector<thread> workers_;
+    mutex lock_;
+    condition_variable wake_;      // a job was posted, or stop
+    condition_variable finished_;  // a worker left the job
+    Job* job_ = nullptr;           // current loop, under lock_
+    int busy_ = 0;                 // workers inside job_
+    unsigned generation_ = 0;      // incremented for each job
+    bool stop_ = false;
+
+    mutex runLock_;                // one loop at a time
+};
@@ -5,6 +5,7 @@
 #include "ObjGeom.h"
 #include "Model.h"
 #include "Graphics.h"
+#include "PointIndex.h"
 #include <memory>
 
 enum class State { WAIT, INTERACT };
@@ -44,10 +45,9 @@ public:
         if (E.Type == EventType::MouseUp && E.info == "0" &&
             currentState == State::INTERACT)
         {
-            pushUndoState(Data);  // Save state before adding object
-            auto obj = std::make_shared<ObjSegment>(
+            auto obj = allocateShape<ObjSegment>(Data.shapePool,
                 Data.drawingOptions, Pstart, Data.currentMousePos);
-            Data.LObjets.push_back(obj);
+            Data.history.add(Data, obj);
             currentState = State::WAIT;
         }
     }
@@ -86,10 +86,9 @@ public:
         if (E.Type == EventType::MouseUp && E.info == "0" &&
             currentState == State::INTERACT)
         {
-            pushUndoState(Data);  // Save state before adding object
-            auto obj = std::make_shared<ObjRectangle>(
+            auto obj = allocateShape<ObjRectangle>(Data.shapePool,
                 Data.drawingOptions, Pstart, Data.currentMousePos);
-            Data.LObjets.push_back(obj);
+            Data.history.add(Data, obj);
             currentState = State::WAIT;
         }
     }
@@ -136,10 +135,9 @@ public:
         if (E.Type == EventType::MouseUp && E.info == "0" &&
             currentState == State::INTERACT)
         {
-            pushUndoState(Data);  // Save state before adding object
-            auto obj = std::make_shared<ObjCircle>(
+            auto obj = allocateShape<ObjCircle>(Data.shapePool,
                 Data.drawingOptions, center_, Data.currentMousePos);
-            Data.LObjets.push_back(obj);
+            Data.history.add(Data, obj);
             currentState = State::WAIT;
         }
     }
@@ -181,9 +179,9 @@ public:
         {
             if (!building)
             {
-                pushUndoState(Data);  // Save state before starting polygon
-                poly_ = std::make_shared<ObjPolygon>(Data.drawingOptions);
-                Data.LObjets.push_back(poly_);
+                // drawn by the tool, out of the scene until finished: a polygon
+                // left unfinished (other tool) never reaches the scene nor the history
+                poly_ = allocateShape<ObjPolygon>(Data.shapePool, Data.drawingOptions);
                 building = true;
                 currentState = State::INTERACT;
             }
@@ -197,8 +195,8 @@ public:
         {
             if (building)
             {
-                if (poly_->pts_.size() < 2)
-                    Data.LObjets.pop_back();
+                if (poly_->pts_.size() >= 2)
+                    Data.history.add(Data, poly_);
 
                 building = false;
                 poly_.reset();
@@ -212,7 +210,6 @@ public:
         {
             if (building)
             {
-                Data.LObjets.pop_back();
                 building = false;
                 poly_.reset();
                 currentState = State::WAIT;
@@ -249,6 +246,7 @@ public:
 class ToolSelection : public Tool
 {
     V2 lastMouse_;
+    V2 dragDelta_;     // total move of the current drag
     bool dragging_ = false;
 
 public:
@@ -259,12 +257,12 @@ public:
         // Drag
         if (E.Type == EventType::MouseMove)
         {
-            if (dragging_ &&
-                Data.selectedObject >= 0 &&
-                Data.selectedObject < (int)Data.LObjets.size())
+            ObjGeom* obj = dragging_ ? Data.editObject(Data.selectedObject) : nullptr;
+            if (obj)
             {
                 V2 delta = Data.currentMousePos - lastMouse_;
-                Data.LObjets[Data.selectedObject]->moveBy(delta);
+                obj->moveBy(delta);
+                dragDelta_ = dragDelta_ + delta;
                 lastMouse_ = Data.currentMousePos;
             }
             return;
@@ -276,10 +274,12 @@ public:
             Data.selectedObject = -1;
             for (int i = Data.LObjets.size() - 1; i >= 0; --i)
             {
-                if (Data.LObjets[i]->hitTest(Data.currentMousePos))
+                ObjGeom* obj = Data.LObjets[i].get();
+                if (obj && obj->hitTest(Data.currentMousePos))
                 {
-                    Data.selectedObject = i;
+                    Data.selectedObject = obj->id_;
                     dragging_ = true;
+                    dragDelta_ = V2(0, 0);
                     lastMouse_ = Data.currentMousePos;
                     break;
                 }
@@ -290,6 +290,8 @@ public:
         // Mouse-up: stop drag
         if (E.Type == EventType::MouseUp && E.info == "0")
         {
+            if (dragging_ && Data.findObject(Data.selectedObject))
+                Data.history.moved(Data, Data.selectedObject, dragDelta_);
             dragging_ = false;
             return;
         }
@@ -297,10 +299,9 @@ public:
         // Right-click: delete
         if (E.Type == EventType::MouseDown && E.info != "0")
         {
-            if (Data.selectedObject >= 0 &&
-                Data.selectedObject < (int)Data.LObjets.size())
+            if (Data.findObject(Data.selectedObject))
             {
-                Data.LObjets.erase(Data.LObjets.begin() + Data.selectedObject);
+                Data.history.remove(Data, Data.selectedObject);
                 Data.selectedObject = -1;
             }
             return;
@@ -309,10 +310,9 @@ public:
         // any key deletes the selected object
         if (E.Type == EventType::KeyDown)
         {
-            if (Data.selectedObject >= 0 &&
-                Data.selectedObject < (int)Data.LObjets.size())
+            if (Data.findObject(Data.selectedObject))
             {
-                Data.LObjets.erase(Data.LObjets.begin() + Data.selectedObject);
+                Data.history.remove(Data, Data.selectedObject);
                 Data.selectedObject = -1;
             }
         }
@@ -320,36 +320,44 @@ public:
 
     void draw(Graphics& G, const Model& Data) override
     {
-        if (Data.selectedObject < 0 ||
-            Data.selectedObject >= (int)Data.LObjets.size())
-            return;
-
-        auto obj = Data.LObjets[Data.selectedObject];
+        const ObjGeom* obj = Data.findObject(Data.selectedObject);
+        if (!obj) return;
 
         // highlight selected object
-        if (auto R = dynamic_pointer_cast<ObjRectangle>(obj))
+        Highlight H(G);
+        obj->accept(H);
+    }
+
+private:
+    // yellow outline of the selected shape
+    struct Highlight : ShapeVisitor
+    {
+        Graphics& G;
+        Highlight(Graphics& g) : G(g) {}
+
+        void visit(const ObjRectangle& R) override
         {
             V2 P, size;
-            getPLH(R->P1_, R->P2_, P, size);
+            getPLH(R.P1_, R.P2_, P, size);
             G.drawRectangle(P, size, Color::Yellow, false, 2);
         }
-        else if (auto S = dynamic_pointer_cast<ObjSegment>(obj))
+
+        void visit(const ObjSegment& S) override
         {
-            G.drawLine(S->P1_, S->P2_, Color::Yellow, 2);
+            G.drawLine(S.P1_, S.P2_, Color::Yellow, 2);
         }
-        else if (auto C = dynamic_pointer_cast<ObjCircle>(obj))
+
+        void visit(const ObjCircle& C) override
         {
-            G.drawCircle(C->center_, C->radius_, Color::Yellow, false, 2);
+            G.drawCircle(C.center_, C.radius_, Color::Yellow, false, 2);
         }
-        else if (auto Pp = dynamic_pointer_cast<ObjPolygon>(obj))
+
+        void visit(const ObjPolygon& Pp) override
         {
-            for (int i = 0; i < (int)Pp->pts_.size() - 1; i++)
-            {
-                G.drawLine(Pp->pts_[i], Pp->pts_[i + 1],
-                    Color::Yellow, 2);
-            }
+            for (int i = 0; i < (int)Pp.pts_.size() - 1; i++)
+                G.drawLine(Pp.pts_[i], Pp.pts_[i + 1], Color::Yellow, 2);
         }
-    }
+    };
 };
 
 ///////////////////////////////////////////////////////////////
@@ -358,59 +366,100 @@ public:
 
 class ToolEditPoints : public Tool
 {
-    int objIndex = -1;
+    int objId = -1;
     int ptIndex = -1;
     bool dragging = false;
 
-public:
-    ToolEditPoints() : Tool() {}
+    // state before the drag, for the history:
+    // the moved vertex for polygons, a copy of the shape otherwise
+    V2 dragFrom_;
+    shared_ptr<ObjGeom> shapeBefore_;
+    bool dragMoved_ = false;
+
+    PointIndex index_;
+    int indexRevision_ = -1;   // sceneRevision the index was built for
+    vector<V2> visible_;       // handles inside the viewport (reused each frame)
+    vector<PointIndex::Handle> near_;
 
-    bool isMouseNearPoint(V2 mouse, V2 point)
+    // rebuild the point index when the object list changed
+    void syncIndex(const Model& Data)
     {
-        return (mouse - point).norm() <= 8.0f;
+        if (indexRevision_ == Data.sceneRevision) return;
+
+        index_.build(Data.LObjets);
+        indexRevision_ = Data.sceneRevision;
+
+        dragging = false;
+        objId = -1;
+        ptIndex = -1;
     }
 
+public:
+    ToolEditPoints() : Tool() {}
+
     void processEvent(const Event& E, Model& Data) override
     {
+        syncIndex(Data);
+
         if (E.Type == EventType::MouseMove && dragging)
         {
-            if (objIndex >= 0 && ptIndex >= 0)
+            ObjGeom* obj = Data.editObject(objId);
+            if (obj && ptIndex >= 0)
             {
-                Data.LObjets[objIndex]->setPoint(ptIndex, Data.currentMousePos);
+                index_.setPoint(objId, *obj, ptIndex, Data.currentMousePos);
+                dragMoved_ = true;
             }
             return;
         }
 
         if (E.Type == EventType::MouseDown && E.info == "0")
         {
-            objIndex = -1;
-            ptIndex = -1;
+            // topmost object first, then lowest point index
+            near_.clear();
+            index_.findNear(Data.currentMousePos, 8, near_);
 
-            for (int i = Data.LObjets.size() - 1; i >= 0; --i)
+            int bestSlot = -1;
+            for (auto& H : near_)
             {
-                int count = Data.LObjets[i]->getPointCount();
-
-                for (int p = 0; p < count; ++p)
+                int slot = Data.slotOf(H.obj);
+                if (slot > bestSlot || (slot == bestSlot && H.pt < ptIndex))
                 {
-                    if (isMouseNearPoint(Data.currentMousePos,
-                                         Data.LObjets[i]->getPoint(p)))
-                    {
-                        objIndex = i;
-                        ptIndex = p;
-                        dragging = true;
-                        return;
-                    }
+                    bestSlot = slot;
+                    objId = H.obj;
+                    ptIndex = H.pt;
                 }
             }
 
+            if (bestSlot >= 0)
+            {
+                ObjGeom* obj = Data.findObject(objId);
+                dragFrom_ = obj->getPoint(ptIndex);
+                shapeBefore_ = nullptr;
+                if (obj->kind() != ShapeKind::Polygon)
+                    shapeBefore_ = obj->clone(Data.shapePool);
+
+                dragMoved_ = false;
+                dragging = true;
+                return;
+            }
+
             dragging = false;
-            objIndex = -1;
+            objId = -1;
             ptIndex = -1;
             return;
         }
 
         if (E.Type == EventType::MouseUp && E.info == "0")
         {
+            ObjGeom* obj = Data.findObject(objId);
+            if (dragging && dragMoved_ && obj)
+            {
+                if (shapeBefore_)
+                    Data.history.reshaped(Data, objId, shapeBefore_);
+                else
+                    Data.history.pointMoved(Data, objId, ptIndex, dragFrom_, obj->getPoint(ptIndex));
+                shapeBefore_ = nullptr;
+            }
             dragging = false;
             return;
         }
@@ -418,12 +467,16 @@ public:
 
     void draw(Graphics& G, const Model& Data) override
     {
-        for (auto& obj : Data.LObjets)
-            obj->drawPoints(G);
+        syncIndex(Data);
+
+        visible_.clear();
+        index_.collect(V2(0, 0), G.getWindowSize(), visible_);
+        G.drawSquares(visible_, 5, Color::Yellow);
 
-        if (objIndex >= 0 && ptIndex >= 0)
+        const ObjGeom* obj = Data.findObject(objId);
+        if (obj && ptIndex >= 0)
         {
-            V2 P = Data.LObjets[objIndex]->getPoint(ptIndex);
+            V2 P = obj->getPoint(ptIndex);
 
             int s = 6;
             G.drawRectangle(P - V2(s, s), V2(2*s, 2*s), Color::Red, true);
@@ -34,6 +34,24 @@
 #include <stdlib.h>
 #include <string.h>
 
+// SIMD versions of the IDCT, the upsampling and the colour conversion, chosen
+// at run time (see Decoder::LimitSimd); they give the same image as the
+// scalar code, bit for bit.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define JPEG_DECODER_SSE2
+    #include <emmintrin.h>
+    #if defined(_MSC_VER)
+        #define JPEG_DECODER_AVX2
+        #define JPEG_DECODER_AVX2_FUNC
+        #include <intrin.h>
+        #include <immintrin.h>
+    #elif defined(__GNUC__)
+        #define JPEG_DECODER_AVX2
+        #define JPEG_DECODER_AVX2_FUNC __attribute__((target("avx2")))
+        #include <immintrin.h>
+    #endif
+#endif
+
 #ifdef _MSC_VER
     #pragma warning(push)
     #pragma warning(disable: 4127) // conditional expression is constant
@@ -57,11 +75,42 @@ namespace Jpeg
             Internal_Finished, // used internally, will never be reported
         };
 
-        // decode the raw data. object is very large, and probably shouldn't
-        // go on the stack.
+        // decode the raw data.
         Decoder(const unsigned char* data, size_t size, void *(*allocFunc)(size_t) = malloc, void (*freeFunc)(void*) = free);
         ~Decoder();
 
+        // a decoder for several images, one Decode() after the other: the
+        // image buffers are kept from one to the next, and only grown (with
+        // allocFunc and freeFunc) when an image needs more.
+        Decoder(void *(*allocFunc)(size_t) = malloc, void (*freeFunc)(void*) = free);
+        DecodeResult Decode(const unsigned char* data, size_t size);
+
+        // the bytes held in image buffers, and their release (the next
+        // Decode allocates them again)
+        size_t GetBufferSize() const;
+        void ReleaseBuffers();
+
+        // parallel decoding of the large images, for the next Decode calls:
+        // run(user, count, task, arg) must call task(arg, 0) ... task(arg,
+        // count - 1), on up to threads threads, and return when all are done.
+        // The restart intervals of a scan are then decoded in parallel, and
+        // the upsampling and colour conversion run in stripes. Without
+        // restart markers the scan is decoded in sequence.
+        typedef void (*TaskFunc)(void* arg, int index);
+        typedef void (*RunFunc)(void* user, int count, TaskFunc task, void* arg);
+        void SetParallel(RunFunc run, void* user, int threads);
+
+        // decoding at a reduced size, for the next Decode calls: scale 2, 4
+        // or 8 divides the width and the height (rounded up), the blocks
+        // going through IDCTs of their low frequencies only. GetScale gives
+        // the one used: lower when a subsampled plane would be too small.
+        void SetScale(int scale);
+        int GetScale() const;
+
+        // the size of the image in the JPEG data, from its header; false if
+        // no frame header comes before the image data
+        static bool ReadSize(const unsigned char* data, size_t size, int& width, int& height);
+
         // the result of decode
         DecodeResult GetResult() const;
 
@@ -77,6 +126,12 @@ namespace Jpeg
 
         // in bytes
         size_t GetImageSize() const;
+
+        // instruction sets: a decoder uses the best one of the processor, at
+        // most the one given to LimitSimd (for tests and measures)
+        enum Simd { SimdScalar = 0, SimdSSE2, SimdAVX2 };
+        static void LimitSimd(Simd max);
+        Simd GetSimd() const;
         
         //////////////////////////////////////////////////////////////////////
         //////////////////////////////////////////////////////////////////////
@@ -93,6 +148,22 @@ namespace Jpeg
             unsigned char bits, code;
         };
 
+        enum { FastBits = 9 };
+
+        // a Huffman table: the codes of at most FastBits bits are looked up
+        // in fast, the longer ones found from the code ranges of each length
+        struct VlcTable {
+            VlcCode fast[1 << FastBits];
+            int maxcode[17];            // the last code of each length (below its first if none)
+            int valptr[17];             // index in values of the code 0 of each length
+            unsigned char values[256];
+        };
+
+        struct Buffer {
+            unsigned char *data;
+            size_t size;
+        };
+
         struct Component {
             int cid;
             int ssx, ssy;
@@ -116,15 +187,24 @@ namespace Jpeg
             Component comp[3];
             int qtused, qtavail;
             unsigned char qtab[4][64];
-            VlcCode vlctab[4][65536];
+            VlcTable vlctab[4];
             int buf, bufbits;
             int block[64];
             int rstinterval;
+            int shift;          // of the scale: blocks of 8 >> shift pixels
             unsigned char *rgb;
         };
 
         Context ctx;
-        char ZZ[64];
+        Buffer pixbuf[3][2];    // pixels of each component, and the other buffer of its upsampling
+        Buffer rgbbuf;
+        char ZZ[64];    // zigzag order; transposed blocks with SIMD, see _RowIDCT4
+        Simd simd;
+        RunFunc run;
+        void* runUser;
+        int threads;
+        enum { ParallelPixels = 1 << 18 };      // below, all in sequence
+        int scale;
         void *(*AllocMem)(size_t);
         void (*FreeMem)(void*);
 
@@ -236,8 +316,285 @@ namespace Jpeg
             *out = _Clip(((x7 - x1) >> 14) + 128);
         }
 
+        // the widest instruction set of the processor that we use, once
+        static Simd _DetectSimd() {
+#if defined(JPEG_DECODER_AVX2) && defined(_MSC_VER)
+            int r[4];
+            __cpuid(r, 0);
+            if (r[0] < 7) return SimdSSE2;
+            __cpuid(r, 1);
+            if (!(r[2] & (1 << 27)) || !(r[2] & (1 << 28))) return SimdSSE2;     // OSXSAVE, AVX
+            if ((_xgetbv(0) & 6) != 6) return SimdSSE2;                         // YMM saved by the system
+            __cpuidex(r, 7, 0);
+            return (r[1] & (1 << 5)) ? SimdAVX2 : SimdSSE2;
+#elif defined(JPEG_DECODER_AVX2)
+            return __builtin_cpu_supports("avx2") ? SimdAVX2 : SimdSSE2;
+#elif defined(JPEG_DECODER_SSE2)
+            return SimdSSE2;
+#else
+            return SimdScalar;
+#endif
+        }
+
+        static Simd& _SimdLimit() {
+            static Simd limit = SimdAVX2;
+            return limit;
+        }
+
+#ifdef JPEG_DECODER_SSE2
+        // _RowIDCT4 and _ColIDCT4 are _RowIDCT and _ColIDCT on vectors: with
+        // blk transposed (blk[8 * j + r] is the element j of row r), v[j] holds
+        // the element j of a row per lane. The lanes whose shortcut the scalar
+        // code takes get its values.
+        // SSE2 has no 32-bit multiply low: two 32x32->64 multiplies instead
+        static inline __m128i _Mul4(const __m128i a, const int k) {
+            const __m128i kk = _mm_set1_epi32(k);
+            __m128i even = _mm_mul_epu32(a, kk), odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), kk);
+            return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+        }
+
+        static inline __m128i _Select4(const __m128i mask, const __m128i a, const __m128i b) {
+            return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+        }
+
+        static inline void _Transpose4(__m128i& a, __m128i& b, __m128i& c, __m128i& d) {
+            __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpacklo_epi32(c, d);
+            __m128i t2 = _mm_unpackhi_epi32(a, b), t3 = _mm_unpackhi_epi32(c, d);
+            a = _mm_unpacklo_epi64(t0, t1);  b = _mm_unpackhi_epi64(t0, t1);
+            c = _mm_unpacklo_epi64(t2, t3);  d = _mm_unpackhi_epi64(t2, t3);
+        }
+
+        static inline void _RowIDCT4(__m128i* v) {
+            __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, flat;
+            x1 = _mm_slli_epi32(v[4], 11);  x2 = v[6];  x3 = v[2];  x4 = v[1];  x5 = v[7];  x6 = v[5];  x7 = v[3];
+            flat = _mm_or_si128(_mm_or_si128(_mm_or_si128(x1, x2), _mm_or_si128(x3, x4)), _mm_or_si128(_mm_or_si128(x5, x6), x7));
+            flat = _mm_cmpeq_epi32(flat, _mm_setzero_si128());
+            x0 = _mm_add_epi32(_mm_slli_epi32(v[0], 11), _mm_set1_epi32(128));
+            x8 = _Mul4(_mm_add_epi32(x4, x5), W7);
+            x4 = _mm_add_epi32(x8, _Mul4(x4, W1 - W7));
+            x5 = _mm_sub_epi32(x8, _Mul4(x5, W1 + W7));
+            x8 = _Mul4(_mm_add_epi32(x6, x7), W3);
+            x6 = _mm_sub_epi32(x8, _Mul4(x6, W3 - W5));
+            x7 = _mm_sub_epi32(x8, _Mul4(x7, W3 + W5));
+            x8 = _mm_add_epi32(x0, x1);
+            x0 = _mm_sub_epi32(x0, x1);
+            x1 = _Mul4(_mm_add_epi32(x3, x2), W6);
+            x2 = _mm_sub_epi32(x1, _Mul4(x2, W2 + W6));
+            x3 = _mm_add_epi32(x1, _Mul4(x3, W2 - W6));
+            x1 = _mm_add_epi32(x4, x6);
+            x4 = _mm_sub_epi32(x4, x6);
+            x6 = _mm_add_epi32(x5, x7);
+            x5 = _mm_sub_epi32(x5, x7);
+            x7 = _mm_add_epi32(x8, x3);
+            x8 = _mm_sub_epi32(x8, x3);
+            x3 = _mm_add_epi32(x0, x2);
+            x0 = _mm_sub_epi32(x0, x2);
+            x2 = _mm_srai_epi32(_mm_add_epi32(_Mul4(_mm_add_epi32(x4, x5), 181), _mm_set1_epi32(128)), 8);
+            x4 = _mm_srai_epi32(_mm_add_epi32(_Mul4(_mm_sub_epi32(x4, x5), 181), _mm_set1_epi32(128)), 8);
+            const __m128i dc = _mm_slli_epi32(v[0], 3);
+            v[0] = _Select4(flat, dc, _mm_srai_epi32(_mm_add_epi32(x7, x1), 8));
+            v[1] = _Select4(flat, dc, _mm_srai_epi32(_mm_add_epi32(x3, x2), 8));
+            v[2] = _Select4(flat, dc, _mm_srai_epi32(_mm_add_epi32(x0, x4), 8));
+            v[3] = _Select4(flat, dc, _mm_srai_epi32(_mm_add_epi32(x8, x6), 8));
+            v[4] = _Select4(flat, dc, _mm_srai_epi32(_mm_sub_epi32(x8, x6), 8));
+            v[5] = _Select4(flat, dc, _mm_srai_epi32(_mm_sub_epi32(x0, x4), 8));
+            v[6] = _Select4(flat, dc, _mm_srai_epi32(_mm_sub_epi32(x3, x2), 8));
+            v[7] = _Select4(flat, dc, _mm_srai_epi32(_mm_sub_epi32(x7, x1), 8));
+        }
+
+        // v[i]: row i of the columns; out: the pixels before clipping
+        static inline void _ColIDCT4(__m128i* v) {
+            __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, flat;
+            const __m128i four = _mm_set1_epi32(4), c128 = _mm_set1_epi32(128);
+            x1 = _mm_slli_epi32(v[4], 8);  x2 = v[6];  x3 = v[2];  x4 = v[1];  x5 = v[7];  x6 = v[5];  x7 = v[3];
+            flat = _mm_or_si128(_mm_or_si128(_mm_or_si128(x1, x2), _mm_or_si128(x3, x4)), _mm_or_si128(_mm_or_si128(x5, x6), x7));
+            flat = _mm_cmpeq_epi32(flat, _mm_setzero_si128());
+            x0 = _mm_add_epi32(_mm_slli_epi32(v[0], 8), _mm_set1_epi32(8192));
+            x8 = _mm_add_epi32(_Mul4(_mm_add_epi32(x4, x5), W7), four);
+            x4 = _mm_srai_epi32(_mm_add_epi32(x8, _Mul4(x4, W1 - W7)), 3);
+            x5 = _mm_srai_epi32(_mm_sub_epi32(x8, _Mul4(x5, W1 + W7)), 3);
+            x8 = _mm_add_epi32(_Mul4(_mm_add_epi32(x6, x7), W3), four);
+            x6 = _mm_srai_epi32(_mm_sub_epi32(x8, _Mul4(x6, W3 - W5)), 3);
+            x7 = _mm_srai_epi32(_mm_sub_epi32(x8, _Mul4(x7, W3 + W5)), 3);
+            x8 = _mm_add_epi32(x0, x1);
+            x0 = _mm_sub_epi32(x0, x1);
+            x1 = _mm_add_epi32(_Mul4(_mm_add_epi32(x3, x2), W6), four);
+            x2 = _mm_srai_epi32(_mm_sub_epi32(x1, _Mul4(x2, W2 + W6)), 3);
+            x3 = _mm_srai_epi32(_mm_add_epi32(x1, _Mul4(x3, W2 - W6)), 3);
+            x1 = _mm_add_epi32(x4, x6);
+            x4 = _mm_sub_epi32(x4, x6);
+            x6 = _mm_add_epi32(x5, x7);
+            x5 = _mm_sub_epi32(x5, x7);
+            x7 = _mm_add_epi32(x8, x3);
+            x8 = _mm_sub_epi32(x8, x3);
+            x3 = _mm_add_epi32(x0, x2);
+            x0 = _mm_sub_epi32(x0, x2);
+            x2 = _mm_srai_epi32(_mm_add_epi32(_Mul4(_mm_add_epi32(x4, x5), 181), c128), 8);
+            x4 = _mm_srai_epi32(_mm_add_epi32(_Mul4(_mm_sub_epi32(x4, x5), 181), c128), 8);
+            const __m128i dc = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(v[0], _mm_set1_epi32(32)), 6), c128);
+            v[0] = _Select4(flat, dc, _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(x7, x1), 14), c128));
+            v[1] = _Select4(flat, dc, _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(x3, x2), 14), c128));
+            v[2] = _Select4(flat, dc, _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(x0, x4), 14), c128));
+            v[3] = _Select4(flat, dc, _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(x8, x6), 14), c128));
+            v[4] = _Select4(flat, dc, _mm_add_epi32(_mm_srai_epi32(_mm_sub_epi32(x8, x6), 14), c128));
+            v[5] = _Select4(flat, dc, _mm_add_epi32(_mm_srai_epi32(_mm_sub_epi32(x0, x4), 14), c128));
+            v[6] = _Select4(flat, dc, _mm_add_epi32(_mm_srai_epi32(_mm_sub_epi32(x3, x2), 14), c128));
+            v[7] = _Select4(flat, dc, _mm_add_epi32(_mm_srai_epi32(_mm_sub_epi32(x7, x1), 14), c128));
+        }
+
+        // rows 0-3 then 4-7 in lo and hi; then columns 0-3 and 4-7
+        static void _IDCT_SSE2(const int* blk, unsigned char *out, int stride) {
+            __m128i lo[8], hi[8];
+            int i;
+            for (i = 0;  i < 8;  ++i) {
+                lo[i] = _mm_loadu_si128((const __m128i*) &blk[8 * i]);
+                hi[i] = _mm_loadu_si128((const __m128i*) &blk[8 * i + 4]);
+            }
+            _RowIDCT4(lo);
+            _RowIDCT4(hi);
+            __m128i left[8] = { lo[0], lo[1], lo[2], lo[3], hi[0], hi[1], hi[2], hi[3] };
+            __m128i right[8] = { lo[4], lo[5], lo[6], lo[7], hi[4], hi[5], hi[6], hi[7] };
+            _Transpose4(left[0], left[1], left[2], left[3]);
+            _Transpose4(left[4], left[5], left[6], left[7]);
+            _Transpose4(right[0], right[1], right[2], right[3]);
+            _Transpose4(right[4], right[5], right[6], right[7]);
+            _ColIDCT4(left);
+            _ColIDCT4(right);
+            for (i = 0;  i < 8;  ++i) {
+                __m128i p = _mm_packs_epi32(left[i], right[i]);     // saturated, then clipped by packus as _Clip does
+                _mm_storel_epi64((__m128i*) &out[i * stride], _mm_packus_epi16(p, p));
+            }
+        }
+#endif
+
+#ifdef JPEG_DECODER_AVX2
+        // the same on eight lanes: a whole row or column per vector
+        JPEG_DECODER_AVX2_FUNC static inline __m256i _Mul8(const __m256i a, const int k) {
+            return _mm256_mullo_epi32(a, _mm256_set1_epi32(k));
+        }
+
+        JPEG_DECODER_AVX2_FUNC static void _IDCT_AVX2(const int* blk, unsigned char *out, int stride) {
+            __m256i v[8], x0, x1, x2, x3, x4, x5, x6, x7, x8, flat, dc;
+            const __m256i zero = _mm256_setzero_si256(), c128 = _mm256_set1_epi32(128), four = _mm256_set1_epi32(4);
+            int i;
+            for (i = 0;  i < 8;  ++i)
+                v[i] = _mm256_loadu_si256((const __m256i*) &blk[8 * i]);
+
+            // rows
+            x1 = _mm256_slli_epi32(v[4], 11);  x2 = v[6];  x3 = v[2];  x4 = v[1];  x5 = v[7];  x6 = v[5];  x7 = v[3];
+            flat = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(x1, x2), _mm256_or_si256(x3, x4)), _mm256_or_si256(_mm256_or_si256(x5, x6), x7));
+            flat = _mm256_cmpeq_epi32(flat, zero);
+            x0 = _mm256_add_epi32(_mm256_slli_epi32(v[0], 11), c128);
+            x8 = _Mul8(_mm256_add_epi32(x4, x5), W7);
+            x4 = _mm256_add_epi32(x8, _Mul8(x4, W1 - W7));
+            x5 = _mm256_sub_epi32(x8, _Mul8(x5, W1 + W7));
+            x8 = _Mul8(_mm256_add_epi32(x6, x7), W3);
+            x6 = _mm256_sub_epi32(x8, _Mul8(x6, W3 - W5));
+            x7 = _mm256_sub_epi32(x8, _Mul8(x7, W3 + W5));
+            x8 = _mm256_add_epi32(x0, x1);
+            x0 = _mm256_sub_epi32(x0, x1);
+            x1 = _Mul8(_mm256_add_epi32(x3, x2), W6);
+            x2 = _mm256_sub_epi32(x1, _Mul8(x2, W2 + W6));
+            x3 = _mm256_add_epi32(x1, _Mul8(x3, W2 - W6));
+            x1 = _mm256_add_epi32(x4, x6);
+            x4 = _mm256_sub_epi32(x4, x6);
+            x6 = _mm256_add_epi32(x5, x7);
+            x5 = _mm256_sub_epi32(x5, x7);
+            x7 = _mm256_add_epi32(x8, x3);
+            x8 = _mm256_sub_epi32(x8, x3);
+            x3 = _mm256_add_epi32(x0, x2);
+            x0 = _mm256_sub_epi32(x0, x2);
+            x2 = _mm256_srai_epi32(_mm256_add_epi32(_Mul8(_mm256_add_epi32(x4, x5), 181), c128), 8);
+            x4 = _mm256_srai_epi32(_mm256_add_epi32(_Mul8(_mm256_sub_epi32(x4, x5), 181), c128), 8);
+            dc = _mm256_slli_epi32(v[0], 3);
+            v[0] = _mm256_blendv_epi8(_mm256_srai_epi32(_mm256_add_epi32(x7, x1), 8), dc, flat);
+            v[1] = _mm256_blendv_epi8(_mm256_srai_epi32(_mm256_add_epi32(x3, x2), 8), dc, flat);
+            v[2] = _mm256_blendv_epi8(_mm256_srai_epi32(_mm256_add_epi32(x0, x4), 8), dc, flat);
+            v[3] = _mm256_blendv_epi8(_mm256_srai_epi32(_mm256_add_epi32(x8, x6), 8), dc, flat);
+            v[4] = _mm256_blendv_epi8(_mm256_srai_epi32(_mm256_sub_epi32(x8, x6), 8), dc, flat);
+            v[5] = _mm256_blendv_epi8(_mm256_srai_epi32(_mm256_sub_epi32(x0, x4), 8), dc, flat);
+            v[6] = _mm256_blendv_epi8(_mm256_srai_epi32(_mm256_sub_epi32(x3, x2), 8), dc, flat);
+            v[7] = _mm256_blendv_epi8(_mm256_srai_epi32(_mm256_sub_epi32(x7, x1), 8), dc, flat);
+
+            // transpose: v[i] becomes the row i of the columns
+            x0 = _mm256_unpacklo_epi32(v[0], v[1]);  x1 = _mm256_unpackhi_epi32(v[0], v[1]);
+            x2 = _mm256_unpacklo_epi32(v[2], v[3]);  x3 = _mm256_unpackhi_epi32(v[2], v[3]);
+            x4 = _mm256_unpacklo_epi32(v[4], v[5]);  x5 = _mm256_unpackhi_epi32(v[4], v[5]);
+            x6 = _mm256_unpacklo_epi32(v[6], v[7]);  x7 = _mm256_unpackhi_epi32(v[6], v[7]);
+            v[0] = _mm256_unpacklo_epi64(x0, x2);  v[1] = _mm256_unpackhi_epi64(x0, x2);
+            v[2] = _mm256_unpacklo_epi64(x1, x3);  v[3] = _mm256_unpackhi_epi64(x1, x3);
+            v[4] = _mm256_unpacklo_epi64(x4, x6);  v[5] = _mm256_unpackhi_epi64(x4, x6);
+            v[6] = _mm256_unpacklo_epi64(x5, x7);  v[7] = _mm256_unpackhi_epi64(x5, x7);
+            for (i = 0;  i < 4;  ++i) {
+                x0 = v[i];
+                v[i] = _mm256_permute2x128_si256(x0, v[i + 4], 0x20);
+                v[i + 4] = _mm256_permute2x128_si256(x0, v[i + 4], 0x31);
+            }
+
+            // columns
+            x1 = _mm256_slli_epi32(v[4], 8);  x2 = v[6];  x3 = v[2];  x4 = v[1];  x5 = v[7];  x6 = v[5];  x7 = v[3];
+            flat = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(x1, x2), _mm256_or_si256(x3, x4)), _mm256_or_si256(_mm256_or_si256(x5, x6), x7));
+            flat = _mm256_cmpeq_epi32(flat, zero);
+            x0 = _mm256_add_epi32(_mm256_slli_epi32(v[0], 8), _mm256_set1_epi32(8192));
+            x8 = _mm256_add_epi32(_Mul8(_mm256_add_epi32(x4, x5), W7), four);
+            x4 = _mm256_srai_epi32(_mm256_add_epi32(x8, _Mul8(x4, W1 - W7)), 3);
+            x5 = _mm256_srai_epi32(_mm256_sub_epi32(x8, _Mul8(x5, W1 + W7)), 3);
+            x8 = _mm256_add_epi32(_Mul8(_mm256_add_epi32(x6, x7), W3), four);
+            x6 = _mm256_srai_epi32(_mm256_sub_epi32(x8, _Mul8(x6, W3 - W5)), 3);
+            x7 = _mm256_srai_epi32(_mm256_sub_epi32(x8, _Mul8(x7, W3 + W5)), 3);
+            x8 = _mm256_add_epi32(x0, x1);
+            x0 = _mm256_sub_epi32(x0, x1);
+            x1 = _mm256_add_epi32(_Mul8(_mm256_add_epi32(x3, x2), W6), four);
+            x2 = _mm256_srai_epi32(_mm256_sub_epi32(x1, _Mul8(x2, W2 + W6)), 3);
+            x3 = _mm256_srai_epi32(_mm256_add_epi32(x1, _Mul8(x3, W2 - W6)), 3);
+            x1 = _mm256_add_epi32(x4, x6);
+            x4 = _mm256_sub_epi32(x4, x6);
+            x6 = _mm256_add_epi32(x5, x7);
+            x5 = _mm256_sub_epi32(x5, x7);
+            x7 = _mm256_add_epi32(x8, x3);
+            x8 = _mm256_sub_epi32(x8, x3);
+            x3 = _mm256_add_epi32(x0, x2);
+            x0 = _mm256_sub_epi32(x0, x2);
+            x2 = _mm256_srai_epi32(_mm256_add_epi32(_Mul8(_mm256_add_epi32(x4, x5), 181), c128), 8);
+            x4 = _mm256_srai_epi32(_mm256_add_epi32(_Mul8(_mm256_sub_epi32(x4, x5), 181), c128), 8);
+            dc = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(v[0], _mm256_set1_epi32(32)), 6), c128);
+            v[0] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(x7, x1), 14), c128);
+            v[1] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(x3, x2), 14), c128);
+            v[2] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(x0, x4), 14), c128);
+            v[3] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(x8, x6), 14), c128);
+            v[4] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_sub_epi32(x8, x6), 14), c128);
+            v[5] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_sub_epi32(x0, x4), 14), c128);
+            v[6] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_sub_epi32(x3, x2), 14), c128);
+            v[7] = _mm256_add_epi32(_mm256_srai_epi32(_mm256_sub_epi32(x7, x1), 14), c128);
+            for (i = 0;  i < 8;  ++i) {
+                __m256i r = _mm256_blendv_epi8(v[i], dc, flat);
+                __m128i p = _mm_packs_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+                _mm_storel_epi64((__m128i*) &out[i * stride], _mm_packus_epi16(p, p));
+            }
+        }
+#endif
+
         #define JPEG_DECODER_THROW(e) do { ctx.error = e; return; } while (0)
 
+        // b, grown to size bytes if smaller; NULL if out of memory
+        inline unsigned char* _Reserve(Buffer& b, size_t size) {
+            if (b.size < size) {
+                if (b.data) FreeMem(b.data);
+                b.data = (unsigned char*)AllocMem(size);
+                b.size = b.data ? size : 0;
+            }
+            return b.data;
+        }
+
+        // the upsampled pixels of c become its pixels; the old ones the next destination
+        inline void _SwapBuffers(Component* c) {
+            Buffer* b = pixbuf[c - ctx.comp];
+            Buffer t = b[0];
+            b[0] = b[1];
+            b[1] = t;
+            c->pixels = b[0].data;
+        }
+
         inline int _ShowBits(int bits) {
             unsigned char newbyte;
             if (!bits) return 0;
@@ -346,24 +703,33 @@ namespace Jpeg
             ctx.mbsizey = ssymax << 3;
             ctx.mbwidth = (ctx.width + ctx.mbsizex - 1) / ctx.mbsizex;
             ctx.mbheight = (ctx.height + ctx.mbsizey - 1) / ctx.mbsizey;
+            // the scale asked, or a lower one that leaves subsampled planes big enough to upsample
+            for (ctx.shift = (scale >= 8) ? 3 : (scale >= 4) ? 2 : (scale >= 2) ? 1 : 0;  ctx.shift;  --ctx.shift) {
+                const int w = (ctx.width + (1 << ctx.shift) - 1) >> ctx.shift, h = (ctx.height + (1 << ctx.shift) - 1) >> ctx.shift;
+                for (i = 0, c = ctx.comp;  i < ctx.ncomp;  ++i, ++c)
+                    if ((((w * c->ssx + ssxmax - 1) / ssxmax < 3) && (c->ssx != ssxmax)) || (((h * c->ssy + ssymax - 1) / ssymax < 3) && (c->ssy != ssymax))) break;
+                if (i == ctx.ncomp) break;
+            }
+            ctx.width = (ctx.width + (1 << ctx.shift) - 1) >> ctx.shift;
+            ctx.height = (ctx.height + (1 << ctx.shift) - 1) >> ctx.shift;
             for (i = 0, c = ctx.comp;  i < ctx.ncomp;  ++i, ++c) {
                 c->width = (ctx.width * c->ssx + ssxmax - 1) / ssxmax;
                 c->stride = (c->width + 7) & 0x7FFFFFF8;
                 c->height = (ctx.height * c->ssy + ssymax - 1) / ssymax;
-                c->stride = ctx.mbwidth * ctx.mbsizex * c->ssx / ssxmax;
+                c->stride = (ctx.mbwidth * ctx.mbsizex * c->ssx / ssxmax) >> ctx.shift;
                 if (((c->width < 3) && (c->ssx != ssxmax)) || ((c->height < 3) && (c->ssy != ssymax))) JPEG_DECODER_THROW(Unsupported);
-                if (!(c->pixels = (unsigned char*)AllocMem(c->stride * (ctx.mbheight * ctx.mbsizey * c->ssy / ssymax)))) JPEG_DECODER_THROW(OutOfMemory);
+                if (!(c->pixels = _Reserve(pixbuf[i][0], c->stride * ((ctx.mbheight * ctx.mbsizey * c->ssy / ssymax) >> ctx.shift)))) JPEG_DECODER_THROW(OutOfMemory);
             }
             if (ctx.ncomp == 3) {
-                ctx.rgb = (unsigned char*)AllocMem(ctx.width * ctx.height * ctx.ncomp);
+                ctx.rgb = _Reserve(rgbbuf, ctx.width * ctx.height * ctx.ncomp);
                 if (!ctx.rgb) JPEG_DECODER_THROW(OutOfMemory);
             }
             _Skip(ctx.length);
         }
 
         inline void _DecodeDHT(void) {
-            int codelen, currcnt, remain, spread, i, j;
-            VlcCode *vlc;
+            int codelen, currcnt, remain, code, count, i, j;
+            VlcTable *vlc;
             unsigned char counts[16];
             _DecodeLength();
             while (ctx.length >= 17) {
@@ -374,29 +740,30 @@ namespace Jpeg
                 for (codelen = 1;  codelen <= 16;  ++codelen)
                     counts[codelen - 1] = ctx.pos[codelen];
                 _Skip(17);
-                vlc = &ctx.vlctab[i][0];
-                remain = spread = 65536;
-                for (codelen = 1;  codelen <= 16;  ++codelen) {
-                    spread >>= 1;
+                vlc = &ctx.vlctab[i];
+                memset(vlc->fast, 0, sizeof(vlc->fast));
+                remain = 65536;
+                code = count = 0;
+                for (codelen = 1;  codelen <= 16;  ++codelen, code <<= 1) {
                     currcnt = counts[codelen - 1];
+                    vlc->maxcode[codelen] = code + currcnt - 1;
+                    vlc->valptr[codelen] = count - code;
                     if (!currcnt) continue;
                     if (ctx.length < currcnt) JPEG_DECODER_THROW(SyntaxError);
                     remain -= currcnt << (16 - codelen);
                     if (remain < 0) JPEG_DECODER_THROW(SyntaxError);
-                    for (i = 0;  i < currcnt;  ++i) {
-                        register unsigned char code = ctx.pos[i];
-                        for (j = spread;  j;  --j) {
-                            vlc->bits = (unsigned char) codelen;
-                            vlc->code = code;
-                            ++vlc;
+                    if (count + currcnt > 256) JPEG_DECODER_THROW(SyntaxError);
+                    for (i = 0;  i < currcnt;  ++i, ++code) {
+                        vlc->values[count++] = ctx.pos[i];
+                        if (codelen > FastBits) continue;
+                        VlcCode *fast = &vlc->fast[code << (FastBits - codelen)];
+                        for (j = 1 << (FastBits - codelen);  j;  --j, ++fast) {
+                            fast->bits = (unsigned char) codelen;
+                            fast->code = ctx.pos[i];
                         }
                     }
                     _Skip(currcnt);
                 }
-                while (remain--) {
-                    vlc->bits = 0;
-                    ++vlc;
-                }
             }
             if (ctx.length) JPEG_DECODER_THROW(SyntaxError);
         }
@@ -424,12 +791,21 @@ namespace Jpeg
             _Skip(ctx.length);
         }
 
-        inline int _GetVLC(VlcCode* vlc, unsigned char* code) {
+        inline int _GetVLC(const VlcTable* vlc, unsigned char* code) {
             int value = _ShowBits(16);
-            int bits = vlc[value].bits;
-            if (!bits) { ctx.error = SyntaxError; return 0; }
+            int bits = vlc->fast[value >> (16 - FastBits)].bits;
+            if (bits)
+                value = vlc->fast[value >> (16 - FastBits)].code;
+            else {
+                // longer than FastBits: the codes of a length follow those of
+                // the shorter ones, so the first length whose last code is not
+                // below our bits is the one
+                for (bits = FastBits + 1;  bits <= 16;  ++bits)
+                    if ((value >> (16 - bits)) <= vlc->maxcode[bits]) break;
+                if (bits > 16) { ctx.error = SyntaxError; return 0; }
+                value = vlc->values[vlc->valptr[bits] + (value >> (16 - bits))];
+            }
             _SkipBits(bits);
-            value = vlc[value].code;
             if (code) *code = (unsigned char) value;
             bits = value & 15;
             if (!bits) return 0;
@@ -439,29 +815,172 @@ namespace Jpeg
             return value;
         }
 
+        // the IDCT of the n x n lowest frequencies (n = 2 or 4) at n x n
+        // points: the 8 x 8 block at a lower resolution, with the same level.
+        // Constants: c(u) cos((2x + 1) u pi / 2n) << 13, c(0) = 1, c(u) = sqrt(2),
+        // that is 8192 and, for n = 4, 10703 and 4433
+        inline void _ReducedIDCT(const int* blk, unsigned char *out, int stride, const int n) {
+            const int du = (simd == SimdScalar) ? 1 : 8, dv = 9 - du;   // blk transposed with SIMD
+            int t[4][4], x, y, e0, e1, o0, o1;
+            if (n == 2) {
+                // all the constants are 8192: sums and differences
+                const int f00 = blk[0], f10 = blk[du], f01 = blk[dv], f11 = blk[du + dv];
+                out[0]          = _Clip(((f00 + f10 + f01 + f11 + 4) >> 3) + 128);
+                out[1]          = _Clip(((f00 - f10 + f01 - f11 + 4) >> 3) + 128);
+                out[stride]     = _Clip(((f00 + f10 - f01 - f11 + 4) >> 3) + 128);
+                out[stride + 1] = _Clip(((f00 - f10 - f01 + f11 + 4) >> 3) + 128);
+                return;
+            }
+            // columns, scaled by 4
+            for (x = 0;  x < 4;  ++x) {
+                const int* f = &blk[x * du];
+                e0 = (f[0] + f[2 * dv]) << 13;
+                e1 = (f[0] - f[2 * dv]) << 13;
+                o0 = 10703 * f[dv] + 4433 * f[3 * dv];
+                o1 = 4433 * f[dv] - 10703 * f[3 * dv];
+                t[0][x] = (e0 + o0 + 1024) >> 11;
+                t[1][x] = (e1 + o1 + 1024) >> 11;
+                t[2][x] = (e1 - o1 + 1024) >> 11;
+                t[3][x] = (e0 - o0 + 1024) >> 11;
+            }
+            // rows, the 8 x 8 IDCT level being 1 / 8
+            for (y = 0;  y < 4;  ++y, out += stride) {
+                e0 = (t[y][0] + t[y][2]) << 13;
+                e1 = (t[y][0] - t[y][2]) << 13;
+                o0 = 10703 * t[y][1] + 4433 * t[y][3];
+                o1 = 4433 * t[y][1] - 10703 * t[y][3];
+                out[0] = _Clip(((e0 + o0 + (1 << 17)) >> 18) + 128);
+                out[1] = _Clip(((e1 + o1 + (1 << 17)) >> 18) + 128);
+                out[2] = _Clip(((e1 - o1 + (1 << 17)) >> 18) + 128);
+                out[3] = _Clip(((e0 - o0 + (1 << 17)) >> 18) + 128);
+            }
+        }
+
         inline void _DecodeBlock(Component* c, unsigned char* out) {
             unsigned char code;
             int value, coef = 0;
             memset(ctx.block, 0, sizeof(ctx.block));
-            c->dcpred += _GetVLC(&ctx.vlctab[c->dctabsel][0], NULL);
+            c->dcpred += _GetVLC(&ctx.vlctab[c->dctabsel], NULL);
             ctx.block[0] = (c->dcpred) * ctx.qtab[c->qtsel][0];
             do {
-                value = _GetVLC(&ctx.vlctab[c->actabsel][0], &code);
+                value = _GetVLC(&ctx.vlctab[c->actabsel], &code);
                 if (!code) break;  // EOB
                 if (!(code & 0x0F) && (code != 0xF0)) JPEG_DECODER_THROW(SyntaxError);
                 coef += (code >> 4) + 1;
                 if (coef > 63) JPEG_DECODER_THROW(SyntaxError);
                 ctx.block[(int) ZZ[coef]] = value * ctx.qtab[c->qtsel][coef];
             } while (coef < 63);
+            const int n = 8 >> ctx.shift;
+            if (!coef || (n == 1)) {
+                // DC only: what both IDCT passes give, a flat block
+                const unsigned char v = _Clip(((ctx.block[0] + 4) >> 3) + 128);
+                for (coef = 0;  coef < n;  ++coef)
+                    memset(&out[coef * c->stride], v, n);
+                return;
+            }
+            if (n < 8) { _ReducedIDCT(ctx.block, out, c->stride, n);  return; }
+#ifdef JPEG_DECODER_AVX2
+            if (simd == SimdAVX2) { _IDCT_AVX2(ctx.block, out, c->stride);  return; }
+#endif
+#ifdef JPEG_DECODER_SSE2
+            if (simd == SimdSSE2) { _IDCT_SSE2(ctx.block, out, c->stride);  return; }
+#endif
             for (coef = 0;  coef < 64;  coef += 8)
                 _RowIDCT(&ctx.block[coef]);
             for (coef = 0;  coef < 8;  ++coef)
                 _ColIDCT(&ctx.block[coef], &out[coef], c->stride);
         }
 
+        // the MCUs first .. last - 1, then the restart marker rst if rst >= 0
+        inline void _DecodeInterval(const int first, const int last, const int rst) {
+            int i, m, mbx, mby, sbx, sby;
+            Component* c;
+            for (m = first;  m < last;  ++m) {
+                mbx = m % ctx.mbwidth;
+                mby = m / ctx.mbwidth;
+                for (i = 0, c = ctx.comp;  i < ctx.ncomp;  ++i, ++c)
+                    for (sby = 0;  sby < c->ssy;  ++sby)
+                        for (sbx = 0;  sbx < c->ssx;  ++sbx) {
+                            _DecodeBlock(c, &c->pixels[((mby * c->ssy + sby) * c->stride + mbx * c->ssx + sbx) << (3 - ctx.shift)]);
+                            if (ctx.error)
+                            return;
+                        }
+            }
+            if (rst < 0) return;
+            _ByteAlign();
+            i = _GetBits(16);
+            if (((i & 0xFFF8) != 0xFFD0) || ((i & 7) != rst)) JPEG_DECODER_THROW(SyntaxError);
+        }
+
+        // the intervals of a task, each from its own position in the scan
+        struct Restarts {
+            Decoder* owner;
+            const int* starts;          // of each interval, from the scan; the end of the last
+            int intervals, tasks;
+            DecodeResult* errors;       // of each task
+        };
+
+        static void _RestartTask(void* arg, int task) {
+            const Restarts& R = *(const Restarts*) arg;
+            const Decoder& d = *R.owner;
+            const int count = d.ctx.mbwidth * d.ctx.mbheight;
+            const int first = (int) ((long long) R.intervals * task / R.tasks), last = (int) ((long long) R.intervals * (task + 1) / R.tasks);
+            Decoder worker(d.AllocMem, d.FreeMem);      // owns no buffer: decodes into those of d
+            int s, i;
+            worker.ctx = d.ctx;
+            worker.simd = d.simd;
+            memcpy(worker.ZZ, d.ZZ, sizeof(ZZ));
+            for (s = first;  (s < last) && !worker.ctx.error;  ++s) {
+                worker.ctx.pos = d.ctx.pos + R.starts[s];
+                worker.ctx.size = R.starts[s + 1] - R.starts[s];
+                worker.ctx.buf = worker.ctx.bufbits = 0;
+                for (i = 0;  i < 3;  ++i)
+                    worker.ctx.comp[i].dcpred = 0;
+                const int m = s * d.ctx.rstinterval;
+                worker._DecodeInterval(m, (count - m > d.ctx.rstinterval) ? m + d.ctx.rstinterval : count, (s + 1 < R.intervals) ? s & 7 : -1);
+            }
+            R.errors[task] = worker.ctx.error;
+        }
+
+        // the restart intervals decoded in parallel, found by their markers
+        // first; false to decode them one after the other, as when a marker
+        // is missing (the sequential decoding then reports where)
+        inline bool _DecodeRestarts(void) {
+            const int count = ctx.mbwidth * ctx.mbheight;
+            const int intervals = (count + ctx.rstinterval - 1) / ctx.rstinterval;
+            if (!run || (threads < 2) || (intervals < 2) || (count * 64 * (ctx.mbsizex >> 3) * (ctx.mbsizey >> 3) < ParallelPixels)) return false;
+            int *starts = (int*)AllocMem((intervals + 1) * sizeof(int));
+            int i, n = 1;
+            if (!starts) return false;
+            starts[0] = 0;
+            for (i = 0;  (i + 1 < ctx.size) && (n < intervals);  ++i) {
+                if (ctx.pos[i] != 0xFF) continue;
+                if (!ctx.pos[i + 1]) { ++i;  continue; }            // stuffed 0xFF
+                if ((ctx.pos[i + 1] & 0xF8) != 0xD0) break;         // end of the scan
+                starts[n++] = ++i + 1;                              // after the marker, checked by the interval before
+            }
+            starts[intervals] = ctx.size;   // the last interval: up to the end, as in sequence
+            Restarts R;
+            R.owner = this;
+            R.starts = starts;
+            R.intervals = intervals;
+            R.tasks = (intervals < 4 * threads) ? intervals : 4 * threads;
+            R.errors = (DecodeResult*)AllocMem(R.tasks * sizeof(DecodeResult));
+            if ((n < intervals) || !R.errors) {
+                FreeMem(starts);
+                if (R.errors) FreeMem(R.errors);
+                return false;
+            }
+            run(runUser, R.tasks, _RestartTask, &R);
+            for (i = 0;  (i < R.tasks) && !ctx.error;  ++i)
+                ctx.error = R.errors[i];
+            FreeMem(starts);
+            FreeMem(R.errors);
+            return true;
+        }
+
         inline void _DecodeScan(void) {
-            int i, mbx, mby, sbx, sby;
-            int rstcount = ctx.rstinterval, nextrst = 0;
+            int i, m;
             Component* c;
             _DecodeLength();
             if (ctx.length < (4 + 2 * ctx.ncomp)) JPEG_DECODER_THROW(SyntaxError);
@@ -476,26 +995,18 @@ namespace Jpeg
             }
             if (ctx.pos[0] || (ctx.pos[1] != 63) || ctx.pos[2]) JPEG_DECODER_THROW(Unsupported);
             _Skip(ctx.length);
-            for (mby = 0;  mby < ctx.mbheight;  ++mby)
-                for (mbx = 0;  mbx < ctx.mbwidth;  ++mbx) {
-                    for (i = 0, c = ctx.comp;  i < ctx.ncomp;  ++i, ++c)
-                        for (sby = 0;  sby < c->ssy;  ++sby)
-                            for (sbx = 0;  sbx < c->ssx;  ++sbx) {
-                                _DecodeBlock(c, &c->pixels[((mby * c->ssy + sby) * c->stride + mbx * c->ssx + sbx) << 3]);
-                                if (ctx.error)
-                                return;
-                            }
-                    if (ctx.rstinterval && !(--rstcount)) {
-                        _ByteAlign();
-                        i = _GetBits(16);
-                        if (((i & 0xFFF8) != 0xFFD0) || ((i & 7) != nextrst)) JPEG_DECODER_THROW(SyntaxError);
-                        nextrst = (nextrst + 1) & 7;
-                        rstcount = ctx.rstinterval;
-                        for (i = 0;  i < 3;  ++i)
-                            ctx.comp[i].dcpred = 0;
-                    }
+            const int count = ctx.mbwidth * ctx.mbheight;
+            const int interval = ctx.rstinterval ? ctx.rstinterval : count;
+            if (!ctx.rstinterval || !_DecodeRestarts()) {
+                // no restart marker after the last interval
+                for (m = 0;  m < count;  m += interval) {
+                    _DecodeInterval(m, (count - m > interval) ? m + interval : count, (count - m > interval) ? (m / interval) & 7 : -1);
+                    if (ctx.error) return;
+                    for (i = 0;  i < 3;  ++i)
+                        ctx.comp[i].dcpred = 0;
                 }
-            ctx.error = Internal_Finished;
+            }
+            if (!ctx.error) ctx.error = Internal_Finished;
         }
 
         enum {
@@ -517,19 +1028,112 @@ namespace Jpeg
             return _Clip((x + 64) >> 7);
         }
 
+#ifdef JPEG_DECODER_SSE2
+        // CF on eight sums of 8-bit samples, split in their positive and
+        // negative taps p and n to stay in 16 bits: below zero saturates to 0
+        static inline __m128i _CF8(const __m128i p, const __m128i n) {
+            return _mm_srli_epi16(_mm_subs_epu16(_mm_add_epi16(p, _mm_set1_epi16(64)), n), 7);
+        }
+
+        // the inner loop of _UpsampleH, 16 samples a step; returns where it stopped
+        static int _UpsampleRowH_SSE2(const unsigned char* lin, unsigned char* lout, const int xmax) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i kB = _mm_set1_epi16(CF4B), kC = _mm_set1_epi16(CF4C), kA = _mm_set1_epi16(-CF4A), kD = _mm_set1_epi16(-CF4D);
+            int x;
+            for (x = 0;  x + 16 <= xmax;  x += 16) {
+                const __m128i a = _mm_loadu_si128((const __m128i*) &lin[x]), b = _mm_loadu_si128((const __m128i*) &lin[x + 1]);
+                const __m128i c = _mm_loadu_si128((const __m128i*) &lin[x + 2]), d = _mm_loadu_si128((const __m128i*) &lin[x + 3]);
+                __m128i a0 = _mm_unpacklo_epi8(a, zero), b0 = _mm_unpacklo_epi8(b, zero), c0 = _mm_unpacklo_epi8(c, zero), d0 = _mm_unpacklo_epi8(d, zero);
+                __m128i a1 = _mm_unpackhi_epi8(a, zero), b1 = _mm_unpackhi_epi8(b, zero), c1 = _mm_unpackhi_epi8(c, zero), d1 = _mm_unpackhi_epi8(d, zero);
+                __m128i even = _mm_packus_epi16(
+                    _CF8(_mm_add_epi16(_mm_mullo_epi16(b0, kB), _mm_mullo_epi16(c0, kC)), _mm_add_epi16(_mm_mullo_epi16(a0, kA), _mm_mullo_epi16(d0, kD))),
+                    _CF8(_mm_add_epi16(_mm_mullo_epi16(b1, kB), _mm_mullo_epi16(c1, kC)), _mm_add_epi16(_mm_mullo_epi16(a1, kA), _mm_mullo_epi16(d1, kD))));
+                __m128i odd = _mm_packus_epi16(
+                    _CF8(_mm_add_epi16(_mm_mullo_epi16(b0, kC), _mm_mullo_epi16(c0, kB)), _mm_add_epi16(_mm_mullo_epi16(a0, kD), _mm_mullo_epi16(d0, kA))),
+                    _CF8(_mm_add_epi16(_mm_mullo_epi16(b1, kC), _mm_mullo_epi16(c1, kB)), _mm_add_epi16(_mm_mullo_epi16(a1, kD), _mm_mullo_epi16(d1, kA))));
+                _mm_storeu_si128((__m128i*) &lout[(x << 1) + 3], _mm_unpacklo_epi8(even, odd));
+                _mm_storeu_si128((__m128i*) &lout[(x << 1) + 19], _mm_unpackhi_epi8(even, odd));
+            }
+            return x;
+        }
+
+        // one output row of _UpsampleV, out[x] = CF(k0 r0[x] + ... + k3 r3[x]),
+        // 16 samples a step; returns where it stopped
+        static int _UpsampleRowV_SSE2(unsigned char* out, const unsigned char* const r[4], const int k[4], const int w) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i kk[4];
+            int x, i;
+            for (i = 0;  i < 4;  ++i)
+                kk[i] = _mm_set1_epi16((short) (k[i] < 0 ? -k[i] : k[i]));
+            for (x = 0;  x + 16 <= w;  x += 16) {
+                __m128i p0 = zero, p1 = zero, n0 = zero, n1 = zero;
+                for (i = 0;  i < 4;  ++i) {
+                    if (!k[i]) continue;
+                    const __m128i v = _mm_loadu_si128((const __m128i*) &r[i][x]);
+                    const __m128i t0 = _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), kk[i]);
+                    const __m128i t1 = _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), kk[i]);
+                    if (k[i] > 0) { p0 = _mm_add_epi16(p0, t0);  p1 = _mm_add_epi16(p1, t1); }
+                    else          { n0 = _mm_add_epi16(n0, t0);  n1 = _mm_add_epi16(n1, t1); }
+                }
+                _mm_storeu_si128((__m128i*) &out[x], _mm_packus_epi16(_CF8(p0, n0), _CF8(p1, n1)));
+            }
+            return x;
+        }
+#endif
+
+        // f(c, out, i0, i1) over [0, count), in stripes on the threads of
+        // SetParallel for a large image
+        typedef void (Decoder::*StripeFunc)(const Component* c, unsigned char* out, int i0, int i1);
+
+        struct Stripes {
+            Decoder* d;
+            StripeFunc f;
+            const Component* c;
+            unsigned char* out;
+            int count, stripes;
+        };
+
+        static void _StripeTask(void* arg, int stripe) {
+            const Stripes& S = *(const Stripes*) arg;
+            (S.d->*S.f)(S.c, S.out, (int) ((long long) S.count * stripe / S.stripes), (int) ((long long) S.count * (stripe + 1) / S.stripes));
+        }
+
+        inline void _Stripes(StripeFunc f, const Component* c, unsigned char* out, int count) {
+            if (run && (threads > 1) && (ctx.width * ctx.height >= ParallelPixels)) {
+                Stripes S;
+                S.d = this;  S.f = f;  S.c = c;  S.out = out;  S.count = count;
+                S.stripes = (count < 2 * threads) ? count : 2 * threads;
+                run(runUser, S.stripes, _StripeTask, &S);
+            } else
+                (this->*f)(c, out, 0, count);
+        }
+
         inline void _UpsampleH(Component* c) {
+            unsigned char *out;
+            out = _Reserve(pixbuf[c - ctx.comp][1], (c->width * c->height) << 1);
+            if (!out) JPEG_DECODER_THROW(OutOfMemory);
+            _Stripes(&Decoder::_UpsampleHRows, c, out, c->height);
+            c->width <<= 1;
+            c->stride = c->width;
+            _SwapBuffers(c);
+        }
+
+        inline void _UpsampleHRows(const Component* c, unsigned char* out, int y0, int y1) {
             const int xmax = c->width - 3;
-            unsigned char *out, *lin, *lout;
+            const unsigned char *lin;
+            unsigned char *lout;
             int x, y;
-            out = (unsigned char*)AllocMem((c->width * c->height) << 1);
-            if (!out) JPEG_DECODER_THROW(OutOfMemory);
-            lin = c->pixels;
-            lout = out;
-            for (y = c->height;  y;  --y) {
+            lin = &c->pixels[y0 * c->stride];
+            lout = &out[y0 * (c->width << 1)];
+            for (y = y1 - y0;  y;  --y) {
                 lout[0] = CF(CF2A * lin[0] + CF2B * lin[1]);
                 lout[1] = CF(CF3X * lin[0] + CF3Y * lin[1] + CF3Z * lin[2]);
                 lout[2] = CF(CF3A * lin[0] + CF3B * lin[1] + CF3C * lin[2]);
-                for (x = 0;  x < xmax;  ++x) {
+                x = 0;
+#ifdef JPEG_DECODER_SSE2
+                if (simd != SimdScalar) x = _UpsampleRowH_SSE2(lin, lout, xmax);
+#endif
+                for (;  x < xmax;  ++x) {
                     lout[(x << 1) + 3] = CF(CF4A * lin[x] + CF4B * lin[x + 1] + CF4C * lin[x + 2] + CF4D * lin[x + 3]);
                     lout[(x << 1) + 4] = CF(CF4D * lin[x] + CF4C * lin[x + 1] + CF4B * lin[x + 2] + CF4A * lin[x + 3]);
                 }
@@ -539,19 +1143,65 @@ namespace Jpeg
                 lout[-2] = CF(CF3X * lin[-1] + CF3Y * lin[-2] + CF3Z * lin[-3]);
                 lout[-1] = CF(CF2A * lin[-1] + CF2B * lin[-2]);
             }
-            c->width <<= 1;
-            c->stride = c->width;
-            FreeMem(c->pixels);
-            c->pixels = out;
         }
 
+#ifdef JPEG_DECODER_SSE2
+        inline void _TapsV(unsigned char* out, const unsigned char* r0, const unsigned char* r1, const unsigned char* r2, const unsigned char* r3,
+                           const int k0, const int k1, const int k2, const int k3, const int w) {
+            const unsigned char* const r[4] = { r0, r1, r2, r3 };
+            const int k[4] = { k0, k1, k2, k3 };
+            int x;
+            for (x = _UpsampleRowV_SSE2(out, r, k, w);  x < w;  ++x)
+                out[x] = CF(k0 * r0[x] + k1 * r1[x] + k2 * r2[x] + k3 * r3[x]);
+        }
+
+        // _UpsampleVCols row by row, with the same taps: the first three rows
+        // (0), two rows from four (1 .. h - 3), the last three rows (h - 2)
+        inline void _UpsampleVRows(const Component* c, unsigned char* out, int u0, int u1) {
+            const int w = c->width, h = c->height, s = c->stride;
+            const unsigned char* row;
+            int u;
+            for (u = u0;  u < u1;  ++u) {
+                if (!u) {
+                    row = c->pixels;
+                    _TapsV(out, row, row + s, row, row, CF2A, CF2B, 0, 0, w);
+                    _TapsV(out + w, row, row + s, row + 2 * s, row, CF3X, CF3Y, CF3Z, 0, w);
+                    _TapsV(out + 2 * w, row, row + s, row + 2 * s, row, CF3A, CF3B, CF3C, 0, w);
+                } else if (u < h - 2) {
+                    row = &c->pixels[(u - 1) * s];
+                    _TapsV(&out[(2 * u + 1) * w], row, row + s, row + 2 * s, row + 3 * s, CF4A, CF4B, CF4C, CF4D, w);
+                    _TapsV(&out[(2 * u + 2) * w], row, row + s, row + 2 * s, row + 3 * s, CF4D, CF4C, CF4B, CF4A, w);
+                } else {
+                    row = &c->pixels[(h - 1) * s];
+                    _TapsV(&out[(2 * h - 3) * w], row, row - s, row - 2 * s, row, CF3A, CF3B, CF3C, 0, w);
+                    _TapsV(&out[(2 * h - 2) * w], row, row - s, row - 2 * s, row, CF3X, CF3Y, CF3Z, 0, w);
+                    _TapsV(&out[(2 * h - 1) * w], row, row - s, row, row, CF2A, CF2B, 0, 0, w);
+                }
+            }
+        }
+#endif
+
         inline void _UpsampleV(Component* c) {
+            unsigned char *out;
+            out = _Reserve(pixbuf[c - ctx.comp][1], (c->width * c->height) << 1);
+            if (!out) JPEG_DECODER_THROW(OutOfMemory);
+#ifdef JPEG_DECODER_SSE2
+            if ((simd != SimdScalar) && (c->height >= 3))
+                _Stripes(&Decoder::_UpsampleVRows, c, out, c->height - 1);
+            else
+#endif
+                _Stripes(&Decoder::_UpsampleVCols, c, out, c->width);
+            c->height <<= 1;
+            c->stride = c->width;
+            _SwapBuffers(c);
+        }
+
+        inline void _UpsampleVCols(const Component* c, unsigned char* out, int x0, int x1) {
             const int w = c->width, s1 = c->stride, s2 = s1 + s1;
-            unsigned char *out, *cin, *cout;
+            const unsigned char *cin;
+            unsigned char *cout;
             int x, y;
-            out = (unsigned char*)AllocMem((c->width * c->height) << 1);
-            if (!out) JPEG_DECODER_THROW(OutOfMemory);
-            for (x = 0;  x < w;  ++x) {
+            for (x = x0;  x < x1;  ++x) {
                 cin = &c->pixels[x];
                 cout = &out[x];
                 *cout = CF(CF2A * cin[0] + CF2B * cin[s1]);  cout += w;
@@ -568,10 +1218,90 @@ namespace Jpeg
                 *cout = CF(CF3X * cin[0] + CF3Y * cin[-s1] + CF3Z * cin[-s2]);  cout += w;
                 *cout = CF(CF2A * cin[0] + CF2B * cin[-s1]);
             }
-            c->height <<= 1;
-            c->stride = c->width;
-            FreeMem(c->pixels);
-            c->pixels = out;
+        }
+
+#ifdef JPEG_DECODER_SSE2
+        // (k * c + 128) >> 8 for eight chroma samples c (16 bits, centred),
+        // with the products in 32 bits
+        static inline __m128i _Chroma8(const __m128i c, const __m128i k) {
+            const __m128i one = _mm_set1_epi16(1);
+            return _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(c, one), k), 8),
+                                   _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(c, one), k), 8));
+        }
+
+        // 4 RGBx pixels to 12 RGB bytes, the last 4 bytes zero
+        static inline __m128i _Pack3(const __m128i q) {
+            const __m128i m = _mm_setr_epi32(0x00FFFFFF, 0, 0, 0);
+            return _mm_or_si128(_mm_or_si128(_mm_and_si128(q, m), _mm_srli_si128(_mm_and_si128(q, _mm_slli_si128(m, 4)), 1)),
+                                _mm_or_si128(_mm_srli_si128(_mm_and_si128(q, _mm_slli_si128(m, 8)), 2), _mm_srli_si128(_mm_and_si128(q, _mm_slli_si128(m, 12)), 3)));
+        }
+
+        // the inner loop of the RGB conversion, 16 pixels a step; returns where it stopped
+        static int _ConvertRow_SSE2(const unsigned char* py, const unsigned char* pcb, const unsigned char* pcr, unsigned char* prgb, const int width) {
+            const __m128i zero = _mm_setzero_si128(), c128 = _mm_set1_epi16(128);
+            const __m128i kR = _mm_setr_epi16(359, 128, 359, 128, 359, 128, 359, 128);
+            const __m128i kB = _mm_setr_epi16(454, 128, 454, 128, 454, 128, 454, 128);
+            const __m128i kG = _mm_setr_epi16(-88, -183, -88, -183, -88, -183, -88, -183);
+            const __m128i r128 = _mm_set1_epi32(128);
+            int x;
+            for (x = 0;  x + 16 <= width;  x += 16) {
+                const __m128i y = _mm_loadu_si128((const __m128i*) &py[x]);
+                const __m128i cb = _mm_loadu_si128((const __m128i*) &pcb[x]), cr = _mm_loadu_si128((const __m128i*) &pcr[x]);
+                __m128i rgb[3][2];
+                int h;
+                for (h = 0;  h < 2;  ++h) {
+                    const __m128i y16 = h ? _mm_unpackhi_epi8(y, zero) : _mm_unpacklo_epi8(y, zero);
+                    const __m128i cb16 = _mm_sub_epi16(h ? _mm_unpackhi_epi8(cb, zero) : _mm_unpacklo_epi8(cb, zero), c128);
+                    const __m128i cr16 = _mm_sub_epi16(h ? _mm_unpackhi_epi8(cr, zero) : _mm_unpacklo_epi8(cr, zero), c128);
+                    const __m128i g = _mm_packs_epi32(
+                        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(cb16, cr16), kG), r128), 8),
+                        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(cb16, cr16), kG), r128), 8));
+                    rgb[0][h] = _mm_add_epi16(y16, _Chroma8(cr16, kR));
+                    rgb[1][h] = _mm_add_epi16(y16, g);
+                    rgb[2][h] = _mm_add_epi16(y16, _Chroma8(cb16, kB));
+                }
+                const __m128i r = _mm_packus_epi16(rgb[0][0], rgb[0][1]);
+                const __m128i g = _mm_packus_epi16(rgb[1][0], rgb[1][1]);
+                const __m128i b = _mm_packus_epi16(rgb[2][0], rgb[2][1]);
+                const __m128i rg0 = _mm_unpacklo_epi8(r, g), rg1 = _mm_unpackhi_epi8(r, g);
+                const __m128i b0 = _mm_unpacklo_epi8(b, zero), b1 = _mm_unpackhi_epi8(b, zero);
+                const __m128i q0 = _Pack3(_mm_unpacklo_epi16(rg0, b0)), q1 = _Pack3(_mm_unpackhi_epi16(rg0, b0));
+                const __m128i q2 = _Pack3(_mm_unpacklo_epi16(rg1, b1)), q3 = _Pack3(_mm_unpackhi_epi16(rg1, b1));
+                _mm_storeu_si128((__m128i*) &prgb[3 * x], _mm_or_si128(q0, _mm_slli_si128(q1, 12)));
+                _mm_storeu_si128((__m128i*) &prgb[3 * x + 16], _mm_or_si128(_mm_srli_si128(q1, 4), _mm_slli_si128(q2, 8)));
+                _mm_storeu_si128((__m128i*) &prgb[3 * x + 32], _mm_or_si128(_mm_srli_si128(q2, 8), _mm_slli_si128(q3, 4)));
+            }
+            return x;
+        }
+#endif
+
+        // YCbCr to RGB, the rows y0 .. y1 - 1
+        inline void _ConvertRows(const Component* comp, unsigned char* rgb, int y0, int y1) {
+            int x, yy;
+            unsigned char *prgb = &rgb[y0 * ctx.width * 3];
+            const unsigned char *py  = &comp[0].pixels[y0 * comp[0].stride];
+            const unsigned char *pcb = &comp[1].pixels[y0 * comp[1].stride];
+            const unsigned char *pcr = &comp[2].pixels[y0 * comp[2].stride];
+            for (yy = y1 - y0;  yy;  --yy) {
+                x = 0;
+#ifdef JPEG_DECODER_SSE2
+                if (simd != SimdScalar) {
+                    x = _ConvertRow_SSE2(py, pcb, pcr, prgb, ctx.width);
+                    prgb += 3 * x;
+                }
+#endif
+                for (;  x < ctx.width;  ++x) {
+                    register int y = py[x] << 8;
+                    register int cb = pcb[x] - 128;
+                    register int cr = pcr[x] - 128;
+                    *prgb++ = _Clip((y            + 359 * cr + 128) >> 8);
+                    *prgb++ = _Clip((y -  88 * cb - 183 * cr + 128) >> 8);
+                    *prgb++ = _Clip((y + 454 * cb            + 128) >> 8);
+                }
+                py += comp[0].stride;
+                pcb += comp[1].stride;
+                pcr += comp[2].stride;
+            }
         }
 
         inline void _Convert() {
@@ -588,24 +1318,7 @@ namespace Jpeg
             }
             if (ctx.ncomp == 3) {
                 // convert to RGB
-                int x, yy;
-                unsigned char *prgb = ctx.rgb;
-                const unsigned char *py  = ctx.comp[0].pixels;
-                const unsigned char *pcb = ctx.comp[1].pixels;
-                const unsigned char *pcr = ctx.comp[2].pixels;
-                for (yy = ctx.height;  yy;  --yy) {
-                    for (x = 0;  x < ctx.width;  ++x) {
-                        register int y = py[x] << 8;
-                        register int cb = pcb[x] - 128;
-                        register int cr = pcr[x] - 128;
-                        *prgb++ = _Clip((y            + 359 * cr + 128) >> 8);
-                        *prgb++ = _Clip((y -  88 * cb - 183 * cr + 128) >> 8);
-                        *prgb++ = _Clip((y + 454 * cb            + 128) >> 8);
-                    }
-                    py += ctx.comp[0].stride;
-                    pcb += ctx.comp[1].stride;
-                    pcr += ctx.comp[2].stride;
-                }
+                _Stripes(&Decoder::_ConvertRows, ctx.comp, ctx.rgb, ctx.height);
             } else if (ctx.comp[0].width != ctx.comp[0].stride) {
                 // grayscale -> only remove stride
                 unsigned char *pin = &ctx.comp[0].pixels[ctx.comp[0].stride];
@@ -648,21 +1361,80 @@ namespace Jpeg
             _Convert();
             return ctx.error;
         }
+
+        void _Init();
     };
 
 
-inline Decoder::Decoder(const unsigned char* data, size_t size, void *(*allocFunc)(size_t), void (*freeFunc)(void*))
-    : AllocMem(allocFunc)
-    , FreeMem(freeFunc)
+inline void Decoder::_Init()
 {
     // should be static data, but this keeps us as a header
     char temp[64] = { 0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18,
         11, 4, 5, 12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28, 35,
         42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51, 58, 59, 52, 45,
         38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
-    memcpy(ZZ, temp, sizeof(ZZ));
+    static const Simd detected = _DetectSimd();
+    simd = (detected < _SimdLimit()) ? detected : _SimdLimit();
+    // the SIMD IDCT takes the blocks transposed: see _RowIDCT4
+    int i;
+    for (i = 0;  i < 64;  ++i)
+        ZZ[i] = (simd == SimdScalar) ? temp[i] : (char) (((temp[i] & 7) << 3) | (temp[i] >> 3));
+    memset(&ctx, 0, sizeof(Context));
+    memset(pixbuf, 0, sizeof(pixbuf));
+    memset(&rgbbuf, 0, sizeof(rgbbuf));
+    run = NULL;
+    runUser = NULL;
+    threads = 1;
+    scale = 1;
+}
+
+inline Decoder::Decoder(const unsigned char* data, size_t size, void *(*allocFunc)(size_t), void (*freeFunc)(void*))
+    : AllocMem(allocFunc)
+    , FreeMem(freeFunc)
+{
+    _Init();
+    Decode(data, size);
+}
+
+inline Decoder::Decoder(void *(*allocFunc)(size_t), void (*freeFunc)(void*))
+    : AllocMem(allocFunc)
+    , FreeMem(freeFunc)
+{
+    _Init();
+}
+
+inline Decoder::DecodeResult Decoder::Decode(const unsigned char* data, size_t size)
+{
+    int i, j;
     memset(&ctx, 0, sizeof(Context));
-    _Decode(data, size);
+    for (i = 0;  i < 4;  ++i)      // no table yet: every code is an error
+        for (j = 0;  j < 17;  ++j)
+            ctx.vlctab[i].maxcode[j] = -1;
+    ctx.error = _Decode(data, size);
+    return ctx.error;
+}
+
+inline size_t Decoder::GetBufferSize() const
+{
+    size_t size = rgbbuf.size;
+    int i;
+    for (i = 0;  i < 3;  ++i)
+        size += pixbuf[i][0].size + pixbuf[i][1].size;
+    return size;
+}
+
+inline void Decoder::ReleaseBuffers()
+{
+    int i, j;
+    for (i = 0;  i < 3;  ++i)
+        for (j = 0;  j < 2;  ++j)
+            if (pixbuf[i][j].data) FreeMem((void*) pixbuf[i][j].data);
+    if (rgbbuf.data) FreeMem((void*) rgbbuf.data);
+    memset(pixbuf, 0, sizeof(pixbuf));
+    memset(&rgbbuf, 0, sizeof(rgbbuf));
+    for (i = 0;  i < 3;  ++i)
+        ctx.comp[i].pixels = NULL;
+    ctx.rgb = NULL;
 }
 
 inline Decoder::DecodeResult Decoder::GetResult() const { return ctx.error; }
@@ -671,13 +1443,44 @@ inline int Decoder::GetHeight() const { return ctx.height; }
 inline bool Decoder::IsColor() const { return ctx.ncomp != 1; }
 inline unsigned char* Decoder::GetImage() const { return (ctx.ncomp == 1) ? ctx.comp[0].pixels : ctx.rgb; }
 inline size_t Decoder::GetImageSize(void) const { return ctx.width * ctx.height * ctx.ncomp; }
+inline void Decoder::SetParallel(RunFunc run_, void* user, int threads_)
+{
+    run = run_;
+    runUser = user;
+    threads = threads_;
+}
+
+inline void Decoder::SetScale(int scale_) { scale = scale_; }
+inline int Decoder::GetScale() const { return 1 << ctx.shift; }
+
+inline bool Decoder::ReadSize(const unsigned char* data, size_t size, int& width, int& height)
+{
+    size_t pos = 2, length;
+    if ((size < 2) || (data[0] != 0xFF) || (data[1] != 0xD8)) return false;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) return false;
+        if (data[pos + 1] == 0xFF) { ++pos;  continue; }     // fill byte
+        length = (data[pos + 2] << 8) | data[pos + 3];
+        switch (data[pos + 1]) {
+            case 0xC0: case 0xC1: case 0xC2: case 0xC3:
+                if ((length < 7) || (pos + 9 > size)) return false;
+                height = (data[pos + 5] << 8) | data[pos + 6];
+                width = (data[pos + 7] << 8) | data[pos + 8];
+                return true;
+            case 0xDA: case 0xD9:
+                return false;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+inline void Decoder::LimitSimd(Simd max) { _SimdLimit() = max; }
+inline Decoder::Simd Decoder::GetSimd() const { return simd; }
 
 inline Decoder::~Decoder()
 {
-    int i;
-    for (i = 0;  i < 3;  ++i)
-        if (ctx.comp[i].pixels) FreeMem((void*) ctx.comp[i].pixels);
-    if (ctx.rgb) FreeMem((void*) ctx.rgb);
+    ReleaseBuffers();
 }
 
 }
@@ -1,4 +1,10 @@
+#include "picoPNG.h"
 #include <vector>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PICOPNG_SSE2 //vector unfilter and color conversion
+#endif
 
 /*
 decodePNG: The picoPNG function, decodes a PNG file buffer in memory, into a raw pixel buffer.
@@ -19,9 +25,14 @@ convert_to_rgba32: optional parameter, true by default.
   Information about the color type or palette colors are not provided. You need
   to know this information yourself to be able to use the data so this only
   works for trusted PNG files. Use LodePNG instead of picoPNG if you need this information.
+flip_vertically: optional parameter, false by default.
+  Set to true to get the last row of the image first, as OpenGL textures expect. The rows
+  are placed there while they are decoded, without another pass over the image.
+buffers: optional parameter, working memory kept by the caller from one call to the next
+  (see picoPNG.h); out_image keeps its capacity as well.
 return: 0 if success, not 0 if some error occured.
 */
-int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width, unsigned long& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32 = true)
+int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width, unsigned long& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32, bool flip_vertically, PNGBuffers* buffers)
 {
     // picoPNG version 20101224
     // Copyright (c) 2005-2010 Lode Vandevenne
@@ -56,64 +67,82 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
     static const unsigned long CLCL[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 }; //code length code lengths
     struct Zlib //nested functions for zlib decompression
     {
-        static unsigned long readBitFromStream(size_t& bitp, const unsigned char* bits) { unsigned long result = (bits[bitp >> 3] >> (bitp & 0x7)) & 1; bitp++; return result; }
-        static unsigned long readBitsFromStream(size_t& bitp, const unsigned char* bits, size_t nbits)
+        static unsigned long long peekBits(const unsigned char* bits, size_t bitp, size_t avail)
+        { //64-bit window of the stream starting at bit bitp: at least 57 valid bits, zeros past the end of the data
+            size_t p = bitp >> 3; unsigned long long w = 0;
+            if (p + 8 <= avail) std::memcpy(&w, bits + p, 8); //one unaligned load (little-endian, as on x86)
+            else for (size_t i = 0; p + i < avail && i < 8; i++) w |= (unsigned long long)bits[p + i] << (8 * i);
+            return w >> (bitp & 0x7);
+        }
+        static unsigned long readBitsFromStream(size_t& bitp, const unsigned char* bits, size_t nbits, size_t avail)
         {
-            unsigned long result = 0;
-            for (size_t i = 0; i < nbits; i++) result += (readBitFromStream(bitp, bits)) << i;
+            unsigned long result = (unsigned long)(peekBits(bits, bitp, avail) & ((1ull << nbits) - 1));
+            bitp += nbits;
             return result;
         }
         struct HuffmanTree
-        {
+        { //lookup tables: the next ROOTBITS bits of the stream index the root table; a longer code leads to a subtable indexed by its remaining bits
+            enum { ROOTBITS = 9, NOCODE = 16 };
             int makeFromLengths(const std::vector<unsigned long>& bitlen, unsigned long maxbitlen)
-            { //make tree given the lengths
-                unsigned long numcodes = (unsigned long)(bitlen.size()), treepos = 0, nodefilled = 0;
-                std::vector<unsigned long> tree1d(numcodes), blcount(maxbitlen + 1, 0), nextcode(maxbitlen + 1, 0);
-                for (unsigned long bits = 0; bits < numcodes; bits++) blcount[bitlen[bits]]++; //count number of instances of each code length
-                for (unsigned long bits = 1; bits <= maxbitlen; bits++) nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
-                for (unsigned long n = 0; n < numcodes; n++) if (bitlen[n] != 0) tree1d[n] = nextcode[bitlen[n]]++; //generate all the codes
-                tree2d.clear(); tree2d.resize(numcodes * 2, 32767); //32767 here means the tree2d isn't filled there yet
-                for (unsigned long n = 0; n < numcodes; n++) //the codes
-                    for (unsigned long i = 0; i < bitlen[n]; i++) //the bits for this code
+            { //make the tables given the lengths
+                unsigned long numcodes = (unsigned long)(bitlen.size()), rootsize = 1u << ROOTBITS, kraft = 0;
+                std::vector<unsigned long> codes(numcodes), blcount(maxbitlen + 1, 0), nextcode(maxbitlen + 1, 0);
+                for (unsigned long n = 0; n < numcodes; n++) blcount[bitlen[n]]++; //count number of instances of each code length
+                blcount[0] = 0;
+                for (unsigned long bits = 1; bits <= maxbitlen; bits++) { nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1; kraft += blcount[bits] << (15 - bits); }
+                if (kraft > (1u << 15)) return 55; //more codes than the lengths allow
+                for (unsigned long n = 0; n < numcodes; n++) //the codes, bit reversed: the stream gives their first bit first
+                {
+                    unsigned long len = bitlen[n], code = len ? nextcode[len]++ : 0, rev = 0;
+                    for (unsigned long i = 0; i < len; i++) rev |= ((code >> i) & 1) << (len - 1 - i);
+                    codes[n] = rev;
+                }
+                tablelen.assign(rootsize, NOCODE); tablevalue.assign(rootsize, 0);
+                for (unsigned long n = 0; n < numcodes; n++) //longest code behind each root entry
+                    if (bitlen[n] > ROOTBITS)
                     {
-                        unsigned long bit = (tree1d[n] >> (bitlen[n] - i - 1)) & 1;
-                        if (treepos > numcodes - 2) return 55;
-                        if (tree2d[2 * treepos + bit] == 32767) //not yet filled in
-                        {
-                            if (i + 1 == bitlen[n]) { tree2d[2 * treepos + bit] = n; treepos = 0; } //last bit
-                            else { tree2d[2 * treepos + bit] = ++nodefilled + numcodes; treepos = nodefilled; } //addresses are encoded as values > numcodes
-                        }
-                        else treepos = tree2d[2 * treepos + bit] - numcodes; //subtract numcodes from address to get address value
+                        unsigned long r = codes[n] & (rootsize - 1);
+                        if (tablelen[r] == NOCODE || tablelen[r] < bitlen[n]) tablelen[r] = (unsigned char)bitlen[n];
                     }
+                size_t size = rootsize;
+                for (unsigned long r = 0; r < rootsize; r++) //place the subtables
+                    if (tablelen[r] != NOCODE) { tablevalue[r] = (unsigned short)size; size += (size_t)1 << (tablelen[r] - ROOTBITS); }
+                tablelen.resize(size, NOCODE); tablevalue.resize(size, 0);
+                for (unsigned long n = 0; n < numcodes; n++) //every index whose low bits are the code
+                {
+                    unsigned long len = bitlen[n];
+                    if (len == 0) continue;
+                    if (len <= ROOTBITS)
+                        for (unsigned long j = codes[n]; j < rootsize; j += 1u << len) { tablelen[j] = (unsigned char)len; tablevalue[j] = (unsigned short)n; }
+                    else
+                    {
+                        unsigned long r = codes[n] & (rootsize - 1), sub = tablevalue[r], subbits = tablelen[r] - ROOTBITS;
+                        for (unsigned long j = codes[n] >> ROOTBITS; j < (1u << subbits); j += 1u << (len - ROOTBITS)) { tablelen[sub + j] = (unsigned char)len; tablevalue[sub + j] = (unsigned short)n; }
+                    }
+                }
                 return 0;
             }
-            int decode(bool& decoded, unsigned long& result, size_t& treepos, unsigned long bit) const
-            { //Decodes a symbol from the tree
-                unsigned long numcodes = (unsigned long)tree2d.size() / 2;
-                if (treepos >= numcodes) return 11; //error: you appeared outside the codetree
-                result = tree2d[2 * treepos + bit];
-                decoded = (result < numcodes);
-                treepos = decoded ? 0 : result - numcodes;
-                return 0;
-            }
-            std::vector<unsigned long> tree2d; //2D representation of a huffman tree: The one dimension is "0" or "1", the other contains all nodes and leaves of the tree.
+            std::vector<unsigned char> tablelen; //root entry of a long code: length of the longest code of its subtable; NOCODE: no code has these bits
+            std::vector<unsigned short> tablevalue; //symbol, or start of the subtable
         };
         struct Inflator
         {
             int error;
-            void inflate(std::vector<unsigned char>& out, const std::vector<unsigned char>& in, size_t inpos = 0)
+            size_t avail; //bytes of the stream that can be read
+            void inflate(std::vector<unsigned char>& out, const unsigned char* in, size_t insize, size_t inpos = 0)
             {
                 size_t bp = 0, pos = 0; //bit pointer and byte pointer
                 error = 0;
+                avail = insize - inpos;
                 unsigned long BFINAL = 0;
                 while (!BFINAL && !error)
                 {
-                    if (bp >> 3 >= in.size()) { error = 52; return; } //error, bit pointer will jump past memory
-                    BFINAL = readBitFromStream(bp, &in[inpos]);
-                    unsigned long BTYPE = readBitFromStream(bp, &in[inpos]); BTYPE += 2 * readBitFromStream(bp, &in[inpos]);
+                    if (bp >> 3 >= insize) { error = 52; return; } //error, bit pointer will jump past memory
+                    BFINAL = readBitsFromStream(bp, &in[inpos], 1, avail);
+                    unsigned long BTYPE = readBitsFromStream(bp, &in[inpos], 2, avail);
                     if (BTYPE == 3) { error = 20; return; } //error: invalid BTYPE
-                    else if (BTYPE == 0) inflateNoCompression(out, &in[inpos], bp, pos, in.size());
-                    else inflateHuffmanBlock(out, &in[inpos], bp, pos, in.size(), BTYPE);
+                    else if (BTYPE == 0) inflateNoCompression(out, &in[inpos], bp, pos, insize);
+                    else inflateHuffmanBlock(out, &in[inpos], bp, pos, insize, BTYPE);
                 }
                 if (!error) out.resize(pos); //Only now we know the true size of out, resize it to that
             }
@@ -126,25 +155,34 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                 treeD.makeFromLengths(bitlenD, 15);
             }
             HuffmanTree codetree, codetreeD, codelengthcodetree; //the code tree for Huffman codes, dist codes, and code length codes
+            HuffmanTree fixedtree, fixedtreeD; //made at the first block with fixed trees, kept for the next ones
             unsigned long huffmanDecodeSymbol(const unsigned char* in, size_t& bp, const HuffmanTree& codetree, size_t inlength)
             { //decode a single symbol from given list of bits with given code tree. return value is the symbol
-                bool decoded; unsigned long ct;
-                for (size_t treepos = 0;;)
+                return decodeSymbol(codetree, peekBits(in, bp, avail), bp, inlength);
+            }
+            unsigned long decodeSymbol(const HuffmanTree& codetree, unsigned long long bits, size_t& bp, size_t inlength)
+            { //same, the bits of the stream from bp already loaded
+                size_t index = (size_t)(bits & ((1u << HuffmanTree::ROOTBITS) - 1));
+                unsigned long len = codetree.tablelen[index], symbol = codetree.tablevalue[index];
+                if (len > HuffmanTree::ROOTBITS && len != HuffmanTree::NOCODE) //second level
                 {
-                    if ((bp & 0x07) == 0 && (bp >> 3) > inlength) { error = 10; return 0; } //error: end reached without endcode
-                    error = codetree.decode(decoded, ct, treepos, readBitFromStream(bp, in)); if (error) return 0; //stop, an error happened
-                    if (decoded) return ct;
+                    index = symbol + (size_t)((bits >> HuffmanTree::ROOTBITS) & ((1u << (len - HuffmanTree::ROOTBITS)) - 1));
+                    len = codetree.tablelen[index]; symbol = codetree.tablevalue[index];
                 }
+                if (((bp + len - 1) >> 3) > inlength) { error = 10; return 0; } //error: end reached without endcode
+                if (len == HuffmanTree::NOCODE) { error = 11; return 0; } //error: these bits are no code of the tree
+                bp += len;
+                return symbol;
             }
             void getTreeInflateDynamic(HuffmanTree& tree, HuffmanTree& treeD, const unsigned char* in, size_t& bp, size_t inlength)
             { //get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree
                 std::vector<unsigned long> bitlen(288, 0), bitlenD(32, 0);
                 if (bp >> 3 >= inlength - 2) { error = 49; return; } //the bit pointer is or will go past the memory
-                size_t HLIT = readBitsFromStream(bp, in, 5) + 257; //number of literal/length codes + 257
-                size_t HDIST = readBitsFromStream(bp, in, 5) + 1; //number of dist codes + 1
-                size_t HCLEN = readBitsFromStream(bp, in, 4) + 4; //number of code length codes + 4
+                size_t HLIT = readBitsFromStream(bp, in, 5, avail) + 257; //number of literal/length codes + 257
+                size_t HDIST = readBitsFromStream(bp, in, 5, avail) + 1; //number of dist codes + 1
+                size_t HCLEN = readBitsFromStream(bp, in, 4, avail) + 4; //number of code length codes + 4
                 std::vector<unsigned long> codelengthcode(19); //lengths of tree to decode the lengths of the dynamic tree
-                for (size_t i = 0; i < 19; i++) codelengthcode[CLCL[i]] = (i < HCLEN) ? readBitsFromStream(bp, in, 3) : 0;
+                for (size_t i = 0; i < 19; i++) codelengthcode[CLCL[i]] = (i < HCLEN) ? readBitsFromStream(bp, in, 3, avail) : 0;
                 error = codelengthcodetree.makeFromLengths(codelengthcode, 7); if (error) return;
                 size_t i = 0, replength;
                 while (i < HLIT + HDIST)
@@ -154,7 +192,8 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                     else if (code == 16) //repeat previous
                     {
                         if (bp >> 3 >= inlength) { error = 50; return; } //error, bit pointer jumps past memory
-                        replength = 3 + readBitsFromStream(bp, in, 2);
+                        replength = 3 + readBitsFromStream(bp, in, 2, avail);
+                        if (i == 0) { error = 54; return; } //error: no previous length to repeat
                         unsigned long value; //set value to the previous code
                         if ((i - 1) < HLIT) value = bitlen[i - 1];
                         else value = bitlenD[i - HLIT - 1];
@@ -167,7 +206,7 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                     else if (code == 17) //repeat "0" 3-10 times
                     {
                         if (bp >> 3 >= inlength) { error = 50; return; } //error, bit pointer jumps past memory
-                        replength = 3 + readBitsFromStream(bp, in, 3);
+                        replength = 3 + readBitsFromStream(bp, in, 3, avail);
                         for (size_t n = 0; n < replength; n++) //repeat this value in the next lengths
                         {
                             if (i >= HLIT + HDIST) { error = 14; return; } //error: i is larger than the amount of codes
@@ -177,7 +216,7 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                     else if (code == 18) //repeat "0" 11-138 times
                     {
                         if (bp >> 3 >= inlength) { error = 50; return; } //error, bit pointer jumps past memory
-                        replength = 11 + readBitsFromStream(bp, in, 7);
+                        replength = 11 + readBitsFromStream(bp, in, 7, avail);
                         for (size_t n = 0; n < replength; n++) //repeat this value in the next lengths
                         {
                             if (i >= HLIT + HDIST) { error = 15; return; } //error: i is larger than the amount of codes
@@ -192,11 +231,13 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
             }
             void inflateHuffmanBlock(std::vector<unsigned char>& out, const unsigned char* in, size_t& bp, size_t& pos, size_t inlength, unsigned long btype)
             {
-                if (btype == 1) { generateFixedTrees(codetree, codetreeD); }
+                if (btype == 1 && fixedtree.tablelen.empty()) generateFixedTrees(fixedtree, fixedtreeD);
                 else if (btype == 2) { getTreeInflateDynamic(codetree, codetreeD, in, bp, inlength); if (error) return; }
+                const HuffmanTree& tree = btype == 1 ? fixedtree : codetree, &treeD = btype == 1 ? fixedtreeD : codetreeD;
                 for (;;)
                 {
-                    unsigned long code = huffmanDecodeSymbol(in, bp, codetree, inlength); if (error) return;
+                    size_t start = bp; unsigned long long bits = peekBits(in, bp, avail); //one load for a whole literal or match: 15 + 5 + 15 + 13 bits at most
+                    unsigned long code = decodeSymbol(tree, bits, bp, inlength); if (error) return;
                     if (code == 256) return; //end code
                     else if (code <= 255) //literal symbol
                     {
@@ -207,15 +248,20 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                     {
                         size_t length = LENBASE[code - 257], numextrabits = LENEXTRA[code - 257];
                         if ((bp >> 3) >= inlength) { error = 51; return; } //error, bit pointer will jump past memory
-                        length += readBitsFromStream(bp, in, numextrabits);
-                        unsigned long codeD = huffmanDecodeSymbol(in, bp, codetreeD, inlength); if (error) return;
+                        length += (size_t)((bits >> (bp - start)) & ((1ull << numextrabits) - 1)); bp += numextrabits;
+                        unsigned long codeD = decodeSymbol(treeD, bits >> (bp - start), bp, inlength); if (error) return;
                         if (codeD > 29) { error = 18; return; } //error: invalid dist code (30-31 are never used)
                         unsigned long dist = DISTBASE[codeD], numextrabitsD = DISTEXTRA[codeD];
                         if ((bp >> 3) >= inlength) { error = 51; return; } //error, bit pointer will jump past memory
-                        dist += readBitsFromStream(bp, in, numextrabitsD);
-                        size_t start = pos, back = start - dist; //backwards
+                        dist += (unsigned long)((bits >> (bp - start)) & ((1ull << numextrabitsD) - 1)); bp += numextrabitsD;
+                        if (dist > pos) { error = 52; return; } //error: distance before the start of the data
                         if (pos + length >= out.size()) out.resize((pos + length) * 2); //reserve more room
-                        for (size_t i = 0; i < length; i++) { out[pos++] = out[back++]; if (back >= start) back = start - dist; }
+                        unsigned char* o = &out[0] + pos; const unsigned char* back = o - dist; //backwards
+                        if (dist >= 8 && pos + length + 8 <= out.size()) //8 bytes at a time, the copies do not overlap; the bytes written past the end are overwritten later
+                            for (size_t i = 0; i < length; i += 8) std::memcpy(o + i, back + i, 8);
+                        else if (dist == 1) std::memset(o, *back, length);
+                        else for (size_t i = 0; i < length; i++) o[i] = back[i]; //repeats the last dist bytes
+                        pos += length;
                     }
                 }
             }
@@ -228,19 +274,20 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                 if (LEN + NLEN != 65535) { error = 21; return; } //error: NLEN is not one's complement of LEN
                 if (pos + LEN >= out.size()) out.resize(pos + LEN);
                 if (p + LEN > inlength) { error = 23; return; } //error: reading outside of in buffer
-                for (unsigned long n = 0; n < LEN; n++) out[pos++] = in[p++]; //read LEN bytes of literal data
+                if (LEN) std::memcpy(&out[pos], &in[p], LEN); //read LEN bytes of literal data
+                pos += LEN; p += LEN;
                 bp = p * 8;
             }
         };
-        int decompress(std::vector<unsigned char>& out, const std::vector<unsigned char>& in) //returns error value
+        int decompress(std::vector<unsigned char>& out, const unsigned char* in, size_t insize) //returns error value
         {
             Inflator inflator;
-            if (in.size() < 2) { return 53; } //error, size of zlib data too small
+            if (insize < 2) { return 53; } //error, size of zlib data too small
             if ((in[0] * 256 + in[1]) % 31 != 0) { return 24; } //error: 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way
             unsigned long CM = in[0] & 15, CINFO = (in[0] >> 4) & 15, FDICT = (in[1] >> 5) & 1;
             if (CM != 8 || CINFO > 7) { return 25; } //error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec
             if (FDICT != 0) { return 26; } //error: the specification of PNG says about the zlib stream: "The additional flags shall not specify a preset dictionary."
-            inflator.inflate(out, in, 2);
+            inflator.inflate(out, in, insize, 2);
             return inflator.error; //note: adler32 checksum was skipped and ignored
         }
     };
@@ -253,13 +300,17 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
             std::vector<unsigned char> palette;
         } info;
         int error;
-        void decode(std::vector<unsigned char>& out, const unsigned char* in, size_t size, bool convert_to_rgba32)
+        bool flip; //rows placed from the bottom up
+        size_t outRow(size_t y) const { return flip ? info.height - 1 - y : y; } //row of the output for row y of the image
+        void decode(std::vector<unsigned char>& out, const unsigned char* in, size_t size, bool convert_to_rgba32, bool flip_vertically, PNGBuffers& buffers)
         {
-            error = 0;
+            error = 0; flip = flip_vertically;
             if (size == 0 || in == 0) { error = 48; return; } //the given data is empty
             readPngHeader(&in[0], size); if (error) return;
             size_t pos = 33; //first byte of the first chunk after the header
-            std::vector<unsigned char> idat; //the data from idat chunks
+            std::vector<unsigned char>& idat = buffers.idat; //the data from idat chunks, when there are several
+            const unsigned char* idatp = 0; size_t idatsize = 0, idatcount = 0; //a single idat chunk is read in place
+            idat.clear();
             bool IEND = false, known_type = true;
             info.key_defined = false;
             while (!IEND) //loop through the chunks, ignoring unknown chunks and stopping at IEND chunk. IDAT data is put at the start of the in buffer
@@ -270,7 +321,12 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                 if (pos + chunkLength >= size) { error = 35; return; } //error: size of the in buffer too small to contain next chunk
                 if (in[pos + 0] == 'I' && in[pos + 1] == 'D' && in[pos + 2] == 'A' && in[pos + 3] == 'T') //IDAT chunk, containing compressed image data
                 {
-                    idat.insert(idat.end(), &in[pos + 4], &in[pos + 4 + chunkLength]);
+                    if (idatcount++ == 0) { idatp = &in[pos + 4]; idatsize = chunkLength; }
+                    else
+                    {
+                        if (idatcount == 2) idat.assign(idatp, idatp + idatsize);
+                        idat.insert(idat.end(), &in[pos + 4], &in[pos + 4 + chunkLength]);
+                    }
                     pos += (4 + chunkLength);
                 }
                 else if (in[pos + 0] == 'I' && in[pos + 1] == 'E' && in[pos + 2] == 'N' && in[pos + 3] == 'D') { pos += 4; IEND = true; }
@@ -316,13 +372,19 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                 }
                 pos += 4; //step over CRC (which is ignored)
             }
+            if (idatcount > 1) { idatp = &idat[0]; idatsize = idat.size(); }
             unsigned long bpp = getBpp(info);
-            std::vector<unsigned char> scanlines(((info.width * (info.height * bpp + 7)) / 8) + info.height); //now the out buffer will be filled
+            std::vector<unsigned char>& scanlines = buffers.scanlines;
+            scanlines.assign(((info.width * (info.height * bpp + 7)) / 8) + info.height, 0); //now the out buffer will be filled
             Zlib zlib; //decompress with the Zlib decompressor
-            error = zlib.decompress(scanlines, idat); if (error) return; //stop if the zlib decompressor returned an error
+            error = zlib.decompress(scanlines, idatp, idatsize); if (error) return; //stop if the zlib decompressor returned an error
+            if (scanlines.size() < scanlinesSize(bpp)) { error = 91; return; } //error: less data than the image needs (reused buffers hold the previous image past it)
             size_t bytewidth = (bpp + 7) / 8, outlength = (info.height * info.width * bpp + 7) / 8;
-            out.resize(outlength); //time to fill the out buffer
-            unsigned char* out_ = outlength ? &out[0] : 0; //use a regular pointer to the std::vector for faster code if compiled without optimization
+            bool converted = convert_to_rgba32 && (info.colorType != 6 || info.bitDepth != 8);
+            std::vector<unsigned char>& pixels = converted ? buffers.pixels : out; //unfiltered pixels, converted from there into out
+            if (bpp < 8) pixels.assign(outlength, 0); //filled bit by bit
+            else pixels.resize(outlength); //time to fill the out buffer
+            unsigned char* out_ = outlength ? &pixels[0] : 0; //use a regular pointer to the std::vector for faster code if compiled without optimization
             if (info.interlaceMethod == 0) //no interlace, just filter
             {
                 size_t linestart = 0, linelength = (info.width * bpp + 7) / 8; //length in bytes of a scanline, excluding the filtertype byte
@@ -330,19 +392,21 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                     for (unsigned long y = 0; y < info.height; y++)
                     {
                         unsigned long filterType = scanlines[linestart];
-                        const unsigned char* prevline = (y == 0) ? 0 : &out_[(y - 1) * info.width * bytewidth];
-                        unFilterScanline(&out_[linestart - y], &scanlines[linestart + 1], prevline, bytewidth, filterType, linelength); if (error) return;
+                        const unsigned char* prevline = (y == 0) ? 0 : &out_[outRow(y - 1) * linelength];
+                        unFilterScanline(&out_[outRow(y) * linelength], &scanlines[linestart + 1], prevline, bytewidth, filterType, linelength); if (error) return;
                         linestart += (1 + linelength); //go to start of next scanline
                     }
                 else //less than 8 bits per pixel, so fill it up bit per bit
                 {
-                    std::vector<unsigned char> templine((info.width * bpp + 7) >> 3); //only used if bpp < 8
+                    std::vector<unsigned char> templine((info.width * bpp + 7) >> 3), prevtemp(templine.size()); //only used if bpp < 8
                     for (size_t y = 0, obp = 0; y < info.height; y++)
                     {
                         unsigned long filterType = scanlines[linestart];
-                        const unsigned char* prevline = (y == 0) ? 0 : &out_[(y - 1) * info.width * bytewidth];
+                        const unsigned char* prevline = (y == 0) ? 0 : &prevtemp[0]; //the row above, unfiltered
                         unFilterScanline(&templine[0], &scanlines[linestart + 1], prevline, bytewidth, filterType, linelength); if (error) return;
+                        obp = outRow(y) * info.width * bpp; //rows of less than 8 bits per pixel are not byte aligned
                         for (size_t bp = 0; bp < info.width * bpp;) setBitOfReversedStream(obp, out_, readBitFromReversedStream(bp, &templine[0]));
+                        templine.swap(prevtemp);
                         linestart += (1 + linelength); //go to start of next scanline
                     }
                 }
@@ -355,14 +419,23 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                 size_t pattern[28] = { 0,4,0,2,0,1,0,0,0,4,0,2,0,1,8,8,4,4,2,2,1,8,8,8,4,4,2,2 }; //values for the adam7 passes
                 for (int i = 0; i < 6; i++) passstart[i + 1] = passstart[i] + passh[i] * ((passw[i] ? 1 : 0) + (passw[i] * bpp + 7) / 8);
                 std::vector<unsigned char> scanlineo((info.width * bpp + 7) / 8), scanlinen((info.width * bpp + 7) / 8); //"old" and "new" scanline
-                for (int i = 0; i < 7; i++)
+                for (int i = 0; i < 7 && !error; i++)
                     adam7Pass(&out_[0], &scanlinen[0], &scanlineo[0], &scanlines[passstart[i]], info.width, pattern[i], pattern[i + 7], pattern[i + 14], pattern[i + 21], passw[i], passh[i], bpp);
             }
-            if (convert_to_rgba32 && (info.colorType != 6 || info.bitDepth != 8)) //conversion needed
+            if (error) return; //an unexisting filter type in an Adam7 pass
+            if (converted) error = convert(out, out_, info, info.width, info.height); //pixel i of pixels becomes pixel i of out: the flip is kept
+        }
+        size_t scanlinesSize(unsigned long bpp) const //bytes of the filtered scanlines of the image, filter type bytes included
+        {
+            if (info.interlaceMethod == 0) return info.height * (1 + (info.width * bpp + 7) / 8);
+            static const unsigned long x0[7] = { 0,4,0,2,0,1,0 }, y0[7] = { 0,0,4,0,2,0,1 }, dx[7] = { 8,8,4,4,2,2,1 }, dy[7] = { 8,8,8,4,4,2,2 }; //the adam7 passes
+            size_t size = 0;
+            for (int i = 0; i < 7; i++)
             {
-                std::vector<unsigned char> data = out;
-                error = convert(out, &data[0], info, info.width, info.height);
+                size_t w = info.width > x0[i] ? (info.width - x0[i] + dx[i] - 1) / dx[i] : 0, h = info.height > y0[i] ? (info.height - y0[i] + dy[i] - 1) / dy[i] : 0;
+                if (w) size += h * (1 + (w * bpp + 7) / 8);
             }
+            return size;
         }
         void readPngHeader(const unsigned char* in, size_t inlength) //read the information from the header and store it in the Info
         {
@@ -377,45 +450,114 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
             error = checkColorValidity(info.colorType, info.bitDepth);
         }
         void unFilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t bytewidth, unsigned long filterType, size_t length)
-        {
+        { //the vector kernels do what they can, the loops finish the row from byte i
+            size_t i = 0;
+#ifdef PICOPNG_SSE2
+            i = unFilterSSE2(recon, scanline, precon, bytewidth, filterType, length);
+#endif
             switch (filterType)
             {
-            case 0: for (size_t i = 0; i < length; i++) recon[i] = scanline[i]; break;
+            case 0: if (length) std::memcpy(recon, scanline, length); break;
             case 1:
-                for (size_t i = 0; i < bytewidth; i++) recon[i] = scanline[i];
-                for (size_t i = bytewidth; i < length; i++) recon[i] = scanline[i] + recon[i - bytewidth];
+                for (; i < bytewidth && i < length; i++) recon[i] = scanline[i];
+                for (; i < length; i++) recon[i] = scanline[i] + recon[i - bytewidth];
                 break;
             case 2:
-                if (precon) for (size_t i = 0; i < length; i++) recon[i] = scanline[i] + precon[i];
-                else       for (size_t i = 0; i < length; i++) recon[i] = scanline[i];
+                if (precon) for (; i < length; i++) recon[i] = scanline[i] + precon[i];
+                else if (length) std::memcpy(recon, scanline, length);
                 break;
             case 3:
                 if (precon)
                 {
-                    for (size_t i = 0; i < bytewidth; i++) recon[i] = scanline[i] + precon[i] / 2;
-                    for (size_t i = bytewidth; i < length; i++) recon[i] = scanline[i] + ((recon[i - bytewidth] + precon[i]) / 2);
+                    for (; i < bytewidth && i < length; i++) recon[i] = scanline[i] + precon[i] / 2;
+                    for (; i < length; i++) recon[i] = scanline[i] + ((recon[i - bytewidth] + precon[i]) / 2);
                 }
                 else
                 {
-                    for (size_t i = 0; i < bytewidth; i++) recon[i] = scanline[i];
-                    for (size_t i = bytewidth; i < length; i++) recon[i] = scanline[i] + recon[i - bytewidth] / 2;
+                    for (; i < bytewidth && i < length; i++) recon[i] = scanline[i];
+                    for (; i < length; i++) recon[i] = scanline[i] + recon[i - bytewidth] / 2;
                 }
                 break;
             case 4:
                 if (precon)
                 {
-                    for (size_t i = 0; i < bytewidth; i++) recon[i] = scanline[i] + paethPredictor(0, precon[i], 0);
-                    for (size_t i = bytewidth; i < length; i++) recon[i] = scanline[i] + paethPredictor(recon[i - bytewidth], precon[i], precon[i - bytewidth]);
+                    for (; i < bytewidth && i < length; i++) recon[i] = scanline[i] + paethPredictor(0, precon[i], 0);
+                    for (; i < length; i++) recon[i] = scanline[i] + paethPredictor(recon[i - bytewidth], precon[i], precon[i - bytewidth]);
                 }
                 else
                 {
-                    for (size_t i = 0; i < bytewidth; i++) recon[i] = scanline[i];
-                    for (size_t i = bytewidth; i < length; i++) recon[i] = scanline[i] + paethPredictor(recon[i - bytewidth], 0, 0);
+                    for (; i < bytewidth && i < length; i++) recon[i] = scanline[i];
+                    for (; i < length; i++) recon[i] = scanline[i] + paethPredictor(recon[i - bytewidth], 0, 0);
                 }
                 break;
             default: error = 36; return; //error: unexisting filter type given
             }
         }
+#ifdef PICOPNG_SSE2
+        static __m128i load32(const unsigned char* p) { int v; std::memcpy(&v, p, 4); return _mm_cvtsi32_si128(v); }
+        static void store32(unsigned char* p, __m128i x) { int v = _mm_cvtsi128_si32(x); std::memcpy(p, &v, 4); }
+        static size_t unFilterSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t bytewidth, unsigned long filterType, size_t length)
+        { //returns the number of bytes done. Up: 16 bytes at a time. Sub: prefix sums over 4 pixels of 3 or 4 bytes. Average, Paeth: one pixel of 3 or 4 bytes at a time, as 4 bytes: the byte after a pixel of 3 is rewritten by the next one
+            const __m128i zero = _mm_setzero_si128();
+            size_t i = 0;
+            if (filterType == 2 && precon)
+                for (; i + 16 <= length; i += 16) _mm_storeu_si128((__m128i*)(recon + i), _mm_add_epi8(_mm_loadu_si128((const __m128i*)(scanline + i)), _mm_loadu_si128((const __m128i*)(precon + i))));
+            if (bytewidth != 3 && bytewidth != 4) return i;
+            if (filterType == 1 || (filterType == 4 && !precon)) //Paeth of the first row: the pixel on the left
+            {
+                __m128i last = zero; //previous pixel, in every pixel of the register
+                if (bytewidth == 4)
+                    for (; i + 16 <= length; i += 16)
+                    {
+                        __m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+                        x = _mm_add_epi8(x, _mm_slli_si128(x, 4)); x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+                        x = _mm_add_epi8(x, last);
+                        _mm_storeu_si128((__m128i*)(recon + i), x);
+                        last = _mm_shuffle_epi32(x, 0xff);
+                    }
+                else
+                    for (; i + 16 <= length; i += 12) //4 pixels, the 4 bytes after them are rewritten by the next step
+                    {
+                        __m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+                        x = _mm_add_epi8(x, _mm_slli_si128(x, 3)); x = _mm_add_epi8(x, _mm_slli_si128(x, 6));
+                        x = _mm_add_epi8(x, last);
+                        _mm_storeu_si128((__m128i*)(recon + i), x);
+                        __m128i p = _mm_and_si128(_mm_srli_si128(x, 9), _mm_cvtsi32_si128(0xffffff));
+                        p = _mm_or_si128(p, _mm_slli_si128(p, 3)); last = _mm_or_si128(p, _mm_slli_si128(p, 6));
+                    }
+            }
+            else if (filterType == 3)
+            {
+                const __m128i one = _mm_set1_epi8(1);
+                __m128i a = zero;
+                for (; i + 4 <= length; i += bytewidth)
+                {
+                    __m128i b = precon ? load32(precon + i) : zero;
+                    __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one)); //(a + b) / 2: avg_epu8 rounds up
+                    a = _mm_add_epi8(load32(scanline + i), avg);
+                    store32(recon + i, a);
+                }
+            }
+            else if (filterType == 4) //16-bit lanes: p - a = b - c, p - b = a - c, p - c = (b - c) + (a - c)
+            {
+                __m128i a = zero, c = zero;
+                for (; i + 4 <= length; i += bytewidth)
+                {
+                    __m128i b = _mm_unpacklo_epi8(load32(precon + i), zero);
+                    __m128i pa = _mm_sub_epi16(b, c), pb = _mm_sub_epi16(a, c), pc = _mm_add_epi16(pa, pb);
+                    pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa)); pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb)); pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+                    __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+                    __m128i useb = _mm_cmpeq_epi16(pb, smallest), usea = _mm_cmpeq_epi16(pa, smallest);
+                    __m128i pred = _mm_or_si128(_mm_and_si128(useb, b), _mm_andnot_si128(useb, c));
+                    pred = _mm_or_si128(_mm_and_si128(usea, a), _mm_andnot_si128(usea, pred));
+                    __m128i x = _mm_packus_epi16(_mm_and_si128(_mm_add_epi16(_mm_unpacklo_epi8(load32(scanline + i), zero), pred), _mm_set1_epi16(0xff)), zero);
+                    store32(recon + i, x);
+                    a = _mm_unpacklo_epi8(x, zero); c = b;
+                }
+            }
+            return i;
+        }
+#endif
         void adam7Pass(unsigned char* out, unsigned char* linen, unsigned char* lineo, const unsigned char* in, unsigned long w, size_t passleft, size_t passtop, size_t spacex, size_t spacey, size_t passw, size_t passh, unsigned long bpp)
         { //filter and reposition the pixels into the output when the image is Adam7 interlaced. This function can only do it after the full image is already decoded. The out buffer must have the correct allocated memory size already.
             if (passw == 0) return;
@@ -423,12 +565,12 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
             for (unsigned long y = 0; y < passh; y++)
             {
                 unsigned char filterType = in[y * linelength], * prevline = (y == 0) ? 0 : lineo;
-                unFilterScanline(linen, &in[y * linelength + 1], prevline, bytewidth, filterType, (w * bpp + 7) / 8); if (error) return;
+                unFilterScanline(linen, &in[y * linelength + 1], prevline, bytewidth, filterType, linelength - 1); if (error) return; //the row of the pass, not of the image
                 if (bpp >= 8) for (size_t i = 0; i < passw; i++) for (size_t b = 0; b < bytewidth; b++) //b = current byte of this pixel
-                    out[bytewidth * w * (passtop + spacey * y) + bytewidth * (passleft + spacex * i) + b] = linen[bytewidth * i + b];
+                    out[bytewidth * w * outRow(passtop + spacey * y) + bytewidth * (passleft + spacex * i) + b] = linen[bytewidth * i + b];
                 else for (size_t i = 0; i < passw; i++)
                 {
-                    size_t obp = bpp * w * (passtop + spacey * y) + bpp * (passleft + spacex * i), bp = i * bpp;
+                    size_t obp = bpp * w * outRow(passtop + spacey * y) + bpp * (passleft + spacex * i), bp = i * bpp;
                     for (size_t b = 0; b < bpp; b++) setBitOfReversedStream(obp, out, readBitFromReversedStream(bp, &linen[0]));
                 }
                 unsigned char* temp = linen; linen = lineo; lineo = temp; //swap the two buffer pointers "line old" and "line new"
@@ -456,19 +598,68 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
             else if (info.colorType >= 4) return (info.colorType - 2) * info.bitDepth;
             else return info.bitDepth;
         }
+#ifdef PICOPNG_SSE2
+        static size_t convertSSE2(unsigned char* out_, const unsigned char* in, const Info& infoIn, size_t numpixels)
+        { //8-bit greyscale, RGB without color key, greyscale with alpha; returns the number of pixels done
+            if (infoIn.bitDepth != 8) return 0;
+            if (infoIn.colorType == 4) return convertSSE2GA(out_, in, numpixels);
+            if (infoIn.key_defined) return 0; //alpha per pixel: the loops
+            const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+            size_t i = 0;
+            if (infoIn.colorType == 0)
+                for (; i + 16 <= numpixels; i += 16)
+                {
+                    __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+                    __m128i lo = _mm_unpacklo_epi8(x, x), hi = _mm_unpackhi_epi8(x, x);
+                    _mm_storeu_si128((__m128i*)(out_ + 4 * i), _mm_or_si128(_mm_unpacklo_epi16(lo, lo), alpha));
+                    _mm_storeu_si128((__m128i*)(out_ + 4 * i + 16), _mm_or_si128(_mm_unpackhi_epi16(lo, lo), alpha));
+                    _mm_storeu_si128((__m128i*)(out_ + 4 * i + 32), _mm_or_si128(_mm_unpacklo_epi16(hi, hi), alpha));
+                    _mm_storeu_si128((__m128i*)(out_ + 4 * i + 48), _mm_or_si128(_mm_unpackhi_epi16(hi, hi), alpha));
+                }
+            else if (infoIn.colorType == 2) //4 pixels per load of 16 bytes: pixel k moves k bytes up
+            {
+                const __m128i m0 = _mm_setr_epi32(0xffffff, 0, 0, 0), m1 = _mm_slli_si128(m0, 4), m2 = _mm_slli_si128(m0, 8), m3 = _mm_slli_si128(m0, 12);
+                for (; 3 * i + 16 <= 3 * numpixels; i += 4)
+                {
+                    __m128i x = _mm_loadu_si128((const __m128i*)(in + 3 * i));
+                    __m128i y = _mm_or_si128(_mm_and_si128(x, m0), _mm_and_si128(_mm_slli_si128(x, 1), m1));
+                    y = _mm_or_si128(y, _mm_or_si128(_mm_and_si128(_mm_slli_si128(x, 2), m2), _mm_and_si128(_mm_slli_si128(x, 3), m3)));
+                    _mm_storeu_si128((__m128i*)(out_ + 4 * i), _mm_or_si128(y, alpha));
+                }
+            }
+            return i;
+        }
+        static size_t convertSSE2GA(unsigned char* out_, const unsigned char* in, size_t numpixels)
+        { //grey, alpha doubled to grey, alpha, grey, alpha; byte 1 then gets the grey of byte 0
+            const __m128i keep = _mm_set1_epi32((int)0xffff00ff), grey = _mm_set1_epi32(0xff00);
+            size_t i = 0;
+            for (; i + 8 <= numpixels; i += 8)
+            {
+                __m128i x = _mm_loadu_si128((const __m128i*)(in + 2 * i));
+                __m128i lo = _mm_unpacklo_epi16(x, x), hi = _mm_unpackhi_epi16(x, x);
+                _mm_storeu_si128((__m128i*)(out_ + 4 * i), _mm_or_si128(_mm_and_si128(lo, keep), _mm_and_si128(_mm_slli_epi32(lo, 8), grey)));
+                _mm_storeu_si128((__m128i*)(out_ + 4 * i + 16), _mm_or_si128(_mm_and_si128(hi, keep), _mm_and_si128(_mm_slli_epi32(hi, 8), grey)));
+            }
+            return i;
+        }
+#endif
         int convert(std::vector<unsigned char>& out, const unsigned char* in, Info& infoIn, unsigned long w, unsigned long h)
         { //converts from any color type to 32-bit. return value = LodePNG error code
             size_t numpixels = w * h, bp = 0;
             out.resize(numpixels * 4);
             unsigned char* out_ = out.empty() ? 0 : &out[0]; //faster if compiled without optimization
+            size_t i0 = 0; //pixels already converted
+#ifdef PICOPNG_SSE2
+            i0 = convertSSE2(out_, in, infoIn, numpixels);
+#endif
             if (infoIn.bitDepth == 8 && infoIn.colorType == 0) //greyscale
-                for (size_t i = 0; i < numpixels; i++)
+                for (size_t i = i0; i < numpixels; i++)
                 {
                     out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[i];
                     out_[4 * i + 3] = (infoIn.key_defined && in[i] == infoIn.key_r) ? 0 : 255;
                 }
             else if (infoIn.bitDepth == 8 && infoIn.colorType == 2) //RGB color
-                for (size_t i = 0; i < numpixels; i++)
+                for (size_t i = i0; i < numpixels; i++)
                 {
                     for (size_t c = 0; c < 3; c++) out_[4 * i + c] = in[3 * i + c];
                     out_[4 * i + 3] = (infoIn.key_defined == 1 && in[3 * i + 0] == infoIn.key_r && in[3 * i + 1] == infoIn.key_g && in[3 * i + 2] == infoIn.key_b) ? 0 : 255;
@@ -480,7 +671,7 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
                     for (size_t c = 0; c < 4; c++) out_[4 * i + c] = infoIn.palette[4 * in[i] + c]; //get rgb colors from the palette
                 }
             else if (infoIn.bitDepth == 8 && infoIn.colorType == 4) //greyscale with alpha
-                for (size_t i = 0; i < numpixels; i++)
+                for (size_t i = i0; i < numpixels; i++)
                 {
                     out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[2 * i + 0];
                     out_[4 * i + 3] = in[2 * i + 1];
@@ -527,7 +718,8 @@ int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width,
             return (unsigned char)((pa <= pb && pa <= pc) ? a : pb <= pc ? b : c);
         }
     };
-    PNG decoder; decoder.decode(out_image, in_png, in_size, convert_to_rgba32);
+    PNGBuffers local; //without buffers from the caller, freed on return
+    PNG decoder; decoder.decode(out_image, in_png, in_size, convert_to_rgba32, flip_vertically, buffers ? *buffers : local);
     image_width = decoder.info.width; image_height = decoder.info.height;
     return decoder.error;
 }
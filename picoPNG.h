@@ -0,0 +1,30 @@
+/* Copyright (c) 2024 Lilian Buzer - All rights reserved - */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <utility>
+
+/*
+ picoPNG (see picoPNG.cpp for the parameters of decodePNG).
+ PNGBuffers is the working memory of a decode: the IDAT data when it
+ comes in several chunks (a single chunk is inflated where it lies), the
+ inflated scanlines and the pixels before their conversion to RGBA.
+ A caller decoding one image after the other keeps it, with its output
+ vector, so that decoding no longer allocates once they are large enough.
+*/
+struct PNGBuffers
+{
+    std::vector<unsigned char> idat;
+    std::vector<unsigned char> scanlines;
+    std::vector<unsigned char> pixels;
+
+    size_t bytes() const { return idat.capacity() + scanlines.capacity() + pixels.capacity(); }
+    void release() { PNGBuffers empty; std::swap(*this, empty); }
+};
+
+int decodePNG(std::vector<unsigned char>& out_image, unsigned long& image_width, unsigned long& image_height, const unsigned char* in_png, size_t in_size,
+              bool convert_to_rgba32 = true, bool flip_vertically = false, PNGBuffers* buffers = 0);
+
+void loadFile(std::vector<unsigned char>& buffer, const std::string& filename);